@@ -0,0 +1,76 @@
+/*
+ *  @brief
+ *          Counters the benchmark modes report next to wall time
+ *
+ *  Timing alone does not say why a path got faster. HardwareCounter wraps perf_event_open so a benchmark can report
+ *  branches or cache misses around a loop, and reads as unavailable on kernels or containers that do not expose the
+ *  PMU. Heap allocations come from the per thread count the replaced operator new keeps for memory accounting,
+ *  which the benchmark has to enable first.
+ */
+
+#include "bench_counters.hpp"
+#include "memory_accounting.hpp"
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+const constexpr int CLOSED_DESCRIPTOR = -1;
+const constexpr int CALLING_THREAD = 0;
+const constexpr int ANY_CPU = -1;
+const constexpr int NO_GROUP = -1;
+
+namespace
+{
+    uint64_t perfConfig(const HardwareEvent event)
+    {
+        switch (event)
+        {
+            case HardwareEvent::Instructions: return PERF_COUNT_HW_INSTRUCTIONS;
+            case HardwareEvent::Branches: return PERF_COUNT_HW_BRANCH_INSTRUCTIONS;
+            case HardwareEvent::BranchMisses: return PERF_COUNT_HW_BRANCH_MISSES;
+            case HardwareEvent::CacheMisses: return PERF_COUNT_HW_CACHE_MISSES;
+        }
+        return PERF_COUNT_HW_INSTRUCTIONS;
+    }
+}
+
+HardwareCounter::HardwareCounter(const HardwareEvent event)
+{
+    perf_event_attr attributes;
+    std::memset(&attributes, 0, sizeof(attributes));
+    attributes.type = PERF_TYPE_HARDWARE;
+    attributes.size = sizeof(attributes);
+    attributes.config = perfConfig(event);
+    attributes.disabled = 1;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    descriptor = syscall(SYS_perf_event_open, &attributes, CALLING_THREAD, ANY_CPU, NO_GROUP, 0);
+}
+
+HardwareCounter::~HardwareCounter()
+{
+    if (available()) close(descriptor);
+}
+
+void HardwareCounter::start()
+{
+    if (!available()) return;
+    ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+    ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+uint64_t HardwareCounter::stop()
+{
+    if (!available()) return 0;
+    ioctl(descriptor, PERF_EVENT_IOC_DISABLE, 0);
+    uint64_t count = 0;
+    if (read(descriptor, &count, sizeof(count)) != sizeof(count)) return 0;
+    return count;
+}
+
+uint64_t HEAP_ALLOCATIONS()
+{
+    return THREAD_ALLOCATIONS();
+}
@@ -0,0 +1,31 @@
+#ifndef BENCH_COUNTERS_H
+#define BENCH_COUNTERS_H
+
+#include <cstdint>
+
+enum class HardwareEvent
+{
+    Instructions,
+    Branches,
+    BranchMisses,
+    CacheMisses
+};
+
+/* One perf_event counter on the calling thread, user space only. Counts nothing when the kernel will not open it */
+class HardwareCounter
+{
+    public:
+        explicit HardwareCounter(const HardwareEvent event);
+        ~HardwareCounter();
+        HardwareCounter(const HardwareCounter&) = delete;
+        HardwareCounter& operator=(const HardwareCounter&) = delete;
+        bool available() const {return descriptor >= 0;}
+        void start();
+        uint64_t stop();
+    private:
+        int descriptor;
+};
+
+uint64_t HEAP_ALLOCATIONS();            // operator new calls made by the calling thread since memory accounting was enabled
+
+#endif
@@ -0,0 +1,501 @@
+/*
+ *  @brief
+ *          Compact binary object format with raw payload bytes, a converter both ways and a reader that decodes from bytes
+ *
+ *  The .obj text format spends two ASCII characters on every byte and each one goes through convertFromCharToHex
+ *  before it means anything. The binary form keeps the same H/D/R/T/M/E records in the same order but stores the T
+ *  payloads as raw bytes behind fixed width integer headers, so it is roughly half the size and needs no hex parsing.
+ *
+ *  --to-binary in.obj out.sbo and --to-text in.sbo out.obj convert between the two, a text file with standard field
+ *  widths comes back the same from a round trip apart from a newline after the last record. The default mode
+ *  recognises the magic and disassembles a binary object straight from its bytes: the length pre-scan runs on the
+ *  payload and each instruction's fields come from its raw bytes, hex characters are only made for the object code
+ *  column. Programs with several control sections go through the control section engine, which still works on text
+ *  records, so they are handed over as text.
+ */
+
+#include "binary_object.hpp"
+#include "control_sections.hpp"
+#include "length_scan.hpp"
+#include "sinks.hpp"
+#include "symbol_cache.hpp"
+#include "byte_operations.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+const constexpr int INPUT_FILE_ARG_NUMBER = 1;
+const constexpr int SYMBOL_FILE_ARG_NUMBER = 2;
+const constexpr int OUTPUT_FILE_ARG_NUMBER = 2;
+const constexpr int FIRST_SINK_ARG_NUMBER = 3;
+const constexpr int CONVERT_ARG_COUNT = 3;
+const constexpr int INITIAL_BASE = 0;
+const constexpr int HEX_CHARS_PER_BYTE = 2;
+const constexpr int HEX_BASE = 16;
+const constexpr int ADDRESS_HEX_CHARS = 6;
+const constexpr int LENGTH_HEX_CHARS = 2;
+const constexpr std::size_t RECORD_FIELDS_START = 1;
+const constexpr std::size_t HEADER_FIELDS_SIZE = 2 * ADDRESS_HEX_CHARS;
+const constexpr std::size_t TEXT_LENGTH_FIELD = RECORD_FIELDS_START + ADDRESS_HEX_CHARS;
+const constexpr std::size_t TEXT_PAYLOAD_FIELD = TEXT_LENGTH_FIELD + LENGTH_HEX_CHARS;
+const constexpr std::size_t MODIFICATION_SIGN_FIELD = RECORD_FIELDS_START + ADDRESS_HEX_CHARS + LENGTH_HEX_CHARS;
+const constexpr char HEADER_RECORD = 'H';
+const constexpr char DEFINE_RECORD = 'D';
+const constexpr char REFER_RECORD = 'R';
+const constexpr char TEXT_RECORD = 'T';
+const constexpr char MODIFICATION_RECORD = 'M';
+const constexpr char END_RECORD = 'E';
+const constexpr char NO_SIGN = 0;
+const constexpr int BITS_IN_BYTE = 8;
+const constexpr uint64_t BYTE_MASK = 0xFF;
+const constexpr char* OUTPUT_FILE_NAME = "out.lst";
+
+namespace
+{
+    void fail(const std::string& message)
+    {
+        std::cerr << message << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // Damage inside the object itself, batch modes and the daemon only give up on that one file
+    void corrupt(const std::string& message)
+    {
+        throw CorruptInputError(message);
+    }
+
+    /*********************************************************
+     *                      TEXT FORMAT                      *
+     *********************************************************/
+    const std::string trim(const std::string& field)
+    {
+        const std::size_t last = field.find_last_not_of(' ');
+        return last == std::string::npos ? std::string() : field.substr(0, last + 1);
+    }
+
+    const std::string padName(const std::string& name)
+    {
+        return name.size() >= OBJECT_NAME_SIZE ? name.substr(0, OBJECT_NAME_SIZE) : name + std::string(OBJECT_NAME_SIZE - name.size(), ' ');
+    }
+
+    const std::string hexField(const uint32_t value, const int digits)
+    {
+        std::ostringstream field;
+        field << std::uppercase << std::hex << std::setw(digits) << std::setfill('0') << value;
+        return field.str();
+    }
+
+    uint32_t readHexField(const std::string& line, const std::size_t position, const std::size_t size, const int lineNumber)
+    {
+        const std::string field = position < line.size() ? line.substr(position, size) : std::string();
+        char* end = nullptr;
+        const unsigned long value = std::strtoul(field.c_str(), &end, HEX_BASE);
+        if (field.size() != size || *end != '\0') fail("Bad hex field on line " + std::to_string(lineNumber) + ": " + line);
+        return value;
+    }
+
+    // Fixed width name fields, the last one on a line may have lost its padding
+    const std::string readNameField(const std::string& line, const std::size_t position)
+    {
+        return position < line.size() ? trim(line.substr(position, OBJECT_NAME_SIZE)) : std::string();
+    }
+
+    ObjectRecord emptyRecord(const char kind)
+    {
+        return ObjectRecord{kind, std::string(), 0, 0, NO_SIGN, false, {}, {}};
+    }
+
+    /*********************************************************
+     *                     BINARY FORMAT                     *
+     *********************************************************/
+    // Little endian whatever the host, a .sbo is shipped between machines like the text object it stands for
+    template <typename T>
+    void put(std::string& data, const T value)
+    {
+        for (std::size_t i = 0; i < sizeof(T); i++) data += static_cast<char>((static_cast<uint64_t>(value) >> (i * BITS_IN_BYTE)) & BYTE_MASK);
+    }
+
+    void putName(std::string& data, const std::string& name)
+    {
+        data += padName(name);
+    }
+
+    /* Reads fields off the encoded object in order, a record that runs past the end is a truncated file */
+    class BinaryCursor
+    {
+        public:
+            explicit BinaryCursor(const std::string& data) : data(data), position(BINARY_OBJECT_MAGIC_SIZE) {}
+            bool done() const {return position >= data.size();}
+            template <typename T>
+            T take()
+            {
+                const char* bytes = need(sizeof(T));
+                uint64_t value = 0;
+                for (std::size_t i = 0; i < sizeof(T); i++) value |= static_cast<uint64_t>(static_cast<unsigned char>(bytes[i])) << (i * BITS_IN_BYTE);
+                return static_cast<T>(value);
+            }
+            const std::string takeName() {return trim(std::string(need(OBJECT_NAME_SIZE), OBJECT_NAME_SIZE));}
+            const uint8_t* takeBytes(const std::size_t count) {return reinterpret_cast<const uint8_t*>(need(count));}
+        private:
+            const char* need(const std::size_t count)
+            {
+                if (count > data.size() - position) corrupt("Truncated binary object at byte " + std::to_string(position));
+                const char* field = data.data() + position;
+                position += count;
+                return field;
+            }
+            const std::string& data;
+            std::size_t position;
+    };
+
+    // What getProgramName reads from a text header: the name up to the first digit
+    const std::string programNameOf(const ObjectRecord& header)
+    {
+        const std::string padded = padName(header.name);
+        std::size_t end = 0;
+        while (end < padded.size() && !std::isdigit(static_cast<unsigned char>(padded[end]))) end++;
+        return padded.substr(0, end);
+    }
+
+    const std::string readWholeFile(const char* fileName)
+    {
+        InputFile inputFile = FileHandling::openFile(fileName);
+        const std::string data((std::istreambuf_iterator<char>(inputFile)), std::istreambuf_iterator<char>());
+        inputFile.close();
+        return data;
+    }
+
+    void writeWholeFile(const char* fileName, const std::string& data)
+    {
+        std::ofstream outputFile(fileName, std::ios::binary);
+        if (!outputFile) fail(std::string("Failed to open file: ") + fileName);
+        outputFile << data;
+    }
+
+    // Same walk as the pipeline's resolver, only the bytes never were hex
+    int32_t DISASSEMBLE_TEXT_RECORD(const ObjectRecord& record, const LITMAP& litmap, DisassemblerContext& context)
+    {
+        const std::vector<InstructionBoundary> boundaries = SCAN_INSTRUCTION_LENGTHS(record.bytes, record.address, litmap);
+        int32_t end = record.address;
+        for (const InstructionBoundary& boundary : boundaries)
+        {
+            const int LOCCTR = record.address + boundary.offset;
+            if (boundary.literal) {
+                outputSymbol(context, LOCCTR, *boundary.literal);
+            }
+            else {
+                uint8_t bytes[sizeof(uint32_t)] = {0, 0, 0, 0};         // Record cut off mid instruction reads as zeros like the pipeline
+                const std::size_t available = std::min<std::size_t>(boundary.length, record.bytes.size() - boundary.offset);
+                std::memcpy(bytes, record.bytes.data() + boundary.offset, available);
+                const ParsingResult parsed = parseInstruction(bytes, boundary.length, context.parser);
+                const DisassemblerState state{context.baseAddress, LOCCTR, parsed.instruction, context.registers, context.symbols};
+                context.sink.instruction(state, parsed.bytesReadIn);
+                FileHandling::handleBaseDirective(parsed.instruction.opCode, parsed.instruction.objectCode, context);
+            }
+            end = LOCCTR + boundary.length;
+        }
+        return end;
+    }
+}
+
+/* Every record of a text object file, anything that is not a known record is an error rather than silently dropped */
+std::vector<ObjectRecord> READ_TEXT_OBJECT(std::istream& inputFile)
+{
+    std::vector<ObjectRecord> records;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(inputFile, line))
+    {
+        lineNumber++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+        ObjectRecord record = emptyRecord(line[0]);
+        switch (record.kind)
+        {
+            case HEADER_RECORD: {   // Counted from the end, getProgramName accepts names that lost their padding too
+                const std::size_t startField = std::max(line.size(), HEADER_FIELDS_SIZE) - HEADER_FIELDS_SIZE;
+                record.name = trim(line.substr(RECORD_FIELDS_START, std::max(startField, RECORD_FIELDS_START) - RECORD_FIELDS_START));
+                record.address = readHexField(line, startField, ADDRESS_HEX_CHARS, lineNumber);
+                record.length = readHexField(line, startField + ADDRESS_HEX_CHARS, ADDRESS_HEX_CHARS, lineNumber);
+                break;
+            }
+            case DEFINE_RECORD:
+                for (std::size_t i = RECORD_FIELDS_START; i < line.size(); i += OBJECT_NAME_SIZE + ADDRESS_HEX_CHARS)
+                    record.names.push_back({readNameField(line, i), readHexField(line, i + OBJECT_NAME_SIZE, ADDRESS_HEX_CHARS, lineNumber)});
+                break;
+            case REFER_RECORD:
+                for (std::size_t i = RECORD_FIELDS_START; i < line.size(); i += OBJECT_NAME_SIZE)
+                    record.names.push_back({readNameField(line, i), 0});
+                break;
+            case TEXT_RECORD: {
+                record.address = readHexField(line, RECORD_FIELDS_START, ADDRESS_HEX_CHARS, lineNumber);
+                const uint32_t length = readHexField(line, TEXT_LENGTH_FIELD, LENGTH_HEX_CHARS, lineNumber);
+                if (line.size() != TEXT_PAYLOAD_FIELD + length * HEX_CHARS_PER_BYTE)
+                    fail("T record on line " + std::to_string(lineNumber) + " declares " + std::to_string(length) + " bytes but holds "
+                    + std::to_string((line.size() - std::min(line.size(), TEXT_PAYLOAD_FIELD)) / HEX_CHARS_PER_BYTE));
+                for (uint32_t i = 0; i < length; i++)
+                    record.bytes.push_back(readHexField(line, TEXT_PAYLOAD_FIELD + i * HEX_CHARS_PER_BYTE, HEX_CHARS_PER_BYTE, lineNumber));
+                break;
+            }
+            case MODIFICATION_RECORD:
+                record.address = readHexField(line, RECORD_FIELDS_START, ADDRESS_HEX_CHARS, lineNumber);
+                record.length = readHexField(line, TEXT_LENGTH_FIELD, LENGTH_HEX_CHARS, lineNumber);
+                if (line.size() > MODIFICATION_SIGN_FIELD) {
+                    record.sign = line[MODIFICATION_SIGN_FIELD];
+                    record.name = trim(line.substr(MODIFICATION_SIGN_FIELD + 1, OBJECT_NAME_SIZE));
+                }
+                break;
+            case END_RECORD:
+                record.hasAddress = line.size() > RECORD_FIELDS_START;
+                if (record.hasAddress) record.address = readHexField(line, RECORD_FIELDS_START, ADDRESS_HEX_CHARS, lineNumber);
+                break;
+            default:
+                fail("Unknown record on line " + std::to_string(lineNumber) + ": " + line);
+        }
+        records.push_back(record);
+    }
+    return records;
+}
+
+void WRITE_TEXT_OBJECT(const std::vector<ObjectRecord>& records, std::ostream& outputFile)
+{
+    for (const ObjectRecord& record : records)
+    {
+        outputFile << record.kind;
+        switch (record.kind)
+        {
+            case HEADER_RECORD:
+                outputFile << padName(record.name) << hexField(record.address, ADDRESS_HEX_CHARS) << hexField(record.length, ADDRESS_HEX_CHARS);
+                break;
+            case DEFINE_RECORD:
+                for (const auto& name : record.names) outputFile << padName(name.first) << hexField(name.second, ADDRESS_HEX_CHARS);
+                break;
+            case REFER_RECORD:
+                for (const auto& name : record.names) outputFile << padName(name.first);
+                break;
+            case TEXT_RECORD:
+                outputFile << hexField(record.address, ADDRESS_HEX_CHARS) << hexField(record.bytes.size(), LENGTH_HEX_CHARS);
+                for (const uint8_t byte : record.bytes) outputFile << hexField(byte, HEX_CHARS_PER_BYTE);
+                break;
+            case MODIFICATION_RECORD:
+                outputFile << hexField(record.address, ADDRESS_HEX_CHARS) << hexField(record.length, LENGTH_HEX_CHARS);
+                if (record.sign != NO_SIGN) outputFile << record.sign << record.name;
+                break;
+            case END_RECORD:
+                if (record.hasAddress) outputFile << hexField(record.address, ADDRESS_HEX_CHARS);
+                break;
+        }
+        outputFile << '\n';
+    }
+}
+
+std::string ENCODE_BINARY_OBJECT(const std::vector<ObjectRecord>& records)
+{
+    std::string data(BINARY_OBJECT_MAGIC, BINARY_OBJECT_MAGIC_SIZE);
+    for (const ObjectRecord& record : records)
+    {
+        data += record.kind;
+        switch (record.kind)
+        {
+            case HEADER_RECORD:
+                putName(data, record.name);
+                put<uint32_t>(data, record.address);
+                put<uint32_t>(data, record.length);
+                break;
+            case DEFINE_RECORD:
+            case REFER_RECORD:
+                put<uint16_t>(data, record.names.size());
+                for (const auto& name : record.names)
+                {
+                    putName(data, name.first);
+                    if (record.kind == DEFINE_RECORD) put<uint32_t>(data, name.second);
+                }
+                break;
+            case TEXT_RECORD:
+                put<uint32_t>(data, record.address);
+                put<uint16_t>(data, record.bytes.size());
+                data.append(record.bytes.begin(), record.bytes.end());
+                break;
+            case MODIFICATION_RECORD:
+                put<uint32_t>(data, record.address);
+                put<uint8_t>(data, record.length);
+                data += record.sign;
+                putName(data, record.name);
+                break;
+            case END_RECORD:
+                put<uint8_t>(data, record.hasAddress);
+                put<uint32_t>(data, record.address);
+                break;
+        }
+    }
+    return data;
+}
+
+std::vector<ObjectRecord> DECODE_BINARY_OBJECT(const std::string& data)
+{
+    if (data.compare(0, BINARY_OBJECT_MAGIC_SIZE, BINARY_OBJECT_MAGIC) != 0) corrupt("Not a binary object file");
+    std::vector<ObjectRecord> records;
+    BinaryCursor cursor(data);
+    while (!cursor.done())
+    {
+        ObjectRecord record = emptyRecord(cursor.take<char>());
+        switch (record.kind)
+        {
+            case HEADER_RECORD:
+                record.name = cursor.takeName();
+                record.address = cursor.take<uint32_t>();
+                record.length = cursor.take<uint32_t>();
+                break;
+            case DEFINE_RECORD:
+            case REFER_RECORD: {
+                const uint16_t count = cursor.take<uint16_t>();
+                for (uint16_t i = 0; i < count; i++)
+                {
+                    const std::string name = cursor.takeName();
+                    record.names.push_back({name, record.kind == DEFINE_RECORD ? cursor.take<uint32_t>() : 0});
+                }
+                break;
+            }
+            case TEXT_RECORD: {
+                record.address = cursor.take<uint32_t>();
+                const uint16_t length = cursor.take<uint16_t>();
+                const uint8_t* bytes = cursor.takeBytes(length);
+                record.bytes.assign(bytes, bytes + length);
+                break;
+            }
+            case MODIFICATION_RECORD:
+                record.address = cursor.take<uint32_t>();
+                record.length = cursor.take<uint8_t>();
+                record.sign = cursor.take<char>();
+                record.name = cursor.takeName();
+                break;
+            case END_RECORD:
+                record.hasAddress = cursor.take<uint8_t>();
+                record.address = cursor.take<uint32_t>();
+                break;
+            default:
+                corrupt(std::string("Unknown record kind in binary object: ") + record.kind);
+        }
+        records.push_back(record);
+    }
+    return records;
+}
+
+/* Only the magic is looked at, the stream is left just past it */
+bool IS_BINARY_OBJECT(std::istream& inputFile)
+{
+    char magic[BINARY_OBJECT_MAGIC_SIZE];
+    inputFile.read(magic, BINARY_OBJECT_MAGIC_SIZE);
+    return inputFile.gcount() == BINARY_OBJECT_MAGIC_SIZE && std::memcmp(magic, BINARY_OBJECT_MAGIC, BINARY_OBJECT_MAGIC_SIZE) == 0;
+}
+
+// Peeks at the first byte only, a text object starts with a record letter and never with the magic's first one
+bool STARTS_AS_BINARY_OBJECT(std::istream& inputFile)
+{
+    return inputFile.peek() == BINARY_OBJECT_MAGIC[0];
+}
+
+// For the modes that only read text records, which would otherwise list the magic and raw bytes as a program
+void REFUSE_BINARY_OBJECT(std::istream& inputFile, const char* objectFile, const char* mode)
+{
+    if (!STARTS_AS_BINARY_OBJECT(inputFile)) return;
+    std::cerr << mode << " reads text object files only, convert with --to-text first: " << objectFile << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+// Compressed binaries are recognised too since openFile unpacks them
+bool IS_BINARY_OBJECT(const char* objectFile)
+{
+    InputFile inputFile = FileHandling::openFile(objectFile);
+    return IS_BINARY_OBJECT(inputFile);
+}
+
+/* Same test as for text objects, more than one header or any D/R record needs the control section engine */
+bool HAS_CONTROL_SECTIONS(const std::vector<ObjectRecord>& records)
+{
+    std::size_t headers = 0;
+    for (const ObjectRecord& record : records)
+    {
+        headers += record.kind == HEADER_RECORD;
+        if (record.kind == DEFINE_RECORD || record.kind == REFER_RECORD) return true;
+    }
+    return headers > 1;
+}
+
+const std::string BINARY_PROGRAM_NAME(const std::vector<ObjectRecord>& records)
+{
+    if (records.empty() || records.front().kind != HEADER_RECORD) corrupt("No header record in binary object");
+    return programNameOf(records.front());
+}
+
+/* The T records of a single section program between the opening and closing fillGap, like disassembleTextSections */
+void DISASSEMBLE_BINARY_OBJECT(const std::vector<ObjectRecord>& records, const LITMAP& litmap, const int lastSymbolAddress, DisassemblerContext& context)
+{
+    int32_t lastTextSectionEnd = 0;
+    for (const ObjectRecord& record : records)
+    {
+        if (record.kind != TEXT_RECORD) continue;
+        fillGap(record.address - lastTextSectionEnd, lastTextSectionEnd, context.symbols, context);
+        lastTextSectionEnd = DISASSEMBLE_TEXT_RECORD(record, litmap, context);
+    }
+    fillGap(lastSymbolAddress, lastTextSectionEnd, context.symbols, context);
+}
+
+// Expects argv[1] to be the text object file and argv[2] where the binary one goes
+int runToBinaryMode(const int argc, const char* argv[])
+{
+    if (argc < CONVERT_ARG_COUNT) fail("Usage: --to-binary in.obj out.sbo");
+    InputFile inputFile = FileHandling::openFile(argv[INPUT_FILE_ARG_NUMBER]);
+    const std::string data = ENCODE_BINARY_OBJECT(READ_TEXT_OBJECT(inputFile));
+    writeWholeFile(argv[OUTPUT_FILE_ARG_NUMBER], data);
+    std::cerr << "binary object: " << data.size() << " bytes" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// Expects argv[1] to be the binary object file and argv[2] where the text one goes
+int runToTextMode(const int argc, const char* argv[])
+{
+    if (argc < CONVERT_ARG_COUNT) fail("Usage: --to-text in.sbo out.obj");
+    std::ostringstream text;
+    WRITE_TEXT_OBJECT(DECODE_BINARY_OBJECT(readWholeFile(argv[INPUT_FILE_ARG_NUMBER])), text);
+    writeWholeFile(argv[OUTPUT_FILE_ARG_NUMBER], text.str());
+    return EXIT_SUCCESS;
+}
+
+// Expects argv[1] to be a binary object and argv[2] the symbol file, extra kind=file sinks may follow like the default mode
+int runBinaryObjectMode(const int argc, const char* argv[])
+{
+    const std::vector<ObjectRecord> records = DECODE_BINARY_OBJECT(readWholeFile(argv[INPUT_FILE_ARG_NUMBER]));
+    const std::string programName           = BINARY_PROGRAM_NAME(records);
+    std::ofstream outputFile                (OUTPUT_FILE_NAME);
+    if (HAS_CONTROL_SECTIONS(records)) {
+        if (argc > FIRST_SINK_ARG_NUMBER) std::cerr << "Extra sinks are only fed by single section programs, ignoring them" << std::endl;
+        std::stringstream text;
+        WRITE_TEXT_OBJECT(records, text);
+        DISASSEMBLE_CONTROL_SECTIONS(text, FileHandling::readSymbolTableBlocks(argv[SYMBOL_FILE_ARG_NUMBER]), outputFile);
+        return EXIT_SUCCESS;
+    }
+
+    const CompiledSymbolTable symbols       (argv[SYMBOL_FILE_ARG_NUMBER]);
+    const LITMAP litmap                     = symbols.getLiteralMap();  // Only the length scan wants the map
+    const REGMAP registers                  = REGISTERS();
+    const Parser parser;
+    std::istringstream noInput;             // Nothing is read through the context, the bytes are already in memory
+
+    ListingSink listing                     (outputFile, symbols);
+    FanoutSink sinks;
+    sinks.attach(listing);
+    ATTACH_SINKS(sinks, argc, argv, FIRST_SINK_ARG_NUMBER, symbols);
+    DisassemblerContext                     context{noInput, outputFile, sinks, registers, symbols, parser, INITIAL_BASE, false};
+
+    sinks.start(programName, symbols.getStartAddress());
+    DISASSEMBLE_BINARY_OBJECT(records, litmap, symbols.getLastSymbolAddress(), context);
+    sinks.finish(programName);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,56 @@
+#ifndef BINARY_OBJECT_H
+#define BINARY_OBJECT_H
+
+#include "disassembly.hpp"
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define BINARY_OBJECT_MAGIC "SICXEOB1"
+#define BINARY_OBJECT_MAGIC_SIZE 8
+#define OBJECT_NAME_SIZE 6
+
+/*
+ *  Binary object layout, integers little endian on every host since the file is exchanged like a text object, unlike
+ *  the compiled symbol cache which never leaves the machine that wrote it. The magic is followed by the records in
+ *  the order the text file has them, each one a kind byte and then:
+ *      H   char name[6], uint32 start, uint32 length
+ *      D   uint16 count, count x (char name[6], uint32 address)
+ *      R   uint16 count, count x char name[6]
+ *      T   uint32 start, uint16 length, length raw bytes
+ *      M   uint32 address, uint8 half bytes, char sign (0 when there is no symbol), char symbol[6]
+ *      E   uint8 has address, uint32 address
+ *  Names are space padded to six characters like the text format pads them.
+ */
+
+/* One record of an object file, only the fields its kind uses are filled in */
+struct ObjectRecord
+{
+    char kind;                                              // H, D, R, T, M or E, same letters as the text format
+    std::string name;                                       // H program name, M symbol
+    uint32_t address;                                       // H and T start, M address, E entry point
+    uint32_t length;                                        // H program length, M length in half bytes
+    char sign;                                              // M only, '+' or '-', 0 when no symbol follows
+    bool hasAddress;                                        // E only, an empty E record means the program start
+    std::vector<uint8_t> bytes;                             // T payload
+    std::vector<std::pair<std::string, uint32_t>> names;    // D names with their addresses, R names with 0
+};
+
+std::vector<ObjectRecord> READ_TEXT_OBJECT(std::istream& inputFile);
+void WRITE_TEXT_OBJECT(const std::vector<ObjectRecord>& records, std::ostream& outputFile);
+std::string ENCODE_BINARY_OBJECT(const std::vector<ObjectRecord>& records);
+std::vector<ObjectRecord> DECODE_BINARY_OBJECT(const std::string& data);
+bool IS_BINARY_OBJECT(std::istream& inputFile);
+bool IS_BINARY_OBJECT(const char* objectFile);
+bool STARTS_AS_BINARY_OBJECT(std::istream& inputFile);
+void REFUSE_BINARY_OBJECT(std::istream& inputFile, const char* objectFile, const char* mode);
+bool HAS_CONTROL_SECTIONS(const std::vector<ObjectRecord>& records);
+const std::string BINARY_PROGRAM_NAME(const std::vector<ObjectRecord>& records);
+void DISASSEMBLE_BINARY_OBJECT(const std::vector<ObjectRecord>& records, const LITMAP& litmap, const int lastSymbolAddress, DisassemblerContext& context);
+int runToBinaryMode(const int argc, const char* argv[]);
+int runToTextMode(const int argc, const char* argv[]);
+int runBinaryObjectMode(const int argc, const char* argv[]);
+
+#endif
@@ -0,0 +1,249 @@
+/*
+ *  @brief
+ *          Packs many object/symbol pairs into one bundle file and disassembles programs straight out of it
+ *
+ *  Batch runs over thousands of tiny programs spend most of their time opening and closing files. A bundle is
+ *  opened and mapped once, its table of contents is sorted by name so any program is found with a binary search,
+ *  and each program's symbol data are parsed in place from the mapping through a MemoryBuffer. Its object goes to the
+ *  daemon's RENDER_LISTING with one Parser for the whole run, so text, sectioned and binary objects all list as they
+ *  do on their own.
+ */
+
+#include "bundle.hpp"
+#include "daemon.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+const constexpr int BUNDLE_ARG_NUMBER = 1;
+const constexpr int FIRST_PROGRAM_ARG_NUMBER = 2;
+const constexpr int FILES_PER_PROGRAM = 2;
+const constexpr char BUNDLE_MAGIC[] = "SICBNDL1";
+const constexpr std::size_t MAGIC_SIZE = sizeof(BUNDLE_MAGIC) - 1;
+const constexpr int UINT32_BYTES = 4;
+const constexpr int UINT64_BYTES = 8;
+const constexpr std::size_t HEADER_SIZE = MAGIC_SIZE + 2 * UINT32_BYTES;
+const constexpr std::size_t ENTRY_SIZE = BUNDLE_NAME_SIZE + 4 * UINT64_BYTES;
+const constexpr int BITS_IN_BYTE = 8;
+const constexpr char* OUTPUT_FILE_NAME = "out.lst";
+const constexpr char* NOT_A_BUNDLE_MESSAGE = "Not a valid bundle: ";
+
+namespace
+{
+    void putLittleEndian(std::string& out, const uint64_t value, const int bytes)
+    {
+        for (int i = 0; i < bytes; i++) out += static_cast<char>((value >> (i * BITS_IN_BYTE)) & 0xFF);
+    }
+
+    uint64_t getLittleEndian(const char* in, const int bytes)
+    {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; i++) value |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (i * BITS_IN_BYTE);
+        return value;
+    }
+
+    // Packed as plain text, compressed inputs are decompressed on the way in
+    const std::string readWholeFile(const char* filename)
+    {
+        InputFile inputFile = FileHandling::openFile(filename);
+        std::ostringstream contents;
+        contents << inputFile.rdbuf();
+        return contents.str();
+    }
+
+    // dir/p3test.obj.gz is stored as p3test
+    const std::string programNameFromPath(const std::string& path)
+    {
+        const std::size_t slash = path.find_last_of('/');
+        const std::string base = slash == std::string::npos ? path : path.substr(slash + 1);
+        return base.substr(0, base.find('.'));
+    }
+
+    void failBundle(const char* filename, const std::string& reason)
+    {
+        std::cerr << NOT_A_BUNDLE_MESSAGE << filename << " (" << reason << ")" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    bool fitsIn(const uint64_t offset, const uint64_t size, const std::size_t fileSize)
+    {
+        return offset <= fileSize && size <= fileSize - offset;
+    }
+
+    /*
+     *  Same listing a normal run writes for the program's own files, through the daemon's renderer and the run's parser.
+     *  A program without SYMTAB entries has no START address and is reported and left out, the rest of the bundle goes on
+     */
+    bool DISASSEMBLE_BUNDLED_PROGRAM(const MappedBundle& bundle, const BundleEntry& entry, const Parser& parser, const REGMAP& registers, std::ostream& outputFile)
+    {
+        MemoryBuffer symbolBuffer(bundle.data(entry.symbolOffset), entry.symbolSize);
+        std::istream symbolFile(&symbolBuffer);
+        const std::vector<SymbolEntries> blocks = FileHandling::readSymbolTableBlocks(symbolFile);
+        if (blocks.empty() || blocks.front().SYMTAB.empty()) {
+            std::cerr << "Symbol file has no SYMTAB entries: " << entry.name << std::endl;
+            return false;
+        }
+        const CachedSymbols symbols(blocks);
+        outputFile << RENDER_LISTING(std::string(bundle.data(entry.objectOffset), entry.objectSize), symbols, parser, registers);
+        return true;
+    }
+}
+
+MemoryBuffer::MemoryBuffer(const char* data, const std::size_t size)
+{
+    char* begin = const_cast<char*>(data);      // Only ever read, the get area just has no const flavour
+    setg(begin, begin, begin + size);
+}
+
+std::streambuf::pos_type MemoryBuffer::seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which)
+{
+    char* base = direction == std::ios_base::beg ? eback() : direction == std::ios_base::cur ? gptr() : egptr();
+    if (!(which & std::ios_base::in) || base + offset < eback() || base + offset > egptr()) return pos_type(off_type(-1));
+    setg(eback(), base + offset, egptr());
+    return pos_type(gptr() - eback());
+}
+
+std::streambuf::pos_type MemoryBuffer::seekpos(pos_type position, std::ios_base::openmode which)
+{
+    return seekoff(off_type(position), std::ios_base::beg, which);
+}
+
+MappedBundle::MappedBundle(const char* filename)
+{
+    const int descriptor = open(filename, O_RDONLY);
+    struct stat status;
+    if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+        std::cerr << "Failed to open file: " << filename << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    mappingSize = status.st_size;
+    if (mappingSize < HEADER_SIZE) failBundle(filename, "too short for a header");
+    void* mapped = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);                          // The mapping keeps the file alive
+    if (mapped == MAP_FAILED) failBundle(filename, "mmap failed");
+    mapping = static_cast<const char*>(mapped);
+
+    if (std::memcmp(mapping, BUNDLE_MAGIC, MAGIC_SIZE) != 0) failBundle(filename, "bad magic");
+    const uint64_t count = getLittleEndian(mapping + MAGIC_SIZE, UINT32_BYTES);
+    if (!fitsIn(HEADER_SIZE, count * ENTRY_SIZE, mappingSize)) failBundle(filename, "contents run past the end");
+    for (uint64_t i = 0; i < count; i++)
+    {
+        const char* raw = mapping + HEADER_SIZE + i * ENTRY_SIZE;
+        const char* fields = raw + BUNDLE_NAME_SIZE;
+        BundleEntry entry{std::string(raw, strnlen(raw, BUNDLE_NAME_SIZE)),
+            getLittleEndian(fields, UINT64_BYTES), getLittleEndian(fields + UINT64_BYTES, UINT64_BYTES),
+            getLittleEndian(fields + 2 * UINT64_BYTES, UINT64_BYTES), getLittleEndian(fields + 3 * UINT64_BYTES, UINT64_BYTES)};
+        if (!fitsIn(entry.objectOffset, entry.objectSize, mappingSize) || !fitsIn(entry.symbolOffset, entry.symbolSize, mappingSize))
+            failBundle(filename, "payload of " + entry.name + " runs past the end");
+        entries.push_back(entry);
+    }
+}
+
+MappedBundle::~MappedBundle()
+{
+    munmap(const_cast<char*>(mapping), mappingSize);
+}
+
+/* Contents are sorted by name when packed */
+const BundleEntry* MappedBundle::find(const std::string& name) const
+{
+    auto it = std::lower_bound(entries.begin(), entries.end(), name, [](const BundleEntry& entry, const std::string& key) {return entry.name < key;});
+    return it != entries.end() && it->name == name ? &*it : nullptr;
+}
+
+// Expects argv[1] to be the bundle to write, followed by object and symbol file pairs
+int runPackMode(const int argc, const char* argv[])
+{
+    const int fileCount = argc - FIRST_PROGRAM_ARG_NUMBER;
+    if (fileCount <= 0 || fileCount % FILES_PER_PROGRAM != 0) {
+        std::cerr << "usage: --pack bundle program.obj program.sym [program.obj program.sym ...]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<std::pair<std::string, int>> programs;      // Name and the argument holding its object file
+    for (int i = FIRST_PROGRAM_ARG_NUMBER; i < argc; i += FILES_PER_PROGRAM)
+    {
+        const std::string name = programNameFromPath(argv[i]);
+        if (name.empty() || name.size() >= BUNDLE_NAME_SIZE) {
+            std::cerr << "Program name must be 1 to " << BUNDLE_NAME_SIZE - 1 << " characters: " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+        programs.push_back({name, i});
+    }
+    std::sort(programs.begin(), programs.end());
+    for (std::size_t i = 1; i < programs.size(); i++)
+    {
+        if (programs[i].first != programs[i-1].first) continue;
+        std::cerr << "Two programs named " << programs[i].first << " in one bundle" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string contents, payloads;
+    putLittleEndian(contents, programs.size(), UINT32_BYTES);
+    putLittleEndian(contents, 0, UINT32_BYTES);
+    const uint64_t payloadStart = HEADER_SIZE + programs.size() * ENTRY_SIZE;
+    for (const auto& program : programs)
+    {
+        const std::string objectData = readWholeFile(argv[program.second]);
+        const std::string symbolData = readWholeFile(argv[program.second + 1]);
+        std::string name = program.first;
+        name.resize(BUNDLE_NAME_SIZE, '\0');
+        contents += name;
+        putLittleEndian(contents, payloadStart + payloads.size(), UINT64_BYTES);
+        putLittleEndian(contents, objectData.size(), UINT64_BYTES);
+        putLittleEndian(contents, payloadStart + payloads.size() + objectData.size(), UINT64_BYTES);
+        putLittleEndian(contents, symbolData.size(), UINT64_BYTES);
+        payloads += objectData;
+        payloads += symbolData;
+    }
+
+    std::ofstream bundleFile(argv[BUNDLE_ARG_NUMBER], std::ios::binary);
+    bundleFile.write(BUNDLE_MAGIC, MAGIC_SIZE);
+    bundleFile << contents << payloads;
+    if (!bundleFile) {
+        std::cerr << "Failed to write bundle: " << argv[BUNDLE_ARG_NUMBER] << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cerr << "PACK " << programs.size() << " programs, " << payloadStart + payloads.size() << " bytes" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// Expects argv[1] to be a bundle, any names after it pick the programs to disassemble, none means all of them
+int runBundleMode(const int argc, const char* argv[])
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const MappedBundle bundle(argv[BUNDLE_ARG_NUMBER]);
+    std::vector<const BundleEntry*> selected;
+    for (int i = FIRST_PROGRAM_ARG_NUMBER; i < argc; i++)
+    {
+        const BundleEntry* entry = bundle.find(argv[i]);
+        if (!entry) {
+            std::cerr << "No program named " << argv[i] << " in " << argv[BUNDLE_ARG_NUMBER] << std::endl;
+            return EXIT_FAILURE;
+        }
+        selected.push_back(entry);
+    }
+    if (argc <= FIRST_PROGRAM_ARG_NUMBER)
+        for (const BundleEntry& entry : bundle.getEntries()) selected.push_back(&entry);
+
+    std::ofstream outputFile(OUTPUT_FILE_NAME);
+    const Parser parser;                    // Built once, the programs in a bundle are too small to pay for it each
+    const REGMAP registers = REGISTERS();
+    uint64_t bytes = 0;
+    std::size_t skipped = 0;
+    for (const BundleEntry* entry : selected)
+    {
+        skipped += !DISASSEMBLE_BUNDLED_PROGRAM(bundle, *entry, parser, registers, outputFile);
+        bytes += entry->objectSize + entry->symbolSize;
+    }
+    outputFile.close();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "BUNDLE " << selected.size() << " of " << bundle.getEntries().size() << " programs, " << skipped << " skipped, "
+    << bytes << " bytes in " << seconds << " s" << std::endl;
+    return skipped ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,57 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <cstdint>
+#include <ios>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#define BUNDLE_NAME_SIZE 32         // Program name plus at least one terminating zero
+
+/*
+ *  Bundle layout, every integer little endian
+ *      header      "SICBNDL1", uint32 program count, uint32 reserved
+ *      contents    one entry per program sorted by name: name[32], then offset and size of the object and symbol data
+ *      payloads    the object and symbol files packed back to back, as plain text
+ */
+struct BundleEntry
+{
+    std::string name;
+    uint64_t objectOffset;
+    uint64_t objectSize;
+    uint64_t symbolOffset;
+    uint64_t symbolSize;
+};
+
+/* Reads straight out of mapped memory, nothing is copied */
+class MemoryBuffer : public std::streambuf
+{
+    public:
+        MemoryBuffer(const char* data, const std::size_t size);
+    protected:
+        pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which) override;
+        pos_type seekpos(pos_type position, std::ios_base::openmode which) override;
+};
+
+/* A bundle mapped read only, the contents are parsed once and every payload is served from the mapping */
+class MappedBundle
+{
+    public:
+        explicit MappedBundle(const char* filename);
+        ~MappedBundle();
+        MappedBundle(const MappedBundle&) = delete;
+        MappedBundle& operator=(const MappedBundle&) = delete;
+        const std::vector<BundleEntry>& getEntries() const {return entries;}
+        const BundleEntry* find(const std::string& name) const;
+        const char* data(const uint64_t offset) const {return mapping + offset;}
+    private:
+        const char* mapping;
+        std::size_t mappingSize;
+        std::vector<BundleEntry> entries;
+};
+
+int runPackMode(const int argc, const char* argv[]);
+int runBundleMode(const int argc, const char* argv[]);
+
+#endif
@@ -0,0 +1,418 @@
+/*
+ *  @brief
+ *          Batch disassembly that reports malformed input per record instead of aborting (--checked)
+ *
+ *  The fast path trusts its input: an unknown register number is looked up with find(...)->second, a literal length
+ *  goes straight into std::stoi, a character that is not a hex digit comes out of convertFromCharToHex as whatever
+ *  strchr left behind, and a symbol line with a missing field is indexed past the end of its tokens. On a batch of
+ *  thousands of files one such file takes the whole run down.
+ *
+ *  Here every symbol file line and every T record is checked before the unchecked code sees it. A bad symbol line is
+ *  reported and left out of the tables. A bad record is reported and skipped, the listing goes on with the next T
+ *  record as if the skipped one had been there. Whatever the checks do not foresee and the library throws only
+ *  costs the program it happened in. Programs are spread over a pool of workers sharing one Parser, and the
+ *  listings are written to out.lst in argument order like --bundle does. Usage:
+ *      --checked obj sym [obj sym ...]
+ *
+ *  Errors go to stderr as file:line: reason. The summary gives the time spent in record checks next to the rest of
+ *  the run, which is the same length scan, decode and render the unchecked pipeline does.
+ */
+
+#include "checked_decode.hpp"
+#include "daemon.hpp"
+#include "bundle.hpp"
+#include "pipeline.hpp"
+#include "length_scan.hpp"
+#include "operand_renderers.hpp"
+#include "byte_operations.hpp"
+#include "memory_accounting.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+const constexpr int FIRST_PAIR_ARG_NUMBER = 1;
+const constexpr int FILES_PER_PROGRAM = 2;
+const constexpr int INITIAL_BASE = 0;
+const constexpr int SYMTAB_HEADER_LINES = 2;
+const constexpr int LITTAB_HEADER_LINES = 2;
+const constexpr std::size_t SYMTAB_TOKENS = 3;
+const constexpr std::size_t LITERAL_TOKENS = 3;         // Unnamed literal, LITTAB lines with a name have one more
+const constexpr std::size_t NAMED_LITERAL_TOKENS = 4;
+const constexpr std::size_t MAX_ADDRESS_DIGITS = 8;
+const constexpr std::size_t MAX_LENGTH_DIGITS = 6;
+const constexpr std::size_t LITERAL_PREFIX = 3;         // =X' in front of a literal's bytes
+const constexpr std::size_t BYTE_PREFIX = 2;            // X' in front of a BYTE constant's bytes
+const constexpr std::size_t ADDRESS_COLUMN = 1;
+const constexpr std::size_t ADDRESS_DIGITS = 6;
+const constexpr std::size_t LENGTH_COLUMN = 7;
+const constexpr std::size_t LENGTH_DIGITS = 2;
+const constexpr std::size_t PAYLOAD_COLUMN = 9;
+const constexpr int HEX_CHARS_PER_BYTE = 2;
+const constexpr int FIRST_TWELVE_BITS = 3;
+const constexpr int OPCODE_DIGITS = 2;
+const constexpr double NANOS_PER_MILLI = 1e6;
+const constexpr double PERCENT = 100.0;
+const constexpr char HEADER_RECORD = 'H';
+const constexpr char TEXT_RECORD = 'T';
+const constexpr char DEFINE_RECORD = 'D';
+const constexpr char REFER_RECORD = 'R';
+const constexpr char LITERAL_MARKER = '=';
+const constexpr char* LITTAB_HEADER_WORD = "Name";
+const constexpr char* UNNAMED_LITERAL = "*";
+const constexpr char* LDB_INSTRUCTION = "LDB";
+const constexpr char* OBJECT_HEX_DIGITS = "0123456789ABCDEF";      // All convertFromCharToHex can map
+const constexpr char* OUTPUT_FILE_NAME = "out.lst";
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    uint64_t nanosSince(const Clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    }
+
+    // Runs one check and charges its time to the program's check budget
+    template<typename Check>
+    std::string TIMED_CHECK(uint64_t& nanos, const Check& check)
+    {
+        const Clock::time_point start = Clock::now();
+        const std::string fault = check();
+        nanos += nanosSince(start);
+        return fault;
+    }
+
+    const std::vector<std::string> TOKENS(const std::string& line)
+    {
+        std::vector<std::string> tokens;
+        std::istringstream stream(line);
+        std::string token;
+        while (stream >> token) tokens.push_back(token);
+        return tokens;
+    }
+
+    // hexStringToInt reads either case
+    bool isHexNumber(const std::string& text)
+    {
+        return !text.empty() && text.size() <= MAX_ADDRESS_DIGITS
+            && std::all_of(text.begin(), text.end(), [](const char c) {return std::isxdigit(static_cast<unsigned char>(c));});
+    }
+
+    bool isDecimal(const std::string& text)
+    {
+        return !text.empty() && text.size() <= MAX_LENGTH_DIGITS
+            && std::all_of(text.begin(), text.end(), [](const char c) {return std::isdigit(static_cast<unsigned char>(c));});
+    }
+
+    std::string address(const int32_t value)
+    {
+        return intToHexString(value);
+    }
+
+    const std::string CHECK_SYMTAB_LINE(const std::vector<std::string>& tokens)
+    {
+        if (tokens.size() < SYMTAB_TOKENS)
+            return "SYMTAB line has " + std::to_string(tokens.size()) + " fields, expected symbol, address and flags";
+        if (!isHexNumber(tokens[1])) return "symbol address " + tokens[1] + " is not a hex number";
+        return std::string();
+    }
+
+    // Everything getLiteralBytes and ListingSink::literal take for granted
+    const std::string CHECK_LITTAB_LINE(const std::vector<std::string>& tokens)
+    {
+        if (tokens.size() != LITERAL_TOKENS && tokens.size() != NAMED_LITERAL_TOKENS)
+            return "LITTAB line has " + std::to_string(tokens.size()) + " fields, expected name, constant, length and address";
+        const std::size_t first = tokens.size() - LITERAL_TOKENS;
+        const std::string& constant = tokens[first];
+        const std::string& length = tokens[first + 1];
+        if (!isDecimal(length)) return "literal length " + length + " is not a number";
+        if (std::stoi(length) == 0 || std::stoi(length) % HEX_CHARS_PER_BYTE) return "literal length " + length + " does not cover whole bytes";
+        if (!isHexNumber(tokens[first + 2])) return "literal address " + tokens[first + 2] + " is not a hex number";
+        if (constant.size() < (constant.front() == LITERAL_MARKER ? LITERAL_PREFIX : BYTE_PREFIX)) return "constant " + constant + " is too short to hold any bytes";
+        return std::string();
+    }
+
+    // The object text has to be what convertFromCharToHex maps, returns where it stops being that
+    std::size_t firstNonHex(const std::string& text, const std::size_t from)
+    {
+        const std::size_t position = text.find_first_not_of(OBJECT_HEX_DIGITS, from);
+        return position == std::string::npos ? text.size() : position;
+    }
+
+    // record.sectionFound is set once the address and length are known, even if the payload turns out bad
+    const std::string PARSE_TEXT_RECORD(const std::string& line, TextRecord& record)
+    {
+        if (line.size() < PAYLOAD_COLUMN) return "text record ends before its length byte";
+        if (firstNonHex(line, ADDRESS_COLUMN) < PAYLOAD_COLUMN) return "text record header has a character that is not an uppercase hex digit";
+        record.LOCCTR_START = hexStringToInt(line.substr(ADDRESS_COLUMN, ADDRESS_DIGITS));
+        record.textSectionSize = convertStringToHex(line.substr(LENGTH_COLUMN, LENGTH_DIGITS));
+        record.sectionFound = true;
+        const std::size_t bad = firstNonHex(line, PAYLOAD_COLUMN);
+        if (bad < line.size()) return "column " + std::to_string(bad + 1) + " of the record is not an uppercase hex digit";
+        record.objectCode = line.substr(PAYLOAD_COLUMN);
+        if (record.objectCode.size() != static_cast<std::size_t>(record.textSectionSize * HEX_CHARS_PER_BYTE))
+            return "record at " + address(record.LOCCTR_START) + " says " + std::to_string(record.textSectionSize) + " bytes but holds "
+                + std::to_string(record.objectCode.size()) + " hex digits";
+        return std::string();
+    }
+
+    // DECODE_BOUNDARIES pads an instruction the record cuts off, which hides a truncated record
+    const std::string CHECK_BOUNDARIES(const std::vector<InstructionBoundary>& boundaries, const TextRecord& record)
+    {
+        if (boundaries.empty()) return std::string();
+        const InstructionBoundary& last = boundaries.back();
+        if (last.offset + last.length <= record.textSectionSize) return std::string();
+        return std::string(last.literal ? "literal" : "instruction") + " at " + address(record.LOCCTR_START + last.offset) + " needs "
+            + std::to_string(last.length) + " bytes, the record ends after " + std::to_string(record.textSectionSize - last.offset);
+    }
+
+    // Opcodes the tables do not know and format 2 operands that name no register, BASE follows LDB like the listing
+    const std::string CHECK_ITEMS(const std::vector<DecodedItem>& items, int BASE, const REGMAP& registers)
+    {
+        for (const DecodedItem& item : items)
+        {
+            if (item.literal) continue;
+            const ParsedInstruction& instruction = item.result.instruction;
+            if (instruction.opCode.empty())
+                return "opcode " + instruction.objectCode.substr(0, OPCODE_DIGITS) + " at " + address(item.LOCCTR) + " is not a SIC/XE instruction";
+            if (instruction.format == AddressingFormat::Format2
+                && !registers.count(OPERAND_LOOKUP_ADDRESS(OffsetInfo{BASE, item.LOCCTR + item.result.bytesReadIn}, instruction.objectCode)))
+                return "operand of " + instruction.opCode + " at " + address(item.LOCCTR) + " is not a register";
+            if (instruction.opCode == LDB_INSTRUCTION) BASE = hexStringToInt(instruction.objectCode.substr(FIRST_TWELVE_BITS));
+        }
+        return std::string();
+    }
+
+    struct CheckedListing
+    {
+        DisassemblerContext& context;
+        const LITMAP& litmap;
+        const std::string& file;
+        CheckedProgram& program;
+        int32_t lastTextSectionEnd;
+    };
+
+    // Lists one T record, or reports it and leaves LOCCTR where the record said it would end
+    void LIST_RECORD(const std::string& line, const int lineNumber, CheckedListing& listing)
+    {
+        TraceSpan span("checkedRecord", lineNumber);
+        CheckedProgram& program = listing.program;
+        TextRecord record{0, 0, std::string(), false};
+        std::vector<DecodedItem> items;
+        std::string fault = TIMED_CHECK(program.checkNanos, [&]() {return PARSE_TEXT_RECORD(line, record);});
+        if (fault.empty()) {
+            const std::vector<InstructionBoundary> boundaries = SCAN_INSTRUCTION_LENGTHS(DECODE_HEX_BYTES(record.objectCode), record.LOCCTR_START, listing.litmap);
+            fault = TIMED_CHECK(program.checkNanos, [&]() {return CHECK_BOUNDARIES(boundaries, record);});
+            if (fault.empty()) {
+                items = DECODE_BOUNDARIES(record, boundaries, 0, boundaries.size(), listing.context.parser);
+                fault = TIMED_CHECK(program.checkNanos, [&]() {return CHECK_ITEMS(items, listing.context.baseAddress, listing.context.registers);});
+            }
+        }
+        program.records++;
+        if (!fault.empty()) {
+            program.errors.push_back(DecodeError{listing.file, lineNumber, fault});
+            program.skippedRecords++;
+            if (record.sectionFound) listing.lastTextSectionEnd = record.LOCCTR_START + record.textSectionSize;
+            return;
+        }
+        const int32_t lastTextSectionEnd = listing.lastTextSectionEnd;
+        listing.lastTextSectionEnd = items.empty() ? record.LOCCTR_START : items.back().LOCCTR + items.back().result.bytesReadIn;
+        RENDER_DECODED_RECORD(listing.context, DecodedRecord{record.LOCCTR_START - lastTextSectionEnd, lastTextSectionEnd, std::move(items), false});
+    }
+
+    // Same name getProgramName reads, everything after H up to the first digit
+    const std::string PROGRAM_NAME(const std::string& line)
+    {
+        std::size_t end = 1;
+        while (end < line.size() && !std::isdigit(static_cast<unsigned char>(line[end]))) end++;
+        return line.substr(1, end - 1);
+    }
+
+    const std::string TRIMMED(const std::string& line)
+    {
+        const std::size_t end = line.find_last_not_of(" \t\r");
+        return end == std::string::npos ? std::string() : line.substr(0, end + 1);
+    }
+
+    // A file that is missing or stops inflating part way is reported against itself, the batch goes on
+    bool READ_INPUT(const std::string& file, std::string& contents, CheckedProgram& program)
+    {
+        try {
+            if (READ_FILE_CONTENTS(file, contents)) return true;
+            program.errors.push_back(DecodeError{file, 0, "cannot be read"});
+        }
+        catch (const CorruptInputError& error) {
+            program.errors.push_back(DecodeError{file, 0, error.what()});
+        }
+        return false;
+    }
+
+    void LIST_CHECKED(const std::string& objectFile, const std::string& symbolFile, const Parser& parser, const REGMAP& registers, CheckedProgram& program)
+    {
+        std::string object, symbolText;
+        if (!READ_INPUT(objectFile, object, program) || !READ_INPUT(symbolFile, symbolText, program)) return;
+        MemoryBuffer symbolBuffer(symbolText.data(), symbolText.size());
+        std::istream symbolStream(&symbolBuffer);
+        const SymbolEntries symbolEntries = CHECKED_READ_SYMBOLS(symbolStream, symbolFile, program.errors);
+        if (symbolEntries.SYMTAB.empty()) {program.errors.push_back(DecodeError{symbolFile, 0, "has no usable SYMTAB entries"}); return;}
+        const LITMAP litmap = CREATE_LITMAP(symbolEntries);
+        const SYMMAP symmap = CREATE_SYMMAP(symbolEntries);
+        const MapSymbolProvider symbols(symmap, litmap);
+
+        std::ostringstream listingText;
+        std::istringstream noInput;         // Records are cut out of the object text here, the engine never reads
+        ListingSink sink(listingText, symbols);
+        DisassemblerContext context{noInput, listingText, sink, registers, symbols, parser, INITIAL_BASE, false};
+        CheckedListing listing{context, litmap, objectFile, program, 0};
+
+        MemoryBuffer objectBuffer(object.data(), object.size());
+        std::istream objectStream(&objectBuffer);
+        std::string programName;
+        bool started = false;
+        std::string line;
+        for (int lineNumber = 1; std::getline(objectStream, line); lineNumber++)
+        {
+            line = TRIMMED(line);
+            if (line.empty()) continue;
+            if (line[0] == HEADER_RECORD && started) {program.errors.push_back(DecodeError{objectFile, lineNumber, "second header record, control sections are not checked"}); return;}
+            if (line[0] == DEFINE_RECORD || line[0] == REFER_RECORD) {program.errors.push_back(DecodeError{objectFile, lineNumber, "EXTDEF/EXTREF record, control sections are not checked"}); return;}
+            if (line[0] == HEADER_RECORD) {
+                programName = PROGRAM_NAME(line);
+                sink.start(programName, symbolEntries.SYMTAB[0].address);
+                started = true;
+            }
+            else if (line[0] == TEXT_RECORD) {
+                if (!started) {program.errors.push_back(DecodeError{objectFile, lineNumber, "text record before the header record"}); return;}
+                LIST_RECORD(line, lineNumber, listing);
+            }
+        }
+        if (!started) {program.errors.push_back(DecodeError{objectFile, 0, "has no header record"}); return;}
+        fillGap(GET_LAST_SYMBOL_ADDRESS(symbolEntries), listing.lastTextSectionEnd, symbols, context);
+        sink.finish(programName);
+        program.listing = listingText.str();
+        program.listed = true;
+    }
+
+    void PRINT_CHECKED_SUMMARY(std::ostream& stream, const std::vector<CheckedProgram>& programs)
+    {
+        uint64_t listed = 0, clean = 0, records = 0, skipped = 0, errors = 0, checkNanos = 0, totalNanos = 0;
+        for (const CheckedProgram& program : programs)
+        {
+            listed += program.listed;
+            clean += program.listed && program.errors.empty();
+            records += program.records;
+            skipped += program.skippedRecords;
+            errors += program.errors.size();
+            checkNanos += program.checkNanos;
+            totalNanos += program.totalNanos;
+        }
+        const uint64_t uncheckedNanos = totalNanos - checkNanos;
+        stream << "CHECKED " << programs.size() << " programs: " << clean << " clean, " << listed - clean << " listed with errors, "
+        << programs.size() - listed << " not listed; " << records << " records, " << skipped << " skipped, " << errors << " errors" << std::endl;
+        stream << "checks: " << std::fixed << std::setprecision(3) << checkNanos / NANOS_PER_MILLI << " ms on top of "
+        << uncheckedNanos / NANOS_PER_MILLI << " ms of unchecked work (" << std::setprecision(1)
+        << (uncheckedNanos ? PERCENT * checkNanos / uncheckedNanos : 0) << "%)" << std::endl;
+    }
+}
+
+/* Same layout READ_SYMBOL_BLOCK expects, lines it could not use are reported and left out. Only the first block is read */
+const SymbolEntries CHECKED_READ_SYMBOLS(std::istream& stream, const std::string& file, std::vector<DecodeError>& errors)
+{
+    MemoryScope scope(MemorySubsystem::SymbolTable);
+    std::vector<SYMTAB_Entry> symtab;
+    std::vector<LITTAB_Entry> littab;
+    std::string line;
+    int lineNumber = 0;
+    const auto skipLines = [&](const int count) {for (int i = 0; i < count && std::getline(stream, line); i++) lineNumber++;};
+    skipLines(SYMTAB_HEADER_LINES);
+    bool literals = false;
+    while (std::getline(stream, line))
+    {
+        lineNumber++;
+        const std::vector<std::string> tokens = TOKENS(line);
+        if (tokens.empty()) {
+            if (literals) break;
+            literals = true;
+            skipLines(LITTAB_HEADER_LINES);
+            continue;
+        }
+        if (!literals && tokens.front() == LITTAB_HEADER_WORD) {
+            errors.push_back(DecodeError{file, lineNumber, "LITTAB header without the blank line that ends SYMTAB"});
+            literals = true;
+            skipLines(LITTAB_HEADER_LINES - 1);
+            continue;
+        }
+        const std::string fault = literals ? CHECK_LITTAB_LINE(tokens) : CHECK_SYMTAB_LINE(tokens);
+        if (!fault.empty()) errors.push_back(DecodeError{file, lineNumber, fault});
+        else if (!literals) symtab.push_back(SYMTAB_Entry{tokens[0], tokens[1], tokens[2]});
+        else if (tokens.size() == LITERAL_TOKENS) littab.push_back(LITTAB_Entry{UNNAMED_LITERAL, tokens[0], tokens[1], tokens[2]});
+        else littab.push_back(LITTAB_Entry{tokens[0], tokens[1], tokens[2], tokens[3]});
+    }
+    return SymbolEntries{symtab, littab};
+}
+
+/* Never throws, whatever goes wrong in one program is reported against it */
+CheckedProgram CHECK_PROGRAM(const std::string& objectFile, const std::string& symbolFile, const Parser& parser, const REGMAP& registers)
+{
+    TraceSpan span("checkProgram");
+    const Clock::time_point start = Clock::now();
+    CheckedProgram program;
+    try {
+        LIST_CHECKED(objectFile, symbolFile, parser, registers, program);
+    }
+    catch (const std::exception& error) {
+        program.errors.push_back(DecodeError{objectFile, 0, std::string("stopped by an unchecked fault: ") + error.what()});
+        program.listing.clear();
+        program.listed = false;
+    }
+    program.totalNanos = nanosSince(start);
+    return program;
+}
+
+// Expects object and symbol files in pairs from argv[1] on
+int runCheckedMode(const int argc, const char* argv[])
+{
+    const int files = argc - FIRST_PAIR_ARG_NUMBER;
+    if (files <= 0 || files % FILES_PER_PROGRAM) {
+        std::cerr << "Expected object and symbol files in pairs" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    const std::size_t programCount = files / FILES_PER_PROGRAM;
+    const REGMAP registers = REGISTERS();
+    std::vector<CheckedProgram> programs(programCount);
+    const Parser parser;
+    std::atomic<std::size_t> next(0);
+    const auto work = [&]()
+    {
+        NAME_TRACE_THREAD("checker");
+        for (std::size_t i = next++; i < programCount; i = next++)
+        {
+            const int pair = FIRST_PAIR_ARG_NUMBER + static_cast<int>(i) * FILES_PER_PROGRAM;
+            programs[i] = CHECK_PROGRAM(argv[pair], argv[pair + 1], parser, registers);
+        }
+    };
+    const std::size_t workerCount = std::min<std::size_t>(programCount, std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < workerCount; i++) workers.push_back(std::thread(work));
+    work();
+    for (std::thread& worker : workers) worker.join();
+
+    std::ofstream outputFile(OUTPUT_FILE_NAME);
+    bool faultFree = true;
+    for (const CheckedProgram& program : programs)
+    {
+        outputFile << program.listing;
+        for (const DecodeError& error : program.errors)
+            std::cerr << error.file << ":" << error.line << ": " << error.reason << std::endl;
+        faultFree = faultFree && program.listed && program.errors.empty();
+    }
+    PRINT_CHECKED_SUMMARY(std::cerr, programs);
+    return faultFree ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,33 @@
+#ifndef CHECKED_DECODE_H
+#define CHECKED_DECODE_H
+
+#include "disassembly.hpp"
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+/* One fault in an input file, line is 1 based and 0 when it concerns the file as a whole */
+struct DecodeError
+{
+    std::string file;
+    int line;
+    std::string reason;
+};
+
+struct CheckedProgram
+{
+    std::string listing;
+    std::vector<DecodeError> errors;
+    uint64_t records = 0;
+    uint64_t skippedRecords = 0;
+    uint64_t checkNanos = 0;        // Spent checking records, the rest of totalNanos is the same work the unchecked path does
+    uint64_t totalNanos = 0;
+    bool listed = false;            // False when nothing of the program could be listed
+};
+
+const SymbolEntries CHECKED_READ_SYMBOLS(std::istream& stream, const std::string& file, std::vector<DecodeError>& errors);
+CheckedProgram CHECK_PROGRAM(const std::string& objectFile, const std::string& symbolFile, const Parser& parser, const REGMAP& registers);
+int runCheckedMode(const int argc, const char* argv[]);
+
+#endif
@@ -0,0 +1,321 @@
+/*
+ *  @brief
+ *          Reads gzip and zstd compressed object and symbol files straight off disk
+ *
+ *  The format is picked from the first bytes of the file, not its name. Compressed files are pulled in large blocks
+ *  and inflated into a buffer of the same size that the stream hands to the decode loop, so only one block of
+ *  plaintext is ever held at a time. Seeking back inside that block is free, seeking back past it inflates the file
+ *  again from the start, which only a stream scanned ahead and then rewound ever asks for. zlib is linked in directly. libzstd ships without headers on some of our build
+ *  machines, so it is loaded at runtime the first time a zstd file shows up. A stream that stops inflating throws
+ *  CorruptInputError: a single run reports it and exits, batch modes and the daemon only give up on that file.
+ */
+
+#include "compressed_input.hpp"
+#include <zlib.h>
+#include <dlfcn.h>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+const constexpr std::size_t BLOCK_SIZE = 256 * 1024;
+const constexpr std::size_t MAGIC_SIZE = 4;
+const constexpr unsigned char GZIP_MAGIC[] = {0x1F, 0x8B};
+const constexpr unsigned char ZSTD_MAGIC[] = {0x28, 0xB5, 0x2F, 0xFD};
+const constexpr int ZLIB_AUTO_HEADER_WINDOW = 15 + 32;     // Largest window, accept either a gzip or zlib header
+const constexpr double BYTES_PER_MEGABYTE = 1024.0 * 1024.0;
+const constexpr double NANOS_PER_SECOND = 1e9;
+const constexpr char* ZSTD_LIBRARY_NAMES[] = {"libzstd.so.1", "libzstd.so"};
+const constexpr char* CORRUPT_INPUT_MESSAGE = "Corrupt compressed input: ";
+
+namespace
+{
+    std::mutex statsLock;
+    std::map<std::string, DecompressionStats> statsByFile;
+
+    const char* formatName(const Compression format)
+    {
+        return format == Compression::Gzip ? "gzip" : format == Compression::Zstd ? "zstd" : "none";
+    }
+
+    /* Everything but the actual inflate call, the formats only differ in which library turns input into output */
+    class DecompressingBuffer : public std::streambuf
+    {
+        public:
+            DecompressingBuffer(std::unique_ptr<std::filebuf> file, const std::string& name, const Compression format)
+                : name(name), input(BLOCK_SIZE), output(BLOCK_SIZE), file(std::move(file))
+            {
+                std::lock_guard<std::mutex> guard(statsLock);
+                DecompressionStats& stats = statsByFile.insert({name, DecompressionStats{format, 0, 0, 0, 0}}).first->second;
+                stats.opens++;
+            }
+            virtual ~DecompressingBuffer() {}
+        protected:
+            int_type underflow() override
+            {
+                if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+                blockStart += egptr() - eback();
+                setg(output.data(), output.data(), output.data());
+                const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                compressedRead = 0;
+                const std::size_t produced = decompress(output.data(), output.size());
+                record(produced, std::chrono::steady_clock::now() - start);
+                if (produced == 0) return traits_type::eof();
+                setg(output.data(), output.data(), output.data() + produced);
+                return traits_type::to_int_type(*gptr());
+            }
+
+            // Plaintext offsets, only the reading side of the stream has a position
+            pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which) override
+            {
+                if (direction == std::ios_base::cur) offset += blockStart + (gptr() - eback());
+                else if (direction != std::ios_base::beg) return pos_type(off_type(-1));
+                return seekpos(pos_type(offset), which);
+            }
+
+            pos_type seekpos(pos_type position, std::ios_base::openmode which) override
+            {
+                const off_type target = position;
+                if (!(which & std::ios_base::in) || target < 0) return pos_type(off_type(-1));
+                if (target < blockStart) {
+                    file->pubseekpos(0, std::ios_base::in);
+                    restart();
+                    blockStart = 0;
+                    setg(output.data(), output.data(), output.data());
+                }
+                while (target > blockStart + (egptr() - eback()))
+                {
+                    setg(eback(), egptr(), egptr());
+                    if (traits_type::eq_int_type(underflow(), traits_type::eof())) return pos_type(off_type(-1));
+                }
+                setg(eback(), eback() + (target - blockStart), egptr());
+                return position;
+            }
+
+            virtual std::size_t decompress(char* out, const std::size_t capacity) = 0;     // 0 once the input is used up
+            virtual void restart() = 0;         // Back to the state the constructor left, the file is already at its start
+
+            // Next compressed block into input, returns how many bytes came in
+            std::size_t refill()
+            {
+                const std::streamsize bytesRead = file->sgetn(input.data(), input.size());
+                compressedRead += bytesRead;
+                return bytesRead > 0 ? bytesRead : 0;
+            }
+
+            void fail(const std::string& reason) const
+            {
+                throw CorruptInputError(CORRUPT_INPUT_MESSAGE + name + " (" + reason + ")");
+            }
+
+            const std::string name;
+            std::vector<char> input;
+            std::vector<char> output;
+        private:
+            void record(const std::size_t produced, const std::chrono::steady_clock::duration elapsed)
+            {
+                std::lock_guard<std::mutex> guard(statsLock);
+                DecompressionStats& stats = statsByFile.find(name)->second;
+                stats.compressedBytes += compressedRead;
+                stats.uncompressedBytes += produced;
+                stats.nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+            }
+
+            std::unique_ptr<std::filebuf> file;
+            uint64_t compressedRead = 0;
+            off_type blockStart = 0;            // Plaintext offset of the block in output
+    };
+
+    class GzipBuffer : public DecompressingBuffer
+    {
+        public:
+            GzipBuffer(std::unique_ptr<std::filebuf> file, const std::string& name)
+                : DecompressingBuffer(std::move(file), name, Compression::Gzip)
+            {
+                std::memset(&stream, 0, sizeof(stream));
+                if (inflateInit2(&stream, ZLIB_AUTO_HEADER_WINDOW) != Z_OK) fail("zlib could not be initialised");
+            }
+            ~GzipBuffer() {inflateEnd(&stream);}
+        protected:
+            std::size_t decompress(char* out, const std::size_t capacity) override
+            {
+                stream.next_out = reinterpret_cast<Bytef*>(out);
+                stream.avail_out = capacity;
+                while (stream.avail_out > 0)
+                {
+                    if (stream.avail_in == 0) {
+                        stream.avail_in = refill();
+                        stream.next_in = reinterpret_cast<Bytef*>(input.data());
+                        if (stream.avail_in == 0) {
+                            if (!memberEnded) fail("truncated gzip stream");
+                            break;
+                        }
+                    }
+                    if (memberEnded) {                  // More bytes after a finished member means another member follows
+                        inflateReset(&stream);
+                        memberEnded = false;
+                    }
+                    const int status = inflate(&stream, Z_NO_FLUSH);
+                    if (status == Z_STREAM_END) memberEnded = true;
+                    else if (status != Z_OK && status != Z_BUF_ERROR) fail(stream.msg ? stream.msg : "inflate failed");
+                }
+                return capacity - stream.avail_out;
+            }
+
+            void restart() override
+            {
+                inflateReset(&stream);
+                stream.avail_in = 0;
+                memberEnded = false;
+            }
+        private:
+            z_stream stream;
+            bool memberEnded = false;
+    };
+
+    /* The few libzstd entry points streaming needs, ZSTD_inBuffer and ZSTD_outBuffer are part of its stable ABI */
+    struct ZstdInBuffer {const void* src; std::size_t size; std::size_t pos;};
+    struct ZstdOutBuffer {void* dst; std::size_t size; std::size_t pos;};
+    struct ZstdLibrary
+    {
+        void* (*createDStream)();
+        std::size_t (*freeDStream)(void*);
+        std::size_t (*initDStream)(void*);
+        std::size_t (*decompressStream)(void*, ZstdOutBuffer*, ZstdInBuffer*);
+        unsigned (*isError)(std::size_t);
+        const char* (*getErrorName)(std::size_t);
+    };
+
+    const ZstdLibrary& loadZstd()
+    {
+        static const ZstdLibrary library = []()
+        {
+            void* handle = nullptr;
+            for (const char* libraryName : ZSTD_LIBRARY_NAMES)
+                if ((handle = dlopen(libraryName, RTLD_NOW))) break;
+            if (!handle) {
+                std::cerr << "zstd input needs libzstd: " << dlerror() << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            return ZstdLibrary{
+                reinterpret_cast<void* (*)()>(dlsym(handle, "ZSTD_createDStream")),
+                reinterpret_cast<std::size_t (*)(void*)>(dlsym(handle, "ZSTD_freeDStream")),
+                reinterpret_cast<std::size_t (*)(void*)>(dlsym(handle, "ZSTD_initDStream")),
+                reinterpret_cast<std::size_t (*)(void*, ZstdOutBuffer*, ZstdInBuffer*)>(dlsym(handle, "ZSTD_decompressStream")),
+                reinterpret_cast<unsigned (*)(std::size_t)>(dlsym(handle, "ZSTD_isError")),
+                reinterpret_cast<const char* (*)(std::size_t)>(dlsym(handle, "ZSTD_getErrorName"))};
+        }();
+        return library;
+    }
+
+    class ZstdBuffer : public DecompressingBuffer
+    {
+        public:
+            ZstdBuffer(std::unique_ptr<std::filebuf> file, const std::string& name)
+                : DecompressingBuffer(std::move(file), name, Compression::Zstd), zstd(loadZstd()), stream(zstd.createDStream())
+            {
+                if (!stream || zstd.isError(zstd.initDStream(stream))) fail("zstd could not be initialised");
+            }
+            ~ZstdBuffer() {zstd.freeDStream(stream);}
+        protected:
+            std::size_t decompress(char* out, const std::size_t capacity) override
+            {
+                ZstdOutBuffer outBuffer{out, capacity, 0};
+                while (outBuffer.pos < outBuffer.size)
+                {
+                    if (inBuffer.pos == inBuffer.size) {
+                        inBuffer = ZstdInBuffer{input.data(), refill(), 0};
+                        if (inBuffer.size == 0) {
+                            if (frameRemaining) fail("truncated zstd frame");
+                            break;
+                        }
+                    }
+                    const std::size_t status = zstd.decompressStream(stream, &outBuffer, &inBuffer);
+                    if (zstd.isError(status)) fail(zstd.getErrorName(status));
+                    frameRemaining = status != 0;
+                }
+                return outBuffer.pos;
+            }
+
+            void restart() override
+            {
+                zstd.initDStream(stream);
+                inBuffer = ZstdInBuffer{nullptr, 0, 0};
+                frameRemaining = false;
+            }
+        private:
+            const ZstdLibrary& zstd;
+            void* stream;
+            ZstdInBuffer inBuffer{nullptr, 0, 0};
+            bool frameRemaining = false;
+    };
+
+    bool startsWith(const char* magic, const std::size_t magicSize, const unsigned char* expected, const std::size_t expectedSize)
+    {
+        return magicSize >= expectedSize && std::memcmp(magic, expected, expectedSize) == 0;
+    }
+}
+
+InputFile::InputFile(std::unique_ptr<std::streambuf> buffer)
+    : std::istream(buffer.get()), buffer(std::move(buffer))
+{
+    exceptions(std::ios::badbit);       // Only an exception from the buffer sets badbit, without this it reads as end of file
+}
+
+InputFile::InputFile(InputFile&& other)
+    : std::istream(std::move(other)), buffer(std::move(other.buffer))
+{
+    set_rdbuf(buffer.get());
+}
+
+void InputFile::close()
+{
+    exceptions(std::ios::goodbit);
+    rdbuf(nullptr);     // Also marks the stream bad so nothing reads from the freed buffer
+    buffer.reset();
+}
+
+/* Peek at the magic bytes and rewind, the caller still gets the file from its first byte */
+Compression DETECT_COMPRESSION(std::streambuf& file)
+{
+    char magic[MAGIC_SIZE];
+    const std::streamsize magicSize = file.sgetn(magic, MAGIC_SIZE);
+    file.pubseekpos(0, std::ios::in);
+    if (magicSize <= 0) return Compression::None;
+    if (startsWith(magic, magicSize, GZIP_MAGIC, sizeof(GZIP_MAGIC))) return Compression::Gzip;
+    if (startsWith(magic, magicSize, ZSTD_MAGIC, sizeof(ZSTD_MAGIC))) return Compression::Zstd;
+    return Compression::None;
+}
+
+/* Plain files are handed back as they are, so they pay nothing for the compressed path. Null if it cannot be opened */
+std::unique_ptr<std::streambuf> OPEN_INPUT_BUFFER(const char* filename)
+{
+    std::unique_ptr<std::filebuf> file(new std::filebuf());
+    if (!filename || !file->open(filename, std::ios::in | std::ios::binary)) return nullptr;
+    switch (DETECT_COMPRESSION(*file))
+    {
+        case Compression::Gzip:     return std::unique_ptr<std::streambuf>(new GzipBuffer(std::move(file), filename));
+        case Compression::Zstd:     return std::unique_ptr<std::streambuf>(new ZstdBuffer(std::move(file), filename));
+        default:                    return std::move(file);
+    }
+}
+
+/* One line per compressed file read during the run, nothing at all when every input was plain */
+void FileHandling::printDecompressionStats(std::ostream& stream)
+{
+    std::lock_guard<std::mutex> guard(statsLock);
+    for (const auto& entry : statsByFile)
+    {
+        const DecompressionStats& stats = entry.second;
+        const double seconds = stats.nanos / NANOS_PER_SECOND;
+        const double compressedRate = seconds > 0 ? stats.compressedBytes / BYTES_PER_MEGABYTE / seconds : 0;
+        const double uncompressedRate = seconds > 0 ? stats.uncompressedBytes / BYTES_PER_MEGABYTE / seconds : 0;
+        stream << "DECOMPRESS " << entry.first << " (" << formatName(stats.format) << ", " << stats.opens << " opens): "
+        << stats.compressedBytes << " -> " << stats.uncompressedBytes << " bytes, " << std::fixed << std::setprecision(1)
+        << compressedRate << " MB/s compressed, " << uncompressedRate << " MB/s uncompressed" << std::endl;
+    }
+}
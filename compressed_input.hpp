@@ -0,0 +1,57 @@
+#ifndef COMPRESSED_INPUT_H
+#define COMPRESSED_INPUT_H
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+
+enum class Compression
+{
+    None,
+    Gzip,
+    Zstd
+};
+
+/* Running totals for one compressed file, added up over every time it is opened */
+struct DecompressionStats
+{
+    Compression format;
+    uint64_t opens;
+    uint64_t compressedBytes;
+    uint64_t uncompressedBytes;
+    uint64_t nanos;
+};
+
+/* A compressed file that stops inflating part way or a binary object cut short, thrown so batch modes and the daemon can give up on that one file */
+class CorruptInputError : public std::runtime_error
+{
+    public:
+        explicit CorruptInputError(const std::string& message) : std::runtime_error(message) {}
+};
+
+/*
+ *  An input stream that owns its buffer, so a plain file and a decompressing one look the same to the decode loop.
+ *  A CorruptInputError from the buffer is let through instead of being turned into end of file.
+ */
+class InputFile : public std::istream
+{
+    public:
+        explicit InputFile(std::unique_ptr<std::streambuf> buffer);
+        InputFile(InputFile&& other);
+        void close();
+    private:
+        std::unique_ptr<std::streambuf> buffer;
+};
+
+Compression DETECT_COMPRESSION(std::streambuf& file);
+std::unique_ptr<std::streambuf> OPEN_INPUT_BUFFER(const char* filename);
+
+namespace FileHandling
+{
+    void printDecompressionStats(std::ostream& stream);
+}
+
+#endif
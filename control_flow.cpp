@@ -0,0 +1,234 @@
+/*
+ *  @brief
+ *          Recursive descent disassembly, only bytes reachable from the entry point are decoded as instructions
+ *
+ *  The linear sweep in disassembly.cpp decodes every byte that is not in LITTAB, which turns embedded tables and
+ *  padding into garbage instructions. Here we start at the address in the E record and follow J/JEQ/JGT/JLT/JSUB/RSUB
+ *  with a worklist, decoding each reachable instruction exactly once. Whatever is left over is emitted as BYTE data
+ *  in chunks, and branch targets without a label in SYMTAB get a synthesized one so the listing reads naturally.
+ */
+
+#include "control_flow.hpp"
+#include "byte_operations.hpp"
+#include "binary_object.hpp"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+const constexpr int INPUT_FILE_ARG_NUMBER = 1;
+const constexpr int INITIAL_BASE = 0;
+const constexpr int HEX_CHARS_PER_BYTE = 2;
+const constexpr int MAX_INSTRUCTION_HEX_CHARS = 8;
+const constexpr int WORD_BYTES = 3;
+const constexpr int LABEL_ADDRESS_DIGITS = 4;
+const constexpr int SYMBOL_ADDRESS_DIGITS = 6;
+const constexpr char* SYNTHESIZED_LABEL_PREFIX = "L";
+const constexpr char* SYNTHESIZED_LABEL_FLAGS = "S";
+const constexpr char* LDB_INSTRUCTION = "LDB";
+const constexpr char* OUTPUT_FILE_NAME = "out.lst";
+
+namespace
+{
+    const std::map<std::string, FlowKind> FLOW_KINDS
+    {
+        {"J", FlowKind::Jump},
+        {"JEQ", FlowKind::ConditionalJump},
+        {"JGT", FlowKind::ConditionalJump},
+        {"JLT", FlowKind::ConditionalJump},
+        {"JSUB", FlowKind::Call},
+        {"RSUB", FlowKind::Return}
+    };
+
+    FlowKind GET_FLOW_KIND(const std::string& opCode)
+    {
+        if (opCode.empty()) return FlowKind::Stop;  // Opcode not in InstructionBindings
+        auto it = FLOW_KINDS.find(opCode);
+        return it == FLOW_KINDS.end() ? FlowKind::FallThrough : it->second;
+    }
+
+    bool HAS_TARGET(const FlowKind kind)
+    {
+        return kind == FlowKind::Jump || kind == FlowKind::ConditionalJump || kind == FlowKind::Call;
+    }
+
+    bool HAS_NEXT(const FlowKind kind)
+    {
+        return kind == FlowKind::FallThrough || kind == FlowKind::ConditionalJump || kind == FlowKind::Call;
+    }
+
+    const std::string zeroPad(const std::string& hex, const int digits)
+    {
+        return hex.size() >= static_cast<std::size_t>(digits) ? hex : std::string(digits - hex.size(), '0') + hex;
+    }
+
+    // Work item, the BASE register value travels along each path so base relative targets can be computed
+    struct FlowEdge
+    {
+        const int32_t address;
+        const int BASE;
+    };
+}
+
+/* Lay every text record out by address */
+MemoryImage LOAD_MEMORY_IMAGE(std::istream& inputFile)
+{
+    MemoryImage image;
+    int32_t imageEnd = 0;
+    for (TextRecord record = FileHandling::readTextRecord(inputFile); record.sectionFound; record = FileHandling::readTextRecord(inputFile))
+    {
+        imageEnd = std::max<int32_t>(imageEnd, record.LOCCTR_START + record.objectCode.size() / HEX_CHARS_PER_BYTE);
+        image.records.push_back(record);
+    }
+    image.hex = std::string(imageEnd * HEX_CHARS_PER_BYTE + MAX_INSTRUCTION_HEX_CHARS, '0'); // Padding lets us read past the end safely
+    image.loaded = std::vector<bool>(imageEnd, false);
+    for (const TextRecord& record : image.records)
+    {
+        image.hex.replace(record.LOCCTR_START * HEX_CHARS_PER_BYTE, record.objectCode.size(), record.objectCode);
+        for (std::size_t i = 0; i < record.objectCode.size() / HEX_CHARS_PER_BYTE; i++)
+            image.loaded[record.LOCCTR_START + i] = true;
+    }
+    return image;
+}
+
+bool isLoaded(const MemoryImage& image, const int32_t address, const int32_t length)
+{
+    for (int32_t i = address; i < address + length; i++)
+        if (i < 0 || i >= static_cast<int32_t>(image.loaded.size()) || !image.loaded[i]) return false;
+    return true;
+}
+
+/* Worklist traversal starting from the entry point */
+ControlFlowResult TRACE_CONTROL_FLOW(const MemoryImage& image, const int32_t entryPoint, const LITMAP& litmap, const Parser& parser)
+{
+    ControlFlowResult result;
+    std::vector<FlowEdge> worklist{FlowEdge{entryPoint, INITIAL_BASE}};
+    while (!worklist.empty())
+    {
+        const FlowEdge edge = worklist.back();
+        worklist.pop_back();
+        if (result.instructions.count(edge.address) || checkForSymbol(edge.address, litmap) || !isLoaded(image, edge.address, 1)) continue;
+
+        std::istringstream stream(image.hex.substr(edge.address * HEX_CHARS_PER_BYTE, MAX_INSTRUCTION_HEX_CHARS));
+        const ParsingResult parsed = parseInstruction(stream, parser);
+        const FlowKind kind = GET_FLOW_KIND(parsed.instruction.opCode);
+        if (kind == FlowKind::Stop || !isLoaded(image, edge.address, parsed.bytesReadIn)) continue;
+        result.instructions.insert({edge.address, parsed});
+
+        const int32_t next = edge.address + parsed.bytesReadIn;
+        const int BASE = parsed.instruction.opCode == LDB_INSTRUCTION ? hexStringToInt(parsed.instruction.objectCode.substr(3)) : edge.BASE;
+        if (HAS_NEXT(kind)) worklist.push_back(FlowEdge{next, BASE});
+        if (HAS_TARGET(kind) && parsed.instruction.addresingMode != AddressingMode::Indirect && parsed.instruction.format != AddressingFormat::Format2)
+        {   // Indirect jumps go through memory so their target is not known until run time
+            const int32_t target = CALCULATE_TARGET_ADDRESS(parsed.instruction.targetAddressMode, parsed.instruction.objectCode, OffsetInfo{BASE, next});
+            result.branchTargets.insert(target);
+            worklist.push_back(FlowEdge{target, BASE});
+        }
+    }
+    return result;
+}
+
+/* Give every unlabeled branch target a label of the form L<address> */
+SYMMAP SYNTHESIZE_LABELS(const SYMMAP& symmap, const LITMAP& litmap, const std::set<int32_t>& branchTargets)
+{
+    SYMMAP labeled = symmap;
+    for (const int32_t target : branchTargets)
+    {
+        if (checkForSymbol(target, symmap) || checkForSymbol(target, litmap)) continue;
+        const std::string address = intToHexString(target);
+        labeled.insert({target, SYMTAB_Entry{SYNTHESIZED_LABEL_PREFIX + zeroPad(address, LABEL_ADDRESS_DIGITS), zeroPad(address, SYMBOL_ADDRESS_DIGITS), SYNTHESIZED_LABEL_FLAGS}});
+    }
+    return labeled;
+}
+
+/* A label, literal or reachable instruction ends whatever data run came before it */
+bool STARTS_UNIT(const int32_t address, const ControlFlowResult& flow, const DisassemblerContext& context)
+{
+    return flow.instructions.count(address) || context.symbols.hasLiteral(address) || context.symbols.hasSymbol(address);
+}
+
+int32_t FIND_UNIT_END(const int32_t LOCCTR, const int32_t end, const ControlFlowResult& flow, const DisassemblerContext& context)
+{
+    int32_t unitEnd = LOCCTR + 1;
+    while (unitEnd < end && !STARTS_UNIT(unitEnd, flow, context)) unitEnd++;
+    return unitEnd;
+}
+
+/* One directive per word, or BYTE constants no wider than the listing's operand column */
+int32_t EMIT_DATA_BYTES(const MemoryImage& image, const int32_t LOCCTR, const int32_t end, const DataDirective directive, DisassemblerContext& context, EmissionCounts& counts)
+{
+    const int32_t chunkBytes = directive == DataDirective::Word ? WORD_BYTES : BYTE_CONSTANT_MAX_BYTES;
+    for (int32_t chunk = LOCCTR; chunk < end; chunk += chunkBytes)
+    {
+        const int32_t bytes = std::min(chunkBytes, end - chunk);
+        context.sink.data(chunk, image.hex.substr(chunk * HEX_CHARS_PER_BYTE, bytes * HEX_CHARS_PER_BYTE), directive);
+        counts.dataLines++;
+    }
+    counts.dataBytes += end - LOCCTR;
+    return end;
+}
+
+/* Literals and reachable instructions are written the same way by every traced mode, the rest is up to the caller */
+int32_t EMIT_TRACED_RECORD(const TextRecord& record, const ControlFlowResult& flow, DisassemblerContext& context, EmissionCounts& counts, const UnreachedEmitter& unreached)
+{
+    int32_t LOCCTR = record.LOCCTR_START;
+    const int32_t end = record.LOCCTR_START + record.objectCode.size() / HEX_CHARS_PER_BYTE;
+    while (LOCCTR < end)
+    {
+        auto instruction = flow.instructions.find(LOCCTR);
+        if (context.symbols.hasLiteral(LOCCTR)) {
+            const LITTAB_Entry entry = context.symbols.getLiteral(LOCCTR);
+            outputSymbol(context, LOCCTR, entry);
+            LOCCTR += getLiteralBytes(entry);
+        }
+        else if (instruction != flow.instructions.end()) {
+            const ParsingResult& parsed = instruction->second;
+            const DisassemblerState state{context.baseAddress, LOCCTR, parsed.instruction, context.registers, context.symbols};
+            context.sink.instruction(state, parsed.bytesReadIn);
+            FileHandling::handleBaseDirective(parsed.instruction.opCode, parsed.instruction.objectCode, context);
+            LOCCTR += parsed.bytesReadIn;
+            counts.instructions++;
+        }
+        else {
+            LOCCTR = unreached(LOCCTR, end);
+        }
+    }
+    return LOCCTR;
+}
+
+// Expects argv[1] to be the object file and argv[2] the symbol file, exactly like the default mode
+int runControlFlowMode(const int argc, const char* argv[])
+{
+    InputFile inputFile                     = FileHandling::openFile(argv[INPUT_FILE_ARG_NUMBER]);
+    REFUSE_BINARY_OBJECT(inputFile, argv[INPUT_FILE_ARG_NUMBER], "--flow");
+    std::ofstream outputFile                (OUTPUT_FILE_NAME);
+    const SymbolEntries symbolEntries       = printHeader(argv, outputFile);
+    const LITMAP litmap                     = CREATE_LITMAP(symbolEntries);
+    const SYMMAP symmap                     = CREATE_SYMMAP(symbolEntries);
+    const REGMAP registers                  = REGISTERS();
+    const Parser parser;
+
+    const MemoryImage image                 = LOAD_MEMORY_IMAGE(inputFile);
+    const ControlFlowResult flow            = TRACE_CONTROL_FLOW(image, FileHandling::getEntryPoint(argv[INPUT_FILE_ARG_NUMBER]), litmap, parser);
+    const SYMMAP labeled                    = SYNTHESIZE_LABELS(symmap, litmap, flow.branchTargets);
+
+    const MapSymbolProvider symbols         (labeled, litmap);
+    ListingSink listing                     (outputFile, symbols);
+    DisassemblerContext                     context{inputFile, outputFile, listing, registers, symbols, parser, INITIAL_BASE, false};
+    EmissionCounts counts{0, 0, 0};
+    int32_t lastTextSectionEnd = 0;
+    for (const TextRecord& record : image.records)
+    {
+        fillGap(record.LOCCTR_START - lastTextSectionEnd, lastTextSectionEnd, symbols, context);
+        lastTextSectionEnd = EMIT_TRACED_RECORD(record, flow, context, counts, [&](const int32_t LOCCTR, const int32_t end)
+        {   // Bytes nobody reaches are printed as BYTE constants, split wherever a label starts
+            return EMIT_DATA_BYTES(image, LOCCTR, FIND_UNIT_END(LOCCTR, end, flow, context), DataDirective::Byte, context, counts);
+        });
+    }
+    fillGap(GET_LAST_SYMBOL_ADDRESS(symbolEntries), lastTextSectionEnd, symbols, context);
+
+    FileHandling::printEnd(outputFile, FileHandling::getProgramName(argv[INPUT_FILE_ARG_NUMBER]));
+    std::cerr << "reachable instructions: " << counts.instructions
+    << ", data bytes: " << counts.dataBytes << " in " << counts.dataLines << " lines"
+    << ", synthesized labels: " << labeled.size() - symmap.size() << std::endl;
+    return FileHandling::close(inputFile, outputFile);
+}
@@ -0,0 +1,61 @@
+#ifndef CONTROL_FLOW_H
+#define CONTROL_FLOW_H
+
+#include "disassembly.hpp"
+#include "sinks.hpp"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+struct DisassemblerContext;
+
+/* Every text record laid out by address, hex characters kept so the usual parser can decode anywhere in it */
+struct MemoryImage
+{
+    std::vector<TextRecord> records;
+    std::string hex;                // Two characters per byte, address * 2 is the offset of a byte
+    std::vector<bool> loaded;       // Whether a text record actually covered this address
+};
+
+/* Result of following control flow from the entry point */
+struct ControlFlowResult
+{
+    std::map<int32_t, ParsingResult> instructions;  // Keyed by address, each reachable instruction decoded once
+    std::set<int32_t> branchTargets;
+};
+
+enum class FlowKind
+{
+    FallThrough,        // Ordinary instruction, continue with the next one
+    Jump,               // J, only the target is reachable
+    ConditionalJump,    // JEQ JGT JLT, target and next instruction
+    Call,               // JSUB, assume the subroutine returns
+    Return,             // RSUB, nothing follows
+    Stop                // Could not decode, stop this path
+};
+
+/* Running totals of what a traced listing wrote */
+struct EmissionCounts
+{
+    uint64_t instructions;
+    uint64_t dataBytes;
+    uint64_t dataLines;
+};
+
+/* Called for an address the trace never reached, writes from LOCCTR up to at most end and returns where it stopped */
+using UnreachedEmitter = std::function<int32_t(const int32_t LOCCTR, const int32_t end)>;
+
+MemoryImage LOAD_MEMORY_IMAGE(std::istream& inputFile);
+bool isLoaded(const MemoryImage& image, const int32_t address, const int32_t length);
+ControlFlowResult TRACE_CONTROL_FLOW(const MemoryImage& image, const int32_t entryPoint, const LITMAP& litmap, const Parser& parser);
+SYMMAP SYNTHESIZE_LABELS(const SYMMAP& symmap, const LITMAP& litmap, const std::set<int32_t>& branchTargets);
+bool STARTS_UNIT(const int32_t address, const ControlFlowResult& flow, const DisassemblerContext& context);
+int32_t FIND_UNIT_END(const int32_t LOCCTR, const int32_t end, const ControlFlowResult& flow, const DisassemblerContext& context);
+int32_t EMIT_DATA_BYTES(const MemoryImage& image, const int32_t LOCCTR, const int32_t end, const DataDirective directive, DisassemblerContext& context, EmissionCounts& counts);
+int32_t EMIT_TRACED_RECORD(const TextRecord& record, const ControlFlowResult& flow, DisassemblerContext& context, EmissionCounts& counts, const UnreachedEmitter& unreached);
+int runControlFlowMode(const int argc, const char* argv[]);
+
+#endif
@@ -0,0 +1,227 @@
+/*
+ *  @brief
+ *          Handles object files that hold several control sections, each with its own H...E records
+ *
+ *  Every section gets its own listing block (START for the first, CSECT after that) with its EXTDEF and EXTREF
+ *  names, and its own symbol scope taken from the matching SYMTAB/LITTAB pair of the symbol file. Sections share
+ *  no BASE or LOCCTR state, so a small pool of threads disassembles them at the same time into separate buffers
+ *  which are then written out in file order.
+ */
+
+#include "control_sections.hpp"
+#include "byte_operations.hpp"
+#include "trace.hpp"
+#include "binary_object.hpp"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <thread>
+
+const constexpr int INPUT_FILE_ARG_NUMBER = 1;
+const constexpr int SYMBOL_FILE_ARG_NUMBER = 2;
+const constexpr int INITIAL_BASE = 0;
+const constexpr int NAME_FIELD_SIZE = 6;
+const constexpr int ADDRESS_FIELD_SIZE = 6;
+const constexpr unsigned int MIN_WORKERS = 1;
+const constexpr char HEADER_RECORD_IDENTIFIER = 'H';
+const constexpr char DEFINE_RECORD_IDENTIFIER = 'D';
+const constexpr char REFER_RECORD_IDENTIFIER = 'R';
+const constexpr char* EXTDEF_DIRECTIVE = "EXTDEF";
+const constexpr char* EXTREF_DIRECTIVE = "EXTREF";
+const constexpr char* EXTDEF_FLAGS = "R";
+const constexpr char* OUTPUT_FILE_NAME = "out.lst";
+
+namespace
+{
+    const std::string trim(const std::string& field)
+    {
+        const std::size_t first = field.find_first_not_of(' ');
+        if (first == std::string::npos) return std::string();
+        return field.substr(first, field.find_last_not_of(' ') - first + 1);
+    }
+
+    // Fixed width fields, the last one on a line may have lost its padding
+    const std::string readField(const std::string& line, const std::size_t position, const std::size_t size)
+    {
+        if (position >= line.size()) return std::string();
+        return trim(line.substr(position, size));
+    }
+
+    void READ_DEFINE_RECORD(const std::string& line, ControlSection& section)
+    {
+        for (std::size_t i = 1; i < line.size(); i += NAME_FIELD_SIZE + ADDRESS_FIELD_SIZE)
+        {
+            const std::string name = readField(line, i, NAME_FIELD_SIZE);
+            if (!name.empty()) section.extdefs.push_back({name, readField(line, i + NAME_FIELD_SIZE, ADDRESS_FIELD_SIZE)});
+        }
+    }
+
+    void READ_REFER_RECORD(const std::string& line, ControlSection& section)
+    {
+        for (std::size_t i = 1; i < line.size(); i += NAME_FIELD_SIZE)
+        {
+            const std::string name = readField(line, i, NAME_FIELD_SIZE);
+            if (!name.empty()) section.extrefs.push_back(name);
+        }
+    }
+
+    // Names exported through D records belong to the section even if the symbol file left them out
+    const SymbolEntries SECTION_SCOPE(const ControlSection& section, const SymbolEntries& symbolEntries)
+    {
+        std::vector<SYMTAB_Entry> symtab = symbolEntries.SYMTAB;
+        for (const auto& extdef : section.extdefs)
+        {
+            const bool listed = std::any_of(symtab.begin(), symtab.end(), [&extdef](const SYMTAB_Entry& entry) {return entry.symbol == extdef.first;});
+            if (!listed) symtab.push_back(SYMTAB_Entry{extdef.first, extdef.second, EXTDEF_FLAGS});
+        }
+        std::vector<const SYMTAB_Entry*> ordered;    // Entries are immutable, so order pointers and copy them out
+        for (const SYMTAB_Entry& entry : symtab) ordered.push_back(&entry);
+        std::stable_sort(ordered.begin(), ordered.end(), [](const SYMTAB_Entry* a, const SYMTAB_Entry* b) {return hexStringToInt(a->address) < hexStringToInt(b->address);});
+        std::vector<SYMTAB_Entry> sorted;
+        for (const SYMTAB_Entry* entry : ordered) sorted.push_back(*entry);
+        return SymbolEntries{sorted, symbolEntries.LITTAB};
+    }
+
+    // One SYMTAB/LITTAB pair shared by every section keeps older single table symbol files working
+    const SymbolEntries SCOPE_FOR(const std::vector<SymbolEntries>& blocks, const std::size_t sectionIndex)
+    {
+        if (blocks.size() == 1) return blocks.front();
+        if (sectionIndex < blocks.size()) return blocks[sectionIndex];
+        return SymbolEntries{std::vector<SYMTAB_Entry>(), std::vector<LITTAB_Entry>()};
+    }
+
+    /* Any D/R record or a header past the first means sections, headers counts the ones already read */
+    bool SECTION_RECORDS_FOLLOW(std::istream& inputFile, int headers)
+    {
+        std::string line;
+        while (std::getline(inputFile, line))
+        {
+            if (line.empty()) continue;
+            if (line[0] == HEADER_RECORD_IDENTIFIER) headers++;
+            if (line[0] == DEFINE_RECORD_IDENTIFIER || line[0] == REFER_RECORD_IDENTIFIER || headers > 1) return true;
+        }
+        return false;
+    }
+}
+
+/* Split the object file on its H records */
+std::vector<ControlSection> READ_CONTROL_SECTIONS(std::istream& inputFile)
+{
+    std::vector<ControlSection> sections;
+    std::string line;
+    while (std::getline(inputFile, line))
+    {
+        if (line.empty()) continue;
+        if (line[0] == HEADER_RECORD_IDENTIFIER) {
+            sections.push_back(ControlSection{readField(line, 1, NAME_FIELD_SIZE), readField(line, 1 + NAME_FIELD_SIZE, ADDRESS_FIELD_SIZE), {}, {}, std::string()});
+            continue;
+        }
+        if (sections.empty()) continue;     // Nothing before the first header belongs to a section
+        if (line[0] == DEFINE_RECORD_IDENTIFIER) READ_DEFINE_RECORD(line, sections.back());
+        else if (line[0] == REFER_RECORD_IDENTIFIER) READ_REFER_RECORD(line, sections.back());
+        else sections.back().records += line + "\n";
+    }
+    return sections;
+}
+
+/* Cheap scan so main only takes the section path when the file needs it */
+bool HAS_CONTROL_SECTIONS(const char* objectFile)
+{
+    InputFile inputFile = FileHandling::openFile(objectFile);
+    return HAS_CONTROL_SECTIONS(inputFile);
+}
+
+/*
+ *  The streaming form for callers that list the program from the stream they read its name from. Sections can be
+ *  told by D/R records or by nothing more than a second header further down, so every record after the header is
+ *  scanned and the stream is then put back. It has to be inside the header record, where getProgramName leaves it,
+ *  and is left in front of the next record.
+ */
+bool LEADS_INTO_CONTROL_SECTIONS(std::istream& inputFile)
+{
+    inputFile.ignore(std::numeric_limits<std::streamsize>::max(), '\n');     // Rest of the header record
+    const std::istream::pos_type records = inputFile.tellg();
+    if (records == std::istream::pos_type(-1)) return false;    // Nothing after the header
+    const bool sections = SECTION_RECORDS_FOLLOW(inputFile, 1);
+    inputFile.clear();
+    inputFile.seekg(records);
+    return sections;
+}
+
+bool HAS_CONTROL_SECTIONS(std::istream& inputFile)
+{
+    return SECTION_RECORDS_FOLLOW(inputFile, 0);
+}
+
+/* The symbols a section sees, its own SYMTAB/LITTAB pair plus whatever it exports */
+const SymbolEntries SECTION_SYMBOLS(const ControlSection& section, const std::vector<SymbolEntries>& blocks, const std::size_t sectionIndex)
+{
+    return SECTION_SCOPE(section, SCOPE_FOR(blocks, sectionIndex));
+}
+
+/* Render one section's listing block, safe to call from several threads since only the const parser is shared */
+const std::string DISASSEMBLE_CONTROL_SECTION(const ControlSection& section, const SymbolEntries& symbolEntries, const bool firstSection, const Parser& parser)
+{
+    std::istringstream inputFile(section.records);
+    std::ostringstream outputFile;
+    const SymbolEntries scope               = SECTION_SCOPE(section, symbolEntries);
+    const LITMAP litmap                     = CREATE_LITMAP(scope);
+    const SYMMAP symmap                     = CREATE_SYMMAP(scope);
+    const REGMAP registers                  = REGISTERS();
+    const MapSymbolProvider symbols         (symmap, litmap);
+
+    if (firstSection) FileHandling::print_column_names(outputFile, section.name, section.startAddress);
+    else FileHandling::printCsect(outputFile, section.name, section.startAddress);
+    std::vector<std::string> extdefNames;
+    for (const auto& extdef : section.extdefs) extdefNames.push_back(extdef.first);
+    FileHandling::printExternalDirective(outputFile, EXTDEF_DIRECTIVE, extdefNames);
+    FileHandling::printExternalDirective(outputFile, EXTREF_DIRECTIVE, section.extrefs);
+
+    ListingSink listing                     (outputFile, symbols);
+    DisassemblerContext                     context{inputFile, outputFile, listing, registers, symbols, parser, INITIAL_BASE, false};
+    disassembleTextSections(context, GET_LAST_SYMBOL_ADDRESS(scope));
+    return outputFile.str();
+}
+
+/* Every section of one object file, rendered in parallel and merged in file order under a single END */
+void DISASSEMBLE_CONTROL_SECTIONS(std::istream& inputFile, const std::vector<SymbolEntries>& blocks, std::ostream& outputFile)
+{
+    const Parser parser;
+    DISASSEMBLE_CONTROL_SECTIONS(inputFile, blocks, outputFile, parser);
+}
+
+/* Same for callers that already hold a parser */
+void DISASSEMBLE_CONTROL_SECTIONS(std::istream& inputFile, const std::vector<SymbolEntries>& blocks, std::ostream& outputFile, const Parser& parser)
+{
+    const std::vector<ControlSection> sections  = READ_CONTROL_SECTIONS(inputFile);
+    std::vector<std::string> listings(sections.size());
+    std::atomic<std::size_t> nextSection(0);
+    auto worker = [&]()
+    {
+        NAME_TRACE_THREAD("section worker");
+        for (std::size_t i = nextSection++; i < sections.size(); i = nextSection++)
+        {
+            TraceSpan span("disassembleSection", i);
+            listings[i] = DISASSEMBLE_CONTROL_SECTION(sections[i], SCOPE_FOR(blocks, i), i == 0, parser);
+        }
+    };
+    const unsigned int workerCount = std::max(MIN_WORKERS, std::min<unsigned int>(std::thread::hardware_concurrency(), sections.size()));
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < workerCount; i++) workers.push_back(std::thread(worker));
+    for (std::thread& thread : workers) thread.join();
+
+    for (const std::string& listing : listings) outputFile << listing;     // Merge in file order
+    if (!sections.empty()) FileHandling::printEnd(outputFile, sections.front().name);
+}
+
+// Expects argv[1] to be the object file and argv[2] the symbol file, exactly like the default mode
+int runControlSectionsMode(const int argc, const char* argv[])
+{
+    InputFile inputFile                     = FileHandling::openFile(argv[INPUT_FILE_ARG_NUMBER]);
+    REFUSE_BINARY_OBJECT(inputFile, argv[INPUT_FILE_ARG_NUMBER], "--sections");
+    std::ofstream outputFile                (OUTPUT_FILE_NAME);
+    DISASSEMBLE_CONTROL_SECTIONS(inputFile, FileHandling::readSymbolTableBlocks(argv[SYMBOL_FILE_ARG_NUMBER]), outputFile);
+    return FileHandling::close(inputFile, outputFile);
+}
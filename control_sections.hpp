@@ -0,0 +1,29 @@
+#ifndef CONTROL_SECTIONS_H
+#define CONTROL_SECTIONS_H
+
+#include "disassembly.hpp"
+#include <string>
+#include <utility>
+#include <vector>
+
+/* One H...E block of an object file */
+struct ControlSection
+{
+    std::string name;
+    std::string startAddress;                                       // Hex digits as written in the H record
+    std::vector<std::pair<std::string, std::string>> extdefs;       // Name and address from D records
+    std::vector<std::string> extrefs;                               // Names from R records
+    std::string records;                                            // Remaining T, M and E lines of the section
+};
+
+std::vector<ControlSection> READ_CONTROL_SECTIONS(std::istream& inputFile);
+bool HAS_CONTROL_SECTIONS(const char* objectFile);
+bool HAS_CONTROL_SECTIONS(std::istream& inputFile);
+bool LEADS_INTO_CONTROL_SECTIONS(std::istream& inputFile);
+const SymbolEntries SECTION_SYMBOLS(const ControlSection& section, const std::vector<SymbolEntries>& blocks, const std::size_t sectionIndex);
+const std::string DISASSEMBLE_CONTROL_SECTION(const ControlSection& section, const SymbolEntries& symbolEntries, const bool firstSection, const Parser& parser);
+void DISASSEMBLE_CONTROL_SECTIONS(std::istream& inputFile, const std::vector<SymbolEntries>& blocks, std::ostream& outputFile);
+void DISASSEMBLE_CONTROL_SECTIONS(std::istream& inputFile, const std::vector<SymbolEntries>& blocks, std::ostream& outputFile, const Parser& parser);
+int runControlSectionsMode(const int argc, const char* argv[]);
+
+#endif
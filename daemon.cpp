@@ -0,0 +1,453 @@
+/*
+ *  @brief
+ *          Long running daemon that keeps instruction tables and symbol tables warm, plus the thin client for it
+ *
+ *  A CI farm starting the disassembler tens of thousands of times a day pays for process startup, building
+ *  InstructionBindings and parsing the symbol file on every run. The daemon listens on a Unix domain socket and
+ *  hands each connection to a pool of workers. The workers share one Parser built at startup, its lookups only read
+ *  the bindings, and parsed symbol files are shared between them keyed by a hash of their contents, a hit still
+ *  compares the contents. Text and binary objects are both served. A request that fails, whether the client stops
+ *  sending, an input is corrupt or a file does not parse, gets its error back without taking down the daemon.
+ *  The client takes the same object and symbol arguments as a normal run and writes the same out.lst.
+ */
+
+#include "daemon.hpp"
+#include "binary_object.hpp"
+#include "bundle.hpp"
+#include "control_sections.hpp"
+#include "symbol_cache.hpp"
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+const constexpr int SOCKET_ARG_NUMBER = 1;
+const constexpr int WORKERS_ARG_NUMBER = 2;
+const constexpr int CLIENT_FIRST_FILE_ARG_NUMBER = 2;
+const constexpr int LISTEN_BACKLOG = 128;
+const constexpr unsigned int MIN_WORKERS = 1;
+const constexpr std::size_t MAX_BLOB_SIZE = 256 << 20;
+const constexpr std::size_t MAX_LENGTH_DIGITS = 20;
+const constexpr std::size_t SYMBOL_CACHE_CAPACITY = 256;
+const constexpr std::size_t READ_BLOCK_SIZE = 64 * 1024;
+const constexpr std::chrono::seconds REQUEST_READ_TIMEOUT(30);     // A client that stops sending only holds its worker this long
+const constexpr std::size_t LATENCY_SAMPLES = 65536;   // Percentiles are over the most recent requests
+const constexpr double NANOS_PER_MICRO = 1000.0;
+const constexpr int INITIAL_BASE = 0;
+const constexpr char* INLINE_FLAG = "--inline";
+const constexpr char* STATS_FLAG = "--stats";
+const constexpr char* OUTPUT_FILE_NAME = "out.lst";
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point NO_DEADLINE = Clock::time_point::max();
+
+    bool writeAll(const int fd, const char* data, std::size_t size)
+    {
+        while (size > 0)
+        {
+            const ssize_t written = write(fd, data, size);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return false;
+            data += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    // Waits for input no later than the deadline, the client waits on the daemon for as long as a listing takes
+    bool waitReadable(const int fd, const Clock::time_point deadline)
+    {
+        if (deadline == NO_DEADLINE) return true;
+        while (true)
+        {
+            const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            if (remaining <= 0) return false;
+            pollfd request{fd, POLLIN, 0};
+            const int ready = poll(&request, 1, static_cast<int>(std::min<long long>(remaining, INT_MAX)));
+            if (ready < 0 && errno == EINTR) continue;
+            return ready > 0;
+        }
+    }
+
+    bool readExact(const int fd, char* data, std::size_t size, const Clock::time_point deadline)
+    {
+        while (size > 0)
+        {
+            if (!waitReadable(fd, deadline)) return false;
+            const ssize_t bytesRead = read(fd, data, size);
+            if (bytesRead < 0 && errno == EINTR) continue;
+            if (bytesRead <= 0) return false;
+            data += bytesRead;
+            size -= bytesRead;
+        }
+        return true;
+    }
+
+    bool writeBlob(const int fd, const std::string& blob)
+    {
+        const std::string length = std::to_string(blob.size()) + "\n";
+        return writeAll(fd, length.data(), length.size()) && writeAll(fd, blob.data(), blob.size());
+    }
+
+    bool readBlob(const int fd, std::string& blob, const Clock::time_point deadline)
+    {
+        std::string length;
+        char digit = 0;
+        while (readExact(fd, &digit, 1, deadline) && digit != '\n')
+        {
+            if (!std::isdigit(static_cast<unsigned char>(digit)) || length.size() == MAX_LENGTH_DIGITS) return false;
+            length += digit;
+        }
+        if (digit != '\n' || length.empty()) return false;
+        const unsigned long long size = std::stoull(length);
+        if (size > MAX_BLOB_SIZE) return false;
+        blob.resize(size);
+        return readExact(fd, &blob[0], size, deadline);
+    }
+
+    /* Parsed symbol files keyed by content hash, the oldest entry goes once the cache is full */
+    class SymbolCache
+    {
+        public:
+            std::shared_ptr<const CachedSymbols> get(const std::string& contents, DaemonStats& stats)
+            {
+                const uint64_t hash = FNV_HASH(contents.data(), contents.size());
+                bool collided = false;
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    auto it = entries.find(hash);
+                    if (it != entries.end() && it->second.contents == contents) {
+                        stats.symbolCacheHits++;
+                        return it->second.symbols;
+                    }
+                    collided = it != entries.end();     // Another file with the same hash keeps its entry, this one is parsed every time
+                    stats.symbolCacheMisses++;
+                }
+                MemoryBuffer buffer(contents.data(), contents.size());      // Parse outside the lock
+                std::istream symbolFile(&buffer);
+                const std::vector<SymbolEntries> blocks = FileHandling::readSymbolTableBlocks(symbolFile);
+                if (blocks.empty() || blocks.front().SYMTAB.empty()) return nullptr;
+                std::shared_ptr<const CachedSymbols> parsed(new CachedSymbols(blocks));
+                if (collided) return parsed;
+
+                std::lock_guard<std::mutex> guard(lock);
+                if (entries.insert({hash, Entry{contents, parsed}}).second) order.push_back(hash);
+                if (order.size() > SYMBOL_CACHE_CAPACITY) {
+                    entries.erase(order.front());
+                    order.pop_front();
+                }
+                return parsed;
+            }
+        private:
+            struct Entry
+            {
+                std::string contents;
+                std::shared_ptr<const CachedSymbols> symbols;
+            };
+
+            std::mutex lock;
+            std::map<uint64_t, Entry> entries;
+            std::deque<uint64_t> order;
+    };
+
+    /* Keeps the most recent request latencies in a ring and reports percentiles over them */
+    class LatencyRecorder
+    {
+        public:
+            void record(const uint64_t nanos)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (samples.size() < LATENCY_SAMPLES) samples.push_back(nanos);
+                else samples[next] = nanos;
+                next = (next + 1) % LATENCY_SAMPLES;
+            }
+
+            const std::string summary()
+            {
+                std::vector<uint64_t> sorted;
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    sorted = samples;
+                }
+                std::sort(sorted.begin(), sorted.end());
+                std::ostringstream stream;
+                stream << std::fixed << std::setprecision(1) << "latency us over last " << sorted.size() << ":";
+                for (const double percentile : {0.50, 0.90, 0.99})
+                    stream << " p" << std::lround(percentile * 100) << " " << at(sorted, percentile) / NANOS_PER_MICRO;
+                stream << " max " << (sorted.empty() ? 0 : sorted.back() / NANOS_PER_MICRO);
+                return stream.str();
+            }
+        private:
+            static uint64_t at(const std::vector<uint64_t>& sorted, const double percentile)
+            {
+                return sorted.empty() ? 0 : sorted[static_cast<std::size_t>(percentile * (sorted.size() - 1))];
+            }
+
+            std::mutex lock;
+            std::vector<uint64_t> samples;
+            std::size_t next = 0;
+    };
+
+    struct Server
+    {
+        std::mutex lock;                    // Guards the connection queue and stats
+        std::condition_variable ready;
+        std::deque<int> connections;
+        DaemonStats stats;
+        SymbolCache symbolCache;
+        LatencyRecorder latencies;
+    };
+
+    // Fills status and body, returns false only when the request itself could not be read in time
+    bool SERVE_REQUEST(const int fd, Server& server, const Parser& parser, const REGMAP& registers, std::string& status, std::string& body)
+    {
+        const Clock::time_point deadline = Clock::now() + REQUEST_READ_TIMEOUT;
+        std::string kind, object, symbols;
+        if (!readBlob(fd, kind, deadline)) return false;
+        status = DAEMON_STATUS_ERROR;
+        if (kind == DAEMON_REQUEST_STATS) {
+            std::lock_guard<std::mutex> guard(server.lock);
+            std::ostringstream stream;
+            stream << "requests " << server.stats.requests << ", errors " << server.stats.errors << ", symbol cache "
+            << server.stats.symbolCacheHits << " hits " << server.stats.symbolCacheMisses << " misses" << std::endl;
+            status = DAEMON_STATUS_OK;
+            body = stream.str() + server.latencies.summary() + "\n";
+            return true;
+        }
+        if (!readBlob(fd, object, deadline) || !readBlob(fd, symbols, deadline)) return false;
+        if (kind == DAEMON_REQUEST_PATHS) {
+            const std::string objectPath = object, symbolPath = symbols;
+            if (!READ_FILE_CONTENTS(objectPath, object)) {body = "Failed to open file: " + objectPath; return true;}
+            if (!READ_FILE_CONTENTS(symbolPath, symbols)) {body = "Failed to open file: " + symbolPath; return true;}
+        }
+        else if (kind != DAEMON_REQUEST_INLINE) {
+            body = "Unknown request: " + kind;
+            return true;
+        }
+        DaemonStats cacheStats{0, 0, 0, 0};
+        const std::shared_ptr<const CachedSymbols> cached = server.symbolCache.get(symbols, cacheStats);
+        {
+            std::lock_guard<std::mutex> guard(server.lock);
+            server.stats.symbolCacheHits += cacheStats.symbolCacheHits;
+            server.stats.symbolCacheMisses += cacheStats.symbolCacheMisses;
+        }
+        if (!cached) {
+            body = "Symbol file has no SYMTAB entries";
+            return true;
+        }
+        status = DAEMON_STATUS_OK;
+        body = RENDER_LISTING(object, *cached, parser, registers);
+        return true;
+    }
+
+    void WORKER(Server& server, const Parser& parser, const REGMAP& registers)
+    {
+        while (true)
+        {
+            int fd;
+            {
+                std::unique_lock<std::mutex> guard(server.lock);
+                server.ready.wait(guard, [&server]() {return !server.connections.empty();});
+                fd = server.connections.front();
+                server.connections.pop_front();
+            }
+            const Clock::time_point start = Clock::now();
+            std::string status, body;
+            bool served;
+            try {
+                served = SERVE_REQUEST(fd, server, parser, registers, status, body);
+            }
+            catch (const std::exception& error) {   // Corrupt input or a field that does not parse, only this request fails
+                status = DAEMON_STATUS_ERROR;
+                body = std::string("Request failed: ") + error.what();
+                served = true;
+            }
+            served = served && writeBlob(fd, status) && writeBlob(fd, body);
+            close(fd);
+            server.latencies.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+            std::lock_guard<std::mutex> guard(server.lock);
+            server.stats.requests++;
+            if (!served || status != DAEMON_STATUS_OK) server.stats.errors++;
+        }
+    }
+
+    const sockaddr_un SOCKET_ADDRESS(const char* path)
+    {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (std::strlen(path) >= sizeof(address.sun_path)) {
+            std::cerr << "Socket path too long: " << path << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        std::strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+        return address;
+    }
+
+    const std::string absolutePath(const char* path)
+    {
+        char resolved[PATH_MAX];
+        return realpath(path, resolved) ? std::string(resolved) : std::string(path);
+    }
+}
+
+// Same as FileHandling::openFile, compressed files included, but a missing file must not take the daemon down.
+// Read straight off the buffer, copying through a stream would turn a CorruptInputError into a short file
+bool READ_FILE_CONTENTS(const std::string& path, std::string& contents)
+{
+    std::unique_ptr<std::streambuf> buffer = OPEN_INPUT_BUFFER(path.c_str());
+    if (!buffer) return false;
+    contents.clear();
+    char block[READ_BLOCK_SIZE];
+    for (std::streamsize bytesRead; (bytesRead = buffer->sgetn(block, READ_BLOCK_SIZE)) > 0;)
+        contents.append(block, bytesRead);
+    return true;
+}
+
+/* Same listing a normal run writes, text or binary, using the daemon's parser instead of building a new one */
+const std::string RENDER_LISTING(const std::string& object, const CachedSymbols& cached, const Parser& parser, const REGMAP& registers)
+{
+    MemoryBuffer objectBuffer(object.data(), object.size());
+    std::istream objectFile(&objectBuffer);
+    std::ostringstream outputFile;
+    const SymbolEntries& symbolEntries = cached.blocks.front();
+    const bool binary = IS_BINARY_OBJECT(objectFile);
+    objectFile.clear();
+    objectFile.seekg(0);
+    if (binary) {
+        const std::vector<ObjectRecord> records = DECODE_BINARY_OBJECT(object);
+        const std::string programName = BINARY_PROGRAM_NAME(records);
+        if (HAS_CONTROL_SECTIONS(records)) {
+            std::stringstream text;
+            WRITE_TEXT_OBJECT(records, text);
+            DISASSEMBLE_CONTROL_SECTIONS(text, cached.blocks, outputFile, parser);
+            return outputFile.str();
+        }
+        ListingSink listing(outputFile, cached.symbols);
+        listing.start(programName, symbolEntries.SYMTAB[0].address);
+        DisassemblerContext context{objectFile, outputFile, listing, registers, cached.symbols, parser, INITIAL_BASE, false};
+        DISASSEMBLE_BINARY_OBJECT(records, cached.litmap, GET_LAST_SYMBOL_ADDRESS(symbolEntries), context);
+        listing.finish(programName);
+        return outputFile.str();
+    }
+
+    const bool hasSections = HAS_CONTROL_SECTIONS(objectFile);
+    objectFile.clear();
+    objectFile.seekg(0);
+    if (hasSections) {
+        DISASSEMBLE_CONTROL_SECTIONS(objectFile, cached.blocks, outputFile, parser);
+        return outputFile.str();
+    }
+    const std::string programName = FileHandling::getProgramName(objectFile);
+    objectFile.clear();
+    objectFile.seekg(0);
+    ListingSink listing(outputFile, cached.symbols);
+    listing.start(programName, symbolEntries.SYMTAB[0].address);
+    DisassemblerContext context{objectFile, outputFile, listing, registers, cached.symbols, parser, INITIAL_BASE, false};
+    disassembleTextSections(context, GET_LAST_SYMBOL_ADDRESS(symbolEntries));
+    listing.finish(programName);
+    return outputFile.str();
+}
+
+// Expects argv[1] to be the socket path, argv[2] optionally sets how many workers serve requests
+int runDaemonMode(const int argc, const char* argv[])
+{
+    const sockaddr_un address = SOCKET_ADDRESS(argv[SOCKET_ARG_NUMBER]);
+    const unsigned int workerCount = argc > WORKERS_ARG_NUMBER ? std::max(MIN_WORKERS, static_cast<unsigned int>(std::stoul(argv[WORKERS_ARG_NUMBER])))
+                                                               : std::max(MIN_WORKERS, std::thread::hardware_concurrency());
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(address.sun_path);               // A socket left behind by an earlier daemon
+    if (listener < 0 || bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, LISTEN_BACKLOG) != 0) {
+        std::cerr << "Failed to listen on " << argv[SOCKET_ARG_NUMBER] << ": " << std::strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::signal(SIGPIPE, SIG_IGN);          // A client hanging up early only fails that one write
+
+    Server server;
+    server.stats = DaemonStats{0, 0, 0, 0};
+    const Parser parser;                    // Built once for every worker, that is most of what the daemon saves
+    const REGMAP registers = REGISTERS();
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < workerCount; i++) workers.push_back(std::thread(WORKER, std::ref(server), std::cref(parser), std::cref(registers)));
+    std::cerr << "DAEMON listening on " << argv[SOCKET_ARG_NUMBER] << " with " << workerCount << " workers" << std::endl;
+    while (true)
+    {
+        const int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) continue;
+        std::lock_guard<std::mutex> guard(server.lock);
+        server.connections.push_back(fd);
+        server.ready.notify_one();
+    }
+}
+
+// Expects argv[1] to be the socket path followed by the usual object and symbol files, --inline sends their
+// contents instead of their paths, --stats asks for the daemon's counters and latency percentiles
+int runClientMode(const int argc, const char* argv[])
+{
+    int fileArg = CLIENT_FIRST_FILE_ARG_NUMBER;
+    const bool statsOnly = argc > fileArg && std::strcmp(argv[fileArg], STATS_FLAG) == 0;
+    const bool sendInline = argc > fileArg && std::strcmp(argv[fileArg], INLINE_FLAG) == 0;
+    if (sendInline) fileArg++;
+    if (!statsOnly && argc < fileArg + 2) {
+        std::cerr << "usage: --client socket [--inline] program.obj program.sym | --client socket --stats" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const sockaddr_un address = SOCKET_ADDRESS(argv[SOCKET_ARG_NUMBER]);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "Failed to reach daemon at " << argv[SOCKET_ARG_NUMBER] << ": " << std::strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+    bool sent;
+    if (statsOnly) sent = writeBlob(fd, DAEMON_REQUEST_STATS);
+    else if (sendInline) {
+        std::string object, symbols;
+        for (int i = fileArg; i < fileArg + 2; i++)
+        {
+            if (READ_FILE_CONTENTS(argv[i], i == fileArg ? object : symbols)) continue;
+            std::cerr << "Failed to open file: " << argv[i] << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        sent = writeBlob(fd, DAEMON_REQUEST_INLINE) && writeBlob(fd, object) && writeBlob(fd, symbols);
+    }
+    else sent = writeBlob(fd, DAEMON_REQUEST_PATHS) && writeBlob(fd, absolutePath(argv[fileArg])) && writeBlob(fd, absolutePath(argv[fileArg + 1]));
+
+    std::string status, body;
+    const bool answered = sent && readBlob(fd, status, NO_DEADLINE) && readBlob(fd, body, NO_DEADLINE);
+    close(fd);
+    if (!answered) {
+        std::cerr << "Daemon closed the connection without answering" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (status != DAEMON_STATUS_OK) {
+        std::cerr << body << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (statsOnly) {
+        std::cout << body;
+        return EXIT_SUCCESS;
+    }
+    std::ofstream outputFile(OUTPUT_FILE_NAME);
+    outputFile << body;
+    return EXIT_SUCCESS;
+}
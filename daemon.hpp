@@ -0,0 +1,47 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "disassembly.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ *  Wire format, both directions are a series of blobs written as "<decimal length>\n<bytes>"
+ *      request     kind, then for PATHS the object and symbol paths, for INLINE the object and symbol contents,
+ *                  STATS has nothing after the kind
+ *      response    status (OK or ERR), then the listing or the error message
+ */
+#define DAEMON_REQUEST_PATHS "PATHS"
+#define DAEMON_REQUEST_INLINE "INLINE"
+#define DAEMON_REQUEST_STATS "STATS"
+#define DAEMON_STATUS_OK "OK"
+#define DAEMON_STATUS_ERROR "ERR"
+
+/* A parsed symbol file shared by every request whose symbol file has the same contents */
+struct CachedSymbols
+{
+    explicit CachedSymbols(const std::vector<SymbolEntries>& blocks)
+        : blocks(blocks), symmap(CREATE_SYMMAP(blocks.front())), litmap(CREATE_LITMAP(blocks.front())), symbols(symmap, litmap)
+    {}
+    const std::vector<SymbolEntries> blocks;    // Every SYMTAB/LITTAB pair, for objects with control sections
+    const SYMMAP symmap;                        // The first pair, for plain programs
+    const LITMAP litmap;
+    const MapSymbolProvider symbols;
+};
+
+struct DaemonStats
+{
+    uint64_t requests;
+    uint64_t errors;
+    uint64_t symbolCacheHits;
+    uint64_t symbolCacheMisses;
+};
+
+bool READ_FILE_CONTENTS(const std::string& path, std::string& contents);
+const std::string RENDER_LISTING(const std::string& object, const CachedSymbols& cached, const Parser& parser, const REGMAP& registers);
+int runDaemonMode(const int argc, const char* argv[]);
+int runClientMode(const int argc, const char* argv[]);
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ *  @brief
+ *          Linear sweep that recognises data regions and writes them as BYTE/WORD directives instead of decoding them
+ *
+ *  The default sweep only treats LITTAB addresses as data, so a table that is not a literal is decoded one bogus
+ *  instruction at a time. Here the code reachable from the entry point is traced first and its operands tell us
+ *  which SYMTAB labels are loaded or stored but never jumped to. An unreached address becomes the start of a data
+ *  region when it carries such a label or when its opcode is not one InstructionBindings knows. The region runs to
+ *  the next label, literal or reachable instruction and is written in bulk, everything else is swept as usual.
+ */
+
+#include "data_regions.hpp"
+#include "byte_operations.hpp"
+#include "binary_object.hpp"
+#include <iostream>
+#include <sstream>
+
+const constexpr int INPUT_FILE_ARG_NUMBER = 1;
+const constexpr int SYMBOL_FILE_ARG_NUMBER = 2;
+const constexpr int FIRST_SINK_ARG_NUMBER = 3;
+const constexpr int INITIAL_BASE = 0;
+const constexpr int HEX_CHARS_PER_BYTE = 2;
+const constexpr int FIRST_TWELVE_BITS = 3;
+const constexpr int MAX_INSTRUCTION_HEX_CHARS = 8;
+const constexpr int WORD_BYTES = 3;
+const constexpr char* LDB_INSTRUCTION = "LDB";
+const constexpr char* OUTPUT_FILE_NAME = "out.lst";
+
+namespace
+{
+    const std::set<std::string> BRANCH_INSTRUCTIONS {"J", "JEQ", "JGT", "JLT", "JSUB"};
+    const std::set<std::string> BYTE_INSTRUCTIONS {"LDCH", "STCH", "RD", "WD", "TD"};
+
+    struct DataCounts
+    {
+        uint64_t labelled;
+        uint64_t invalidOpcodes;
+    };
+
+    bool INVALID_OPCODE(const MemoryImage& image, const int32_t LOCCTR, const Parser& parser)
+    {
+        return parser.determineOpCode(image.hex.substr(LOCCTR * HEX_CHARS_PER_BYTE, FIRST_TWELVE_BITS)).empty();
+    }
+
+    // WORD only fits a region made of whole words, anything else goes out as BYTE constants
+    int32_t EMIT_DATA_REGION(const MemoryImage& image, const int32_t LOCCTR, const int32_t end, const DataDirective directive, const ControlFlowResult& flow, DisassemblerContext& context, EmissionCounts& counts)
+    {
+        const int32_t regionEnd = FIND_UNIT_END(LOCCTR, end, flow, context);
+        const bool words = directive == DataDirective::Word && (regionEnd - LOCCTR) % WORD_BYTES == 0;
+        return EMIT_DATA_BYTES(image, LOCCTR, regionEnd, words ? DataDirective::Word : DataDirective::Byte, context, counts);
+    }
+
+    // Unreached bytes are data when a label or an unknown opcode says so, otherwise they are swept as usual
+    int32_t EMIT_UNREACHED(const MemoryImage& image, const int32_t LOCCTR, const int32_t end, const ControlFlowResult& flow, const DataStarts& dataStarts, DisassemblerContext& context, DataCounts& regions, EmissionCounts& counts)
+    {
+        const DataStarts::const_iterator dataStart = dataStarts.find(LOCCTR);
+        if (dataStart != dataStarts.end()) {
+            regions.labelled++;
+            return EMIT_DATA_REGION(image, LOCCTR, end, dataStart->second, flow, context, counts);
+        }
+        if (INVALID_OPCODE(image, LOCCTR, context.parser)) {
+            regions.invalidOpcodes++;
+            return EMIT_DATA_REGION(image, LOCCTR, end, DataDirective::Byte, flow, context, counts);
+        }
+        std::istringstream stream(image.hex.substr(LOCCTR * HEX_CHARS_PER_BYTE, MAX_INSTRUCTION_HEX_CHARS));
+        const ParsingResult parsed = parseInstruction(stream, context.parser);
+        const DisassemblerState state{context.baseAddress, LOCCTR, parsed.instruction, context.registers, context.symbols};
+        context.sink.instruction(state, parsed.bytesReadIn);
+        FileHandling::handleBaseDirective(parsed.instruction.opCode, parsed.instruction.objectCode, context);
+        return LOCCTR + parsed.bytesReadIn;
+    }
+}
+
+/* Operand targets of the reachable code, BASE follows LDB in address order the same way the listing does */
+OperandUsage COLLECT_OPERAND_USAGE(const ControlFlowResult& flow)
+{
+    OperandUsage usage;
+    int BASE = INITIAL_BASE;
+    for (const auto& decoded : flow.instructions)
+    {
+        const ParsedInstruction& instruction = decoded.second.instruction;
+        if (instruction.opCode == LDB_INSTRUCTION) BASE = hexStringToInt(instruction.objectCode.substr(FIRST_TWELVE_BITS));
+        if (instruction.format == AddressingFormat::Format2 || instruction.addresingMode == AddressingMode::Immediate) continue;
+        const int32_t target = CALCULATE_TARGET_ADDRESS(instruction.targetAddressMode, instruction.objectCode, OffsetInfo{BASE, decoded.first + decoded.second.bytesReadIn});
+        if (instruction.addresingMode == AddressingMode::Indirect) usage.wordAccesses.insert(target);     // The operand holds an address
+        else if (BRANCH_INSTRUCTIONS.count(instruction.opCode)) usage.branchTargets.insert(target);
+        else if (BYTE_INSTRUCTIONS.count(instruction.opCode)) usage.byteAccesses.insert(target);
+        else usage.wordAccesses.insert(target);
+    }
+    return usage;
+}
+
+/* SYMTAB labels the reachable code reads or writes but never jumps to, and that the trace never decoded as code */
+DataStarts CLASSIFY_DATA_LABELS(const MemoryImage& image, const ControlFlowResult& flow, const SYMMAP& symmap)
+{
+    const OperandUsage usage = COLLECT_OPERAND_USAGE(flow);
+    DataStarts dataStarts;
+    for (const auto& symbol : symmap)
+    {
+        const int32_t address = symbol.first;
+        if (!isLoaded(image, address, 1) || flow.instructions.count(address) || usage.branchTargets.count(address)) continue;
+        if (usage.byteAccesses.count(address)) dataStarts.insert({address, DataDirective::Byte});
+        else if (usage.wordAccesses.count(address)) dataStarts.insert({address, DataDirective::Word});
+    }
+    return dataStarts;
+}
+
+// Expects argv[1] to be the object file and argv[2] the symbol file, extra kind=file sinks may follow like the default mode
+int runDataRegionMode(const int argc, const char* argv[])
+{
+    InputFile inputFile                     = FileHandling::openFile(argv[INPUT_FILE_ARG_NUMBER]);
+    REFUSE_BINARY_OBJECT(inputFile, argv[INPUT_FILE_ARG_NUMBER], "--data");
+    std::ofstream outputFile                (OUTPUT_FILE_NAME);
+    const SymbolEntries symbolEntries       = FileHandling::readSymbolTableFile(argv[SYMBOL_FILE_ARG_NUMBER]);
+    const LITMAP litmap                     = CREATE_LITMAP(symbolEntries);
+    const SYMMAP symmap                     = CREATE_SYMMAP(symbolEntries);
+    const REGMAP registers                  = REGISTERS();
+    const MapSymbolProvider symbols         (symmap, litmap);
+    const Parser parser;
+    const std::string programName           = FileHandling::getProgramName(argv[INPUT_FILE_ARG_NUMBER]);
+
+    const MemoryImage image                 = LOAD_MEMORY_IMAGE(inputFile);
+    const ControlFlowResult flow            = TRACE_CONTROL_FLOW(image, FileHandling::getEntryPoint(argv[INPUT_FILE_ARG_NUMBER]), litmap, parser);
+    const DataStarts dataStarts             = CLASSIFY_DATA_LABELS(image, flow, symmap);
+
+    ListingSink listing                     (outputFile, symbols);
+    FanoutSink sinks;
+    sinks.attach(listing);
+    ATTACH_SINKS(sinks, argc, argv, FIRST_SINK_ARG_NUMBER, symbols);
+    DisassemblerContext                     context{inputFile, outputFile, sinks, registers, symbols, parser, INITIAL_BASE, false};
+
+    sinks.start(programName, symbolEntries.SYMTAB.empty() ? std::string() : symbolEntries.SYMTAB[0].address);   // Empty like the default mode
+    DataCounts regions{0, 0};
+    EmissionCounts counts{0, 0, 0};
+    int32_t lastTextSectionEnd = 0;
+    for (const TextRecord& record : image.records)
+    {
+        fillGap(record.LOCCTR_START - lastTextSectionEnd, lastTextSectionEnd, symbols, context);
+        lastTextSectionEnd = EMIT_TRACED_RECORD(record, flow, context, counts, [&](const int32_t LOCCTR, const int32_t end)
+        {
+            return EMIT_UNREACHED(image, LOCCTR, end, flow, dataStarts, context, regions, counts);
+        });
+    }
+    fillGap(GET_LAST_SYMBOL_ADDRESS(symbolEntries), lastTextSectionEnd, symbols, context);
+    sinks.finish(programName);
+
+    std::cerr << "data regions: " << regions.labelled << " from labels, " << regions.invalidOpcodes << " from invalid opcodes, "
+    << counts.dataBytes << " bytes in " << counts.dataLines << " lines" << std::endl;
+    return FileHandling::close(inputFile, outputFile);
+}
@@ -0,0 +1,25 @@
+#ifndef DATA_REGIONS_H
+#define DATA_REGIONS_H
+
+#include "control_flow.hpp"
+#include "sinks.hpp"
+#include <cstdint>
+#include <map>
+#include <set>
+
+/* What the reachable code does with each labelled address, gathered from its operands */
+struct OperandUsage
+{
+    std::set<int32_t> branchTargets;    // J/JEQ/JGT/JLT/JSUB operands
+    std::set<int32_t> wordAccesses;     // Every other memory operand
+    std::set<int32_t> byteAccesses;     // LDCH/STCH operands
+};
+
+/* Addresses where a data region starts and the directive its bytes are written with */
+using DataStarts = std::map<int32_t, DataDirective>;
+
+OperandUsage COLLECT_OPERAND_USAGE(const ControlFlowResult& flow);
+DataStarts CLASSIFY_DATA_LABELS(const MemoryImage& image, const ControlFlowResult& flow, const SYMMAP& symmap);
+int runDataRegionMode(const int argc, const char* argv[]);
+
+#endif
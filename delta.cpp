@@ -0,0 +1,290 @@
+/*
+ *  @brief
+ *          Delta listing between two builds of the same program
+ *
+ *  Diffing two out.lst files is noisy because every LOCCTR after an insertion moves. Instead we line up the T records
+ *  of both builds, first by address and then by the shift of the nearest symbol both builds define. Records whose
+ *  bytes still match are skipped without decoding. Only the records that really differ are decoded on both sides,
+ *  and their lines are diffed on label, opcode and operand, so a moved but otherwise identical line is not reported.
+ */
+
+#include "delta.hpp"
+#include "byte_operations.hpp"
+#include "length_scan.hpp"
+#include "binary_object.hpp"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+const constexpr int OLD_OBJECT_ARG_NUMBER = 1;
+const constexpr int OLD_SYMBOL_ARG_NUMBER = 2;
+const constexpr int NEW_OBJECT_ARG_NUMBER = 3;
+const constexpr int NEW_SYMBOL_ARG_NUMBER = 4;
+const constexpr int DELTA_ARG_COUNT = 5;
+const constexpr int INITIAL_BASE = 0;
+const constexpr int HEX_CHARS_PER_BYTE = 2;
+const constexpr int MAX_INSTRUCTION_HEX_CHARS = 8;
+const constexpr int COLUMN_SPACING = 12;
+const constexpr std::size_t ADDRESS_DIGITS = 4;
+const constexpr int COMPARED_COLUMNS = 3;      // Label, opcode and operand, LOCCTR and object code are expected to move
+const constexpr char* REMOVED_MARKER = "- ";
+const constexpr char* INSERTED_MARKER = "+ ";
+const constexpr char* OUTPUT_FILE_NAME = "out.lst";
+
+namespace
+{
+    bool SAME_BYTES(const MemoryImage& oldImage, const int32_t oldStart, const MemoryImage& newImage, const int32_t newStart, const int32_t length)
+    {
+        if (!isLoaded(oldImage, oldStart, length) || !isLoaded(newImage, newStart, length)) return false;
+        return oldImage.hex.compare(oldStart * HEX_CHARS_PER_BYTE, length * HEX_CHARS_PER_BYTE, newImage.hex, newStart * HEX_CHARS_PER_BYTE, length * HEX_CHARS_PER_BYTE) == 0;
+    }
+
+    int32_t shiftAt(const int32_t address, const std::map<int32_t, int32_t>& shifts)
+    {
+        auto it = shifts.upper_bound(address);
+        if (it == shifts.begin()) return 0;
+        return (--it)->second;
+    }
+
+    // One unit of the listing, an instruction or literal together with any BASE/LTORG line it produced
+    struct DeltaLine
+    {
+        const std::string text;
+        const std::string key;
+        const int32_t address;
+        const int32_t length;       // Bytes the unit covers, so only what was really decoded counts as lined up
+    };
+
+    // Every line of the unit counts, a literal's first line is the LTORG in front of it and says nothing about the literal
+    const std::string COMPARISON_KEY(const std::string& text)
+    {
+        std::istringstream lines(text);
+        std::string line, key;
+        while (std::getline(lines, line))
+            key += (line.size() <= COLUMN_SPACING ? std::string() : line.substr(COLUMN_SPACING, COLUMN_SPACING * COMPARED_COLUMNS)) + "\n";
+        return key;
+    }
+
+    /* Decode one address range of a build the same way the linear sweep would */
+    std::vector<DeltaLine> RENDER_RANGE(const MemoryImage& image, const int32_t start, const int32_t length, DisassemblerContext& context, std::ostringstream& buffer)
+    {
+        std::vector<DeltaLine> lines;
+        int32_t LOCCTR = start;
+        while (LOCCTR < start + length && isLoaded(image, LOCCTR, 1))
+        {
+            buffer.str(std::string());
+            int32_t bytes;
+            if (context.symbols.hasLiteral(LOCCTR)) {
+                const LITTAB_Entry entry = context.symbols.getLiteral(LOCCTR);
+                outputSymbol(context, LOCCTR, entry);
+                bytes = getLiteralBytes(entry);
+            }
+            else {
+                std::istringstream stream(image.hex.substr(LOCCTR * HEX_CHARS_PER_BYTE, MAX_INSTRUCTION_HEX_CHARS));
+                const ParsingResult parsed = parseInstruction(stream, context.parser);
+                const DisassemblerState state{context.baseAddress, LOCCTR, parsed.instruction, context.registers, context.symbols};
+                context.sink.instruction(state, parsed.bytesReadIn);
+                FileHandling::handleBaseDirective(parsed.instruction.opCode, parsed.instruction.objectCode, context);
+                bytes = parsed.bytesReadIn;
+            }
+            if (bytes <= 0) break;  // A zero length literal would never move LOCCTR
+            lines.push_back(DeltaLine{buffer.str(), COMPARISON_KEY(buffer.str()), LOCCTR, bytes});
+            LOCCTR += bytes;
+        }
+        return lines;
+    }
+
+    // Records skipped without decoding still leave BASE and LTORG behind for the lines after them
+    void SKIP_RANGE(const MemoryImage& image, const int32_t start, const int32_t length, const LITMAP& litmap, DisassemblerContext& context)
+    {
+        const std::vector<uint8_t> bytes = DECODE_HEX_BYTES(image.hex.substr(start * HEX_CHARS_PER_BYTE, length * HEX_CHARS_PER_BYTE));
+        for (const InstructionBoundary& boundary : SCAN_INSTRUCTION_LENGTHS(bytes, start, litmap)) skipUnit(bytes, boundary, context);
+    }
+
+    // Where a linear sweep of every record of a build, each one from its first byte, starts a unit
+    const std::vector<bool> UNIT_STARTS(const MemoryImage& image, const LITMAP& litmap)
+    {
+        std::vector<bool> starts(image.loaded.size(), false);
+        for (const TextRecord& record : image.records)
+            for (const InstructionBoundary& boundary : SCAN_INSTRUCTION_LENGTHS(DECODE_HEX_BYTES(record.objectCode), record.LOCCTR_START, litmap))
+                if (record.LOCCTR_START + boundary.offset < static_cast<int32_t>(starts.size())) starts[record.LOCCTR_START + boundary.offset] = true;
+        return starts;
+    }
+
+    void markRange(std::vector<bool>& matched, const int32_t start, const int32_t length)
+    {
+        for (int32_t i = std::max(0, start); i < start + length && i < static_cast<int32_t>(matched.size()); i++) matched[i] = true;
+    }
+
+    bool anyMarked(const std::vector<bool>& matched, const int32_t start, const int32_t length)
+    {
+        for (int32_t i = std::max(0, start); i < start + length && i < static_cast<int32_t>(matched.size()); i++)
+            if (matched[i]) return true;
+        return false;
+    }
+
+    const std::string zeroPad(const std::string& hex)
+    {
+        return hex.size() >= ADDRESS_DIGITS ? hex : std::string(ADDRESS_DIGITS - hex.size(), '0') + hex;
+    }
+
+    // A unit can span several lines when it produced a BASE or LTORG line, each one gets the marker
+    void MARK_LINES(const char* marker, const std::string& text, std::ostream& outputFile)
+    {
+        std::istringstream lines(text);
+        std::string line;
+        while (std::getline(lines, line)) outputFile << marker << line << std::endl;
+    }
+
+    /* Longest common subsequence on the comparison keys, everything off the subsequence was removed or inserted */
+    uint64_t EMIT_LINE_DIFF(const std::vector<DeltaLine>& oldLines, const std::vector<DeltaLine>& newLines, std::ostream& outputFile)
+    {
+        const std::size_t n = oldLines.size(), m = newLines.size();
+        std::vector<std::vector<uint32_t>> common(n + 1, std::vector<uint32_t>(m + 1, 0));
+        for (std::size_t i = n; i-- > 0;)
+            for (std::size_t j = m; j-- > 0;)
+                common[i][j] = oldLines[i].key == newLines[j].key ? common[i+1][j+1] + 1 : std::max(common[i+1][j], common[i][j+1]);
+
+        uint64_t changed = 0;
+        std::size_t i = 0, j = 0;
+        while (i < n || j < m)
+        {
+            if (i < n && j < m && oldLines[i].key == newLines[j].key) {i++; j++;}
+            else if (j == m || (i < n && common[i+1][j] >= common[i][j+1])) {MARK_LINES(REMOVED_MARKER, oldLines[i++].text, outputFile); changed++;}
+            else {MARK_LINES(INSERTED_MARKER, newLines[j++].text, outputFile); changed++;}
+        }
+        return changed;
+    }
+
+    const std::string hunkHeader(const std::string& description, const int32_t newStart, const int32_t oldStart)
+    {
+        return "@@ " + description + " " + zeroPad(intToHexString(newStart)) + " (old " + zeroPad(intToHexString(oldStart)) + ") @@";
+    }
+
+    // Only records that end up with changed lines get a hunk, byte changes that render the same stay quiet
+    uint64_t EMIT_HUNK(const std::string& header, const std::vector<DeltaLine>& oldLines, const std::vector<DeltaLine>& newLines, std::ostream& outputFile)
+    {
+        std::ostringstream lines;
+        const uint64_t changed = EMIT_LINE_DIFF(oldLines, newLines, lines);
+        if (changed) outputFile << header << std::endl << lines.str();
+        return changed;
+    }
+}
+
+/* For every symbol both builds define, how far it moved, keyed by its new address */
+std::map<int32_t, int32_t> CREATE_SHIFT_MAP(const SYMMAP& oldSymmap, const SYMMAP& newSymmap)
+{
+    std::map<std::string, int32_t> oldAddresses;
+    for (const auto& entry : oldSymmap) oldAddresses.insert({entry.second.symbol, entry.first});
+    std::map<int32_t, int32_t> shifts;
+    for (const auto& entry : newSymmap)
+    {
+        auto old = oldAddresses.find(entry.second.symbol);
+        if (old != oldAddresses.end()) shifts.insert({entry.first, entry.first - old->second});
+    }
+    return shifts;
+}
+
+/* Same address first, then wherever the nearest shared symbol says the bytes moved to */
+RecordAlignment ALIGN_RECORD(const TextRecord& record, const MemoryImage& oldImage, const MemoryImage& newImage, const std::map<int32_t, int32_t>& shifts)
+{
+    const int32_t length = record.objectCode.size() / HEX_CHARS_PER_BYTE;
+    if (SAME_BYTES(oldImage, record.LOCCTR_START, newImage, record.LOCCTR_START, length))
+        return RecordAlignment{record.LOCCTR_START, record.LOCCTR_START, length, true};
+    const int32_t oldStart = record.LOCCTR_START - shiftAt(record.LOCCTR_START, shifts);
+    return RecordAlignment{record.LOCCTR_START, oldStart, length, SAME_BYTES(oldImage, oldStart, newImage, record.LOCCTR_START, length)};
+}
+
+// Expects the old object and symbol file followed by the new object and symbol file
+int runDeltaMode(const int argc, const char* argv[])
+{
+    if (argc < DELTA_ARG_COUNT) {
+        std::cerr << "usage: --delta <old.obj> <old.sym> <new.obj> <new.sym>" << std::endl;
+        return EXIT_FAILURE;
+    }
+    InputFile oldInput                      = FileHandling::openFile(argv[OLD_OBJECT_ARG_NUMBER]);
+    InputFile newInput                      = FileHandling::openFile(argv[NEW_OBJECT_ARG_NUMBER]);
+    REFUSE_BINARY_OBJECT(oldInput, argv[OLD_OBJECT_ARG_NUMBER], "--delta");
+    REFUSE_BINARY_OBJECT(newInput, argv[NEW_OBJECT_ARG_NUMBER], "--delta");
+    std::ofstream outputFile                (OUTPUT_FILE_NAME);
+    const SymbolEntries oldEntries          = FileHandling::readSymbolTableFile(argv[OLD_SYMBOL_ARG_NUMBER]);
+    const SymbolEntries newEntries          = FileHandling::readSymbolTableFile(argv[NEW_SYMBOL_ARG_NUMBER]);
+    const SYMMAP oldSymmap                  = CREATE_SYMMAP(oldEntries);
+    const SYMMAP newSymmap                  = CREATE_SYMMAP(newEntries);
+    const LITMAP oldLitmap                  = CREATE_LITMAP(oldEntries);
+    const LITMAP newLitmap                  = CREATE_LITMAP(newEntries);
+    const REGMAP registers                  = REGISTERS();
+    const Parser parser;
+    const MemoryImage oldImage              = LOAD_MEMORY_IMAGE(oldInput);
+    const MemoryImage newImage              = LOAD_MEMORY_IMAGE(newInput);
+    const std::map<int32_t, int32_t> shifts = CREATE_SHIFT_MAP(oldSymmap, newSymmap);
+
+    const MapSymbolProvider oldSymbols      (oldSymmap, oldLitmap);
+    const MapSymbolProvider newSymbols      (newSymmap, newLitmap);
+
+    std::ostringstream oldBuffer, newBuffer;
+    ListingSink oldListing(oldBuffer, oldSymbols), newListing(newBuffer, newSymbols);
+    DisassemblerContext oldContext{oldInput, oldBuffer, oldListing, registers, oldSymbols, parser, INITIAL_BASE, false};
+    DisassemblerContext newContext{newInput, newBuffer, newListing, registers, newSymbols, parser, INITIAL_BASE, false};
+
+    std::ostringstream hunks;
+    DeltaStats stats{0, 0, 0, 0};
+    std::vector<bool> oldMatched(oldImage.loaded.size(), false);      // Old bytes some new record accounts for
+    const std::vector<bool> oldUnitStarts = UNIT_STARTS(oldImage, oldLitmap);
+    for (const TextRecord& record : newImage.records)
+    {
+        const RecordAlignment alignment = ALIGN_RECORD(record, oldImage, newImage, shifts);
+        if (alignment.unchanged) {
+            markRange(oldMatched, alignment.oldStart, alignment.length);
+            SKIP_RANGE(oldImage, alignment.oldStart, alignment.length, oldLitmap, oldContext);
+            SKIP_RANGE(newImage, alignment.newStart, alignment.length, newLitmap, newContext);
+            alignment.oldStart == alignment.newStart ? stats.sameAddress++ : stats.shifted++;
+            continue;   // Never decoded
+        }
+        // A shift can land inside an old instruction, the old side is decoded from the next unit the old build starts
+        const int32_t oldEnd = alignment.oldStart + alignment.length;
+        int32_t oldStart = std::max(0, alignment.oldStart);
+        while (oldStart < oldEnd && oldStart < static_cast<int32_t>(oldUnitStarts.size()) && !oldUnitStarts[oldStart]) oldStart++;
+        const std::vector<DeltaLine> oldLines = RENDER_RANGE(oldImage, oldStart, oldEnd - oldStart, oldContext, oldBuffer);
+        for (const DeltaLine& line : oldLines) markRange(oldMatched, line.address, line.length);
+        stats.decodedRecords++;
+        stats.changedLines += EMIT_HUNK(hunkHeader("changed", alignment.newStart, alignment.oldStart), oldLines,
+                                        RENDER_RANGE(newImage, alignment.newStart, alignment.length, newContext, newBuffer), hunks);
+    }
+
+    oldContext.baseAddress = INITIAL_BASE;  // The old build is swept again from the top, carrying BASE through what it skips
+    oldContext.LTORG = false;
+    for (const TextRecord& record : oldImage.records)   // Old units no new record lined up with were removed
+    {
+        const std::vector<uint8_t> bytes = DECODE_HEX_BYTES(record.objectCode);
+        int32_t runStart = 0, runEnd = 0;
+        const auto emitRun = [&]()
+        {
+            if (runEnd == runStart) return;
+            stats.decodedRecords++;
+            stats.changedLines += EMIT_HUNK(hunkHeader("removed", runStart + shiftAt(runStart, shifts), runStart),
+                                            RENDER_RANGE(oldImage, runStart, runEnd - runStart, oldContext, oldBuffer), std::vector<DeltaLine>(), hunks);
+            runStart = runEnd;
+        };
+        for (const InstructionBoundary& boundary : SCAN_INSTRUCTION_LENGTHS(bytes, record.LOCCTR_START, oldLitmap))
+        {
+            const int32_t start = record.LOCCTR_START + boundary.offset;
+            if (!anyMarked(oldMatched, start, boundary.length)) {
+                if (runEnd != start) runStart = start;
+                runEnd = start + boundary.length;
+                continue;
+            }
+            emitRun();
+            skipUnit(bytes, boundary, oldContext);
+        }
+        emitRun();
+    }
+
+    outputFile << "DELTA " << FileHandling::getProgramName(argv[OLD_OBJECT_ARG_NUMBER]) << " -> " << FileHandling::getProgramName(argv[NEW_OBJECT_ARG_NUMBER]) << std::endl
+    << "records: " << newImage.records.size() << " new, " << oldImage.records.size() << " old, "
+    << stats.sameAddress << " unchanged, " << stats.shifted << " shifted, " << stats.decodedRecords << " decoded, "
+    << stats.changedLines << " changed lines" << std::endl
+    << hunks.str();
+    oldInput.close();
+    return FileHandling::close(newInput, outputFile);
+}
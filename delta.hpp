@@ -0,0 +1,31 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include "control_flow.hpp"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/* Where a new record's bytes are expected in the old build */
+struct RecordAlignment
+{
+    const int32_t newStart;
+    const int32_t oldStart;
+    const int32_t length;
+    const bool unchanged;
+};
+
+struct DeltaStats
+{
+    uint64_t sameAddress;       // Identical bytes at the identical address
+    uint64_t shifted;           // Identical bytes once symbol shifts are applied
+    uint64_t decodedRecords;
+    uint64_t changedLines;
+};
+
+std::map<int32_t, int32_t> CREATE_SHIFT_MAP(const SYMMAP& oldSymmap, const SYMMAP& newSymmap);
+RecordAlignment ALIGN_RECORD(const TextRecord& record, const MemoryImage& oldImage, const MemoryImage& newImage, const std::map<int32_t, int32_t>& shifts);
+int runDeltaMode(const int argc, const char* argv[]);
+
+#endif
@@ -0,0 +1,197 @@
+/*
+ *  @brief
+ *          Defines the disassembly engine that walks text sections and drives the output handler
+ *
+ *  These used to live in main, they are pulled out here so that every mode of the program (the default linear
+ *  sweep as well as the alternative engines) can share the same instruction parsing and output generation.
+ */
+
+#include "disassembly.hpp"
+#include "memory_accounting.hpp"
+#include "byte_operations.hpp"
+#include "operand_renderers.hpp"
+#include "length_scan.hpp"
+#include "trace.hpp"
+#include <fstream>
+#include <iostream>
+
+////////////////////////////////////////////////////////////
+using PrintToConsole = void;
+const constexpr int ONE_BYTE = 1;
+const constexpr int NO_HALF_BYTE = 0;
+const constexpr int PLUS_HALF_BYTE = 1;
+const constexpr int NUMBER_OF_HEX_CHARS_IN_ONE_BYTE = 2;
+const constexpr int INITIAL_BASE = 0;
+const constexpr int NIBBLE_BITS = 4;
+const constexpr int LOW_NIBBLE_MASK = 0x0F;
+const constexpr int BYTE_BITS = 8;
+const constexpr int WORD_BITS = 32;
+const constexpr int OPCODE_BYTES = 1;
+const constexpr uint8_t OPCODE_MASK = 0xFC;
+const constexpr uint8_t LDB_OPCODE = 0x68;
+const constexpr char LITERAL_MARKER = '=';
+const constexpr char* HEX_DIGITS = "0123456789ABCDEF";
+const constexpr bool STILL_MORE_BYTES(int bytes) {return bytes > 0;}
+const int BYTES_IN_HEX_STRING(const std::string& hex_str) {return hex_str.size() / NUMBER_OF_HEX_CHARS_IN_ONE_BYTE;}
+///////////////////////////////////////////////////////////
+
+/* Call our parser for all our info, print it, and return how many bytes we traversed */
+ParsingResult parseInstruction(std::istream& inputFile, const Parser& parser)
+{
+    MemoryScope scope(MemorySubsystem::Parser);
+    const std::string firstTwelveBits =           FileHandling::readInBytes(inputFile, ONE_BYTE, PLUS_HALF_BYTE);
+    const std::string opCode =                    parser.determineOpCode(firstTwelveBits);
+    const AddressingFormat format =               parser.determineFormat(firstTwelveBits);
+    const AddressingMode addresingMode =          parser.determineAddressingMode(firstTwelveBits);
+    const bool isIndexed =                        parser.isIndexed(firstTwelveBits);
+    const TargetAddressMode targetAddressMode =   parser.determineTargetAddressMode(firstTwelveBits);
+    const std::string objectCode =                parser.readInFullInstruction(inputFile, firstTwelveBits, format);
+    const ParsedInstruction parsedInstruction     {opCode, format, addresingMode, isIndexed, targetAddressMode, objectCode};
+    return ParsingResult                          {parsedInstruction, BYTES_IN_HEX_STRING(objectCode)} ;  // Return the total number of bytes traversed
+}
+
+/* Same fields for an instruction whose bytes were already cut out of the record, nothing is read to find its end */
+ParsingResult parseInstruction(const std::string& objectCode, const Parser& parser)
+{
+    MemoryScope scope(MemorySubsystem::Parser);
+    const std::string firstTwelveBits =           objectCode.substr(0, NUMBER_OF_HEX_CHARS_IN_ONE_BYTE + PLUS_HALF_BYTE);
+    const ParsedInstruction parsedInstruction     {parser.determineOpCode(firstTwelveBits), parser.determineFormat(firstTwelveBits),
+                                                   parser.determineAddressingMode(firstTwelveBits), parser.isIndexed(firstTwelveBits),
+                                                   parser.determineTargetAddressMode(firstTwelveBits), objectCode};
+    return ParsingResult                          {parsedInstruction, BYTES_IN_HEX_STRING(objectCode)};
+}
+
+/* Fields straight from an instruction's bytes, hex characters are only made for the object code column */
+ParsingResult parseInstruction(const uint8_t* bytes, const int length, const Parser& parser)
+{
+    MemoryScope scope(MemorySubsystem::Parser);
+    std::string objectCode(length * NUMBER_OF_HEX_CHARS_IN_ONE_BYTE, '0');
+    for (int i = 0; i < length; i++)
+    {
+        objectCode[NUMBER_OF_HEX_CHARS_IN_ONE_BYTE * i] = HEX_DIGITS[bytes[i] >> NIBBLE_BITS];
+        objectCode[NUMBER_OF_HEX_CHARS_IN_ONE_BYTE * i + 1] = HEX_DIGITS[bytes[i] & LOW_NIBBLE_MASK];
+    }
+    const ParsedInstruction parsedInstruction     {parser.determineOpCode(bytes[0]), parser.determineFormat(bytes[0], bytes[1]),
+                                                   parser.determineAddressingMode(bytes[0]), parser.isIndexed(bytes[0], bytes[1]),
+                                                   parser.determineTargetAddressMode(bytes[0], bytes[1]), objectCode};
+    return ParsingResult                          {parsedInstruction, length};
+}
+
+// This function will use the current state variables like LOCCTR, pc counter, and the last read instruction
+// to be able to output to our text file the correct information
+PrintToConsole generateOutput(const DisassemblerState& state, const int bytesReadIn, std::ostream& outputFile)
+{
+    const OffsetInfo  OFFSETS           {state.BASE, state.LOCCTR + bytesReadIn};
+    const std::string LOCCTR_OUTPUT     = CREATE_LOCCTR_OUTPUT(state.LOCCTR);
+    const std::string SYMBOL_OUTPUT     = CREATE_SYMBOL_OUTPUT(state.LOCCTR, state.symbols);
+    const std::string OPCODE_OUTPUT     = CREATE_OPCODE_OUTPUT(state.instruction.opCode, state.instruction.format);
+    const std::string ADDRESS_OUTPUT    = RENDER_OPERAND(OFFSETS, state);
+    const std::string OBJECT_OUTPUT     = CREATE_OBJECT_OUTPUT(state.instruction.objectCode);
+    outputFile                          << Output{LOCCTR_OUTPUT, SYMBOL_OUTPUT, OPCODE_OUTPUT, ADDRESS_OUTPUT, OBJECT_OUTPUT};
+}
+
+// Literals and BYTE constants record their length in hex characters
+const int getLiteralBytes(const LITTAB_Entry& entry)
+{
+    return std::stoi(entry.length)/NUMBER_OF_HEX_CHARS_IN_ONE_BYTE;
+}
+
+// The disassembler will behave differently if it's a symbol instead of an instruction
+// here it will have to look for an entry in the table and find and output the appropriate information
+// like the handle instruction function it will also have to keep track of the amount of bytes traversed
+const int handleSymbol(DisassemblerContext& context, const int LOCCTR)
+{
+    const LITTAB_Entry entry = context.symbols.getLiteral(LOCCTR);
+    const int labelBytes = getLiteralBytes(entry);
+    FileHandling::readInBytes(context.inputFile, labelBytes, NO_HALF_BYTE);
+    outputSymbol(context, LOCCTR, entry);
+    return labelBytes;
+}
+
+// If no symbol is found will go through with our default behaviour which is to parsing instruction and output the disassembled code
+const int handleInstruction(DisassemblerContext& context, const int LOCCTR)
+{
+    const ParsingResult parseResult = parseInstruction(context.inputFile, context.parser);
+    const DisassemblerState state = DisassemblerState{context.baseAddress, LOCCTR, parseResult.instruction, context.registers, context.symbols};
+    context.sink.instruction(state, parseResult.bytesReadIn);
+    FileHandling::handleBaseDirective(parseResult.instruction.opCode, parseResult.instruction.objectCode, context);
+    return parseResult.bytesReadIn;
+}
+
+// A unit of a record that is not listed still leaves behind the BASE an LDB sets and whether LTORG was printed.
+// The address field is sign extended from its width the same way handleBaseDirective reads it from hex
+void skipUnit(const std::vector<uint8_t>& bytes, const InstructionBoundary& boundary, DisassemblerContext& context)
+{
+    if (boundary.literal) {
+        context.LTORG = context.LTORG || boundary.literal->lit_const.front() == LITERAL_MARKER;
+        return;
+    }
+    if ((bytes[boundary.offset] & OPCODE_MASK) != LDB_OPCODE || boundary.offset + boundary.length > static_cast<int>(bytes.size())) return;
+    uint32_t field = bytes[boundary.offset + OPCODE_BYTES] & LOW_NIBBLE_MASK;
+    for (int i = OPCODE_BYTES + 1; i < boundary.length; i++) field = field << BYTE_BITS | bytes[boundary.offset + i];
+    const int unusedBits = WORD_BITS - NIBBLE_BITS - BYTE_BITS * (boundary.length - OPCODE_BYTES - 1);
+    context.baseAddress = static_cast<int32_t>(field << unusedBits) >> unusedBits;
+}
+
+// This recursive function will allow us to avoid mutable state while looping through text file.
+// It will Naturally keep track of the LOCCTR because the handle symbol and handle instruction functions return bytes traversed
+int32_t recurseTextSection(DisassemblerContext& context, const int textBytesRemaining, const int LOCCTR)
+{
+    if (STILL_MORE_BYTES(textBytesRemaining) && context.inputFile.good()) {    // A record cut short by EOF ends with the file
+        int bytesTraversed;
+        if (context.symbols.hasLiteral(LOCCTR)) {
+            bytesTraversed = handleSymbol(context, LOCCTR);
+        }
+        else {
+            bytesTraversed = handleInstruction(context, LOCCTR);
+        }
+        if (bytesTraversed <= 0) return LOCCTR;     // A literal recorded with no length would never get past its address
+        return recurseTextSection(context, textBytesRemaining-bytesTraversed, LOCCTR+bytesTraversed);
+    }
+    else return LOCCTR;
+}
+
+int getNextSymbolGap(const int start, const int end, const SymbolProvider& symbols)
+{
+    int i = 1;
+    while (!symbols.hasSymbol(i+start))
+    {
+        if (i == end)
+            return i;
+        i++;
+    }
+    return i;
+}
+
+// Rows past lastListed are left out, their RESB sizes still run to the next symbol or the end of the gap
+void fillGap(const int sectionGap, const int lastTextSectionEnd, const SymbolProvider& symbols, const DisassemblerContext& context, const int lastListed)
+{
+    if (sectionGap <= 0) return;    // Back to back records, keeps empty gaps out of the trace
+    TraceSpan span("fillGap", sectionGap);
+    int i = 0;
+    while (i < sectionGap && i+lastTextSectionEnd <= lastListed)
+    {
+        if (symbols.hasSymbol(i+lastTextSectionEnd))
+            HANDLE_RESB_DIRECTIVE(getNextSymbolGap(i+lastTextSectionEnd, sectionGap-i, symbols), lastTextSectionEnd+i, context);
+        i++;
+    }
+}
+
+// Walk every text record of the input, filling the gaps between them with RESB directives
+int32_t disassembleTextSections(DisassemblerContext& context, const int lastSymbolAddress)
+{
+    int32_t lastTextSectionEnd = 0;
+    while (context.inputFile.good()) {
+        TraceSpan recordSpan("textRecord");
+        const TextSectionDescriptor descriptor = FileHandling::locateTextSection(context.inputFile);
+        const int32_t sectionGap = descriptor.LOCCTR_START - lastTextSectionEnd;
+        recordSpan.setValue(descriptor.LOCCTR_START);
+        fillGap(sectionGap, lastTextSectionEnd, context.symbols, context);
+        if (descriptor.sectionFound) {
+            TraceSpan span("recurseTextSection", descriptor.textSectionSize);
+            lastTextSectionEnd = recurseTextSection(context, descriptor.textSectionSize, descriptor.LOCCTR_START);
+        }
+    }
+    fillGap(lastSymbolAddress, lastTextSectionEnd, context.symbols, context);
+    return lastTextSectionEnd;
+}
@@ -4,19 +4,21 @@
 #include "input_handler.hpp"
 #include "output_handler.hpp"
 #include "parser.hpp"
+#include <limits>
 #include <set>
 
 struct ParsedInstruction;
+class DisassemblySink;
 
 using REGMAP = std::map<int32_t, std::string>;
 
 struct DisassemblerContext 
 {
-    std::ifstream& inputFile;
-    std::ofstream& outputFile;
+    std::istream& inputFile;
+    std::ostream& outputFile;
+    DisassemblySink& sink;                  // Where every decoded unit is reported, the listing is one of these
     const REGMAP& registers;
-    const SYMMAP& symmap;
-    const LITMAP& litmap;
+    const SymbolProvider& symbols;
     const Parser& parser;
     int baseAddress;
     bool LTORG;
@@ -28,8 +30,22 @@ struct DisassemblerState
     const int LOCCTR; 
     const ParsedInstruction& instruction;
     const REGMAP& registers;
-    const SYMMAP& symmap;
-    const LITMAP& litmap;
+    const SymbolProvider& symbols;
 };
 
+struct ParsingResult;
+struct InstructionBoundary;
+
+ParsingResult parseInstruction(std::istream& inputFile, const Parser& parser);
+ParsingResult parseInstruction(const std::string& objectCode, const Parser& parser);
+ParsingResult parseInstruction(const uint8_t* bytes, const int length, const Parser& parser);
+void generateOutput(const DisassemblerState& state, const int bytesReadIn, std::ostream& outputFile);
+const int getLiteralBytes(const LITTAB_Entry& entry);
+const int handleSymbol(DisassemblerContext& context, const int LOCCTR);
+const int handleInstruction(DisassemblerContext& context, const int LOCCTR);
+void skipUnit(const std::vector<uint8_t>& bytes, const InstructionBoundary& boundary, DisassemblerContext& context);
+int32_t recurseTextSection(DisassemblerContext& context, const int textBytesRemaining, const int LOCCTR);
+void fillGap(const int sectionGap, const int lastTextSectionEnd, const SymbolProvider& symbols, const DisassemblerContext& context, const int lastListed = std::numeric_limits<int>::max());
+int32_t disassembleTextSections(DisassemblerContext& context, const int lastSymbolAddress);
+
 #endif
\ No newline at end of file
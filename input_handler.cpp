@@ -10,6 +10,7 @@
 
 #include "input_handler.hpp"
 #include "byte_operations.hpp"
+#include "trace.hpp"
 #include <stdio.h>
 #include <fstream>
 #include <iostream>
@@ -19,27 +20,32 @@
 
 #define FILE_OPEN_FAILURE_MESSAGE "Failed to open file: " 
 #define TEXT_SECTION_IDENTIFIER 'T'
+#define HEADER_RECORD_IDENTIFIER 'H'
+#define END_RECORD_IDENTIFIER 'E'
+#define NUM_HEADER_START_OFFSET 7
+#define NUM_ADDRESS_HEX_CHARS 6
 #define NUM_ADDRESS_DESCRIPTION_BYTES 3
 #define LOOP_COUNTER_FINISH 0
 #define REMAINING_TEXT_SECTION_BYTES 0
+#define HEX_DIGITS "0123456789ABCDEF"
 
 namespace // Reading From Input
 {
-    char readInChar(std::ifstream& input) 
+    char readInChar(std::istream& input) 
     {
         char character;
         input.get(character);
         return character;
     }
 
-    std::string readInLine(std::ifstream& input) 
+    std::string readInLine(std::istream& input) 
     {
         std::string line;
         std::getline(input, line);  
         return line;
     }
 
-    std::string readInByte(std::ifstream& stream) // Byte has two hex digits
+    std::string readInByte(std::istream& stream) // Byte has two hex digits
     {
         std::string str;
         str += readInChar(stream);
@@ -48,18 +54,19 @@ namespace // Reading From Input
     }
 }
 
-std::ifstream FileHandling::openFile(const char* filename)
+/* gzip and zstd files are recognised by their first bytes and decompressed as they are read */
+InputFile FileHandling::openFile(const char* filename)
 {
-    std::ifstream sourceCode(filename);
-    if (!sourceCode) {
+    std::unique_ptr<std::streambuf> buffer = OPEN_INPUT_BUFFER(filename);
+    if (!buffer) {
         std::cerr << FILE_OPEN_FAILURE_MESSAGE << filename << std::endl;
         exit(EXIT_FAILURE);
     }
-    return sourceCode;
+    return InputFile(std::move(buffer));
 }    
 
 /* Our nice wrapper function that allows us to read in any number of bytes and even half bytes (one hex digit) if we want */
-std::string FileHandling::readInBytes(std::ifstream& stream, int numBytes, bool readInHalfByte)
+std::string FileHandling::readInBytes(std::istream& stream, int numBytes, bool readInHalfByte)
 {
     std::string byteStream;
     while (numBytes-- > LOOP_COUNTER_FINISH)
@@ -71,33 +78,75 @@ std::string FileHandling::readInBytes(std::ifstream& stream, int numBytes, bool
 }
 
 /* Looks for T section and grabs in description Bytes. Then we output the size in bytes of our text section to be used later to know how long to iterate */
-TextSectionDescriptor FileHandling::locateTextSection(std::ifstream& stream)
+TextSectionDescriptor FileHandling::locateTextSection(std::istream& stream)
 {
-    while (stream.peek() != TEXT_SECTION_IDENTIFIER && !stream.eof())                       // Read in lines until we see T
+    TraceSpan span("locateTextSection");
+    while (stream.peek() != TEXT_SECTION_IDENTIFIER && stream.good())                       // Read in lines until we see T
         readInLine(stream);
-    if (stream.eof()) return TextSectionDescriptor{0, 0, false};
+    if (!stream.good()) return TextSectionDescriptor{0, 0, false};
     readInChar(stream);                                                                     // Grab 'T'
-    const int LOCCTR = hexStringToInt(readInBytes(stream, NUM_ADDRESS_DESCRIPTION_BYTES));  // Read in 3 descriptor bytes
-    const int TEXT_SIZE = convertStringToHex(readInByte(stream));
+    const std::string address = readInBytes(stream, NUM_ADDRESS_DESCRIPTION_BYTES);        // Read in 3 descriptor bytes
+    const std::string size = readInByte(stream);
+    if ((address + size).find_first_not_of(HEX_DIGITS) != std::string::npos) {             // Garbage would turn into any LOCCTR and gap size,
+        stream.setstate(std::ios::failbit);                                                 // so the sweep stops at it
+        return TextSectionDescriptor{0, 0, false};
+    }
+    const int LOCCTR = hexStringToInt(address);
+    span.setValue(LOCCTR);
+    const int TEXT_SIZE = convertStringToHex(size);
     return TextSectionDescriptor{LOCCTR, TEXT_SIZE, true};                                        // Read in next byte and return the size it indicates
 }   // This will place you at beginning of instructions
 
+/* Same as above, but also pulls in every byte the record describes so the record can be handed off as a unit */
+TextRecord FileHandling::readTextRecord(std::istream& stream)
+{
+    const TextSectionDescriptor descriptor = locateTextSection(stream);
+    if (!descriptor.sectionFound) return TextRecord{0, 0, std::string(), false};
+    return TextRecord{descriptor.LOCCTR_START, descriptor.textSectionSize, readInBytes(stream, descriptor.textSectionSize), true};
+}
+
 // Read in header record for program name
 const std::string FileHandling::getProgramName(const char* assemblyFile)
+{
+    InputFile assembly = openFile(assemblyFile);
+    return getProgramName(assembly);
+}
+
+// Same as above for an object file that is already open, the stream has to be at the header record
+const std::string FileHandling::getProgramName(std::istream& assembly)
 {
     std::string programName;
-    std::ifstream assembly = openFile(assemblyFile);
     readInChar(assembly); // Skip 'H' header indicator
-    while (std::isdigit(assembly.peek()) == false) //!= numeric
+    while (std::isdigit(assembly.peek()) == false && assembly.good()) //!= numeric, a file without digits ends at EOF
     {
         programName += readInChar(assembly);
     }
     return programName;
 }
 
-int FileHandling::close(std::ifstream& inputFile, std::ofstream& outputFile)
+// Read end record for the address of the first instruction, an empty E record means start of program
+int FileHandling::getEntryPoint(const char* assemblyFile)
+{
+    InputFile assembly = openFile(assemblyFile);
+    std::string line;
+    int programStart = 0;
+    while (std::getline(assembly, line))
+    {
+        if (line.size() >= NUM_HEADER_START_OFFSET + NUM_ADDRESS_HEX_CHARS && line[0] == HEADER_RECORD_IDENTIFIER)
+            programStart = hexStringToInt(line.substr(NUM_HEADER_START_OFFSET, NUM_ADDRESS_HEX_CHARS));
+        if (!line.empty() && line[0] == END_RECORD_IDENTIFIER)
+            return line.size() > NUM_ADDRESS_HEX_CHARS ? hexStringToInt(line.substr(1, NUM_ADDRESS_HEX_CHARS)) : programStart;
+    }
+    return programStart;
+}
+
+int FileHandling::close(InputFile& inputFile, std::ofstream& outputFile)
 {
     inputFile.close();
-    outputFile.close();
+    {
+        TraceSpan span("flushOutput");
+        outputFile.close();
+    }
+    printDecompressionStats(std::cerr);
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <string>
 #include <functional>
 #include "symbol_table.hpp"
+#include "compressed_input.hpp"
 
 struct TextSectionDescriptor
 {
@@ -13,14 +14,37 @@ struct TextSectionDescriptor
     bool sectionFound;
 };
 
+/* A whole text record pulled off the stream at once, object code still in hex characters */
+struct TextRecord
+{
+    int LOCCTR_START;
+    int textSectionSize;
+    std::string objectCode;
+    bool sectionFound;
+};
+
+/* Entry at a time view of a symbol file, for readers that should not hold all of it */
+struct SymbolVisitor
+{
+    std::function<void(const SYMTAB_Entry&)> symbol;
+    std::function<void(const LITTAB_Entry&)> literal;
+};
+
 namespace FileHandling
 {
-    std::string readInBytes(std::ifstream& stream, int numBytes, bool readInHalfByte=false);
-    std::ifstream openFile(const char* filename = nullptr);
+    std::string readInBytes(std::istream& stream, int numBytes, bool readInHalfByte=false);
+    InputFile openFile(const char* filename = nullptr);
     const std::string getProgramName(const char* assemblyFile);
+    const std::string getProgramName(std::istream& assembly);
+    int getEntryPoint(const char* assemblyFile);
     const SymbolEntries readSymbolTableFile(const char* filename);
-    TextSectionDescriptor locateTextSection(std::ifstream& stream);
-    int close(std::ifstream& inputFile, std::ofstream& outputFile);
+    const SymbolEntries readSymbolTable(std::istream& stream);
+    void visitSymbolTable(std::istream& stream, const SymbolVisitor& visitor);
+    const std::vector<SymbolEntries> readSymbolTableBlocks(const char* filename);
+    const std::vector<SymbolEntries> readSymbolTableBlocks(std::istream& stream);
+    TextSectionDescriptor locateTextSection(std::istream& stream);
+    TextRecord readTextRecord(std::istream& stream);
+    int close(InputFile& inputFile, std::ofstream& outputFile);
 }
 
 #endif
\ No newline at end of file
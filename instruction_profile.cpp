@@ -0,0 +1,326 @@
+/*
+ *  @brief
+ *          Static instruction mix of a set of programs, to see which decode and render paths are worth optimizing (--profile)
+ *
+ *  Nothing is listed. Every T record goes through the same length pre-scan the pipeline decodes with, and each unit
+ *  it finds is counted straight from its bytes into fixed arrays: one counter per opcode (the high six bits of the
+ *  first byte) and format, and one per nixbpe value of the format 3/4 instructions. SIC format instructions (ni=00)
+ *  only have a counter of their own, the bits after their x flag are address bits. The addressing mode and target
+ *  address mode splits are sums over these counters when the profile is printed. Literals and BYTE constants
+ *  come out of the scan as LITTAB boundaries and are told apart by the '=' of a literal.
+ *
+ *  Only LITTAB decides where units start, so single section programs open their symbol file with the lazy table and
+ *  never read its SYMTAB. Control sections and binary objects are profiled as well, with the LITTAB of each section.
+ *  Programs are spread over a pool of workers that each fill their own profile, and the profiles are added up at the
+ *  end. Usage:
+ *      --profile [--json] obj sym [obj sym ...]
+ */
+
+#include "instruction_profile.hpp"
+#include "lazy_symbols.hpp"
+#include "length_scan.hpp"
+#include "control_sections.hpp"
+#include "binary_object.hpp"
+#include "instructions.hpp"
+#include "byte_operations.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+
+const constexpr int FIRST_PAIR_ARG_NUMBER = 1;
+const constexpr int FILES_PER_PROGRAM = 2;
+const constexpr int COLUMN_WIDTH = 12;
+const constexpr int OPCODE_SHIFT = 2;               // Opcodes are multiples of four, ni takes the low two bits
+const constexpr int NI_MASK = 0x03;
+const constexpr int NI_SHIFT = 4;
+const constexpr int XBPE_SHIFT = 4;                 // High nibble of the second byte
+const constexpr int X_FLAG = 0x08;
+const constexpr int BP_SHIFT = 1;
+const constexpr int BP_MASK = 0x03;
+const constexpr int FIRST_FORMAT = 2;               // Column 0 of the opcode counters
+const constexpr int ADDRESSING_MODES = 4;           // ni: SIC, immediate, indirect, simple
+const constexpr int SIC_ADDRESSING = 0;
+const constexpr int TARGET_MODES = 4;               // bp: absolute, PC, base, both set
+const constexpr double PERCENT = 100.0;
+const constexpr char LITERAL_MARKER = '=';
+const constexpr char HEADER_RECORD = 'H';
+const constexpr char TEXT_RECORD = 'T';
+const constexpr char* JSON_FLAG = "--json";
+const constexpr char* UNKNOWN_MNEMONIC = "?";
+const constexpr char* ADDRESSING_NAMES[ADDRESSING_MODES] = {"sic", "immediate", "indirect", "simple"};
+const constexpr char* TARGET_NAMES[TARGET_MODES] = {"absolute", "pc", "base", "invalid"};
+
+namespace
+{
+    struct ProfileSums
+    {
+        uint64_t instructions;
+        uint64_t formats[PROFILE_FORMATS];
+        uint64_t flagged;                           // Format 3/4 instructions whose nixbpe was counted
+        uint64_t addressed;                         // Those and the SIC format ones, what the addressing modes split
+        uint64_t addressing[ADDRESSING_MODES];
+        uint64_t targets[TARGET_MODES];
+        uint64_t indexed;
+    };
+
+    // Opcode slot to mnemonic, empty for the slots no instruction uses
+    const std::vector<std::string> BUILD_MNEMONICS()
+    {
+        const InstructionConstants constants;
+        std::vector<std::string> mnemonics(PROFILE_OPCODES);
+        for (int i = 0; i < NUM_INSTRUCTIONS; i++)
+            mnemonics[convertStringToHex(constants.ops[i]) >> OPCODE_SHIFT] = constants.mnemonics[i];
+        return mnemonics;
+    }
+
+    const std::string MNEMONIC(const int slot)
+    {
+        static const std::vector<std::string> mnemonics = BUILD_MNEMONICS();
+        return mnemonics[slot].empty() ? UNKNOWN_MNEMONIC + intToHexString(slot << OPCODE_SHIFT) : mnemonics[slot];
+    }
+
+    const ProfileSums SUM_PROFILE(const InstructionProfile& profile)
+    {
+        ProfileSums sums{};
+        for (int slot = 0; slot < PROFILE_OPCODES; slot++)
+            for (int format = 0; format < PROFILE_FORMATS; format++)
+            {
+                sums.formats[format] += profile.opcodes[slot][format];
+                sums.instructions += profile.opcodes[slot][format];
+            }
+        for (int nixbpe = 0; nixbpe < PROFILE_FLAG_VALUES; nixbpe++)
+        {
+            const uint64_t count = profile.flags[nixbpe];
+            sums.flagged += count;
+            sums.addressing[nixbpe >> NI_SHIFT] += count;
+            sums.targets[(nixbpe >> BP_SHIFT) & BP_MASK] += count;
+            if (nixbpe & X_FLAG) sums.indexed += count;
+        }
+        sums.addressing[SIC_ADDRESSING] = profile.sicFormat;
+        sums.addressed = sums.flagged + profile.sicFormat;
+        return sums;
+    }
+
+    // Opcode slots by total count, most used first, ties in opcode order
+    const std::vector<int> RANK_OPCODES(const InstructionProfile& profile)
+    {
+        std::vector<uint64_t> totals(PROFILE_OPCODES, 0);
+        std::vector<int> slots;
+        for (int slot = 0; slot < PROFILE_OPCODES; slot++)
+        {
+            for (int format = 0; format < PROFILE_FORMATS; format++) totals[slot] += profile.opcodes[slot][format];
+            if (totals[slot]) slots.push_back(slot);
+        }
+        std::stable_sort(slots.begin(), slots.end(), [&totals](const int a, const int b) {return totals[a] > totals[b];});
+        return slots;
+    }
+
+    const std::string share(const uint64_t count, const uint64_t total)
+    {
+        std::ostringstream text;
+        text << std::fixed << std::setprecision(1) << (total ? PERCENT * count / total : 0) << "%";
+        return text.str();
+    }
+
+    void PROFILE_TEXT_RECORDS(std::istream& records, const LITMAP& litmap, InstructionProfile& profile)
+    {
+        for (TextRecord record = FileHandling::readTextRecord(records); record.sectionFound; record = FileHandling::readTextRecord(records))
+            PROFILE_BYTES(DECODE_HEX_BYTES(record.objectCode), record.LOCCTR_START, litmap, profile);
+    }
+
+    // A single section program only needs the LITTAB, which the lazy table reads without touching SYMTAB
+    const std::vector<LITMAP> SECTION_LITMAPS(const char* symbolFile, const std::size_t sections)
+    {
+        if (sections <= 1) {
+            const LazySymbolTable symbols(symbolFile);
+            return std::vector<LITMAP>{symbols.getLitmap()};
+        }
+        const std::vector<SymbolEntries> blocks = FileHandling::readSymbolTableBlocks(symbolFile);
+        std::vector<LITMAP> litmaps;
+        for (std::size_t i = 0; i < sections; i++)      // One pair shared by every section for older symbol files
+            litmaps.push_back(blocks.size() == 1 ? CREATE_LITMAP(blocks.front()) : i < blocks.size() ? CREATE_LITMAP(blocks[i]) : LITMAP());
+        return litmaps;
+    }
+}
+
+void InstructionProfile::merge(const InstructionProfile& other)
+{
+    programs += other.programs;
+    records += other.records;
+    objectBytes += other.objectBytes;
+    for (int slot = 0; slot < PROFILE_OPCODES; slot++)
+        for (int format = 0; format < PROFILE_FORMATS; format++) opcodes[slot][format] += other.opcodes[slot][format];
+    for (int nixbpe = 0; nixbpe < PROFILE_FLAG_VALUES; nixbpe++) flags[nixbpe] += other.flags[nixbpe];
+    truncated += other.truncated;
+    sicFormat += other.sicFormat;
+    literals += other.literals;
+    literalBytes += other.literalBytes;
+    byteConstants += other.byteConstants;
+    byteConstantBytes += other.byteConstantBytes;
+}
+
+/* Counts every unit of one record, the boundaries are the ones the pipeline would decode */
+void PROFILE_BYTES(const std::vector<uint8_t>& bytes, const int LOCCTR_START, const LITMAP& litmap, InstructionProfile& profile)
+{
+    profile.records++;
+    profile.objectBytes += bytes.size();
+    for (const InstructionBoundary& boundary : SCAN_INSTRUCTION_LENGTHS(bytes, LOCCTR_START, litmap))
+    {
+        if (boundary.literal) {
+            const bool isLiteral = boundary.literal->lit_const.front() == LITERAL_MARKER;
+            (isLiteral ? profile.literals : profile.byteConstants)++;
+            (isLiteral ? profile.literalBytes : profile.byteConstantBytes) += boundary.length;
+            continue;
+        }
+        const uint8_t firstByte = bytes[boundary.offset];
+        profile.opcodes[firstByte >> OPCODE_SHIFT][boundary.length - FIRST_FORMAT]++;
+        if (boundary.length == FIRST_FORMAT) continue;
+        if ((firstByte & NI_MASK) == SIC_ADDRESSING) profile.sicFormat++;
+        else if (boundary.offset + 1 < static_cast<int>(bytes.size()))
+            profile.flags[((firstByte & NI_MASK) << NI_SHIFT) | (bytes[boundary.offset + 1] >> XBPE_SHIFT)]++;
+        else profile.truncated++;
+    }
+}
+
+void PROFILE_PROGRAM(const char* objectFile, const char* symbolFile, InstructionProfile& profile)
+{
+    TraceSpan span("profileProgram");
+    profile.programs++;
+    InputFile inputFile = FileHandling::openFile(objectFile);
+    if (STARTS_AS_BINARY_OBJECT(inputFile)) {
+        const std::string contents((std::istreambuf_iterator<char>(inputFile)), std::istreambuf_iterator<char>());
+        const std::vector<ObjectRecord> records = DECODE_BINARY_OBJECT(contents);
+        const std::vector<LITMAP> litmaps = SECTION_LITMAPS(symbolFile, std::count_if(records.begin(), records.end(), [](const ObjectRecord& record) {return record.kind == HEADER_RECORD;}));
+        std::size_t section = 0;
+        bool started = false;
+        for (const ObjectRecord& record : records)
+        {
+            if (record.kind == HEADER_RECORD) section += started, started = true;
+            else if (record.kind == TEXT_RECORD) PROFILE_BYTES(record.bytes, record.address, litmaps[section], profile);
+        }
+        return;
+    }
+    FileHandling::getProgramName(inputFile);
+    if (LEADS_INTO_CONTROL_SECTIONS(inputFile)) {      // Only sectioned objects are read again, from their header on
+        inputFile.seekg(0);
+        const std::vector<ControlSection> sections = READ_CONTROL_SECTIONS(inputFile);
+        const std::vector<LITMAP> litmaps = SECTION_LITMAPS(symbolFile, sections.size());
+        for (std::size_t i = 0; i < sections.size(); i++)
+        {
+            std::istringstream records(sections[i].records);
+            PROFILE_TEXT_RECORDS(records, litmaps[i], profile);
+        }
+        return;
+    }
+    PROFILE_TEXT_RECORDS(inputFile, SECTION_LITMAPS(symbolFile, 1).front(), profile);
+}
+
+void PRINT_PROFILE_TABLE(std::ostream& stream, const InstructionProfile& profile)
+{
+    const ProfileSums sums = SUM_PROFILE(profile);
+    stream << "PROFILE " << profile.programs << " programs, " << profile.records << " records, " << profile.objectBytes << " bytes, "
+    << sums.instructions << " instructions" << std::endl;
+    stream << std::left << std::setw(COLUMN_WIDTH) << "mnemonic" << std::right << std::setw(COLUMN_WIDTH) << "count" << std::setw(COLUMN_WIDTH) << "share";
+    for (int format = 0; format < PROFILE_FORMATS; format++) stream << std::setw(COLUMN_WIDTH) << "format " + std::to_string(format + FIRST_FORMAT);
+    stream << std::endl;
+    for (const int slot : RANK_OPCODES(profile))
+    {
+        uint64_t total = 0;
+        for (int format = 0; format < PROFILE_FORMATS; format++) total += profile.opcodes[slot][format];
+        stream << std::left << std::setw(COLUMN_WIDTH) << MNEMONIC(slot) << std::right << std::setw(COLUMN_WIDTH) << total
+        << std::setw(COLUMN_WIDTH) << share(total, sums.instructions);
+        for (int format = 0; format < PROFILE_FORMATS; format++) stream << std::setw(COLUMN_WIDTH) << profile.opcodes[slot][format];
+        stream << std::endl;
+    }
+
+    stream << "formats:";
+    for (int format = 0; format < PROFILE_FORMATS; format++)
+        stream << " " << format + FIRST_FORMAT << " " << sums.formats[format] << " (" << share(sums.formats[format], sums.instructions) << ")";
+    stream << std::endl << "addressing (format 3/4):";
+    for (int mode = ADDRESSING_MODES - 1; mode >= 0; mode--)
+        stream << " " << ADDRESSING_NAMES[mode] << " " << sums.addressing[mode] << " (" << share(sums.addressing[mode], sums.addressed) << ")";
+    stream << std::endl << "target address (format 3/4 without SIC):";
+    for (int mode = 0; mode < TARGET_MODES; mode++)
+        stream << " " << TARGET_NAMES[mode] << " " << sums.targets[mode] << " (" << share(sums.targets[mode], sums.flagged) << ")";
+    stream << ", indexed " << sums.indexed << " (" << share(sums.indexed, sums.flagged) << ")";
+    if (profile.truncated) stream << ", " << profile.truncated << " cut off before their flags";
+    stream << std::endl << "constants: literals " << profile.literals << " (" << profile.literalBytes << " bytes), BYTE "
+    << profile.byteConstants << " (" << profile.byteConstantBytes << " bytes), literals per BYTE constant ";
+    if (profile.byteConstants) stream << std::fixed << std::setprecision(2) << static_cast<double>(profile.literals) / profile.byteConstants;
+    else stream << "n/a";
+    stream << std::endl;
+}
+
+void PRINT_PROFILE_JSON(std::ostream& stream, const InstructionProfile& profile)
+{
+    const ProfileSums sums = SUM_PROFILE(profile);
+    stream << "{\"programs\":" << profile.programs << ",\"records\":" << profile.records << ",\"bytes\":" << profile.objectBytes
+    << ",\"instructions\":" << sums.instructions << ",\n\"mnemonics\":{";
+    bool first = true;
+    for (const int slot : RANK_OPCODES(profile))
+    {
+        stream << (first ? "" : ",") << "\n\"" << MNEMONIC(slot) << "\":[";
+        for (int format = 0; format < PROFILE_FORMATS; format++) stream << (format ? "," : "") << profile.opcodes[slot][format];
+        stream << "]";
+        first = false;
+    }
+    stream << "},\n\"formats\":{";
+    for (int format = 0; format < PROFILE_FORMATS; format++) stream << (format ? "," : "") << "\"" << format + FIRST_FORMAT << "\":" << sums.formats[format];
+    stream << "},\n\"addressing\":{";
+    for (int mode = 0; mode < ADDRESSING_MODES; mode++) stream << (mode ? "," : "") << "\"" << ADDRESSING_NAMES[mode] << "\":" << sums.addressing[mode];
+    stream << "},\n\"target\":{";
+    for (int mode = 0; mode < TARGET_MODES; mode++) stream << (mode ? "," : "") << "\"" << TARGET_NAMES[mode] << "\":" << sums.targets[mode];
+    stream << "},\n\"indexed\":" << sums.indexed << ",\"truncated\":" << profile.truncated << ",\"sic_format\":" << profile.sicFormat << ",\n\"nixbpe\":[";
+    for (int nixbpe = 0; nixbpe < PROFILE_FLAG_VALUES; nixbpe++) stream << (nixbpe ? "," : "") << profile.flags[nixbpe];
+    stream << "],\n\"literals\":{\"count\":" << profile.literals << ",\"bytes\":" << profile.literalBytes << "},"
+    << "\"byte_constants\":{\"count\":" << profile.byteConstants << ",\"bytes\":" << profile.byteConstantBytes << "}}" << std::endl;
+}
+
+// Expects object and symbol files in pairs, optionally after --json
+int runProfileMode(const int argc, const char* argv[])
+{
+    const bool json = argc > FIRST_PAIR_ARG_NUMBER && std::string(argv[FIRST_PAIR_ARG_NUMBER]) == JSON_FLAG;
+    const int firstPair = FIRST_PAIR_ARG_NUMBER + json;
+    const int files = argc - firstPair;
+    if (files <= 0 || files % FILES_PER_PROGRAM) {
+        std::cerr << "Expected object and symbol files in pairs" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    const std::size_t programCount = files / FILES_PER_PROGRAM;
+    const std::size_t workerCount = std::min<std::size_t>(programCount, std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<InstructionProfile> profiles(workerCount);
+    std::atomic<std::size_t> next(0);
+    const auto work = [&](InstructionProfile& profile)
+    {
+        NAME_TRACE_THREAD("profiler");
+        for (std::size_t i = next++; i < programCount; i = next++)
+        {
+            const int pair = firstPair + static_cast<int>(i) * FILES_PER_PROGRAM;
+            InstructionProfile program;     // Merged only once the whole program was read, a corrupt file leaves no partial counts
+            try {
+                PROFILE_PROGRAM(argv[pair], argv[pair + 1], program);
+                profile.merge(program);
+            }
+            catch (const CorruptInputError& error) {
+                std::cerr << error.what() << ", left out of the profile" << std::endl;
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < workerCount; i++) workers.push_back(std::thread(work, std::ref(profiles[i])));
+    work(profiles.front());
+    for (std::thread& worker : workers) worker.join();
+
+    InstructionProfile total;
+    for (const InstructionProfile& profile : profiles) total.merge(profile);
+    if (json) PRINT_PROFILE_JSON(std::cout, total);
+    else PRINT_PROFILE_TABLE(std::cout, total);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,37 @@
+#ifndef INSTRUCTION_PROFILE_H
+#define INSTRUCTION_PROFILE_H
+
+#include "symbol_table.hpp"
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#define PROFILE_OPCODES 64          // High six bits of the first byte
+#define PROFILE_FORMATS 3           // Formats 2, 3 and 4, the parser reads format 1 opcodes as 3/4 as well
+#define PROFILE_FLAG_VALUES 64      // nixbpe of a format 3/4 instruction, SIC format ones are not counted there
+
+/* Static instruction mix of one or many programs, fixed size so profiles merge by adding them up */
+struct InstructionProfile
+{
+    uint64_t programs = 0;
+    uint64_t records = 0;
+    uint64_t objectBytes = 0;
+    uint64_t opcodes[PROFILE_OPCODES][PROFILE_FORMATS] = {};
+    uint64_t flags[PROFILE_FLAG_VALUES] = {};
+    uint64_t truncated = 0;         // Format 3/4 opcode in the last byte of a record, no flags to count
+    uint64_t sicFormat = 0;         // ni=00, its xbpe bits are part of the address
+    uint64_t literals = 0;
+    uint64_t literalBytes = 0;
+    uint64_t byteConstants = 0;
+    uint64_t byteConstantBytes = 0;
+
+    void merge(const InstructionProfile& other);
+};
+
+void PROFILE_BYTES(const std::vector<uint8_t>& bytes, const int LOCCTR_START, const LITMAP& litmap, InstructionProfile& profile);
+void PROFILE_PROGRAM(const char* objectFile, const char* symbolFile, InstructionProfile& profile);
+void PRINT_PROFILE_TABLE(std::ostream& stream, const InstructionProfile& profile);
+void PRINT_PROFILE_JSON(std::ostream& stream, const InstructionProfile& profile);
+int runProfileMode(const int argc, const char* argv[]);
+
+#endif
@@ -16,12 +16,15 @@ InstructionBindings::InstructionBindings()
     }
 }
 
-std::string InstructionBindings::getMnemonic(const std::string& opcode)
+/* Lookups never insert, so one set of bindings (and the Parser holding it) can be read from several threads */
+std::string InstructionBindings::getMnemonic(const std::string& opcode) const
 {
-    return instructionBindings[opcode].mnemonics;
+    const auto binding = instructionBindings.find(opcode);
+    return binding == instructionBindings.end() ? std::string() : binding->second.mnemonics;
 }
 
-bool InstructionBindings::isFormat2(const std::string& opcode)
+bool InstructionBindings::isFormat2(const std::string& opcode) const
 {
-    return instructionBindings[opcode].isFormat2;
+    const auto binding = instructionBindings.find(opcode);
+    return binding != instructionBindings.end() && binding->second.isFormat2;
 }
@@ -64,8 +64,8 @@ class InstructionBindings
 {
     public:
         InstructionBindings();
-        std::string getMnemonic(const std::string& mnemonic);
-        bool isFormat2(const std::string& mnemonic);
+        std::string getMnemonic(const std::string& mnemonic) const;
+        bool isFormat2(const std::string& mnemonic) const;
     private:
         InstructionConstants constants;
         std::map<OpCode, InstructionDescription> instructionBindings; // Tie our opcode to other info on the instruction 
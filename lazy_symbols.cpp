@@ -0,0 +1,408 @@
+/*
+ *  @brief
+ *          Symbol lookups that read the text symbol file a block at a time, and a mode that lists part of a program (--slice)
+ *
+ *  printHeader and the compiled symbol cache both read the whole symbol file before the first record is decoded, which
+ *  is most of the run when only a few records of a large program are wanted. The SYMTAB of a symbol file is in address
+ *  order, so its first address every LAZY_BLOCK_BYTES bytes is enough to tell which block holds a given address. Opening
+ *  reads the header, the LITTAB from the end of the file (every LOCCTR is checked against it, so it is needed anyway) and
+ *  one line at every block boundary. A block is read with pread and parsed into SYMMAP the first time a lookup lands in
+ *  it, which keeps the time to the first line proportional to the records listed and the labels they touch.
+ *
+ *  Block boundaries are moved past runs of entries with the same address, so a block holds every entry of its addresses
+ *  and the first one in file order wins like in CREATE_SYMMAP. An entry found outside the range its block stands for
+ *  means the file is not address ordered after all, and every block is read in file order from then on.
+ *
+ *  --slice lists the T records overlapping [first, last] (hex, last defaults to the end of the program) with the RESB
+ *  gaps between them. Records in front of the slice are only length scanned for the BASE and LTORG state they leave
+ *  behind, their operands never touch the symbol file. Without addresses the listing is the same as the default one.
+ *  Usage:
+ *      --slice obj sym [first [last]]
+ */
+
+#include "lazy_symbols.hpp"
+#include "disassembly.hpp"
+#include "control_sections.hpp"
+#include "binary_object.hpp"
+#include "length_scan.hpp"
+#include "byte_operations.hpp"
+#include "memory_accounting.hpp"
+#include "trace.hpp"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+
+const constexpr int INPUT_FILE_ARG_NUMBER = 1;
+const constexpr int SYMBOL_FILE_ARG_NUMBER = 2;
+const constexpr int FIRST_ADDRESS_ARG_NUMBER = 3;
+const constexpr int LAST_ADDRESS_ARG_NUMBER = 4;
+const constexpr int INITIAL_BASE = 0;
+const constexpr std::size_t LINE_PROBE_BYTES = 128;         // Enough for any SYMTAB line in one read
+const constexpr std::size_t SYMTAB_TOKENS = 3;
+const constexpr std::size_t LITERAL_TOKENS = 3;             // Unnamed literal, LITTAB lines with a name have one more
+const constexpr std::size_t NAMED_LITERAL_TOKENS = 4;
+const constexpr std::size_t MAX_ADDRESS_DIGITS = 8;
+const constexpr int HEX_BASE = 16;
+const constexpr int32_t END_OF_PROGRAM = std::numeric_limits<int32_t>::max();
+const constexpr double NANOS_PER_MILLI = 1e6;
+const constexpr double BYTES_PER_KILOBYTE = 1024.0;
+const constexpr char* LITTAB_HEADER = "\nName";
+const constexpr char* DASH_LINE = "\n-";
+const constexpr char* LINE_WHITESPACE = " \t\r\n";
+const constexpr char* UNNAMED_LITERAL = "*";
+const constexpr char* OUTPUT_FILE_NAME = "out.lst";
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct SliceCounts
+    {
+        uint64_t listed;
+        uint64_t skipped;
+        double firstRecordMillis;       // Negative when nothing was listed
+    };
+
+    double millisSince(const Clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / NANOS_PER_MILLI;
+    }
+
+    const std::vector<std::string> TOKENS(const std::string& line)
+    {
+        std::vector<std::string> tokens;
+        std::istringstream stream(line);
+        std::string token;
+        while (stream >> token) tokens.push_back(token);
+        return tokens;
+    }
+
+    bool IS_COMPRESSED(const char* filename)
+    {
+        std::filebuf file;
+        return file.open(filename, std::ios::in | std::ios::binary) && DETECT_COMPRESSION(file) != Compression::None;
+    }
+
+    const LITTAB_Entry CREATE_LITTAB_ENTRY(const std::vector<std::string>& tokens)
+    {
+        if (tokens.size() == LITERAL_TOKENS) return LITTAB_Entry{UNNAMED_LITERAL, tokens[0], tokens[1], tokens[2]};
+        return LITTAB_Entry{tokens[0], tokens[1], tokens[2], tokens[3]};
+    }
+
+    int32_t PARSE_ADDRESS(const char* text)
+    {
+        const std::string address = text;
+        if (address.empty() || address.size() > MAX_ADDRESS_DIGITS
+            || !std::all_of(address.begin(), address.end(), [](const char c) {return std::isxdigit(static_cast<unsigned char>(c));})) {
+            std::cerr << "Not a hex address: " << text << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        return std::strtol(text, nullptr, HEX_BASE);        // hexStringToInt would sign extend displacement sized numbers
+    }
+
+    // Records in front of the slice are only scanned for what they leave behind, the BASE an LDB sets and whether LTORG was printed
+    void SKIP_RECORD(const TextRecord& record, DisassemblerContext& context, const LITMAP& litmap)
+    {
+        const std::vector<uint8_t> bytes = DECODE_HEX_BYTES(record.objectCode);
+        for (const InstructionBoundary& boundary : SCAN_INSTRUCTION_LENGTHS(bytes, record.LOCCTR_START, litmap)) skipUnit(bytes, boundary, context);
+    }
+
+    void PRINT_SLICE_STATS(std::ostream& stream, const LazySymbolStats& stats, const bool lazy, const SliceCounts& counts)
+    {
+        stream << "records: " << counts.listed << " listed, " << counts.skipped << " skipped" << std::endl;
+        stream << "symbols: ";
+        if (lazy) stream << stats.blocksLoaded << " of " << stats.blocks << " blocks loaded, ";
+        else stream << "read whole (compressed or not address ordered), ";
+        stream << stats.reads << " reads (" << std::fixed << std::setprecision(1) << stats.bytesRead / BYTES_PER_KILOBYTE << " of "
+        << stats.fileBytes / BYTES_PER_KILOBYTE << " KB), opened in " << std::setprecision(3) << stats.openNanos / NANOS_PER_MILLI << " ms" << std::endl;
+        if (counts.firstRecordMillis >= 0) stream << "first record listed after " << counts.firstRecordMillis << " ms" << std::endl;
+    }
+}
+
+LazySymbolTable::LazySymbolTable(const char* symbolFile) : descriptor(open(symbolFile, O_RDONLY))
+{
+    MemoryScope scope(MemorySubsystem::SymbolTable);
+    TraceSpan span("openLazySymbols");
+    const Clock::time_point start = Clock::now();
+    struct stat status;
+    if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+        std::cerr << "Failed to open file: " << symbolFile << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    stats.fileBytes = status.st_size;
+
+    std::size_t symtabBegin, symtabEnd;
+    readLineAt(0, symtabBegin);                             // SYMTAB header
+    readLineAt(symtabBegin, symtabBegin);
+    if (IS_COMPRESSED(symbolFile) || !readTail(symtabBegin, symtabEnd) || !indexBlocks(symtabBegin, symtabEnd))
+        readWhole(symbolFile);
+    stats.openNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+LazySymbolTable::~LazySymbolTable()
+{
+    close(descriptor);
+}
+
+// Stops at the end of the file, and bytes the previous read already brought in are taken from it, so the line
+// probes of opening and a block starting behind them do not count the same bytes twice
+const std::string LazySymbolTable::readAt(const std::size_t offset, const std::size_t length) const
+{
+    const std::size_t wanted = offset < stats.fileBytes ? std::min<std::size_t>(length, stats.fileBytes - offset) : 0;
+    std::string text;
+    if (offset >= lastReadOffset && offset < lastReadOffset + lastRead.size()) text = lastRead.substr(offset - lastReadOffset, wanted);
+    std::size_t done = text.size();
+    const std::size_t reused = done;
+    text.resize(wanted);
+    while (done < wanted)
+    {
+        const ssize_t count = pread(descriptor, &text[done], wanted - done, offset + done);
+        stats.reads++;
+        if (count <= 0) break;
+        done += count;
+    }
+    stats.bytesRead += done - reused;
+    text.resize(done);
+    lastRead = text;
+    lastReadOffset = offset;
+    return text;
+}
+
+// The rest of the line at offset without its newline, next is where the following line starts
+const std::string LazySymbolTable::readLineAt(const std::size_t offset, std::size_t& next) const
+{
+    std::string line;
+    for (std::size_t probe = offset; probe < stats.fileBytes; probe += LINE_PROBE_BYTES)
+    {
+        const std::string chunk = readAt(probe, LINE_PROBE_BYTES);
+        const std::size_t end = chunk.find('\n');
+        if (end != std::string::npos) {
+            line += chunk.substr(0, end);
+            next = offset + line.size() + 1;
+            return line;
+        }
+        line += chunk;
+    }
+    next = stats.fileBytes;
+    return line;
+}
+
+// Reads back from the end of the file until the LITTAB header and the last SYMTAB line in front of it are both in hand
+bool LazySymbolTable::readTail(const std::size_t symtabBegin, std::size_t& symtabEnd)
+{
+    std::string tail;
+    for (std::size_t tailStart = stats.fileBytes; tailStart > symtabBegin; )
+    {
+        const std::size_t chunkStart = std::max(symtabBegin, tailStart > LAZY_BLOCK_BYTES ? tailStart - LAZY_BLOCK_BYTES : 0);
+        tail = readAt(chunkStart, tailStart - chunkStart) + tail;
+        tailStart = chunkStart;
+
+        const std::size_t header = tail.rfind(LITTAB_HEADER);
+        const std::size_t dashes = header == std::string::npos ? std::string::npos : tail.find('\n', header + 1);
+        if (dashes == std::string::npos || tail.compare(dashes, std::strlen(DASH_LINE), DASH_LINE) != 0) continue;
+        const std::size_t lastSymbolEnd = tail.find_last_not_of(LINE_WHITESPACE, header);
+        const std::size_t lastSymbolLine = lastSymbolEnd == std::string::npos ? std::string::npos : tail.rfind('\n', lastSymbolEnd);
+        if (lastSymbolLine == std::string::npos && tailStart > symtabBegin) continue;
+
+        const std::vector<std::string> lastSymbol = TOKENS(tail.substr(lastSymbolLine + 1, lastSymbolEnd - lastSymbolLine));
+        if (lastSymbol.size() < SYMTAB_TOKENS) return false;
+        lastSymbolAddress = hexStringToInt(lastSymbol[1]);
+        symtabEnd = tailStart + header + 1;
+
+        const std::size_t literals = tail.find('\n', dashes + 1);
+        std::istringstream lines(literals == std::string::npos ? std::string() : tail.substr(literals + 1));
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            const std::vector<std::string> tokens = TOKENS(line);
+            if (tokens.empty()) break;
+            if (tokens.size() != LITERAL_TOKENS && tokens.size() != NAMED_LITERAL_TOKENS) return false;
+            const LITTAB_Entry entry = CREATE_LITTAB_ENTRY(tokens);
+            litmap.insert({hexStringToInt(entry.address), entry});
+        }
+        return true;
+    }
+    return false;
+}
+
+// One line at every block boundary, moved forward past the entries sharing the address of the line it landed in
+bool LazySymbolTable::indexBlocks(const std::size_t symtabBegin, const std::size_t symtabEnd)
+{
+    std::size_t next;
+    const std::vector<std::string> first = TOKENS(readLineAt(symtabBegin, next));
+    if (first.size() < SYMTAB_TOKENS) return false;
+    startAddress = first[1];
+    blockOffsets.push_back(symtabBegin);
+    blockAddresses.push_back(hexStringToInt(first[1]));
+    blocksEnd = symtabEnd;
+
+    for (std::size_t probe = symtabBegin + LAZY_BLOCK_BYTES; probe < symtabEnd; probe += LAZY_BLOCK_BYTES)
+    {
+        readLineAt(probe - 1, next);                        // Rest of the line the probe landed in
+        int32_t runAddress = -1;
+        while (next < symtabEnd)
+        {
+            const std::size_t lineStart = next;
+            const std::vector<std::string> tokens = TOKENS(readLineAt(lineStart, next));
+            if (tokens.size() < SYMTAB_TOKENS) break;       // Blank line in front of LITTAB
+            const int32_t address = hexStringToInt(tokens[1]);
+            if (runAddress >= 0 && address != runAddress) {
+                if (address <= blockAddresses.back()) return false;
+                blockOffsets.push_back(lineStart);
+                blockAddresses.push_back(address);
+                break;
+            }
+            runAddress = address;
+        }
+        probe = std::max(probe, blockOffsets.back());
+    }
+    if (lastSymbolAddress < blockAddresses.back()) return false;
+    loaded.assign(blockOffsets.size(), false);
+    stats.blocks = blockOffsets.size();
+    return true;
+}
+
+void LazySymbolTable::readWhole(const char* symbolFile)
+{
+    const SymbolEntries symbolEntries = FileHandling::readSymbolTableFile(symbolFile);
+    lazy = false;
+    blockOffsets.clear();
+    blockAddresses.clear();
+    loaded.clear();
+    stats.blocks = 0;
+    symmap = CREATE_SYMMAP(symbolEntries);
+    next = symmap.end();
+    litmap = CREATE_LITMAP(symbolEntries);
+    startAddress = symbolEntries.SYMTAB.empty() ? std::string() : symbolEntries.SYMTAB[0].address;
+    lastSymbolAddress = GET_LAST_SYMBOL_ADDRESS(symbolEntries);
+}
+
+// False when an entry lies outside the addresses its block stands for, only checked for ordered reads
+bool LazySymbolTable::readBlock(const std::size_t block, const bool ordered) const
+{
+    MemoryScope scope(MemorySubsystem::SymbolTable);
+    TraceSpan span("readSymbolBlock", block);
+    const std::size_t end = block + 1 < blockOffsets.size() ? blockOffsets[block + 1] : blocksEnd;
+    const int32_t following = block + 1 < blockAddresses.size() ? blockAddresses[block + 1] : lastSymbolAddress + 1;
+    std::istringstream lines(readAt(blockOffsets[block], end - blockOffsets[block]));
+    loaded[block] = true;
+    stats.blocksLoaded++;
+
+    int32_t previous = blockAddresses[block];
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        const std::vector<std::string> tokens = TOKENS(line);
+        if (tokens.empty()) continue;
+        if (tokens.size() < SYMTAB_TOKENS) {
+            std::cerr << "Malformed SYMTAB line: " << line << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        const int32_t address = hexStringToInt(tokens[1]);
+        if (ordered && (address < previous || address >= following)) return false;
+        symmap.insert({address, SYMTAB_Entry{tokens[0], tokens[1], tokens[2]}});
+        previous = address;
+    }
+    return true;
+}
+
+void LazySymbolTable::loadBlock(const std::size_t block) const
+{
+    if (!readBlock(block, true)) loadEveryBlock();
+}
+
+// File order from the first block on, so duplicate addresses resolve like CREATE_SYMMAP
+void LazySymbolTable::loadEveryBlock() const
+{
+    lazy = false;
+    symmap.clear();
+    next = symmap.end();
+    stats.blocksLoaded = 0;
+    for (std::size_t block = 0; block < blockOffsets.size(); block++) readBlock(block, false);
+}
+
+SYMMAP::const_iterator LazySymbolTable::findSymbol(const int address) const
+{
+    if (lazy && address <= lastSymbolAddress && (address < checkedFrom || address >= checkedUntil)) {
+        const std::size_t following = std::upper_bound(blockAddresses.begin(), blockAddresses.end(), address) - blockAddresses.begin();
+        if (following > 0 && !loaded[following - 1]) loadBlock(following - 1);
+        checkedFrom = following > 0 ? blockAddresses[following - 1] : std::numeric_limits<int32_t>::min();
+        checkedUntil = following < blockAddresses.size() ? blockAddresses[following] : lastSymbolAddress + 1;
+    }
+    // fillGap asks for every address of a gap in turn, those all fall in front of the same entry (or past the last one)
+    const bool sameGap = (next == symmap.end() || address <= next->first) && (next == symmap.begin() || std::prev(next)->first < address);
+    if (!sameGap) next = symmap.lower_bound(address);
+    return next != symmap.end() && next->first == address ? next : symmap.end();
+}
+
+// Expects argv[1] to be the object file, argv[2] the symbol file and optionally argv[3] and argv[4] the first and last address in hex
+int runSliceMode(const int argc, const char* argv[])
+{
+    const Clock::time_point start = Clock::now();
+    const char* objectFile = argv[INPUT_FILE_ARG_NUMBER];
+    InputFile inputFile                     = FileHandling::openFile(objectFile);
+    const bool binary                       = STARTS_AS_BINARY_OBJECT(inputFile);
+    const std::string programName           = binary ? std::string() : FileHandling::getProgramName(inputFile);
+    if (binary || LEADS_INTO_CONTROL_SECTIONS(inputFile)) {     // The scan for sections is rewound, the records are read below
+        std::cerr << "--slice lists text object files with a single control section only: " << objectFile << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    const int32_t first = argc > FIRST_ADDRESS_ARG_NUMBER ? PARSE_ADDRESS(argv[FIRST_ADDRESS_ARG_NUMBER]) : 0;
+    const int32_t last = argc > LAST_ADDRESS_ARG_NUMBER ? PARSE_ADDRESS(argv[LAST_ADDRESS_ARG_NUMBER]) : END_OF_PROGRAM;
+    if (last < first) {
+        std::cerr << "Last address of the slice comes before the first" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    const LazySymbolTable symbols           (argv[SYMBOL_FILE_ARG_NUMBER]);
+    if (symbols.getStartAddress().empty()) {
+        std::cerr << "Symbol file has no SYMTAB entries: " << argv[SYMBOL_FILE_ARG_NUMBER] << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    std::ofstream outputFile                (OUTPUT_FILE_NAME);
+    const REGMAP registers                  = REGISTERS();
+    const Parser parser;
+
+    std::istringstream recordStream;        // Holds the record being listed, the engine reads it like the object file
+    ListingSink listing                     (outputFile, symbols);
+    DisassemblerContext                     context{recordStream, outputFile, listing, registers, symbols, parser, INITIAL_BASE, false};
+    listing.start(programName, symbols.getStartAddress());
+
+    SliceCounts counts{0, 0, -1};
+    int32_t lastTextSectionEnd = first;
+    int32_t recordsEnd = 0;                 // End of the last record read, listed or not
+    TextRecord record = FileHandling::readTextRecord(inputFile);
+    for (; record.sectionFound && record.LOCCTR_START <= last; record = FileHandling::readTextRecord(inputFile))
+    {
+        if (record.LOCCTR_START + record.textSectionSize <= first) {
+            SKIP_RECORD(record, context, symbols.getLitmap());
+            recordsEnd = record.LOCCTR_START + record.textSectionSize;
+            counts.skipped++;
+            continue;
+        }
+        TraceSpan span("sliceRecord", record.LOCCTR_START);
+        fillGap(record.LOCCTR_START - lastTextSectionEnd, lastTextSectionEnd, symbols, context, last);
+        recordStream.clear();
+        recordStream.str(record.objectCode);
+        lastTextSectionEnd = recordsEnd = recurseTextSection(context, record.textSectionSize, record.LOCCTR_START);
+        if (!counts.listed++) counts.firstRecordMillis = millisSince(start);
+    }
+    // Past the last record the default listing reserves up to lastSymbolAddress bytes after the end of that record
+    const int32_t gapEnd = record.sectionFound ? record.LOCCTR_START : recordsEnd + symbols.getLastSymbolAddress();
+    fillGap(gapEnd - lastTextSectionEnd, lastTextSectionEnd, symbols, context, last);
+    listing.finish(programName);
+
+    PRINT_SLICE_STATS(std::cerr, symbols.getStats(), symbols.isLazy(), counts);
+    return FileHandling::close(inputFile, outputFile);
+}
@@ -0,0 +1,74 @@
+#ifndef LAZY_SYMBOLS_H
+#define LAZY_SYMBOLS_H
+
+#include "symbol_table.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define LAZY_BLOCK_BYTES 16384
+
+struct LazySymbolStats
+{
+    uint64_t reads;                 // pread calls against the symbol file
+    uint64_t bytesRead;
+    uint64_t fileBytes;
+    std::size_t blocks;
+    std::size_t blocksLoaded;
+    uint64_t openNanos;             // Header, LITTAB and block index
+};
+
+/*
+ *  The SYMTAB of a plain text symbol file read one block of about LAZY_BLOCK_BYTES at a time, as lookups reach it.
+ *  Opening only reads the header, the LITTAB at the end of the file and the first address of every block. Lookups are
+ *  const like on every SymbolProvider, the maps they fill are not, so one table must not be shared between threads.
+ *  Compressed files, and SYMTABs found not to be address ordered, are read whole instead.
+ */
+class LazySymbolTable : public SymbolProvider
+{
+    public:
+        explicit LazySymbolTable(const char* symbolFile);
+        ~LazySymbolTable();
+        LazySymbolTable(const LazySymbolTable&) = delete;
+        LazySymbolTable& operator=(const LazySymbolTable&) = delete;
+        bool hasSymbol(const int address) const override {return findSymbol(address) != symmap.end();}
+        const std::string getSymbol(const int address) const override {return findSymbol(address)->second.symbol;}
+        bool hasLiteral(const int address) const override {return litmap.count(address);}
+        const LITTAB_Entry getLiteral(const int address) const override {return litmap.find(address)->second;}
+        const LITMAP& getLitmap() const {return litmap;}
+        const std::string& getStartAddress() const {return startAddress;}
+        int getLastSymbolAddress() const {return lastSymbolAddress;}
+        bool isLazy() const {return lazy;}
+        const LazySymbolStats& getStats() const {return stats;}
+    private:
+        const std::string readAt(const std::size_t offset, const std::size_t length) const;
+        const std::string readLineAt(const std::size_t offset, std::size_t& next) const;
+        bool readTail(const std::size_t symtabBegin, std::size_t& symtabEnd);
+        bool indexBlocks(const std::size_t symtabBegin, const std::size_t symtabEnd);
+        void readWhole(const char* symbolFile);
+        bool readBlock(const std::size_t block, const bool ordered) const;
+        void loadBlock(const std::size_t block) const;
+        void loadEveryBlock() const;
+        SYMMAP::const_iterator findSymbol(const int address) const;
+
+        int descriptor;
+        mutable bool lazy = true;
+        std::string startAddress;
+        int lastSymbolAddress = 0;
+        std::vector<std::size_t> blockOffsets;  // Where every block starts, the last one ends at blocksEnd
+        std::vector<int32_t> blockAddresses;    // Address of the first entry of every block, strictly increasing
+        std::size_t blocksEnd = 0;
+        mutable std::vector<bool> loaded;
+        mutable int32_t checkedFrom = 0;        // Addresses of the block the last lookup landed in, already loaded
+        mutable int32_t checkedUntil = 0;
+        mutable SYMMAP symmap;
+        mutable SYMMAP::const_iterator next = symmap.end();     // First entry at or after the last address looked up
+        LITMAP litmap;
+        mutable std::string lastRead;           // What the previous readAt returned, from lastReadOffset on
+        mutable std::size_t lastReadOffset = 0;
+        mutable LazySymbolStats stats{0, 0, 0, 0, 0, 0};
+};
+
+int runSliceMode(const int argc, const char* argv[]);
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ *  @brief
+ *          Finds every instruction boundary of a text record up front from a table of lengths
+ *
+ *  parseInstruction only learns where the next instruction starts once it has decoded the current one. The length
+ *  of a SIC/XE instruction is fixed by its first byte (format 2 opcodes) and the e bit of its second (format 3 or 4),
+ *  so a 256 entry table gives the length an instruction would have at every byte of the record in one pass that has
+ *  no branches and no dependence between iterations, which leaves the compiler free to vectorize it. Walking the
+ *  offsets afterwards is one add per instruction, with the LITTAB addresses inside the record as forced boundaries.
+ */
+
+#include "length_scan.hpp"
+#include "memory_accounting.hpp"
+#include "instructions.hpp"
+#include "byte_operations.hpp"
+#include "disassembly.hpp"
+#include <array>
+
+const constexpr int BYTE_VALUES = 256;
+const constexpr int HEX_CHARS_PER_BYTE = 2;
+const constexpr int HIGH_NIBBLE_SHIFT = 4;
+const constexpr int NI_FLAG_VALUES = 4;
+const constexpr int E_FLAG_SHIFT = 4;       // e is the low bit of the second byte's high nibble
+const constexpr int E_FLAG_BIT = 0x01;
+const constexpr uint8_t FORMAT2_LENGTH = 2;
+const constexpr uint8_t FORMAT3_LENGTH = 3;
+
+namespace
+{
+    using ByteTable = std::array<uint8_t, BYTE_VALUES>;
+
+    // The parser masks off ni before looking the opcode up, so all four ni variants of a format 2 opcode are format 2
+    const ByteTable BUILD_LENGTH_TABLE()
+    {
+        const InstructionConstants constants;
+        ByteTable table;
+        table.fill(FORMAT3_LENGTH);         // Unknown opcodes are read as format 3/4 by the parser as well
+        for (int i = 0; i < NUM_INSTRUCTIONS; i++)
+        {
+            if (!constants.format2[i]) continue;
+            const int opCode = convertStringToHex(constants.ops[i]);
+            for (int ni = 0; ni < NI_FLAG_VALUES; ni++) table[opCode | ni] = FORMAT2_LENGTH;
+        }
+        return table;
+    }
+
+    // Anything that is not a hex digit decodes as zero, same as a short read would
+    const ByteTable BUILD_NIBBLE_TABLE()
+    {
+        ByteTable table;
+        table.fill(0);
+        for (int digit = 0; digit < 10; digit++) table['0' + digit] = digit;
+        for (int digit = 0; digit < 6; digit++) table['A' + digit] = table['a' + digit] = 10 + digit;
+        return table;
+    }
+
+    const ByteTable& LENGTH_TABLE()
+    {
+        static const ByteTable table = BUILD_LENGTH_TABLE();
+        return table;
+    }
+
+    const ByteTable& NIBBLE_TABLE()
+    {
+        static const ByteTable table = BUILD_NIBBLE_TABLE();
+        return table;
+    }
+
+    /* Length of an instruction starting at every byte, as if one did. Only the walk decides which of these are real */
+    std::vector<uint8_t> SPECULATE_LENGTHS(const std::vector<uint8_t>& bytes)
+    {
+        const ByteTable& lengths = LENGTH_TABLE();
+        const std::size_t size = bytes.size();
+        std::vector<uint8_t> speculative(size);
+        for (std::size_t i = 0; i + 1 < size; i++)
+        {
+            const uint8_t length = lengths[bytes[i]];
+            speculative[i] = length + ((length == FORMAT3_LENGTH) & (bytes[i + 1] >> E_FLAG_SHIFT) & E_FLAG_BIT);
+        }
+        if (size) speculative[size - 1] = lengths[bytes[size - 1]];    // No second byte to carry an e bit
+        return speculative;
+    }
+}
+
+std::vector<uint8_t> DECODE_HEX_BYTES(const std::string& hex)
+{
+    const ByteTable& nibbles = NIBBLE_TABLE();
+    const std::size_t size = hex.size() / HEX_CHARS_PER_BYTE;
+    const unsigned char* digits = reinterpret_cast<const unsigned char*>(hex.data());
+    std::vector<uint8_t> bytes(size);
+    for (std::size_t i = 0; i < size; i++)
+        bytes[i] = (nibbles[digits[2 * i]] << HIGH_NIBBLE_SHIFT) | nibbles[digits[2 * i + 1]];
+    return bytes;
+}
+
+/* Offsets of every unit in the record, a literal in LITTAB takes its own length instead of the table's */
+std::vector<InstructionBoundary> SCAN_INSTRUCTION_LENGTHS(const std::vector<uint8_t>& bytes, const int LOCCTR_START, const LITMAP& litmap)
+{
+    MemoryScope scope(MemorySubsystem::Parser);
+    const std::vector<uint8_t> speculative = SPECULATE_LENGTHS(bytes);
+    const int size = bytes.size();
+    std::vector<InstructionBoundary> boundaries;
+    LITMAP::const_iterator literal = litmap.lower_bound(LOCCTR_START);
+    int offset = 0;
+    while (offset < size)
+    {
+        while (literal != litmap.end() && literal->first < LOCCTR_START + offset) ++literal;   // Skipped over inside an instruction
+        if (literal != litmap.end() && literal->first == LOCCTR_START + offset) {
+            boundaries.push_back(InstructionBoundary{offset, getLiteralBytes(literal->second), &literal->second});
+        }
+        else {
+            boundaries.push_back(InstructionBoundary{offset, speculative[offset], nullptr});
+        }
+        offset += boundaries.back().length;
+    }
+    return boundaries;
+}
@@ -0,0 +1,20 @@
+#ifndef LENGTH_SCAN_H
+#define LENGTH_SCAN_H
+
+#include "symbol_table.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Where one unit of a text record starts and how many bytes it covers */
+struct InstructionBoundary
+{
+    int offset;                     // Bytes from the start of the record
+    int length;
+    const LITTAB_Entry* literal;    // Points into LITMAP when a literal forced this boundary, nullptr for instructions
+};
+
+std::vector<uint8_t> DECODE_HEX_BYTES(const std::string& hex);
+std::vector<InstructionBoundary> SCAN_INSTRUCTION_LENGTHS(const std::vector<uint8_t>& bytes, const int LOCCTR_START, const LITMAP& litmap);
+
+#endif
@@ -10,6 +10,32 @@
  * - input handler
  * - output handler
  * - parser : depends on byte_operations.hpp and instructions.hpp
+ * - disassembly : the engine that walks each text section
+ * - pipeline : the same engine split into threaded stages (--pipeline)
+ * - control flow : recursive descent from the entry point instead of a linear sweep (--flow)
+ * - control sections : object files with several H...E sections or EXTDEF/EXTREF records
+ * - simulator : runs the program on a SIC/XE model built on the same decoder (--simulate)
+ * - delta : compact listing of what changed between two builds (--delta)
+ * - bundle : many programs packed into one mapped file (--pack, --bundle)
+ * - symbol cache : the symbol file compiled once to <file>.symc and mapped on later runs
+ * - daemon : keeps tables warm and serves listings over a Unix socket (--serve, --client)
+ * - watch : re-lists the .obj/.sym pairs of a directory as inotify reports them changed (--watch dir)
+ * - trace : optional Chrome trace of the hot path spans (--trace file.json before anything else)
+ * - compressed input : gzip and zstd object/symbol files are read as they are, no unpacking first
+ * - sinks : extra views fed by the same decode pass as the listing (obj sym xref=file stats=- map=file ...)
+ * - symbol index : SYMTAB/LITTAB and operand references of many programs in one mapped file (--index, --query)
+ * - data regions : linear sweep that writes unreached tables as BYTE/WORD instead of decoding them (--data)
+ * - length scan : every instruction boundary of a text record from a length table, before any decoding
+ * - parallel output : records rendered side by side and pwritten at known offsets of a preallocated out.lst (--pwrite)
+ * - operand renderers : operand column rendered by a template instance picked from the nixbpe bits (--bench-operands)
+ * - render cache : opcode and operand columns memoized by instruction word and BASE, measured in --bench-operands only
+ * - symbol batch : labels of a whole record resolved by one merge-join against SYMTAB/LITTAB in an array (--bench-symbols)
+ * - out of core : address ordered windows with only their slice of the compiled symbol file resident, under a heap cap (--out-of-core)
+ * - lazy symbols : SYMTAB read a block at a time as lookups reach it, for listing part of a program (--slice)
+ * - instruction profile : opcode, format and nixbpe histograms of many programs from the length scan, no listing (--profile)
+ * - checked decode : batch listing that reports malformed symbol lines and T records and skips them instead of aborting (--checked)
+ * - memory accounting : heap live/peak bytes charged to the symbol table, parser and output subsystems (--memory)
+ * - binary object : compact object format with raw payload bytes, converted both ways and read natively (--to-binary, --to-text)
  * See cpp file of each for more details in each respective area
  ******************************************************************************/
 
@@ -17,142 +43,142 @@
 #include "output_handler.hpp"
 #include "disassembly.hpp"
 #include "parser.hpp"
-#include "byte_operations.hpp"
+#include "pipeline.hpp"
+#include "control_flow.hpp"
+#include "control_sections.hpp"
+#include "simulator.hpp"
+#include "delta.hpp"
+#include "bundle.hpp"
+#include "symbol_cache.hpp"
+#include "daemon.hpp"
+#include "watch.hpp"
+#include "out_of_core.hpp"
+#include "checked_decode.hpp"
+#include "lazy_symbols.hpp"
+#include "instruction_profile.hpp"
+#include "trace.hpp"
+#include "sinks.hpp"
+#include "symbol_index.hpp"
+#include "data_regions.hpp"
+#include "operand_renderers.hpp"
+#include "parallel_output.hpp"
+#include "binary_object.hpp"
+#include "symbol_batch.hpp"
+#include "memory_accounting.hpp"
 #include <fstream>
 #include <iostream>
-#include <math.h>
+#include <map>
 
 ////////////////////////////////////////////////////////////
-using PrintToConsole = void;
+using ModeRunner = int (*)(const int argc, const char* argv[]);
 const constexpr int INPUT_FILE_ARG_NUMBER = 1;
 const constexpr int SYMBOL_FILE_ARG_NUMBER = 2;
-const constexpr int ONE_BYTE = 1;
-const constexpr int NO_HALF_BYTE = 0;
-const constexpr int NO_SYMBOL = 0;
-const constexpr int PLUS_HALF_BYTE = 1;
-const constexpr int NUMBER_OF_HEX_CHARS_IN_ONE_BYTE = 2;
+const constexpr int FIRST_SINK_ARG_NUMBER = 3;
+const constexpr int MODE_ARG_NUMBER = 1;
+const constexpr int TRACE_FILE_ARG_NUMBER = 2;
+const constexpr int TRACE_ARG_COUNT = 2;
+const constexpr char* TRACE_FLAG = "--trace";
+const constexpr char* MEMORY_FLAG = "--memory";
 const constexpr int INITIAL_BASE = 0;
 const constexpr char* OUTPUT_FILE_NAME = "out.lst";
-const constexpr bool FOUND_SYMBOL(int bytes) {return bytes > 0;}
-const constexpr bool STILL_MORE_BYTES(int bytes) {return bytes > 0;}
-const constexpr bool IS_POSITIVE(int number) {return number > 0;}
-const int BYTES_IN_HEX_STRING(const std::string& hex_str) {return hex_str.size() / NUMBER_OF_HEX_CHARS_IN_ONE_BYTE;}
 ///////////////////////////////////////////////////////////
 
-/* Call our parser for all our info, print it, and return how many bytes we traversed */
-ParsingResult parseInstruction(std::ifstream& inputFile, const Parser& parser)
+/* Alternative ways of running the disassembler, selected by passing the flag before the usual arguments */
+const std::map<std::string, ModeRunner> MODES
 {
-    const std::string firstTwelveBits =           FileHandling::readInBytes(inputFile, ONE_BYTE, PLUS_HALF_BYTE);
-    const std::string opCode =                    parser.determineOpCode(firstTwelveBits);
-    const AddressingFormat format =               parser.determineFormat(firstTwelveBits);
-    const AddressingMode addresingMode =          parser.determineAddressingMode(firstTwelveBits);
-    const bool isIndexed =                        parser.isIndexed(firstTwelveBits);
-    const TargetAddressMode targetAddressMode =   parser.determineTargetAddressMode(firstTwelveBits);
-    const std::string objectCode =                parser.readInFullInstruction(inputFile, firstTwelveBits, format);
-    const ParsedInstruction parsedInstruction     {opCode, format, addresingMode, isIndexed, targetAddressMode, objectCode};
-    return ParsingResult                          {parsedInstruction, BYTES_IN_HEX_STRING(objectCode)} ;  // Return the total number of bytes traversed
-}
+    {"--pipeline", runPipelineMode},
+    {"--flow", runControlFlowMode},
+    {"--sections", runControlSectionsMode},
+    {"--simulate", runSimulatorMode},
+    {"--delta", runDeltaMode},
+    {"--pack", runPackMode},
+    {"--bundle", runBundleMode},
+    {"--serve", runDaemonMode},
+    {"--client", runClientMode},
+    {"--watch", runWatchMode},
+    {"--index", runIndexMode},
+    {"--query", runQueryMode},
+    {"--data", runDataRegionMode},
+    {"--bench-operands", runOperandBenchmarkMode},
+    {"--pwrite", runParallelOutputMode},
+    {"--to-binary", runToBinaryMode},
+    {"--to-text", runToTextMode},
+    {"--bench-symbols", runSymbolBenchmarkMode},
+    {"--out-of-core", runOutOfCoreMode},
+    {"--checked", runCheckedMode},
+    {"--slice", runSliceMode},
+    {"--profile", runProfileMode}
+};
 
-// This function will use the current state variables like LOCCTR, pc counter, and the last read instruction
-// to be able to output to our text file the correct information
-PrintToConsole generateOutput(const DisassemblerState& state, const int bytesReadIn, std::ofstream& outputFile)
+// Set up input/output files and traverse input instructions, any kind=file arguments after the two files add sinks.
+// The object is opened once: the first byte tells a binary object apart and a scan of the records after the header,
+// rewound afterwards, tells whether it has control sections. Only those two hand the file over to be read again
+int runDefaultMode(const int argc, const char* argv[])
 {
-    const AddressingInfo ADDRESSMODES   {state.instruction.addresingMode, state.instruction.targetAddressMode, state.instruction.isIndexed};
-    const OffsetInfo  OFFSETS           {state.BASE, state.LOCCTR + bytesReadIn};
-    const std::string LOCCTR_OUTPUT     = CREATE_LOCCTR_OUTPUT(state.LOCCTR);
-    const std::string SYMBOL_OUTPUT     = CREATE_SYMBOL_OUTPUT(state.LOCCTR, state.symmap, state.litmap);
-    const std::string OPCODE_OUTPUT     = CREATE_OPCODE_OUTPUT(state.instruction.opCode, state.instruction.format);
-    const std::string ADDRESS_OUTPUT    = CREATE_ADDRESS_OUTPUT(ADDRESSMODES, OFFSETS, state);
-    const std::string OBJECT_OUTPUT     = CREATE_OBJECT_OUTPUT(state.instruction.objectCode);
-    outputFile                          << Output{LOCCTR_OUTPUT, SYMBOL_OUTPUT, OPCODE_OUTPUT, ADDRESS_OUTPUT, OBJECT_OUTPUT};
-}
+    InputFile inputFile                     = FileHandling::openFile(argv[INPUT_FILE_ARG_NUMBER]);
+    if (STARTS_AS_BINARY_OBJECT(inputFile)) {
+        inputFile.close();
+        return runBinaryObjectMode(argc, argv);
+    }
+    const std::string programName           = FileHandling::getProgramName(inputFile);
+    if (LEADS_INTO_CONTROL_SECTIONS(inputFile)) {
+        inputFile.close();
+        if (argc > FIRST_SINK_ARG_NUMBER) std::cerr << "Extra sinks are only fed by single section programs, ignoring them" << std::endl;
+        return runControlSectionsMode(argc, argv);
+    }
 
-// The disassembler will behave differently if it's a symbol instead of an instruction
-// here it will have to look for an entry in the table and find and output the appropriate information
-// like the handle instruction function it will also have to keep track of the amount of bytes traversed
-const int handleSymbol(DisassemblerContext& context, const int LOCCTR)
-{
-    const LITTAB_Entry entry = context.litmap.find(LOCCTR)->second;
-    const int labelBytes = std::stoi(entry.length)/NUMBER_OF_HEX_CHARS_IN_ONE_BYTE;
-    FileHandling::readInBytes(context.inputFile, labelBytes, NO_HALF_BYTE);
-    outputSymbol(context, LOCCTR, entry, context.outputFile);
-    return labelBytes;
+    std::ofstream outputFile                (OUTPUT_FILE_NAME);       
+    const CompiledSymbolTable symbols       (argv[SYMBOL_FILE_ARG_NUMBER]);
+    const REGMAP registers                  = REGISTERS();
+    const Parser parser;
+
+    ListingSink listing                     (outputFile, symbols);
+    FanoutSink sinks;
+    sinks.attach(listing);
+    ATTACH_SINKS(sinks, argc, argv, FIRST_SINK_ARG_NUMBER, symbols);
+
+    sinks.start(programName, symbols.getStartAddress());
+    DisassemblerContext                     context{inputFile, outputFile, sinks, registers, symbols, parser, INITIAL_BASE, false};
+    disassembleTextSections(context, symbols.getLastSymbolAddress());
+    sinks.finish(programName);
+    return FileHandling::close(inputFile, outputFile); 
 }
 
-// If no symbol is found will go through with our default behaviour which is to parsing instruction and output the disassembled code
-const int handleInstruction(DisassemblerContext& context, const int LOCCTR)
+// A corrupt compressed input ends a single run the way a missing file does
+int runMode(const int argc, const char* argv[])
 {
-    const ParsingResult parseResult = parseInstruction(context.inputFile, context.parser);
-    const DisassemblerState state = DisassemblerState{context.baseAddress, LOCCTR, parseResult.instruction, context.registers, context.symmap, context.litmap};
-    generateOutput(state, parseResult.bytesReadIn, context.outputFile); 
-    FileHandling::handleBaseDirective(parseResult.instruction.opCode, parseResult.instruction.objectCode, context);
-    return parseResult.bytesReadIn;
-}
- 
-// This recursive function will allow us to avoid mutable state while looping through text file.
-// It will Naturally keep track of the LOCCTR because the handle symbol and handle instruction functions return bytes traversed
-int32_t recurseTextSection(DisassemblerContext& context, const int textBytesRemaining, const int LOCCTR) 
-{  
-    if (STILL_MORE_BYTES(textBytesRemaining)) {
-        int bytesTraversed;
-        if (checkForSymbol(LOCCTR, context.litmap)) {
-            bytesTraversed = handleSymbol(context, LOCCTR);
-        }
-        else {
-            bytesTraversed = handleInstruction(context, LOCCTR);
-        }
-        return recurseTextSection(context, textBytesRemaining-bytesTraversed, LOCCTR+bytesTraversed);
+    try {
+        if (argc > MODE_ARG_NUMBER && MODES.count(argv[MODE_ARG_NUMBER]))
+            return MODES.at(argv[MODE_ARG_NUMBER])(argc-MODE_ARG_NUMBER, argv+MODE_ARG_NUMBER); // Shift so modes see the usual argument layout
+        return runDefaultMode(argc, argv);
+    }
+    catch (const CorruptInputError& error) {
+        std::cerr << error.what() << std::endl;
+        return EXIT_FAILURE;        // Returned, not exited, so a --trace file is still written
     }
-    else return LOCCTR; 
 }
 
-int getNextSymbolGap(const int start, const int end, const SYMMAP& symmap)
+// --trace file.json may come before anything else, the rest of the command line runs exactly as it would without it
+int runTraced(const int argc, const char* argv[])
 {
-    int i = 1;
-    while (symmap.find(i+start) == symmap.end())
-    {
-        if (i == end) 
-            return i;
-        i++;
+    if (argc > TRACE_FILE_ARG_NUMBER && std::string(argv[MODE_ARG_NUMBER]) == TRACE_FLAG) {
+        START_TRACE(argv[TRACE_FILE_ARG_NUMBER]);
+        const int result = runMode(argc-TRACE_ARG_COUNT, argv+TRACE_ARG_COUNT);
+        WRITE_TRACE();
+        return result;
     }
-    return i;
+    return runMode(argc, argv);
 }
 
-void fillGap(const int sectionGap, const int lastTextSectionEnd, const SYMMAP& symmap, const DisassemblerContext& context)
-{
-    int i = 0;
-    while (i < sectionGap)
-    {
-        if (symmap.find(i+lastTextSectionEnd) !=  symmap.end()) 
-            HANDLE_RESB_DIRECTIVE(getNextSymbolGap(i+lastTextSectionEnd, sectionGap-i, symmap), lastTextSectionEnd+i, context);
-        i++;
-    } 
-} 
-
-// Set up input/output files and traverse input instructions
+// --memory goes first of all and prints the heap accounts when the program exits, even through an error exit
 int main(const int argc, const char* argv[])
 {
-    std::ifstream inputFile                 = FileHandling::openFile(argv[INPUT_FILE_ARG_NUMBER]);
-    std::ofstream outputFile                (OUTPUT_FILE_NAME);       
-    const SymbolEntries symbolEntries       = printHeader(argv, outputFile);          
-    const LITMAP litmap                     = CREATE_LITMAP(symbolEntries);
-    const SYMMAP symmap                     = CREATE_SYMMAP(symbolEntries);
-    const REGMAP registers                  = REGISTERS();
-    const Parser parser;
-
-    DisassemblerContext                     context{inputFile, outputFile, registers, symmap, litmap, parser, INITIAL_BASE, false};
-
-    int32_t lastTextSectionEnd = 0;
-    while (!inputFile.eof()) {
-        const TextSectionDescriptor descriptor = FileHandling::locateTextSection(inputFile);
-        const int32_t sectionGap = descriptor.LOCCTR_START - lastTextSectionEnd; 
-        fillGap(sectionGap, lastTextSectionEnd, symmap, context);
-        if (descriptor.sectionFound) lastTextSectionEnd = recurseTextSection(context, descriptor.textSectionSize, descriptor.LOCCTR_START);   
-    }   
-    fillGap(hexStringToInt(symbolEntries.SYMTAB[symbolEntries.SYMTAB.size()-1].address), lastTextSectionEnd, symmap, context);
-
-    FileHandling::printEnd(outputFile, FileHandling::getProgramName(argv[INPUT_FILE_ARG_NUMBER]));
-    return FileHandling::close(inputFile, outputFile); 
+    if (argc > MODE_ARG_NUMBER && std::string(argv[MODE_ARG_NUMBER]) == MEMORY_FLAG) {
+        ENABLE_MEMORY_ACCOUNTING();
+        REPORT_MEMORY_AT_EXIT();
+        return runTraced(argc-MODE_ARG_NUMBER, argv+MODE_ARG_NUMBER);
+    }
+    return runTraced(argc, argv);
 }
 
 // |*           * |
\ No newline at end of file
@@ -0,0 +1,227 @@
+/*
+ *  @brief
+ *          Heap accounting per subsystem, kept by the replaced global operator new and delete once it is enabled
+ *
+ *  Until ENABLE_MEMORY_ACCOUNTING is called the replacements are plain malloc and free behind one flag test, so a
+ *  run that never asks for the accounts pays for nothing else. Once enabled, every allocation is recorded in a side
+ *  table with its size and the subsystem the allocating thread was in, so delete can take the bytes off the right
+ *  account even when another subsystem frees them. Blocks allocated before that are not in the table and are left
+ *  alone when freed. Each account tracks live bytes, the peak of live bytes and how much was ever allocated, which
+ *  tells how memory splits between symbol tables, decoded instructions and output buffering on a large input.
+ *
+ *  Code declares what it is working for with a MemoryScope, the same way TraceSpan marks a span. --memory before
+ *  the usual arguments enables the accounts and prints them with the process peak RSS to stderr when the program
+ *  exits. --out-of-core and the operand benchmark enable them for themselves.
+ */
+
+#include "memory_accounting.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <sys/resource.h>
+
+const constexpr int COLUMN_WIDTH = 14;
+const constexpr double BYTES_PER_KILOBYTE = 1024.0;
+const constexpr std::size_t ALLOCATION_SHARDS = 16;         // Threads allocating at once rarely wait on the same lock
+const constexpr int ALIGNMENT_BITS = 4;                     // malloc hands out 16 byte aligned blocks, the low bits never differ
+
+namespace
+{
+    struct Allocation
+    {
+        std::size_t size;
+        MemorySubsystem subsystem;
+    };
+
+    // The table's own memory comes straight from malloc, so recording an allocation never recurses into operator new
+    template<typename T>
+    struct MallocAllocator
+    {
+        using value_type = T;
+        MallocAllocator() = default;
+        template<typename U> MallocAllocator(const MallocAllocator<U>&) {}
+        T* allocate(const std::size_t count)
+        {
+            void* memory = std::malloc(count * sizeof(T));
+            if (!memory) throw std::bad_alloc();
+            return static_cast<T*>(memory);
+        }
+        void deallocate(T* memory, const std::size_t) {std::free(memory);}
+    };
+
+    template<typename T, typename U> bool operator==(const MallocAllocator<T>&, const MallocAllocator<U>&) {return true;}
+    template<typename T, typename U> bool operator!=(const MallocAllocator<T>&, const MallocAllocator<U>&) {return false;}
+
+    struct AllocationShard
+    {
+        std::mutex lock;
+        std::unordered_map<void*, Allocation, std::hash<void*>, std::equal_to<void*>, MallocAllocator<std::pair<void* const, Allocation>>> live;
+    };
+
+    // Zero initialised before any constructor runs, operator new is called during static initialisation too
+    struct Account
+    {
+        std::atomic<int64_t> liveBytes;
+        std::atomic<int64_t> peakBytes;
+        std::atomic<uint64_t> allocations;
+        std::atomic<uint64_t> allocatedBytes;
+    };
+
+    Account accounts[MEMORY_SUBSYSTEMS];
+    std::atomic<bool> accounting(false);
+    AllocationShard* shards = nullptr;     // Never destroyed, blocks are still freed while statics are torn down
+    thread_local MemorySubsystem currentSubsystem = MemorySubsystem::Other;
+    thread_local uint64_t threadAllocations = 0;
+
+    const char* const SUBSYSTEM_NAMES[MEMORY_SUBSYSTEMS] {"other", "symbol table", "parser", "output"};
+
+    void charge(const MemorySubsystem subsystem, const std::size_t size)
+    {
+        Account& account = accounts[static_cast<int>(subsystem)];
+        const int64_t live = account.liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+        int64_t peak = account.peakBytes.load(std::memory_order_relaxed);
+        while (live > peak && !account.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+        account.allocations.fetch_add(1, std::memory_order_relaxed);
+        account.allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    AllocationShard& shardOf(void* memory)
+    {
+        return shards[(reinterpret_cast<std::uintptr_t>(memory) >> ALIGNMENT_BITS) % ALLOCATION_SHARDS];
+    }
+
+    void record(void* memory, const std::size_t size)
+    {
+        threadAllocations++;
+        AllocationShard& shard = shardOf(memory);
+        {
+            std::lock_guard<std::mutex> guard(shard.lock);
+            shard.live[memory] = Allocation{size, currentSubsystem};
+        }
+        charge(currentSubsystem, size);
+    }
+
+    void forget(void* memory)
+    {
+        AllocationShard& shard = shardOf(memory);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        const auto allocation = shard.live.find(memory);
+        if (allocation == shard.live.end()) return;        // Allocated before accounting was enabled
+        accounts[static_cast<int>(allocation->second.subsystem)].liveBytes.fetch_sub(allocation->second.size, std::memory_order_relaxed);
+        shard.live.erase(allocation);
+    }
+
+    void printAtExit()
+    {
+        PRINT_MEMORY_REPORT(std::cerr);
+    }
+
+    double kilobytes(const int64_t bytes)
+    {
+        return bytes / BYTES_PER_KILOBYTE;
+    }
+}
+
+MemoryScope::MemoryScope(const MemorySubsystem subsystem) : previous(currentSubsystem)
+{
+    currentSubsystem = subsystem;
+}
+
+MemoryScope::~MemoryScope()
+{
+    currentSubsystem = previous;
+}
+
+/* Only the first call does anything, the shards are set up before the flag lets any allocation reach them */
+void ENABLE_MEMORY_ACCOUNTING()
+{
+    static std::once_flag enabled;
+    std::call_once(enabled, []()
+    {
+        AllocationShard* table = static_cast<AllocationShard*>(std::malloc(sizeof(AllocationShard) * ALLOCATION_SHARDS));
+        if (!table) throw std::bad_alloc();
+        for (std::size_t shard = 0; shard < ALLOCATION_SHARDS; shard++) new (table + shard) AllocationShard();
+        shards = table;
+        accounting.store(true, std::memory_order_release);
+    });
+}
+
+MemoryUsage MEMORY_USAGE(const MemorySubsystem subsystem)
+{
+    const Account& account = accounts[static_cast<int>(subsystem)];
+    return MemoryUsage{account.liveBytes.load(), account.peakBytes.load(), account.allocations.load(), account.allocatedBytes.load()};
+}
+
+int64_t LIVE_HEAP_BYTES()
+{
+    int64_t live = 0;
+    for (const Account& account : accounts) live += account.liveBytes.load(std::memory_order_relaxed);
+    return live;
+}
+
+/* Peaks are per subsystem and need not line up in time, so they can add up to more than the process ever held */
+void PRINT_MEMORY_REPORT(std::ostream& stream)
+{
+    stream << std::left << std::setw(COLUMN_WIDTH) << "subsystem" << std::right << std::setw(COLUMN_WIDTH) << "live(KB)"
+    << std::setw(COLUMN_WIDTH) << "peak(KB)" << std::setw(COLUMN_WIDTH) << "allocations" << std::setw(COLUMN_WIDTH) << "total(KB)" << std::endl;
+    for (int subsystem = 0; subsystem < MEMORY_SUBSYSTEMS; subsystem++)
+    {
+        const MemoryUsage usage = MEMORY_USAGE(static_cast<MemorySubsystem>(subsystem));
+        stream << std::left << std::setw(COLUMN_WIDTH) << SUBSYSTEM_NAMES[subsystem] << std::right << std::fixed << std::setprecision(1)
+        << std::setw(COLUMN_WIDTH) << kilobytes(usage.liveBytes) << std::setw(COLUMN_WIDTH) << kilobytes(usage.peakBytes)
+        << std::setw(COLUMN_WIDTH) << usage.allocations << std::setw(COLUMN_WIDTH) << kilobytes(usage.allocatedBytes) << std::endl;
+    }
+    rusage resources;
+    if (getrusage(RUSAGE_SELF, &resources) == 0) stream << "peak RSS: " << resources.ru_maxrss << " KB" << std::endl;
+}
+
+void REPORT_MEMORY_AT_EXIT()
+{
+    std::atexit(printAtExit);
+}
+
+uint64_t THREAD_ALLOCATIONS()
+{
+    return threadAllocations;
+}
+
+/* Replacements for the global allocation functions, the array and nothrow forms end up here too */
+void* operator new(std::size_t size)
+{
+    void* memory = std::malloc(size ? size : 1);
+    if (!memory) throw std::bad_alloc();
+    if (accounting.load(std::memory_order_acquire)) record(memory, size);
+    return memory;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try {
+        return operator new(size);
+    }
+    catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* memory) noexcept
+{
+    if (!memory) return;
+    if (accounting.load(std::memory_order_acquire)) forget(memory);
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    operator delete(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+    operator delete(memory);
+}
@@ -0,0 +1,45 @@
+#ifndef MEMORY_ACCOUNTING_H
+#define MEMORY_ACCOUNTING_H
+
+#include <cstdint>
+#include <ostream>
+
+#define MEMORY_SUBSYSTEMS 4
+
+/* Who heap memory is charged to, whatever is allocated outside a MemoryScope goes to Other */
+enum class MemorySubsystem
+{
+    Other,
+    SymbolTable,        // SymbolEntries, SYMMAP/LITMAP, the compiled table and sorted label arrays
+    Parser,             // Opcode tables, parsed instructions and the boundaries of decoded records
+    Output              // Rendered listing lines and the buffers they are written into
+};
+
+/* Allocations on this thread are charged to subsystem until the scope ends, scopes nest */
+class MemoryScope
+{
+    public:
+        explicit MemoryScope(const MemorySubsystem subsystem);
+        ~MemoryScope();
+        MemoryScope(const MemoryScope&) = delete;
+        MemoryScope& operator=(const MemoryScope&) = delete;
+    private:
+        const MemorySubsystem previous;
+};
+
+struct MemoryUsage
+{
+    int64_t liveBytes;
+    int64_t peakBytes;
+    uint64_t allocations;
+    uint64_t allocatedBytes;    // Everything ever allocated, freed or not
+};
+
+void ENABLE_MEMORY_ACCOUNTING();       // Nothing is counted before this, allocations made earlier never show up
+MemoryUsage MEMORY_USAGE(const MemorySubsystem subsystem);
+int64_t LIVE_HEAP_BYTES();             // Live bytes of every subsystem together
+void PRINT_MEMORY_REPORT(std::ostream& stream);
+void REPORT_MEMORY_AT_EXIT();
+uint64_t THREAD_ALLOCATIONS();          // operator new calls made by the calling thread since accounting was enabled
+
+#endif
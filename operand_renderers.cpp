@@ -0,0 +1,325 @@
+/*
+ *  @brief
+ *          Operand column renderers specialised at compile time for every format and nixbpe combination
+ *
+ *  CREATE_ADDRESS_OUTPUT works the operand out at run time, one instruction at a time: getAddress branches on bp,
+ *  prependAddressMode on ni, the ,X suffix is appended on its own and format 2 leaves halfway through, with every
+ *  step building another temporary string. Here each combination is a template instance in which those choices are
+ *  constants, so all that is left at run time is reading the displacement, the label lookup and writing the result
+ *  straight into the one string returned. RENDER_OPERAND picks the instance with a single lookup on the nixbpe bits.
+ *
+ *  --bench-operands renders every operand of a program through both paths and the render cache, fails if they ever
+ *  disagree, and reports the time, heap allocations and (where the kernel exposes them) branches each spends per
+ *  operand, along with how often the cache hit in a single pass.
+ */
+
+#include "operand_renderers.hpp"
+#include "bench_counters.hpp"
+#include "memory_accounting.hpp"
+#include "render_cache.hpp"
+#include "control_flow.hpp"
+#include "length_scan.hpp"
+#include "byte_operations.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+const constexpr int INPUT_FILE_ARG_NUMBER = 1;
+const constexpr int SYMBOL_FILE_ARG_NUMBER = 2;
+const constexpr int ROUNDS_ARG_NUMBER = 3;
+const constexpr int DEFAULT_ROUNDS = 200;
+const constexpr int COLUMN_WIDTH = 18;
+const constexpr int HEX_CHARS_PER_BYTE = 2;
+const constexpr int BITS_PER_HEX_CHAR = 4;
+const constexpr int INT_BITS = 32;
+const constexpr int ADDRESS_DIGITS = 4;             // The operand column always shows four digits
+const constexpr int ADDRESS_MASK = 0xFFFF;
+const constexpr std::size_t NI_DIGIT = 1;           // Low two bits of the second hex character
+const constexpr std::size_t XBPE_DIGIT = 2;
+const constexpr std::size_t DISPLACEMENT_DIGIT = 3;
+const constexpr int NI_MASK = 0x03;
+const constexpr int NI_SHIFT = 4;
+const constexpr int XBPE_MASK = 0x0F;
+const constexpr int X_BIT = 0x08;
+const constexpr int BP_MASK = 0x03;
+const constexpr int BP_SHIFT = 1;
+const constexpr int DECIMAL_DIGITS = 10;
+const constexpr int LOWERCASE_BIT = 0x20;
+const constexpr char IMMEDIATE_INDICATOR = '#';
+const constexpr char INDIRECT_INDICATOR = '@';
+const constexpr char* INDEXED_SUFFIX = ",X";
+const constexpr char* FIRST_DIRECTIVE = "FIRST";
+const constexpr char* LDB_INSTRUCTION = "LDB";
+const constexpr char* HEX_DIGITS = "0123456789ABCDEF";
+
+namespace
+{
+    constexpr int hexValue(const char c)
+    {
+        return c <= '9' ? c - '0' : (c & ~LOWERCASE_BIT) - 'A' + DECIMAL_DIGITS;
+    }
+
+    int32_t readHex(const char* digits, const std::size_t count)
+    {
+        int32_t value = 0;
+        for (std::size_t i = 0; i < count; i++)
+            value = (value << BITS_PER_HEX_CHAR) | hexValue(digits[i]);
+        return value;
+    }
+
+    // Same result hexStringToInt gives for a string of that many digits
+    int32_t signExtend(const int32_t value, const std::size_t digits)
+    {
+        const int shift = INT_BITS - digits * BITS_PER_HEX_CHAR;
+        return static_cast<int32_t>(static_cast<uint32_t>(value) << shift) >> shift;
+    }
+
+    template <int NIXBPE>
+    struct OperandBits
+    {
+        static constexpr AddressingMode ni = static_cast<AddressingMode>(NIXBPE >> NI_SHIFT);
+        static constexpr bool indexed = NIXBPE & X_BIT;
+        static constexpr TargetAddressMode bp = static_cast<TargetAddressMode>((NIXBPE >> BP_SHIFT) & BP_MASK);
+        static constexpr std::size_t prefixLength = ni == AddressingMode::Immediate || ni == AddressingMode::Indirect ? 1 : 0;
+        static constexpr std::size_t suffixLength = indexed ? 2 : 0;
+    };
+
+    /*
+     *  Fills digits with the four digit address column and returns the address labels are looked up at, which like
+     *  the generic path is those four digits read back as a signed number. bp = 11 has no address and looks up 0.
+     */
+    template <TargetAddressMode BP>
+    int32_t renderAddress(const std::string& objectCode, const OffsetInfo& offsetInfo, char* digits, std::size_t& digitCount)
+    {
+        const std::size_t displacementDigits = objectCode.size() - DISPLACEMENT_DIGIT;
+        if (BP == TargetAddressMode::PC || BP == TargetAddressMode::Base) {
+            const int32_t relativeTo = BP == TargetAddressMode::Base ? offsetInfo.BASE : offsetInfo.PC;
+            const int32_t shown = (relativeTo + signExtend(readHex(objectCode.data() + DISPLACEMENT_DIGIT, displacementDigits), displacementDigits)) & ADDRESS_MASK;
+            for (int i = ADDRESS_DIGITS - 1; i >= 0; i--)
+                digits[ADDRESS_DIGITS - 1 - i] = HEX_DIGITS[(shown >> (i * BITS_PER_HEX_CHAR)) & 0xF];
+            digitCount = ADDRESS_DIGITS;
+            return static_cast<int16_t>(shown);
+        }
+        if (BP == TargetAddressMode::Absolute) {
+            const std::size_t kept = std::min<std::size_t>(displacementDigits, ADDRESS_DIGITS);
+            std::memset(digits, '0', ADDRESS_DIGITS - kept);
+            std::memcpy(digits + ADDRESS_DIGITS - kept, objectCode.data() + objectCode.size() - kept, kept);
+            digitCount = ADDRESS_DIGITS;
+            return static_cast<int16_t>(readHex(digits, ADDRESS_DIGITS));
+        }
+        digitCount = 0;
+        return 0;
+    }
+
+    // Format 3 and 4, the label replaces the digits when there is one
+    template <int NIXBPE>
+    const std::string renderMemoryOperand(const OffsetInfo& offsetInfo, const DisassemblerState& state)
+    {
+        using Bits = OperandBits<NIXBPE>;
+        char digits[ADDRESS_DIGITS];
+        std::size_t digitCount;
+        const int32_t tableAddress = renderAddress<Bits::bp>(state.instruction.objectCode, offsetInfo, digits, digitCount);
+        const std::string label = CREATE_SYMBOL_OUTPUT(tableAddress, state.symbols);
+        const bool showDigits = label.empty() || label == FIRST_DIRECTIVE;
+        const char* text = showDigits ? digits : label.data();
+        const std::size_t textLength = showDigits ? digitCount : label.size();
+
+        std::string operand(Bits::prefixLength + textLength + Bits::suffixLength, ' ');
+        if (Bits::ni == AddressingMode::Immediate) operand[0] = IMMEDIATE_INDICATOR;
+        if (Bits::ni == AddressingMode::Indirect) operand[0] = INDIRECT_INDICATOR;
+        std::memcpy(&operand[Bits::prefixLength], text, textLength);
+        if (Bits::indexed) std::memcpy(&operand[Bits::prefixLength + textLength], INDEXED_SUFFIX, Bits::suffixLength);
+        return operand;
+    }
+
+    // Format 2, the same address read as a register number, only bp takes part
+    template <int NIXBPE>
+    const std::string renderRegisterOperand(const OffsetInfo& offsetInfo, const DisassemblerState& state)
+    {
+        char digits[ADDRESS_DIGITS];
+        std::size_t digitCount;
+        return state.registers.find(renderAddress<OperandBits<NIXBPE>::bp>(state.instruction.objectCode, offsetInfo, digits, digitCount))->second;
+    }
+
+    #define RENDERERS_8(R, n) &R<n>, &R<n + 1>, &R<n + 2>, &R<n + 3>, &R<n + 4>, &R<n + 5>, &R<n + 6>, &R<n + 7>
+    #define RENDERERS_64(R) RENDERERS_8(R, 0), RENDERERS_8(R, 8), RENDERERS_8(R, 16), RENDERERS_8(R, 24), \
+                            RENDERERS_8(R, 32), RENDERERS_8(R, 40), RENDERERS_8(R, 48), RENDERERS_8(R, 56)
+
+    // Row 1 is format 2, which is decided by the opcode rather than by e
+    const OperandRenderer OPERAND_RENDERERS[2][NIXBPE_COMBINATIONS]
+    {
+        {RENDERERS_64(renderMemoryOperand)},
+        {RENDERERS_64(renderRegisterOperand)}
+    };
+
+    #undef RENDERERS_64
+    #undef RENDERERS_8
+
+    struct BenchOperand
+    {
+        const int BASE;
+        const int LOCCTR;
+        const ParsingResult parsed;
+    };
+
+    struct BenchResult
+    {
+        double nanosPerOperand;
+        double allocationsPerOperand;
+        double branchesPerOperand;
+        bool branchesCounted;
+    };
+
+    // Linear sweep of every text record, BASE follows LDB like it does in the listing
+    std::vector<BenchOperand> DECODE_OPERANDS(const MemoryImage& image, const LITMAP& litmap, const Parser& parser)
+    {
+        std::vector<BenchOperand> operands;
+        int BASE = 0;
+        for (const TextRecord& record : image.records)
+        {
+            const std::vector<uint8_t> bytes = DECODE_HEX_BYTES(record.objectCode);
+            for (const InstructionBoundary& boundary : SCAN_INSTRUCTION_LENGTHS(bytes, record.LOCCTR_START, litmap))
+            {
+                const std::size_t offset = boundary.offset * HEX_CHARS_PER_BYTE;
+                const std::size_t length = boundary.length * HEX_CHARS_PER_BYTE;
+                if (boundary.literal || offset + length > record.objectCode.size()) continue;
+                const ParsingResult parsed = parseInstruction(record.objectCode.substr(offset, length), parser);
+                operands.push_back(BenchOperand{BASE, record.LOCCTR_START + boundary.offset, parsed});
+                if (parsed.instruction.opCode == LDB_INSTRUCTION) BASE = hexStringToInt(parsed.instruction.objectCode.substr(DISPLACEMENT_DIGIT));
+            }
+        }
+        return operands;
+    }
+
+    const std::string GENERIC_OPERAND(const BenchOperand& operand, const REGMAP& registers, const SymbolProvider& symbols, RenderCache&)
+    {
+        const ParsedInstruction& instruction = operand.parsed.instruction;
+        const DisassemblerState state{operand.BASE, operand.LOCCTR, instruction, registers, symbols};
+        const AddressingInfo addressingInfo{instruction.addresingMode, instruction.targetAddressMode, instruction.isIndexed};
+        return CREATE_ADDRESS_OUTPUT(addressingInfo, OffsetInfo{operand.BASE, operand.LOCCTR + operand.parsed.bytesReadIn}, state);
+    }
+
+    const std::string TABLE_OPERAND(const BenchOperand& operand, const REGMAP& registers, const SymbolProvider& symbols, RenderCache&)
+    {
+        const DisassemblerState state{operand.BASE, operand.LOCCTR, operand.parsed.instruction, registers, symbols};
+        return RENDER_OPERAND(OffsetInfo{operand.BASE, operand.LOCCTR + operand.parsed.bytesReadIn}, state);
+    }
+
+    const std::string CACHED_OPERAND(const BenchOperand& operand, const REGMAP& registers, const SymbolProvider& symbols, RenderCache& cache)
+    {
+        const DisassemblerState state{operand.BASE, operand.LOCCTR, operand.parsed.instruction, registers, symbols};
+        return cache.render(OffsetInfo{operand.BASE, operand.LOCCTR + operand.parsed.bytesReadIn}, state).operand;
+    }
+
+    using OperandPath = const std::string (*)(const BenchOperand& operand, const REGMAP& registers, const SymbolProvider& symbols, RenderCache& cache);
+
+    BenchResult TIME_PATH(const OperandPath path, const std::vector<BenchOperand>& operands, const int rounds, const REGMAP& registers, const SymbolProvider& symbols)
+    {
+        RenderCache cache;
+        HardwareCounter branches(HardwareEvent::Branches);
+        std::size_t rendered = 0;
+        const uint64_t allocationsBefore = HEAP_ALLOCATIONS();
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        branches.start();
+        for (int round = 0; round < rounds; round++)
+            for (const BenchOperand& operand : operands)
+                rendered += path(operand, registers, symbols, cache).size();
+        const uint64_t branchCount = branches.stop();
+        const double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        const uint64_t allocations = HEAP_ALLOCATIONS() - allocationsBefore;
+
+        static volatile std::size_t keepAlive;              // So the rendering cannot be optimised away
+        keepAlive = rendered;
+        (void)keepAlive;
+        const double total = static_cast<double>(operands.size()) * rounds;
+        return BenchResult{nanos / total, allocations / total, branchCount / total, branches.available()};
+    }
+
+    void printResult(const char* path, const BenchResult& result)
+    {
+        std::cout << std::left << std::setw(COLUMN_WIDTH) << path << std::right << std::fixed << std::setprecision(2)
+        << std::setw(COLUMN_WIDTH) << result.nanosPerOperand << std::setw(COLUMN_WIDTH) << result.allocationsPerOperand;
+        if (result.branchesCounted) std::cout << std::setw(COLUMN_WIDTH) << result.branchesPerOperand;
+        else std::cout << std::setw(COLUMN_WIDTH) << "n/a";
+        std::cout << std::endl;
+    }
+}
+
+// ni is the low two bits of the first byte, xbpe the high nibble of the second. Masked so a stray character cannot index past the table
+int EXTRACT_NIXBPE(const std::string& objectCode)
+{
+    return (hexValue(objectCode[NI_DIGIT]) & NI_MASK) << NI_SHIFT | (hexValue(objectCode[XBPE_DIGIT]) & XBPE_MASK);
+}
+
+const std::string RENDER_OPERAND(const OffsetInfo& offsetInfo, const DisassemblerState& state)
+{
+    const bool format2 = state.instruction.format == AddressingFormat::Format2;
+    return OPERAND_RENDERERS[format2][EXTRACT_NIXBPE(state.instruction.objectCode)](offsetInfo, state);
+}
+
+// The address renderMemoryOperand looks its label up at, so labels can be resolved before the operand is rendered
+int32_t OPERAND_LOOKUP_ADDRESS(const OffsetInfo& offsetInfo, const std::string& objectCode)
+{
+    char digits[ADDRESS_DIGITS];
+    std::size_t digitCount;
+    switch ((EXTRACT_NIXBPE(objectCode) >> BP_SHIFT) & BP_MASK)
+    {
+        case static_cast<int>(TargetAddressMode::Absolute): return renderAddress<TargetAddressMode::Absolute>(objectCode, offsetInfo, digits, digitCount);
+        case static_cast<int>(TargetAddressMode::PC): return renderAddress<TargetAddressMode::PC>(objectCode, offsetInfo, digits, digitCount);
+        case static_cast<int>(TargetAddressMode::Base): return renderAddress<TargetAddressMode::Base>(objectCode, offsetInfo, digits, digitCount);
+        default: return 0;      // bp = 11 has no address, the renderer looks up 0 as well
+    }
+}
+
+// Expects argv[1] to be the object file, argv[2] the symbol file and optionally argv[3] how many times to render each operand
+int runOperandBenchmarkMode(const int argc, const char* argv[])
+{
+    ENABLE_MEMORY_ACCOUNTING();             // Allocations per operand come from the accounts
+    InputFile inputFile                     = FileHandling::openFile(argv[INPUT_FILE_ARG_NUMBER]);
+    const SymbolEntries symbolEntries       = FileHandling::readSymbolTableFile(argv[SYMBOL_FILE_ARG_NUMBER]);
+    const LITMAP litmap                     = CREATE_LITMAP(symbolEntries);
+    const SYMMAP symmap                     = CREATE_SYMMAP(symbolEntries);
+    const REGMAP registers                  = REGISTERS();
+    const MapSymbolProvider symbols         (symmap, litmap);
+    const Parser parser;
+    const int rounds                        = argc > ROUNDS_ARG_NUMBER ? std::atoi(argv[ROUNDS_ARG_NUMBER]) : DEFAULT_ROUNDS;
+    if (rounds <= 0) {
+        std::cerr << "Rounds must be a positive number: " << argv[ROUNDS_ARG_NUMBER] << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    const MemoryImage image                 = LOAD_MEMORY_IMAGE(inputFile);
+    const std::vector<BenchOperand> operands = DECODE_OPERANDS(image, litmap, parser);
+    if (operands.empty()) {
+        std::cerr << "No instructions to render in " << argv[INPUT_FILE_ARG_NUMBER] << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    RenderCache onePass;
+    for (const BenchOperand& operand : operands)
+    {
+        const std::string generic = GENERIC_OPERAND(operand, registers, symbols, onePass);
+        const std::string table = TABLE_OPERAND(operand, registers, symbols, onePass);
+        const std::string cached = CACHED_OPERAND(operand, registers, symbols, onePass);
+        if (generic == table && generic == cached) continue;
+        std::cerr << "Renderers disagree at " << intToHexString(operand.LOCCTR) << " (" << operand.parsed.instruction.objectCode << "): "
+        << generic << " vs " << table << " vs " << cached << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    const BenchResult generic = TIME_PATH(GENERIC_OPERAND, operands, rounds, registers, symbols);
+    const BenchResult table = TIME_PATH(TABLE_OPERAND, operands, rounds, registers, symbols);
+    const BenchResult cached = TIME_PATH(CACHED_OPERAND, operands, rounds, registers, symbols);
+    std::cout << operands.size() << " operands x " << rounds << " rounds, all paths agree" << std::endl
+    << std::left << std::setw(COLUMN_WIDTH) << "path" << std::right << std::setw(COLUMN_WIDTH) << "ns/operand"
+    << std::setw(COLUMN_WIDTH) << "allocs/operand" << std::setw(COLUMN_WIDTH) << "branches/operand" << std::endl;
+    printResult("generic", generic);
+    printResult("nixbpe table", table);
+    printResult("render cache", cached);
+    PRINT_RENDER_CACHE_STATS(std::cout, onePass.getStats());     // One pass, the timed rounds after the first hit every word they can
+    inputFile.close();
+    return EXIT_SUCCESS;
+}
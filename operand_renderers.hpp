@@ -0,0 +1,17 @@
+#ifndef OPERAND_RENDERERS_H
+#define OPERAND_RENDERERS_H
+
+#include "disassembly.hpp"
+#include <string>
+
+#define NIXBPE_COMBINATIONS 64
+
+/* Renders the operand column of one instruction, one of these exists for every format and nixbpe combination */
+using OperandRenderer = const std::string (*)(const OffsetInfo& offsetInfo, const DisassemblerState& state);
+
+int EXTRACT_NIXBPE(const std::string& objectCode);
+const std::string RENDER_OPERAND(const OffsetInfo& offsetInfo, const DisassemblerState& state);
+int32_t OPERAND_LOOKUP_ADDRESS(const OffsetInfo& offsetInfo, const std::string& objectCode);
+int runOperandBenchmarkMode(const int argc, const char* argv[]);
+
+#endif
@@ -0,0 +1,359 @@
+/*
+ *  @brief
+ *          Disassembles in address ordered windows with only the symbols each window needs in memory (--out-of-core)
+ *
+ *  The other modes hold the whole symbol file several times over (SymbolEntries, SYMMAP, LITMAP, sorted labels)
+ *  before the first record is read, which is what breaks small containers on archival sweeps. Here the symbol file
+ *  is compiled to its address sorted on-disk form once (symbol_cache) and then only read piecewise with pread.
+ *
+ *  A window is a run of consecutive T records. For each one the slice covering its address range (the RESB gap in
+ *  front of it included) is loaded first, since the literals in that range decide where instructions start. The
+ *  records are then decoded with the length pre-scan, the operand targets of every instruction are collected and the
+ *  labels at those addresses are added to the slice, and the records are rendered through the pipeline's resolver
+ *  into out.lst. The slice and the decoded records are dropped before the next window is read.
+ *
+ *  The window size follows the heap: after every window the live bytes at its peak (memory_accounting) are compared
+ *  with half of the room left under the cap and the next window grows or shrinks accordingly. The RESB tail after
+ *  the last record, which can cover most of the symbol file, is filled in pieces of a bounded number of symbols.
+ *  Going over the cap at any of these points ends the run with an error rather than a listing produced with more
+ *  memory than was asked for. Usage:
+ *      --out-of-core obj sym [cap in KB]
+ */
+
+#include "out_of_core.hpp"
+#include "pipeline.hpp"
+#include "symbol_batch.hpp"
+#include "length_scan.hpp"
+#include "memory_accounting.hpp"
+#include "trace.hpp"
+#include "byte_operations.hpp"
+#include "binary_object.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+const constexpr int INPUT_FILE_ARG_NUMBER = 1;
+const constexpr int SYMBOL_FILE_ARG_NUMBER = 2;
+const constexpr int CAP_ARG_NUMBER = 3;
+const constexpr int INITIAL_BASE = 0;
+const constexpr std::size_t DEFAULT_CAP_KILOBYTES = 4096;
+const constexpr std::size_t BYTES_PER_KILOBYTE = 1024;
+const constexpr std::size_t WINDOW_BUDGET_SHARE = 2;        // Half of what is left under the cap, the rest is headroom for rendering
+const constexpr std::size_t FIRST_WINDOW_SHARE = 64;        // Decoded items take tens of heap bytes per object byte, so start low
+const constexpr std::size_t SLICE_ENTRY_BYTES = 128;        // Rough heap cost of one map entry with its strings
+const constexpr std::size_t MIN_WINDOW_BYTES = 1;           // Always at least one record
+const constexpr double MAX_WINDOW_GROWTH = 2.0;
+const constexpr double MAX_WINDOW_SHRINK = 0.5;
+const constexpr std::size_t NO_LIMIT = std::numeric_limits<std::size_t>::max();
+const constexpr char* OUTPUT_FILE_NAME = "out.lst";
+
+namespace
+{
+    struct WindowStats
+    {
+        uint64_t windows;
+        std::size_t largestWindow;      // Record bytes
+        int64_t peakHeap;               // Live heap bytes at the fullest point of any window
+    };
+
+    std::size_t headroom(const std::size_t capBytes, const int64_t live)
+    {
+        return live < static_cast<int64_t>(capBytes) ? capBytes - live : 0;
+    }
+
+    // Proportional to how far the last window was from the budget, within a factor of two either way
+    std::size_t RESIZE_WINDOW(const std::size_t windowBytes, const int64_t used, const std::size_t budget)
+    {
+        const double scale = used > 0 ? std::min(MAX_WINDOW_GROWTH, std::max(MAX_WINDOW_SHRINK, static_cast<double>(budget) / used)) : MAX_WINDOW_GROWTH;
+        return std::max(MIN_WINDOW_BYTES, static_cast<std::size_t>(windowBytes * scale));
+    }
+
+    // Returns the live heap at the point where the window's slice and decoded records are all resident
+    int64_t RENDER_WINDOW(const std::vector<TextRecord>& records, int32_t& lastTextSectionEnd, DisassemblerContext& context, SymbolSlice& slice)
+    {
+        TraceSpan span("renderWindow", records.size());
+        int32_t first = lastTextSectionEnd, last = lastTextSectionEnd;
+        for (const TextRecord& record : records)
+        {
+            first = std::min(first, record.LOCCTR_START);
+            last = std::max(last, record.LOCCTR_START + record.textSectionSize);
+        }
+        slice.loadRange(first, last, NO_LIMIT);
+
+        std::vector<DecodedRecord> decoded;
+        std::vector<int32_t> targets;
+        int BASE = context.baseAddress;
+        for (const TextRecord& record : records)
+        {
+            const std::vector<InstructionBoundary> boundaries = SCAN_INSTRUCTION_LENGTHS(DECODE_HEX_BYTES(record.objectCode), record.LOCCTR_START, slice.getLitmap());
+            DecodedRecord decodedRecord{record.LOCCTR_START - lastTextSectionEnd, lastTextSectionEnd, DECODE_BOUNDARIES(record, boundaries, 0, boundaries.size(), context.parser), false};
+            const std::vector<int32_t> recordTargets = COLLECT_RECORD_TARGETS(decodedRecord.items, BASE);
+            targets.insert(targets.end(), recordTargets.begin(), recordTargets.end());
+            lastTextSectionEnd = decodedRecord.items.empty() ? record.LOCCTR_START : decodedRecord.items.back().LOCCTR + decodedRecord.items.back().result.bytesReadIn;
+            decoded.push_back(std::move(decodedRecord));
+        }
+        slice.loadTargets(std::move(targets));
+        const int64_t peak = LIVE_HEAP_BYTES();
+
+        for (const DecodedRecord& record : decoded) RENDER_DECODED_RECORD(context, record);
+        slice.release();
+        return peak;
+    }
+
+    // A window is at least one record, so a cap that cannot hold one ends the run instead of being quietly exceeded
+    void ENFORCE_CAP(const int64_t live, const std::size_t capBytes, const std::string& when)
+    {
+        if (live <= static_cast<int64_t>(capBytes)) return;
+        std::cerr << std::fixed << std::setprecision(1) << "Memory cap of " << capBytes / BYTES_PER_KILOBYTE << " KB exceeded " << when
+        << " (" << static_cast<double>(live) / BYTES_PER_KILOBYTE << " KB live), give --out-of-core a larger cap" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // Pieces end on a symbol that is loaded with them, so getNextSymbolGap stops at the same place as in one pass
+    void FILL_TAIL(const int32_t lastTextSectionEnd, DisassemblerContext& context, SymbolSlice& slice, const std::size_t symbolLimit, const std::size_t capBytes)
+    {
+        const int32_t end = lastTextSectionEnd + slice.getLastSymbolAddress();
+        for (int32_t start = lastTextSectionEnd; start < end; )
+        {
+            const int32_t stop = slice.loadRange(start, end, symbolLimit);
+            ENFORCE_CAP(LIVE_HEAP_BYTES(), capBytes, "while filling the gap at " + intToHexString(start));
+            fillGap(stop - start, start, slice, context);
+            slice.release();
+            start = stop;
+        }
+    }
+
+    void PRINT_OUT_OF_CORE_STATS(std::ostream& stream, const WindowStats& windows, const SliceStats& slice, const std::size_t capBytes)
+    {
+        stream << "windows: " << windows.windows << ", largest " << windows.largestWindow << " record bytes" << std::endl;
+        stream << "symbols: " << slice.entriesLoaded << " entries loaded, at most " << slice.largestSlice << " resident, "
+        << slice.reads << " reads (" << std::fixed << std::setprecision(1) << static_cast<double>(slice.bytesRead) / BYTES_PER_KILOBYTE << " KB)" << std::endl;
+        stream << "heap: " << static_cast<double>(windows.peakHeap) / BYTES_PER_KILOBYTE << " KB live at the fullest window, cap "
+        << capBytes / BYTES_PER_KILOBYTE << " KB" << std::endl;
+    }
+}
+
+SymbolSlice::SymbolSlice(const std::string& cacheFile) : descriptor(open(cacheFile.c_str(), O_RDONLY))
+{
+    if (descriptor < 0 || pread(descriptor, &header, sizeof(header), 0) != sizeof(header)) {
+        std::cerr << "Failed to open file: " << cacheFile << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    symbolsOffset = sizeof(CompiledSymbolHeader);
+    literalsOffset = symbolsOffset + header.symbolCount * sizeof(CompiledSymbol);
+    blobOffset = literalsOffset + header.literalCount * sizeof(CompiledLiteral);
+    MemoryScope scope(MemorySubsystem::SymbolTable);
+    symbolPages = indexPages<CompiledSymbol>(symbolsOffset, header.symbolCount);
+    literalPages = indexPages<CompiledLiteral>(literalsOffset, header.literalCount);
+}
+
+SymbolSlice::~SymbolSlice()
+{
+    close(descriptor);
+}
+
+template<typename Entry>
+std::vector<Entry> SymbolSlice::readEntries(const std::size_t arrayOffset, const std::size_t first, const std::size_t count)
+{
+    std::vector<Entry> entries(count);
+    const std::size_t bytes = count * sizeof(Entry);
+    if (pread(descriptor, entries.data(), bytes, arrayOffset + first * sizeof(Entry)) != static_cast<ssize_t>(bytes)) {
+        std::cerr << "Compiled symbol file is shorter than its header says" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    stats.reads++;
+    stats.bytesRead += bytes;
+    return entries;
+}
+
+template<typename Entry>
+std::vector<int32_t> SymbolSlice::indexPages(const std::size_t arrayOffset, const std::size_t count)
+{
+    std::vector<int32_t> pages;
+    for (std::size_t first = 0; first < count; first += SLICE_PAGE_ENTRIES)
+        pages.push_back(readEntries<Entry>(arrayOffset, first, 1).front().address);
+    return pages;
+}
+
+/* Entries from the page that can hold first up to last, or up to one past symbolLimit entries */
+template<typename Entry>
+std::vector<Entry> SymbolSlice::readRange(const std::vector<int32_t>& pages, const std::size_t arrayOffset, const std::size_t count, const int32_t first, const int32_t last, const std::size_t limit)
+{
+    std::vector<Entry> found;
+    const std::size_t following = std::upper_bound(pages.begin(), pages.end(), first) - pages.begin();
+    for (std::size_t page = following ? following - 1 : 0; page * SLICE_PAGE_ENTRIES < count; page++)
+    {
+        const std::size_t start = page * SLICE_PAGE_ENTRIES;
+        for (const Entry& entry : readEntries<Entry>(arrayOffset, start, std::min<std::size_t>(SLICE_PAGE_ENTRIES, count - start)))
+        {
+            if (entry.address < first) continue;
+            if (entry.address > last || found.size() > limit) return found;
+            found.push_back(entry);
+        }
+    }
+    return found;
+}
+
+template<typename Entry>
+bool SymbolSlice::findEntry(const std::vector<int32_t>& pages, const std::size_t arrayOffset, const std::size_t count, const int32_t address, PageCursor<Entry>& cursor, Entry& found)
+{
+    const std::size_t following = std::upper_bound(pages.begin(), pages.end(), address) - pages.begin();
+    if (!following) return false;
+    const std::size_t page = following - 1;
+    if (cursor.entries.empty() || cursor.page != page) {
+        const std::size_t start = page * SLICE_PAGE_ENTRIES;
+        cursor.entries = readEntries<Entry>(arrayOffset, start, std::min<std::size_t>(SLICE_PAGE_ENTRIES, count - start));
+        cursor.page = page;
+    }
+    const auto it = std::lower_bound(cursor.entries.begin(), cursor.entries.end(), address, [](const Entry& entry, const int32_t key) {return entry.address < key;});
+    if (it == cursor.entries.end() || it->address != address) return false;
+    found = *it;
+    return true;
+}
+
+const std::string SymbolSlice::readBlob(const uint32_t offset, const uint32_t length)
+{
+    std::string text(length, '\0');
+    if (length && pread(descriptor, &text[0], length, blobOffset + offset) != static_cast<ssize_t>(length)) {
+        std::cerr << "Compiled symbol file is shorter than its header says" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    stats.reads++;
+    stats.bytesRead += length;
+    return text;
+}
+
+// The compiler writes the strings of consecutive entries back to back, so a run of entries costs one read
+void SymbolSlice::addSymbols(const std::vector<CompiledSymbol>& entries)
+{
+    if (entries.empty()) return;
+    const uint32_t from = entries.front().symbol.offset;
+    const std::string text = readBlob(from, entries.back().symbol.offset + entries.back().symbol.length - from);
+    for (const CompiledSymbol& entry : entries)     // Address and flags text are never asked of a provider
+        symmap.insert({entry.address, SYMTAB_Entry{text.substr(entry.symbol.offset - from, entry.symbol.length), "", ""}});
+    stats.entriesLoaded += entries.size();
+}
+
+void SymbolSlice::addLiterals(const std::vector<CompiledLiteral>& entries)
+{
+    if (entries.empty()) return;
+    const uint32_t from = entries.front().name.offset;
+    const std::string text = readBlob(from, entries.back().addressText.offset + entries.back().addressText.length - from);
+    const auto field = [&](const BlobString& string) {return text.substr(string.offset - from, string.length);};
+    for (const CompiledLiteral& entry : entries)
+        litmap.insert({entry.address, LITTAB_Entry{field(entry.name), field(entry.litConst), field(entry.length), field(entry.addressText)}});
+    stats.entriesLoaded += entries.size();
+}
+
+void SymbolSlice::noteSize()
+{
+    stats.largestSlice = std::max(stats.largestSlice, symmap.size() + litmap.size());
+}
+
+/*
+ *  Loads every symbol and literal from first to last inclusive. With a symbol limit the range is cut short at the
+ *  symbol after the limit, which is loaded too, and its address is returned instead of last.
+ */
+int32_t SymbolSlice::loadRange(const int32_t first, const int32_t last, const std::size_t symbolLimit)
+{
+    MemoryScope scope(MemorySubsystem::SymbolTable);
+    TraceSpan span("loadSlice", first);
+    const std::vector<CompiledSymbol> symbols = readRange<CompiledSymbol>(symbolPages, symbolsOffset, header.symbolCount, first, last, symbolLimit);
+    const int32_t stop = symbols.size() > symbolLimit ? symbols.back().address : last;
+    addSymbols(symbols);
+    addLiterals(readRange<CompiledLiteral>(literalPages, literalsOffset, header.literalCount, first, stop, NO_LIMIT));
+    noteSize();
+    return stop;
+}
+
+/* Operand targets fall anywhere, each one found through the page index and read on its own */
+void SymbolSlice::loadTargets(std::vector<int32_t> addresses)
+{
+    MemoryScope scope(MemorySubsystem::SymbolTable);
+    TraceSpan span("loadTargets", addresses.size());
+    std::sort(addresses.begin(), addresses.end());
+    addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+    PageCursor<CompiledSymbol> symbolCursor;
+    PageCursor<CompiledLiteral> literalCursor;
+    for (const int32_t address : addresses)
+    {
+        CompiledSymbol symbol;
+        CompiledLiteral literal;
+        if (!symmap.count(address) && findEntry(symbolPages, symbolsOffset, header.symbolCount, address, symbolCursor, symbol)) addSymbols({symbol});
+        if (!litmap.count(address) && findEntry(literalPages, literalsOffset, header.literalCount, address, literalCursor, literal)) addLiterals({literal});
+    }
+    noteSize();
+}
+
+void SymbolSlice::release()
+{
+    symmap.clear();
+    litmap.clear();
+}
+
+const std::string SymbolSlice::getStartAddress()
+{
+    return readBlob(header.startAddress.offset, header.startAddress.length);
+}
+
+// Expects argv[1] to be the object file, argv[2] the symbol file and optionally argv[3] the heap cap in KB
+int runOutOfCoreMode(const int argc, const char* argv[])
+{
+    ENABLE_MEMORY_ACCOUNTING();             // Windows are sized from the live heap
+    const std::size_t capBytes = (argc > CAP_ARG_NUMBER ? std::strtoul(argv[CAP_ARG_NUMBER], nullptr, 10) : DEFAULT_CAP_KILOBYTES) * BYTES_PER_KILOBYTE;
+    if (!capBytes) {
+        std::cerr << "Memory cap must be at least 1 KB" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    ENFORCE_CAP(LIVE_HEAP_BYTES(), capBytes, "before the symbol file was read");
+    if (!COMPILE_SYMBOL_CACHE(argv[SYMBOL_FILE_ARG_NUMBER], headroom(capBytes, LIVE_HEAP_BYTES()) / WINDOW_BUDGET_SHARE)) {
+        std::cerr << "Failed to write " << argv[SYMBOL_FILE_ARG_NUMBER] << COMPILED_SYMBOL_SUFFIX << ", out of core needs the compiled symbol file on disk" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    SymbolSlice slice                       (std::string(argv[SYMBOL_FILE_ARG_NUMBER]) + COMPILED_SYMBOL_SUFFIX);
+    InputFile inputFile                     = FileHandling::openFile(argv[INPUT_FILE_ARG_NUMBER]);
+    REFUSE_BINARY_OBJECT(inputFile, argv[INPUT_FILE_ARG_NUMBER], "--out-of-core");
+    std::ofstream outputFile                (OUTPUT_FILE_NAME);
+    const std::string programName           = FileHandling::getProgramName(inputFile);
+    const REGMAP registers                  = REGISTERS();
+    const Parser parser;
+
+    std::istringstream noInput;             // Records are read here and decoded ahead, the engine never reads
+    ListingSink listing                     (outputFile, slice);
+    DisassemblerContext                     context{noInput, outputFile, listing, registers, slice, parser, INITIAL_BASE, false};
+    listing.start(programName, slice.getStartAddress());
+
+    std::size_t windowBytes = std::max(MIN_WINDOW_BYTES, capBytes / FIRST_WINDOW_SHARE);
+    WindowStats windows{0, 0, LIVE_HEAP_BYTES()};
+    int32_t lastTextSectionEnd = 0;
+    TextRecord next = FileHandling::readTextRecord(inputFile);
+    while (next.sectionFound)
+    {
+        std::vector<TextRecord> records;
+        std::size_t recordBytes = 0;
+        do {
+            recordBytes += next.textSectionSize;
+            records.push_back(std::move(next));
+            next = FileHandling::readTextRecord(inputFile);
+        } while (next.sectionFound && recordBytes + next.textSectionSize <= windowBytes);
+
+        const int64_t before = LIVE_HEAP_BYTES();
+        const int64_t peak = RENDER_WINDOW(records, lastTextSectionEnd, context, slice);
+        ENFORCE_CAP(peak, capBytes, "while rendering the window at " + intToHexString(records.front().LOCCTR_START));
+        windows.windows++;
+        windows.largestWindow = std::max(windows.largestWindow, recordBytes);
+        windows.peakHeap = std::max(windows.peakHeap, peak);
+        windowBytes = RESIZE_WINDOW(windowBytes, peak - before, headroom(capBytes, before) / WINDOW_BUDGET_SHARE);
+    }
+    FILL_TAIL(lastTextSectionEnd, context, slice, std::max<std::size_t>(1, headroom(capBytes, LIVE_HEAP_BYTES()) / WINDOW_BUDGET_SHARE / SLICE_ENTRY_BYTES), capBytes);
+    listing.finish(programName);
+
+    PRINT_OUT_OF_CORE_STATS(std::cerr, windows, slice.getStats(), capBytes);
+    return FileHandling::close(inputFile, outputFile);
+}
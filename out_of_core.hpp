@@ -0,0 +1,74 @@
+#ifndef OUT_OF_CORE_H
+#define OUT_OF_CORE_H
+
+#include "symbol_cache.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define SLICE_PAGE_ENTRIES 256
+
+struct SliceStats
+{
+    uint64_t reads;             // pread calls against the compiled file
+    uint64_t bytesRead;
+    uint64_t entriesLoaded;
+    std::size_t largestSlice;   // Most SYMTAB plus LITTAB entries resident at once
+};
+
+/*
+ *  The part of a compiled symbol file (symbol_cache) that one window of the object needs, read with pread from its
+ *  address sorted arrays instead of mapping or parsing the whole table. Only the first address of every page of
+ *  SLICE_PAGE_ENTRIES entries stays resident between windows, release() drops everything else.
+ */
+class SymbolSlice : public SymbolProvider
+{
+    public:
+        explicit SymbolSlice(const std::string& cacheFile);
+        ~SymbolSlice();
+        SymbolSlice(const SymbolSlice&) = delete;
+        SymbolSlice& operator=(const SymbolSlice&) = delete;
+        int32_t loadRange(const int32_t first, const int32_t last, const std::size_t symbolLimit);
+        void loadTargets(std::vector<int32_t> addresses);
+        void release();
+        bool hasSymbol(const int address) const override {return symmap.count(address);}
+        const std::string getSymbol(const int address) const override {return symmap.find(address)->second.symbol;}
+        bool hasLiteral(const int address) const override {return litmap.count(address);}
+        const LITTAB_Entry getLiteral(const int address) const override {return litmap.find(address)->second;}
+        const LITMAP& getLitmap() const {return litmap;}
+        const std::string getStartAddress();
+        int getLastSymbolAddress() const {return header.lastSymbolAddress;}
+        const SliceStats& getStats() const {return stats;}
+    private:
+        /* The page a run of target lookups last read, neighbouring targets usually share it */
+        template<typename Entry>
+        struct PageCursor
+        {
+            std::size_t page;
+            std::vector<Entry> entries;
+        };
+
+        template<typename Entry> std::vector<Entry> readEntries(const std::size_t arrayOffset, const std::size_t first, const std::size_t count);
+        template<typename Entry> std::vector<int32_t> indexPages(const std::size_t arrayOffset, const std::size_t count);
+        template<typename Entry> std::vector<Entry> readRange(const std::vector<int32_t>& pages, const std::size_t arrayOffset, const std::size_t count, const int32_t first, const int32_t last, const std::size_t limit);
+        template<typename Entry> bool findEntry(const std::vector<int32_t>& pages, const std::size_t arrayOffset, const std::size_t count, const int32_t address, PageCursor<Entry>& cursor, Entry& found);
+        const std::string readBlob(const uint32_t offset, const uint32_t length);
+        void addSymbols(const std::vector<CompiledSymbol>& entries);
+        void addLiterals(const std::vector<CompiledLiteral>& entries);
+        void noteSize();
+
+        int descriptor;
+        CompiledSymbolHeader header;
+        std::size_t symbolsOffset;
+        std::size_t literalsOffset;
+        std::size_t blobOffset;
+        std::vector<int32_t> symbolPages;       // Address of the first entry of every page
+        std::vector<int32_t> literalPages;
+        SYMMAP symmap;
+        LITMAP litmap;
+        SliceStats stats{0, 0, 0, 0};
+};
+
+int runOutOfCoreMode(const int argc, const char* argv[]);
+
+#endif
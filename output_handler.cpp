@@ -6,6 +6,7 @@
  */
 
 #include "output_handler.hpp"
+#include "memory_accounting.hpp"
 #include "byte_operations.hpp"
 #include <iostream>
 #include <vector>
@@ -14,7 +15,7 @@
 const constexpr int INPUT_FILE_ARG_NUMBER = 1;
 const constexpr int SYMBOL_FILE_ARG_NUMBER = 2;
 const constexpr int NUMBER_PRINTOUT_SIZE =  4;
-const constexpr int COLUMN_SPACING =  12;
+const constexpr int COLUMN_SPACING =  LISTING_COLUMN_WIDTH;
 const constexpr char* IMMEDIATE_INDICATOR =  "#";
 const constexpr char* INDIRECT_INDICATOR =  "@";
 const constexpr char* FORMAT_4_INDICATOR =  "+";
@@ -22,9 +23,11 @@ const constexpr char* NUMBER_PADDING = "0";
 const constexpr char* EMPTY_STRING =  "";
 const constexpr char* SPACE = " ";
 const constexpr char* START_DIRECTIVE =  "START";
+const constexpr char* CSECT_DIRECTIVE =  "CSECT";
 const constexpr char* FIRST_DIRECTIVE =  "FIRST";
 const constexpr char* BASE_DIRECTIVE =  "BASE";
 const constexpr char* BYTE_DIRECTIVE = "BYTE";
+const constexpr char* WORD_DIRECTIVE = "WORD";
 const constexpr char* LITERAL_DIRECTIVE = "*";
 const constexpr char* RESB_DIRECTIVE = "RESB";
 const constexpr char* LTORG_DIRECTIVE = "LTORG";
@@ -71,48 +74,25 @@ const std::string prependString(const std::string& prependStr, const std::string
  *                        OUTPUT                         *
  *********************************************************/
 // Simple helper function that will retrieve the appropriate information to print the column names
-const SymbolEntries printHeader(const char* argv[], std::ofstream& outputFile)
+const SymbolEntries printHeader(const char* argv[], std::ostream& outputFile)
 {
     const SymbolEntries symbolEntries = FileHandling::readSymbolTableFile(argv[SYMBOL_FILE_ARG_NUMBER]);   
     const std::string programName = FileHandling::getProgramName(argv[INPUT_FILE_ARG_NUMBER]);
-    const std::string startAddress = symbolEntries.SYMTAB[0].address;
+    const std::string startAddress = symbolEntries.SYMTAB.empty() ? std::string() : symbolEntries.SYMTAB[0].address;   // Empty like the default mode
     FileHandling::print_column_names(outputFile, programName, startAddress);
     return symbolEntries;
 }
 
-// This will be create the appropriate output for a symbol
-void outputSymbol(DisassemblerContext& context, const int LOCCTR, const LITTAB_Entry& entry, std::ofstream& outputFile)
-{   
-    const bool IS_LITERAL = entry.lit_const.front() == '='; 
-    if(IS_LITERAL)
-    {
-        OUTPUT_LTORG(context);
-        outputFile << 
-        Output
-        {
-            CREATE_LOCCTR_OUTPUT(LOCCTR), 
-            EMPTY_STRING,
-            LITERAL_DIRECTIVE, 
-            entry.lit_const, 
-            entry.lit_const.substr(3, std::stoi(entry.length))
-        };
-    }
-    else
-    {
-        outputFile << 
-        Output
-        {
-            CREATE_LOCCTR_OUTPUT(LOCCTR), 
-            CREATE_SYMBOL_OUTPUT(LOCCTR, context.symmap, context.litmap), 
-            BYTE_DIRECTIVE, 
-            entry.lit_const, 
-            entry.lit_const.substr(2, std::stoi(entry.length))
-        };
-    }
+// Literals are placed after an LTORG the first time one shows up, BYTE constants are not
+void outputSymbol(DisassemblerContext& context, const int LOCCTR, const LITTAB_Entry& entry)
+{
+    const bool IS_LITERAL = entry.lit_const.front() == '=';
+    if (IS_LITERAL) OUTPUT_LTORG(context);
+    context.sink.literal(LOCCTR, entry);
 }
 
 // First row to print
-std::ostream& FileHandling::print_column_names(std::ofstream& stream, const std::string& programName, const std::string& startAddress)
+std::ostream& FileHandling::print_column_names(std::ostream& stream, const std::string& programName, const std::string& startAddress)
 {
     return stream   
     << appendWord(pad(startAddress)) 
@@ -122,8 +102,34 @@ std::ostream& FileHandling::print_column_names(std::ofstream& stream, const std:
     << std::endl; 
 }
 
+// First row of every control section after the first
+std::ostream& FileHandling::printCsect(std::ostream& stream, const std::string& sectionName, const std::string& startAddress)
+{
+    return stream   
+    << appendWord(pad(startAddress)) 
+    << appendWord(sectionName)  
+    << appendWord(CSECT_DIRECTIVE) 
+    << appendWord(EMPTY_STRING) 
+    << std::endl; 
+}
+
+// EXTDEF and EXTREF rows, names are listed comma separated like the assembler source
+std::ostream& FileHandling::printExternalDirective(std::ostream& stream, const std::string& directive, const std::vector<std::string>& names)
+{
+    if (names.empty()) return stream;
+    std::string nameList = names.front();
+    for (std::size_t i = 1; i < names.size(); i++)
+        nameList += "," + names[i];
+    return stream   
+    << appendWord(EMPTY_STRING) 
+    << appendWord(EMPTY_STRING)  
+    << appendWord(directive) 
+    << appendWord(nameList) 
+    << std::endl; 
+}
+
 // Last row to print
-std::ostream& FileHandling::printEnd(std::ofstream& stream, const std::string& programName)
+std::ostream& FileHandling::printEnd(std::ostream& stream, const std::string& programName)
 {
     return stream   
     << appendWord(EMPTY_STRING) 
@@ -133,18 +139,13 @@ std::ostream& FileHandling::printEnd(std::ofstream& stream, const std::string& p
     << std::endl; 
 }
 
-// This will handle the unique output for a BASE_DIRECTIVE
+// LDB is what tells us BASE changed, the listing shows it as a BASE directive
 void FileHandling::handleBaseDirective(const std::string& opcode, const std::string& objectCode, DisassemblerContext& context)
 {
     if (opcode == LDB_INSTRUCTION)
     {
         context.baseAddress = hexStringToInt(objectCode.substr(3, objectCode.size()));
-        context.outputFile 
-        << appendWord(EMPTY_STRING)
-        << appendWord(EMPTY_STRING)
-        << appendWord(BASE_DIRECTIVE) 
-        << appendWord(CREATE_SYMBOL_OUTPUT(context.baseAddress, context.symmap, context.litmap))  
-        << std::endl;
+        context.sink.base(context.baseAddress);
     }          
 }
 
@@ -167,17 +168,16 @@ std::ostream& operator<<(std::ostream& stream, const Output output)
 namespace
 {
     // Search tables for address of interest
-    const std::string findLabel(const int LOCCTR, const SYMMAP& symmap, const LITMAP& litmap)
+    const std::string findLabel(const int LOCCTR, const SymbolProvider& symbols)
     {
-        auto lit_it = litmap.find(LOCCTR);
-        if (lit_it != litmap.end()) {
-            if (lit_it->second.name == LITERAL_DIRECTIVE)
-                return lit_it->second.lit_const;
-            return lit_it->second.name;
+        if (symbols.hasLiteral(LOCCTR)) {
+            const LITTAB_Entry literal = symbols.getLiteral(LOCCTR);
+            if (literal.name == LITERAL_DIRECTIVE)
+                return literal.lit_const;
+            return literal.name;
         }
-        auto sym_it = symmap.find(LOCCTR);
-        if (sym_it != symmap.end()) {
-            return sym_it->second.symbol;
+        if (symbols.hasSymbol(LOCCTR)) {
+            return symbols.getSymbol(LOCCTR);
         }
         return EMPTY_STRING;
     }
@@ -190,9 +190,9 @@ const std::string CREATE_LOCCTR_OUTPUT(const int LOCCTR)
 }
 
 // Search Our Symbol table
-const std::string CREATE_SYMBOL_OUTPUT(const int LOCCTR, const SYMMAP& symmap, const LITMAP& litmap)
+const std::string CREATE_SYMBOL_OUTPUT(const int LOCCTR, const SymbolProvider& symbols)
 {
-    return findLabel(LOCCTR, symmap, litmap);
+    return findLabel(LOCCTR, symbols);
 }
 
 // Will determine if any assembler information needs to be appended/prepended to opcode
@@ -203,16 +203,25 @@ const std::string CREATE_OPCODE_OUTPUT(const std::string& opcode, const Addressi
     return opcode;
 }
 
+// Numeric form of the target address, displacements are signed and absolute addresses are not
+const int32_t CALCULATE_TARGET_ADDRESS(const TargetAddressMode targetAddressMode, const std::string& objectCode, const OffsetInfo& offsetInfo)
+{
+    const std::string address = objectCode.substr(3, objectCode.size()-1); // Last 3 digits of object code
+    if (targetAddressMode == TargetAddressMode::Base)
+        return offsetInfo.BASE + hexStringToInt(address);
+    else if (targetAddressMode == TargetAddressMode::PC)
+        return offsetInfo.PC + hexStringToInt(address);
+    return convertStringToHex(address);
+}
+
 namespace //Helpers to construct address
 {
     // Will add BC or Base to displacement for our address
     const std::string getAddress(const TargetAddressMode targetAddressMode, const std::string& objectCode, const OffsetInfo& offsetInfo)
     {
         const std::string address = objectCode.substr(3, objectCode.size()-1); // Last 3 digits of object code
-        if (targetAddressMode == TargetAddressMode::Base)
-            return pad(intToHexString(offsetInfo.BASE + hexStringToInt(address)));
-        else if (targetAddressMode == TargetAddressMode::PC)
-            return pad(intToHexString(offsetInfo.PC + hexStringToInt(address)));
+        if (targetAddressMode == TargetAddressMode::Base || targetAddressMode == TargetAddressMode::PC)
+            return pad(intToHexString(CALCULATE_TARGET_ADDRESS(targetAddressMode, objectCode, offsetInfo)));
         else if (targetAddressMode == TargetAddressMode::Absolute)
             return pad(address);
         return EMPTY_STRING;
@@ -235,7 +244,7 @@ const std::string CREATE_ADDRESS_OUTPUT(const AddressingInfo& addressingInfo, co
     const std::string address = getAddress(addressingInfo.targetAddressMode, state.instruction.objectCode, offsetInfo);
     const int32_t tableAddress = hexStringToInt(address);
     if (state.instruction.format == AddressingFormat::Format2) return state.registers.find(tableAddress)->second;
-    const std::string tableLabel = findLabel(tableAddress, state.symmap, state.litmap);
+    const std::string tableLabel = findLabel(tableAddress, state.symbols);
     const std::string label = tableLabel==EMPTY_STRING ||tableLabel==FIRST_DIRECTIVE ? address : tableLabel;
     const std::string indexed = addressingInfo.is_indexed ? ",X" : "";
     return prependAddressMode(addressingInfo.addressingMode, label) + indexed;
@@ -244,7 +253,96 @@ const std::string CREATE_ADDRESS_OUTPUT(const AddressingInfo& addressingInfo, co
 void OUTPUT_LTORG(DisassemblerContext& context)
 {
     if (context.LTORG) return;
-    context.outputFile << 
+    context.sink.ltorg();
+    context.LTORG = true;
+}
+
+void HANDLE_RESB_DIRECTIVE(const int32_t sectionGap, const int32_t LOCCTR, const DisassemblerContext& context)
+{
+    context.sink.reserve(LOCCTR, sectionGap);
+}
+
+// No manipulations but keep our main function consistent
+const std::string CREATE_OBJECT_OUTPUT(const std::string& objectCode)
+{
+    return objectCode;
+}/*********************************************************/
+
+/********************************************************* 
+ *                     LISTING SINK                      *
+ *********************************************************/
+void ListingSink::start(const std::string& programName, const std::string& startAddress)
+{
+    MemoryScope scope(MemorySubsystem::Output);
+    FileHandling::print_column_names(stream, programName, startAddress);
+}
+
+void ListingSink::instruction(const DisassemblerState& state, const int bytesReadIn)
+{
+    MemoryScope scope(MemorySubsystem::Output);
+    generateOutput(state, bytesReadIn, stream);
+}
+
+void ListingSink::literal(const int LOCCTR, const LITTAB_Entry& entry)
+{
+    MemoryScope scope(MemorySubsystem::Output);
+    const bool IS_LITERAL = entry.lit_const.front() == '=';
+    if (IS_LITERAL)
+    {
+        stream << 
+        Output
+        {
+            CREATE_LOCCTR_OUTPUT(LOCCTR), 
+            EMPTY_STRING,
+            LITERAL_DIRECTIVE, 
+            entry.lit_const, 
+            entry.lit_const.substr(3, std::stoi(entry.length))
+        };
+    }
+    else
+    {
+        stream << 
+        Output
+        {
+            CREATE_LOCCTR_OUTPUT(LOCCTR), 
+            CREATE_SYMBOL_OUTPUT(LOCCTR, symbols), 
+            BYTE_DIRECTIVE, 
+            entry.lit_const, 
+            entry.lit_const.substr(2, std::stoi(entry.length))
+        };
+    }
+}
+
+// BYTE shows the bytes as a hex constant, WORD shows its value the way the source would have written it
+void ListingSink::data(const int LOCCTR, const std::string& bytes, const DataDirective directive)
+{
+    MemoryScope scope(MemorySubsystem::Output);
+    stream << 
+    Output
+    {
+        CREATE_LOCCTR_OUTPUT(LOCCTR), 
+        CREATE_SYMBOL_OUTPUT(LOCCTR, symbols), 
+        directive == DataDirective::Word ? WORD_DIRECTIVE : BYTE_DIRECTIVE, 
+        directive == DataDirective::Word ? std::to_string(hexStringToInt(bytes)) : "X'" + bytes + "'",
+        bytes
+    };
+}
+
+void ListingSink::base(const int address)
+{
+    MemoryScope scope(MemorySubsystem::Output);
+    stream 
+    << appendWord(EMPTY_STRING)
+    << appendWord(EMPTY_STRING)
+    << appendWord(BASE_DIRECTIVE) 
+    << appendWord(CREATE_SYMBOL_OUTPUT(address, symbols))  
+    << std::endl;
+}
+
+void ListingSink::ltorg()
+{
+    MemoryScope scope(MemorySubsystem::Output);
+    stream << 
     Output
     {
         EMPTY_STRING,
@@ -253,25 +351,24 @@ void OUTPUT_LTORG(DisassemblerContext& context)
         EMPTY_STRING,
         EMPTY_STRING, 
     };
-    context.LTORG = true;
 }
 
-void HANDLE_RESB_DIRECTIVE(const int32_t sectionGap, const int32_t LOCCTR, const DisassemblerContext& context)
+void ListingSink::reserve(const int LOCCTR, const int32_t bytes)
 {
-    context.outputFile << 
+    MemoryScope scope(MemorySubsystem::Output);
+    stream << 
     Output
     {
         CREATE_LOCCTR_OUTPUT(LOCCTR), 
-        CREATE_SYMBOL_OUTPUT(LOCCTR, context.symmap, context.litmap), 
+        CREATE_SYMBOL_OUTPUT(LOCCTR, symbols), 
         RESB_DIRECTIVE, 
-        std::to_string(sectionGap),
+        std::to_string(bytes),
         EMPTY_STRING 
     };
-
 }
 
-// No manipulations but keep our main function consistent
-const std::string CREATE_OBJECT_OUTPUT(const std::string& objectCode)
+void ListingSink::finish(const std::string& programName)
 {
-    return objectCode;
-}
\ No newline at end of file
+    MemoryScope scope(MemorySubsystem::Output);
+    FileHandling::printEnd(stream, programName);
+}
@@ -2,24 +2,48 @@
 #define OUTPUT_HANDLER_H
 
 #include <fstream>
-#include <fstream>
+#include <vector>
 #include "parser.hpp"
 #include "symbol_table.hpp"
 #include "disassembly.hpp"
+#include "sinks.hpp"
+
+#define LISTING_COLUMN_WIDTH 12                                     // Every listing column is padded to this many characters
+#define BYTE_CONSTANT_MAX_BYTES ((LISTING_COLUMN_WIDTH - 4) / 2)    // X'' around the hex plus a separating space still fit a column
 
 struct DisassemblerContext;
 struct DisassemblerState;
 
 namespace FileHandling
 {
-    std::ostream& print_column_names(std::ofstream& stream, const std::string& programName, const std::string& startAddress);
+    std::ostream& print_column_names(std::ostream& stream, const std::string& programName, const std::string& startAddress);
     void handleBaseDirective(const std::string& opcode, const std::string& objectCode, DisassemblerContext& context);
-    std::ostream& printEnd(std::ofstream& stream, const std::string& programName);
+    std::ostream& printEnd(std::ostream& stream, const std::string& programName);
+    std::ostream& printCsect(std::ostream& stream, const std::string& sectionName, const std::string& startAddress);
+    std::ostream& printExternalDirective(std::ostream& stream, const std::string& directive, const std::vector<std::string>& names);
 }
 
 const std::string prependString(const std::string& prependStr, const std::string& str);
-const SymbolEntries printHeader(const char* argv[], std::ofstream& outputFile);
-void outputSymbol(DisassemblerContext& context, const int LOCCTR, const LITTAB_Entry& entry, std::ofstream& outputFile);
+const SymbolEntries printHeader(const char* argv[], std::ostream& outputFile);
+void outputSymbol(DisassemblerContext& context, const int LOCCTR, const LITTAB_Entry& entry);
+
+/* The out.lst writer, every event becomes the listing line it stands for */
+class ListingSink : public DisassemblySink
+{
+    public:
+        ListingSink(std::ostream& stream, const SymbolProvider& symbols) : stream(stream), symbols(symbols) {}
+        void start(const std::string& programName, const std::string& startAddress) override;
+        void instruction(const DisassemblerState& state, const int bytesReadIn) override;
+        void literal(const int LOCCTR, const LITTAB_Entry& entry) override;
+        void data(const int LOCCTR, const std::string& bytes, const DataDirective directive) override;
+        void base(const int address) override;
+        void ltorg() override;
+        void reserve(const int LOCCTR, const int32_t bytes) override;
+        void finish(const std::string& programName) override;
+    private:
+        std::ostream& stream;
+        const SymbolProvider& symbols;
+};
 
 struct AddressingInfo
 {
@@ -68,8 +92,9 @@ struct Indexed
 };
 
 const std::string CREATE_LOCCTR_OUTPUT(const int LOCCTR);
-const std::string CREATE_SYMBOL_OUTPUT(const int LOCCTR, const SYMMAP& symmap, const LITMAP& litmap);
+const std::string CREATE_SYMBOL_OUTPUT(const int LOCCTR, const SymbolProvider& symbols);
 const std::string CREATE_OPCODE_OUTPUT(const std::string& opcode, const AddressingFormat format);
+const int32_t CALCULATE_TARGET_ADDRESS(const TargetAddressMode targetAddressMode, const std::string& objectCode, const OffsetInfo& offsetInfo);
 const std::string CREATE_ADDRESS_OUTPUT(const AddressingInfo& addressingInfo, const OffsetInfo& offsetInfo, const DisassemblerState& state);
 const std::string CREATE_OBJECT_OUTPUT(const std::string& objectCode);
 void HANDLE_RESB_DIRECTIVE(const int32_t sectionGap, const int32_t LOCCTR, const DisassemblerContext& context);
@@ -0,0 +1,270 @@
+/*
+ *  @brief
+ *          Listing written by several threads at once, each one pwrite-ing its records at a known offset of out.lst
+ *
+ *  Even the pipeline funnels every line through one std::ofstream. Here the records are decoded side by side, then a
+ *  cheap sequential walk over the decoded items works out what each record inherits from the ones before it: where
+ *  the previous record ended (its RESB gap), the BASE left by the last LDB and whether LTORG was already printed.
+ *  That is everything a record's listing lines depend on, so each worker renders its own run of records and knows
+ *  the line count and byte span of every one of them. The spans give each run its offset, out.lst is preallocated
+ *  to the total and the workers pwrite their runs without waiting on each other. The result is byte for byte the
+ *  listing the sequential engine writes.
+ *
+ *  Columns are padded to COLUMN_SPACING but a longer label or literal widens its line, so spans are measured from
+ *  the rendered text rather than assumed from a fixed line width.
+ */
+
+#include "parallel_output.hpp"
+#include "pipeline.hpp"
+#include "byte_operations.hpp"
+#include "binary_object.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+const constexpr int INPUT_FILE_ARG_NUMBER = 1;
+const constexpr int THREADS_ARG_NUMBER = 3;
+const constexpr int INITIAL_BASE = 0;
+const constexpr int FIRST_TWELVE_BITS = 3;
+const constexpr int OUTPUT_FILE_MODE = 0644;
+const constexpr double NANOS_PER_MILLI = 1e6;
+const constexpr char LITERAL_PREFIX = '=';
+const constexpr char* LDB_INSTRUCTION = "LDB";
+const constexpr char* OUTPUT_FILE_NAME = "out.lst";
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    /* What a record's listing lines depend on from the records before it */
+    struct RecordLayout
+    {
+        int32_t sectionGap;
+        int32_t lastTextSectionEnd;
+        int BASE;
+        bool LTORG;
+    };
+
+    /* How much of out.lst one record's lines take up */
+    struct RecordSpan
+    {
+        uint64_t lines;
+        uint64_t bytes;
+    };
+
+    /* A contiguous run of records handled by one worker, rendered into one buffer and written with one pwrite */
+    struct RecordRun
+    {
+        std::size_t first;
+        std::size_t last;
+        std::string text;
+        uint64_t offset;
+    };
+
+    double millisSince(const Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / NANOS_PER_MILLI;
+    }
+
+    std::vector<TextRecord> READ_RECORDS(std::istream& inputFile)
+    {
+        std::vector<TextRecord> records;
+        for (TextRecord record = FileHandling::readTextRecord(inputFile); record.sectionFound; record = FileHandling::readTextRecord(inputFile))
+            records.push_back(record);
+        return records;
+    }
+
+    // Runs share out the records so each holds about the same number of bytes of object code
+    std::vector<RecordRun> SPLIT_RUNS(const std::vector<TextRecord>& records, const std::size_t threads)
+    {
+        std::size_t totalBytes = 0;
+        for (const TextRecord& record : records) totalBytes += record.objectCode.size();
+        std::vector<RecordRun> runs;
+        std::size_t first = 0;
+        std::size_t runBytes = 0;
+        for (std::size_t i = 0; i < records.size(); i++)
+        {
+            runBytes += records[i].objectCode.size();
+            if (runBytes * threads >= totalBytes * (runs.size() + 1) || i + 1 == records.size()) {
+                runs.push_back(RecordRun{first, i + 1, std::string(), 0});
+                first = i + 1;
+            }
+        }
+        return runs;
+    }
+
+    template <typename Work>
+    void RUN_EACH(std::vector<RecordRun>& runs, const Work& work)
+    {
+        std::vector<std::thread> workers;
+        for (std::size_t run = 1; run < runs.size(); run++)
+            workers.push_back(std::thread([&, run]() {work(runs[run]);}));
+        if (!runs.empty()) work(runs[0]);
+        for (std::thread& worker : workers) worker.join();
+    }
+
+    // The only sequential pass, it looks at opcodes and literal names and nothing else. One extra layout describes what follows the last record
+    std::vector<RecordLayout> LAY_OUT_RECORDS(const std::vector<TextRecord>& records, const std::vector<std::vector<DecodedItem>>& decoded)
+    {
+        std::vector<RecordLayout> layouts;
+        layouts.reserve(records.size() + 1);
+        int32_t lastTextSectionEnd = 0;
+        int BASE = INITIAL_BASE;
+        bool LTORG = false;
+        for (std::size_t i = 0; i < records.size(); i++)
+        {
+            layouts.push_back(RecordLayout{records[i].LOCCTR_START - lastTextSectionEnd, lastTextSectionEnd, BASE, LTORG});
+            for (const DecodedItem& item : decoded[i])
+            {
+                if (item.literal) LTORG = LTORG || item.literal->lit_const.front() == LITERAL_PREFIX;
+                else if (item.result.instruction.opCode == LDB_INSTRUCTION) BASE = hexStringToInt(item.result.instruction.objectCode.substr(FIRST_TWELVE_BITS));
+            }
+            lastTextSectionEnd = decoded[i].empty() ? records[i].LOCCTR_START : decoded[i].back().LOCCTR + decoded[i].back().result.bytesReadIn;
+        }
+        layouts.push_back(RecordLayout{0, lastTextSectionEnd, BASE, LTORG});
+        return layouts;
+    }
+
+    // Same calls the pipeline's resolver makes, starting from the state the layout says this record inherits
+    void RENDER_RUN(RecordRun& run, const std::vector<std::vector<DecodedItem>>& decoded, const std::vector<RecordLayout>& layouts, const REGMAP& registers, const SymbolProvider& symbols, const Parser& parser, std::vector<RecordSpan>& spans)
+    {
+        std::istringstream noInput;
+        std::ostringstream buffer;
+        ListingSink listing(buffer, symbols);
+        for (std::size_t i = run.first; i < run.last; i++)
+        {
+            const RecordLayout& layout = layouts[i];
+            const std::streamoff before = buffer.tellp();
+            DisassemblerContext context{noInput, buffer, listing, registers, symbols, parser, layout.BASE, layout.LTORG};
+            fillGap(layout.sectionGap, layout.lastTextSectionEnd, symbols, context);
+            for (const DecodedItem& item : decoded[i])
+            {
+                if (item.literal) {
+                    outputSymbol(context, item.LOCCTR, *item.literal);
+                }
+                else {
+                    const DisassemblerState state{context.baseAddress, item.LOCCTR, item.result.instruction, registers, symbols};
+                    context.sink.instruction(state, item.result.bytesReadIn);
+                    FileHandling::handleBaseDirective(item.result.instruction.opCode, item.result.instruction.objectCode, context);
+                }
+            }
+            spans[i].bytes = static_cast<std::streamoff>(buffer.tellp()) - before;
+        }
+        run.text = buffer.str();
+        uint64_t position = 0;
+        for (std::size_t i = run.first; i < run.last; i++)
+        {
+            spans[i].lines = std::count(run.text.begin() + position, run.text.begin() + position + spans[i].bytes, '\n');
+            position += spans[i].bytes;
+        }
+    }
+
+    // pwrite may write less than asked, keep going until the whole run is down
+    void WRITE_AT(const int descriptor, const std::string& text, const uint64_t offset)
+    {
+        std::size_t written = 0;
+        while (written < text.size())
+        {
+            const ssize_t result = pwrite(descriptor, text.data() + written, text.size() - written, offset + written);
+            if (result < 0) {
+                std::cerr << "Failed to write " << OUTPUT_FILE_NAME << ": " << std::strerror(errno) << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            written += result;
+        }
+    }
+
+    // Falls back to ftruncate on filesystems without fallocate, the size is what matters for the offsets
+    int PREALLOCATE_OUTPUT(const uint64_t size)
+    {
+        const int descriptor = open(OUTPUT_FILE_NAME, O_WRONLY | O_CREAT | O_TRUNC, OUTPUT_FILE_MODE);
+        if (descriptor < 0) {
+            std::cerr << "Failed to open file: " << OUTPUT_FILE_NAME << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        if (size > 0 && posix_fallocate(descriptor, 0, size) != 0 && ftruncate(descriptor, size) != 0) {
+            std::cerr << "Failed to preallocate " << size << " bytes for " << OUTPUT_FILE_NAME << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        return descriptor;
+    }
+}
+
+// Expects argv[1] to be the object file, argv[2] the symbol file and optionally argv[3] the number of worker threads
+int runParallelOutputMode(const int argc, const char* argv[])
+{
+    const Clock::time_point start           = Clock::now();
+    InputFile inputFile                     = FileHandling::openFile(argv[INPUT_FILE_ARG_NUMBER]);
+    REFUSE_BINARY_OBJECT(inputFile, argv[INPUT_FILE_ARG_NUMBER], "--pwrite");
+    std::ostringstream header;
+    const SymbolEntries symbolEntries       = printHeader(argv, header);
+    const LITMAP litmap                     = CREATE_LITMAP(symbolEntries);
+    const SYMMAP symmap                     = CREATE_SYMMAP(symbolEntries);
+    const REGMAP registers                  = REGISTERS();
+    const MapSymbolProvider symbols         (symmap, litmap);
+    const Parser parser;
+    const std::string programName           = FileHandling::getProgramName(argv[INPUT_FILE_ARG_NUMBER]);
+    const int threads                       = argc > THREADS_ARG_NUMBER ? std::atoi(argv[THREADS_ARG_NUMBER]) : std::max(1u, std::thread::hardware_concurrency());
+    if (threads <= 0) {
+        std::cerr << "Threads must be a positive number: " << argv[THREADS_ARG_NUMBER] << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    const std::vector<TextRecord> records   = READ_RECORDS(inputFile);
+    std::vector<RecordRun> runs             = SPLIT_RUNS(records, threads);
+    std::vector<std::vector<DecodedItem>>   decoded(records.size());
+    RUN_EACH(runs, [&](RecordRun& run) {
+        for (std::size_t i = run.first; i < run.last; i++)
+        {
+            const std::vector<InstructionBoundary> boundaries = SCAN_INSTRUCTION_LENGTHS(DECODE_HEX_BYTES(records[i].objectCode), records[i].LOCCTR_START, litmap);
+            decoded[i] = DECODE_BOUNDARIES(records[i], boundaries, 0, boundaries.size(), parser);
+        }
+    });
+    const double decodeMillis = millisSince(start);
+
+    const Clock::time_point renderStart = Clock::now();
+    const std::vector<RecordLayout> layouts = LAY_OUT_RECORDS(records, decoded);
+    std::vector<RecordSpan> spans           (records.size());
+    RUN_EACH(runs, [&](RecordRun& run) {RENDER_RUN(run, decoded, layouts, registers, symbols, parser, spans);});
+
+    // Trailing RESB and END, the gap is measured the way the sequential engine measures it
+    std::ostringstream trailer;
+    std::istringstream noInput;
+    ListingSink trailerListing              (trailer, symbols);
+    const RecordLayout& end                 = layouts.back();
+    const DisassemblerContext               trailerContext{noInput, trailer, trailerListing, registers, symbols, parser, end.BASE, end.LTORG};
+    fillGap(GET_LAST_SYMBOL_ADDRESS(symbolEntries), end.lastTextSectionEnd, symbols, trailerContext);
+    FileHandling::printEnd(trailer, programName);
+    const double renderMillis = millisSince(renderStart);
+
+    const Clock::time_point writeStart = Clock::now();
+    uint64_t offset = header.str().size();
+    uint64_t lines = 0;
+    for (RecordRun& run : runs)
+    {
+        run.offset = offset;
+        offset += run.text.size();
+        for (std::size_t i = run.first; i < run.last; i++) lines += spans[i].lines;
+    }
+    const std::string trailerText = trailer.str();
+    const uint64_t totalBytes = offset + trailerText.size();
+    const int descriptor = PREALLOCATE_OUTPUT(totalBytes);
+    WRITE_AT(descriptor, header.str(), 0);
+    RUN_EACH(runs, [&](RecordRun& run) {WRITE_AT(descriptor, run.text, run.offset);});
+    WRITE_AT(descriptor, trailerText, offset);
+    close(descriptor);
+    const double writeMillis = millisSince(writeStart);
+
+    std::cerr << "pwrite: " << records.size() << " records in " << runs.size() << " runs, " << lines << " record lines, "
+    << totalBytes << " bytes, decode " << std::fixed << std::setprecision(3) << decodeMillis << " ms, render " << renderMillis
+    << " ms, write " << writeMillis << " ms" << std::endl;
+    inputFile.close();
+    return EXIT_SUCCESS;
+}
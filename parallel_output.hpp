@@ -0,0 +1,6 @@
+#ifndef PARALLEL_OUTPUT_H
+#define PARALLEL_OUTPUT_H
+
+int runParallelOutputMode(const int argc, const char* argv[]);
+
+#endif
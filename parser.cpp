@@ -7,6 +7,7 @@
  */
 
 #include "parser.hpp"
+#include "memory_accounting.hpp"
 #include "input_handler.hpp"
 #include "byte_operations.hpp"
 
@@ -15,6 +16,8 @@
 #define FIRST_DIGIT 0
 #define SECOND_DIGIT 1
 #define LENGTH_OF_BYTE_IN_CHARS 2
+#define LOW_NIBBLE_MASK 0x0F
+#define NIBBLE_BITS 4
 
 namespace // Helper methods to take the first three hex digits, and get a substring of either the first two or last two digits
 {
@@ -27,11 +30,18 @@ namespace // Helper methods to take the first three hex digits, and get a substr
     {
         return firstThreeHexDigits.substr(SECOND_DIGIT, LENGTH_OF_BYTE_IN_CHARS);
     }
+
+    // The same second and third hex digits as above, put together from raw bytes
+    int getSecondTwoHexDigits(const uint8_t firstByte, const uint8_t secondByte)
+    {
+        return (firstByte & LOW_NIBBLE_MASK) << NIBBLE_BITS | secondByte >> NIBBLE_BITS;
+    }
 }
 
 /* On allocation, will load all instruction constants into memory to be used by parser for format determination*/
 Parser::Parser()
 {
+    MemoryScope scope(MemorySubsystem::Parser);
     this->instructionBindings = std::unique_ptr<InstructionBindings>(new InstructionBindings());   
 }
 
@@ -72,8 +82,35 @@ bool Parser::isIndexed(const std::string& firstThreeHexDigits) const
     return extract_x_flag(convertStringToHex(getSecondTwoHexDigits(firstThreeHexDigits)));
 }
 
+/* Byte versions of the above for objects that were never hex text, each answers exactly what its string twin does */
+std::string Parser::determineOpCode(const uint8_t firstByte) const
+{
+    return this->instructionBindings->getMnemonic(convertHexToString(extractOpCode(firstByte)));
+}
+
+AddressingFormat Parser::determineFormat(const uint8_t firstByte, const uint8_t secondByte) const
+{
+    if (this->instructionBindings->isFormat2(convertHexToString(extractOpCode(firstByte)))) return AddressingFormat::Format2;
+    return extract_e_flag(getSecondTwoHexDigits(firstByte, secondByte)) ? AddressingFormat::Format4 : AddressingFormat::Format3;
+}
+
+AddressingMode Parser::determineAddressingMode(const uint8_t firstByte) const
+{
+    return static_cast<AddressingMode>(extract_ni_flags(firstByte));
+}
+
+TargetAddressMode Parser::determineTargetAddressMode(const uint8_t firstByte, const uint8_t secondByte) const
+{
+    return static_cast<TargetAddressMode>(extract_bp_flags(getSecondTwoHexDigits(firstByte, secondByte)));
+}
+
+bool Parser::isIndexed(const uint8_t firstByte, const uint8_t secondByte) const
+{
+    return extract_x_flag(getSecondTwoHexDigits(firstByte, secondByte));
+}
+
 /* Uses the format determination to figure out how many more bytes need to be read in after the first twelve bits */
-std::string Parser::readInFullInstruction(std::ifstream& stream, const std::string& firstTwelveBits, const AddressingFormat format) const
+std::string Parser::readInFullInstruction(std::istream& stream, const std::string& firstTwelveBits, const AddressingFormat format) const
 {
     return firstTwelveBits + FileHandling::readInBytes(stream, static_cast<int>(format)-TWO_BYTES, PLUS_HALF_BYTE); // static cast format gives value between 2 and 4
 }
@@ -89,6 +126,7 @@ std::map<int, std::string> REGISTERS()
         {4, "S"},
         {5, "T"},
         {6, "F"},
-        {8, "PC"}
+        {8, "PC"},
+        {9, "SW"}
     };
 }
\ No newline at end of file
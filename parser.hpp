@@ -5,6 +5,7 @@
 #include "instructions.hpp"
 #include "symbol_table.hpp"
 
+#include <cstdint>
 #include <memory>
 
 enum class AddressingFormat
@@ -37,7 +38,12 @@ class Parser
         AddressingMode determineAddressingMode(const std::string& instruction) const;
         TargetAddressMode determineTargetAddressMode(const std::string& instruction) const;
         bool isIndexed(const std::string& firstThreeHexDigits) const;
-        std::string readInFullInstruction(std::ifstream& stream, const std::string& firstTwelveBits, const AddressingFormat format) const;
+        std::string determineOpCode(const uint8_t firstByte) const;
+        AddressingFormat determineFormat(const uint8_t firstByte, const uint8_t secondByte) const;
+        AddressingMode determineAddressingMode(const uint8_t firstByte) const;
+        TargetAddressMode determineTargetAddressMode(const uint8_t firstByte, const uint8_t secondByte) const;
+        bool isIndexed(const uint8_t firstByte, const uint8_t secondByte) const;
+        std::string readInFullInstruction(std::istream& stream, const std::string& firstTwelveBits, const AddressingFormat format) const;
     private:
         std::unique_ptr<InstructionBindings> instructionBindings;
 };
@@ -0,0 +1,267 @@
+/*
+ *  @brief
+ *          Runs the disassembler as four stages on their own threads connected by single producer/consumer rings
+ *
+ *  reader   : pulls whole T records off the object file
+ *  decoder  : finds every boundary of a record with the length pre-scan (length_scan), then splits it into literals
+ *             and parsed instructions
+ *  resolver : owns BASE and LTORG state, resolves the labels of a whole record in one batch (symbol_batch) and then
+ *             renders the listing lines (CREATE_*_OUTPUT)
+ *  writer   : streams the rendered text into out.lst
+ *
+ *  Each record flows through the stages in order so the listing is identical to the sequential engine.
+ *  When the run finishes, a table of per stage throughput is printed to stderr to show where the bottleneck is.
+ */
+
+#include "pipeline.hpp"
+#include "trace.hpp"
+#include "spsc_ring.hpp"
+#include "byte_operations.hpp"
+#include "length_scan.hpp"
+#include "memory_accounting.hpp"
+#include "symbol_batch.hpp"
+#include "binary_object.hpp"
+#include <chrono>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+const constexpr int INPUT_FILE_ARG_NUMBER = 1;
+const constexpr int INITIAL_BASE = 0;
+const constexpr int HEX_CHARS_PER_BYTE = 2;
+const constexpr char MISSING_HEX_DIGIT = '0';
+const constexpr std::size_t RING_CAPACITY = 256;
+const constexpr double NANOS_PER_SECOND = 1e9;
+const constexpr double NANOS_PER_MILLI = 1e6;
+const constexpr double BYTES_PER_MEGABYTE = 1024.0 * 1024.0;
+const constexpr char* OUTPUT_FILE_NAME = "out.lst";
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+    using RecordRing = SpscRing<TextRecord, RING_CAPACITY>;
+    using DecodedRing = SpscRing<DecodedRecord, RING_CAPACITY>;
+    using ChunkRing = SpscRing<RenderedChunk, RING_CAPACITY>;
+
+    uint64_t nanosSince(const Clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    }
+
+    // Literals carry no instruction, this fills the slot so every item has the same shape
+    const ParsingResult LITERAL_RESULT(const int bytes)
+    {
+        return ParsingResult{ParsedInstruction{"", AddressingFormat::Format3, AddressingMode::Simple, false, TargetAddressMode::Absolute, ""}, bytes};
+    }
+
+    void READ_STAGE(std::istream& inputFile, RecordRing& records, StageStats& stats, std::exception_ptr& failure)
+    {
+        NAME_TRACE_THREAD("reader");
+        bool sectionFound = true;
+        while (sectionFound)
+        {
+            TraceSpan span("readRecord");
+            const Clock::time_point start = Clock::now();
+            TextRecord record{0, 0, std::string(), false};
+            try {
+                record = FileHandling::readTextRecord(inputFile);
+            }
+            catch (const CorruptInputError&) {  // Ends the input here so the other stages drain and return, rethrown once they are joined
+                failure = std::current_exception();
+            }
+            sectionFound = record.sectionFound;
+            if (sectionFound) {
+                stats.items++;
+                stats.bytes += record.textSectionSize;
+            }
+            stats.busyNanos += nanosSince(start);
+            records.push(std::move(record)); // Record with sectionFound false tells the decoder we are done
+        }
+    }
+
+    // A T record holds at most 255 bytes, a few dozen instructions, so it is decoded on this thread in one go
+    std::vector<DecodedItem> DECODE_RECORD(const TextRecord& record, const LITMAP& litmap, const Parser& parser)
+    {
+        const std::vector<InstructionBoundary> boundaries = SCAN_INSTRUCTION_LENGTHS(DECODE_HEX_BYTES(record.objectCode), record.LOCCTR_START, litmap);
+        return DECODE_BOUNDARIES(record, boundaries, 0, boundaries.size(), parser);
+    }
+
+    void DECODE_STAGE(RecordRing& records, DecodedRing& decoded, const SymbolEntries& symbolEntries, const LITMAP& litmap, const Parser& parser, StageStats& stats)
+    {
+        NAME_TRACE_THREAD("decoder");
+        int32_t lastTextSectionEnd = 0;
+        while (true)
+        {
+            TextRecord record;
+            records.pop(record);
+            TraceSpan span("decodeRecord", record.LOCCTR_START);
+            const Clock::time_point start = Clock::now();
+            if (!record.sectionFound) {
+                const int32_t finalGap = GET_LAST_SYMBOL_ADDRESS(symbolEntries);
+                stats.busyNanos += nanosSince(start);
+                decoded.push(DecodedRecord{finalGap, lastTextSectionEnd, std::vector<DecodedItem>(), true});
+                return;
+            }
+            DecodedRecord decodedRecord{record.LOCCTR_START - lastTextSectionEnd, lastTextSectionEnd, DECODE_RECORD(record, litmap, parser), false};
+            for (const DecodedItem& item : decodedRecord.items) stats.bytes += item.result.bytesReadIn;
+            stats.items += decodedRecord.items.size();
+            lastTextSectionEnd = decodedRecord.items.empty() ? record.LOCCTR_START : decodedRecord.items.back().LOCCTR + decodedRecord.items.back().result.bytesReadIn;
+            stats.busyNanos += nanosSince(start);
+            decoded.push(std::move(decodedRecord));
+        }
+    }
+
+    // Owns the only mutable disassembler state (BASE and LTORG) so label resolution stays in program order
+    void RESOLVE_STAGE(DecodedRing& decoded, ChunkRing& chunks, DisassemblerContext& context, BatchSymbolProvider& batch, std::ostringstream& buffer, StageStats& stats)
+    {
+        NAME_TRACE_THREAD("resolver");
+        while (true)
+        {
+            DecodedRecord record;
+            decoded.pop(record);
+            TraceSpan span("resolveRecord", record.items.size());
+            const Clock::time_point start = Clock::now();
+            buffer.str(std::string());
+            int BASE = context.baseAddress;
+            batch.resolve(COLLECT_RECORD_TARGETS(record.items, BASE));
+            RENDER_DECODED_RECORD(context, record);
+            MemoryScope scope(MemorySubsystem::Output);     // The chunk waits in the ring as output buffering
+            RenderedChunk chunk{buffer.str(), record.last};
+            stats.items += record.items.size();
+            stats.bytes += chunk.text.size();
+            stats.busyNanos += nanosSince(start);
+            chunks.push(std::move(chunk));
+            if (record.last) return;
+        }
+    }
+
+    void WRITE_STAGE(ChunkRing& chunks, std::ostream& outputFile, StageStats& stats)
+    {
+        while (true)
+        {
+            RenderedChunk chunk;
+            chunks.pop(chunk);
+            TraceSpan span("writeChunk", chunk.text.size());
+            const Clock::time_point start = Clock::now();
+            outputFile << chunk.text;
+            stats.items++;
+            stats.bytes += chunk.text.size();
+            stats.busyNanos += nanosSince(start);
+            if (chunk.last) return;
+        }
+    }
+
+    void PRINT_STAGE_STATS(std::ostream& stream, const std::vector<StageStats>& stages)
+    {
+        stream << std::left << std::setw(10) << "stage" << std::right
+        << std::setw(10) << "items" << std::setw(12) << "bytes" << std::setw(12) << "busy(ms)"
+        << std::setw(14) << "items/s" << std::setw(10) << "MB/s"
+        << std::setw(10) << "starved" << std::setw(10) << "blocked" << std::endl;
+        for (const StageStats& stage : stages)
+        {
+            const double seconds = stage.busyNanos / NANOS_PER_SECOND;
+            const double itemsPerSecond = seconds > 0 ? stage.items / seconds : 0;
+            const double megabytesPerSecond = seconds > 0 ? stage.bytes / BYTES_PER_MEGABYTE / seconds : 0;
+            stream << std::left << std::setw(10) << stage.name << std::right
+            << std::setw(10) << stage.items << std::setw(12) << stage.bytes
+            << std::setw(12) << std::fixed << std::setprecision(3) << stage.busyNanos / NANOS_PER_MILLI
+            << std::setw(14) << std::setprecision(0) << itemsPerSecond
+            << std::setw(10) << std::setprecision(2) << megabytesPerSecond
+            << std::setw(10) << stage.starved << std::setw(10) << stage.blocked << std::endl;
+        }
+    }
+}
+
+// Field extraction for one run of boundaries, independent of every other run once the offsets are known
+std::vector<DecodedItem> DECODE_BOUNDARIES(const TextRecord& record, const std::vector<InstructionBoundary>& boundaries, const std::size_t first, const std::size_t last, const Parser& parser)
+{
+    MemoryScope scope(MemorySubsystem::Parser);
+    std::vector<DecodedItem> items;
+    items.reserve(last - first);
+    for (std::size_t i = first; i < last; i++)
+    {
+        const InstructionBoundary& boundary = boundaries[i];
+        const int LOCCTR = record.LOCCTR_START + boundary.offset;
+        if (boundary.literal) {
+            items.push_back(DecodedItem{LOCCTR, LITERAL_RESULT(boundary.length), boundary.literal});
+        }
+        else {
+            std::string objectCode = record.objectCode.substr(boundary.offset * HEX_CHARS_PER_BYTE, boundary.length * HEX_CHARS_PER_BYTE);
+            objectCode.resize(boundary.length * HEX_CHARS_PER_BYTE, MISSING_HEX_DIGIT);    // Record cut off mid instruction
+            items.push_back(DecodedItem{LOCCTR, parseInstruction(objectCode, parser), nullptr});
+        }
+    }
+    return items;
+}
+
+// The RESB gap in front of a decoded record and then its items, in order, into the context's sink
+void RENDER_DECODED_RECORD(DisassemblerContext& context, const DecodedRecord& record)
+{
+    fillGap(record.sectionGap, record.lastTextSectionEnd, context.symbols, context);
+    for (const DecodedItem& item : record.items)
+    {
+        if (item.literal) {
+            outputSymbol(context, item.LOCCTR, *item.literal);
+        }
+        else {
+            const DisassemblerState state{context.baseAddress, item.LOCCTR, item.result.instruction, context.registers, context.symbols};
+            context.sink.instruction(state, item.result.bytesReadIn);
+            FileHandling::handleBaseDirective(item.result.instruction.opCode, item.result.instruction.objectCode, context);
+        }
+    }
+}
+
+// Expects argv[1] to be the object file and argv[2] the symbol file, exactly like the default mode
+int runPipelineMode(const int argc, const char* argv[])
+{
+    InputFile inputFile                     = FileHandling::openFile(argv[INPUT_FILE_ARG_NUMBER]);
+    REFUSE_BINARY_OBJECT(inputFile, argv[INPUT_FILE_ARG_NUMBER], "--pipeline");
+    std::ofstream outputFile                (OUTPUT_FILE_NAME);
+    const SymbolEntries symbolEntries       = printHeader(argv, outputFile);
+    const LITMAP litmap                     = CREATE_LITMAP(symbolEntries);
+    const SYMMAP symmap                     = CREATE_SYMMAP(symbolEntries);
+    const REGMAP registers                  = REGISTERS();
+    const std::vector<SortedLabel> labels   = SORT_LABELS(symmap, litmap);
+    BatchSymbolProvider symbols             (labels);
+    const Parser parser;
+
+    std::istringstream noInput;             // The resolver never reads, records were already pulled in by the reader
+    std::ostringstream buffer;
+    ListingSink listing                     (buffer, symbols);
+    DisassemblerContext                     context{noInput, buffer, listing, registers, symbols, parser, INITIAL_BASE, false};
+
+    RecordRing records;
+    DecodedRing decoded;
+    ChunkRing chunks;
+    std::vector<StageStats> stages
+    {
+        StageStats{"reader", 0, 0, 0, 0, 0},
+        StageStats{"decoder", 0, 0, 0, 0, 0},
+        StageStats{"resolver", 0, 0, 0, 0, 0},
+        StageStats{"writer", 0, 0, 0, 0, 0}
+    };
+
+    std::exception_ptr readFailure;
+    std::thread reader(READ_STAGE, std::ref(inputFile), std::ref(records), std::ref(stages[0]), std::ref(readFailure));
+    std::thread decoder(DECODE_STAGE, std::ref(records), std::ref(decoded), std::cref(symbolEntries), std::cref(litmap), std::cref(parser), std::ref(stages[1]));
+    std::thread resolver(RESOLVE_STAGE, std::ref(decoded), std::ref(chunks), std::ref(context), std::ref(symbols), std::ref(buffer), std::ref(stages[2]));
+    WRITE_STAGE(chunks, outputFile, stages[3]);
+    reader.join();
+    decoder.join();
+    resolver.join();
+    if (readFailure) std::rethrow_exception(readFailure);     // runMode reports it like a single threaded run does
+
+    stages[0].blocked = records.getProducerStalls();
+    stages[1].starved = records.getConsumerStalls();
+    stages[1].blocked = decoded.getProducerStalls();
+    stages[2].starved = decoded.getConsumerStalls();
+    stages[2].blocked = chunks.getProducerStalls();
+    stages[3].starved = chunks.getConsumerStalls();
+
+    FileHandling::printEnd(outputFile, FileHandling::getProgramName(argv[INPUT_FILE_ARG_NUMBER]));
+    PRINT_STAGE_STATS(std::cerr, stages);
+    std::cerr << "labels: " << symbols.getBatchHits() << " lookups answered from record batches, " << symbols.getSweeps() << " from the label array" << std::endl;
+    return FileHandling::close(inputFile, outputFile);
+}
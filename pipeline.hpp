@@ -0,0 +1,49 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "disassembly.hpp"
+#include "length_scan.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* One decoded unit of a text record, either an instruction or a literal found in LITTAB */
+struct DecodedItem
+{
+    const int LOCCTR;
+    const ParsingResult result;
+    const LITTAB_Entry* literal;    // Points into LITMAP when this item is a literal, nullptr for instructions
+};
+
+/* Everything the resolver needs for one text record, including the RESB gap that comes before it */
+struct DecodedRecord
+{
+    int32_t sectionGap;
+    int32_t lastTextSectionEnd;
+    std::vector<DecodedItem> items;
+    bool last;
+};
+
+/* Rendered listing text for one record handed to the writer */
+struct RenderedChunk
+{
+    std::string text;
+    bool last;
+};
+
+/* Per stage throughput counters, busy time excludes time spent waiting on the rings */
+struct StageStats
+{
+    const char* name;
+    uint64_t items;
+    uint64_t bytes;
+    uint64_t busyNanos;
+    uint64_t starved;   // Waits on an empty input ring
+    uint64_t blocked;   // Waits on a full output ring
+};
+
+std::vector<DecodedItem> DECODE_BOUNDARIES(const TextRecord& record, const std::vector<InstructionBoundary>& boundaries, const std::size_t first, const std::size_t last, const Parser& parser);
+void RENDER_DECODED_RECORD(DisassemblerContext& context, const DecodedRecord& record);
+int runPipelineMode(const int argc, const char* argv[]);
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ *  @brief
+ *          Memoized opcode and operand columns keyed by the raw instruction word
+ *
+ *  Programs repeat the same encodings over and over (CLEAR X, RSUB, TIXR T, the same absolute or base relative
+ *  load), yet every occurrence built its opcode and operand columns from scratch, label lookup included. Those two
+ *  columns only depend on the instruction word, on BASE when the operand is base relative and on PC when it is PC
+ *  relative. Words that do not depend on PC are cached with BASE as part of the key, so a repeat costs one hash and
+ *  a compare across four ways. PC relative words go straight to the renderers since no two of them share a PC in a
+ *  sweep, and caching them would only push out entries that can hit.
+ *
+ *  Measured, it does not pay. On big.obj a single pass hits 55.6% of the time and still costs more per operand than
+ *  the nixbpe table renderers it wraps (274 against 223 ns at -O0, 82 against 63 at -O2), and most code is PC
+ *  relative so the rest can never hit. Listings therefore render straight through the table; the cache only runs
+ *  in --bench-operands, which prints its hit rate next to the timings so a change that makes it win would show.
+ */
+
+#include "render_cache.hpp"
+#include "disassembly.hpp"
+#include "operand_renderers.hpp"
+#include <algorithm>
+#include <cctype>
+#include <iomanip>
+
+const constexpr std::size_t MAX_WORD_DIGITS = 8;
+const constexpr int BITS_PER_HEX_CHAR = 4;
+const constexpr int DECIMAL_DIGITS = 10;
+const constexpr int BP_SHIFT = 1;
+const constexpr int BP_MASK = 0x03;
+const constexpr uint32_t WORD_HASH = 0x9E3779B1;
+const constexpr uint32_t BASE_HASH = 0x85EBCA6B;
+const constexpr double PERCENT = 100.0;
+
+namespace
+{
+    // The object code as one number, anything that is not hex (a record cut short) is left to the renderers
+    bool packWord(const std::string& objectCode, uint32_t& word)
+    {
+        if (objectCode.size() > MAX_WORD_DIGITS) return false;
+        word = 0;
+        for (const char digit : objectCode)
+        {
+            if (!std::isxdigit(static_cast<unsigned char>(digit))) return false;
+            word = word << BITS_PER_HEX_CHAR | (std::isdigit(static_cast<unsigned char>(digit)) ? digit - '0' : (std::toupper(digit) - 'A' + DECIMAL_DIGITS));
+        }
+        return true;
+    }
+
+    // Same bits RENDER_OPERAND picks the renderer with, format 2 included since its renderer reads them too
+    TargetAddressMode operandRelativeTo(const std::string& objectCode)
+    {
+        return static_cast<TargetAddressMode>((EXTRACT_NIXBPE(objectCode) >> BP_SHIFT) & BP_MASK);
+    }
+}
+
+RenderCache::RenderCache(const std::size_t capacity) : sets(std::max<std::size_t>(1, capacity / RENDER_CACHE_WAYS)) {}
+
+const RenderedFields& RenderCache::render(const OffsetInfo& offsetInfo, const DisassemblerState& state)
+{
+    const std::string& objectCode = state.instruction.objectCode;
+    const TargetAddressMode relativeMode = operandRelativeTo(objectCode);
+    uint32_t word;
+    if (relativeMode == TargetAddressMode::PC || !packWord(objectCode, word)) {
+        stats.uncacheable++;
+        uncached = RENDER_FIELDS(offsetInfo, state);
+        return uncached;
+    }
+    const uint8_t digits = objectCode.size();
+    const int32_t relativeTo = relativeMode == TargetAddressMode::Base ? offsetInfo.BASE : 0;
+    if (entries.empty()) entries.resize(sets * RENDER_CACHE_WAYS);
+
+    Entry* const set = &entries[((word * WORD_HASH) ^ (static_cast<uint32_t>(relativeTo) * BASE_HASH) ^ digits) % sets * RENDER_CACHE_WAYS];
+    Entry* victim = set;
+    for (Entry* way = set; way < set + RENDER_CACHE_WAYS; way++)
+    {
+        if (way->valid && way->word == word && way->digits == digits && way->relativeTo == relativeTo) {
+            stats.hits++;
+            way->lastUse = ++clock;
+            return way->fields;
+        }
+        if (victim->valid && (!way->valid || way->lastUse < victim->lastUse)) victim = way;
+    }
+    stats.misses++;
+    if (victim->valid) stats.evictions++;
+    *victim = Entry{true, word, digits, relativeTo, ++clock, RENDER_FIELDS(offsetInfo, state)};
+    return victim->fields;
+}
+
+/* What generateOutput used to build for every line */
+const RenderedFields RENDER_FIELDS(const OffsetInfo& offsetInfo, const DisassemblerState& state)
+{
+    return RenderedFields{CREATE_OPCODE_OUTPUT(state.instruction.opCode, state.instruction.format), RENDER_OPERAND(offsetInfo, state)};
+}
+
+double HIT_RATE(const RenderCacheStats& stats)
+{
+    const uint64_t lookups = stats.hits + stats.misses + stats.uncacheable;
+    return lookups ? PERCENT * stats.hits / lookups : 0;
+}
+
+void PRINT_RENDER_CACHE_STATS(std::ostream& stream, const RenderCacheStats& stats)
+{
+    stream << "render cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.uncacheable << " uncached, "
+    << stats.evictions << " evictions, " << std::fixed << std::setprecision(1) << HIT_RATE(stats) << "% hit rate" << std::endl;
+}
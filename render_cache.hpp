@@ -0,0 +1,63 @@
+#ifndef RENDER_CACHE_H
+#define RENDER_CACHE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#define RENDER_CACHE_ENTRIES 4096
+#define RENDER_CACHE_WAYS 4
+
+struct OffsetInfo;
+struct DisassemblerState;
+
+/* The opcode and operand columns of one instruction, everything else on its line depends on where it sits */
+struct RenderedFields
+{
+    std::string opcode;
+    std::string operand;
+};
+
+struct RenderCacheStats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t uncacheable;       // PC relative operands change with every address, words that are not plain hex are skipped too
+    uint64_t evictions;
+};
+
+/*
+ *  Set associative cache of rendered fields keyed by the raw instruction word and the one input its operand depends
+ *  on besides the word: BASE for base relative operands, nothing for the rest. The least recently used way of a set
+ *  makes room for a new word. Labels come from the symbols of the first render, so one cache serves one program.
+ */
+class RenderCache
+{
+    public:
+        explicit RenderCache(const std::size_t capacity = RENDER_CACHE_ENTRIES);
+        const RenderedFields& render(const OffsetInfo& offsetInfo, const DisassemblerState& state);
+        const RenderCacheStats& getStats() const {return stats;}
+    private:
+        struct Entry
+        {
+            bool valid;
+            uint32_t word;
+            uint8_t digits;
+            int32_t relativeTo;
+            uint64_t lastUse;
+            RenderedFields fields;
+        };
+
+        const std::size_t sets;
+        std::vector<Entry> entries;     // Allocated on the first render, a sink that never renders costs nothing
+        RenderedFields uncached;
+        RenderCacheStats stats{0, 0, 0, 0};
+        uint64_t clock = 0;
+};
+
+const RenderedFields RENDER_FIELDS(const OffsetInfo& offsetInfo, const DisassemblerState& state);
+double HIT_RATE(const RenderCacheStats& stats);
+void PRINT_RENDER_CACHE_STATS(std::ostream& stream, const RenderCacheStats& stats);
+
+#endif
@@ -0,0 +1,409 @@
+/*
+ *  @brief
+ *          SIC/XE instruction set simulator that reuses the disassembler's decoder
+ *
+ *  The T records are loaded into a 1 MiB memory image and executed starting at the E record's entry point.
+ *  Each address is decoded with the same Parser the listing uses the first time it runs, and the fields are kept in
+ *  a predecoded cache so hot loops never decode again. Stores into memory invalidate any cached instruction they
+ *  overlap, which keeps self modifying code correct. RD/WD/TD talk to local files named after the device number.
+ */
+
+#include "simulator.hpp"
+#include "byte_operations.hpp"
+#include "binary_object.hpp"
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+const constexpr int INPUT_FILE_ARG_NUMBER = 1;
+const constexpr int MAX_INSTRUCTIONS_ARG_NUMBER = 2;
+const constexpr uint64_t DEFAULT_MAX_INSTRUCTIONS = 100000000;
+const constexpr int HEX_CHARS_PER_BYTE = 2;
+const constexpr int MAX_INSTRUCTION_BYTES = 4;
+const constexpr int WORD_BYTES = 3;
+const constexpr int FLOAT_BYTES = 6;
+const constexpr int32_t WORD_MASK = 0xFFFFFF;
+const constexpr int32_t RETURN_SENTINEL = 0xFFFFFF;     // L starts here, so the program's final RSUB leaves memory
+const constexpr int NUM_REGISTERS = 10;
+const constexpr int FLOAT_EXPONENT_BIAS = 1024;
+const constexpr int FLOAT_FRACTION_BITS = 36;
+const constexpr int32_t CC_LESS = 0x40;
+const constexpr int32_t CC_EQUAL = 0x00;
+const constexpr int32_t CC_GREATER = 0x80;
+const constexpr int32_t CC_MASK = 0xC0;
+const constexpr char* DEVICE_FILE_SUFFIX = ".dev";
+
+// Opcodes from InstructionConstants, as numbers so execution is a switch instead of a string compare
+enum OpCodes : uint8_t
+{
+    ADD = 0x18, ADDF = 0x58, ADDR = 0x90, AND = 0x40, CLEAR = 0xB4, COMP = 0x28,
+    COMPF = 0x88, COMPR = 0xA0, DIV = 0x24, DIVF = 0x64, DIVR = 0x9C, FIX = 0xC4,
+    FLOAT = 0xC0, HIO = 0xF4, J = 0x3C, JEQ = 0x30, JGT = 0x34, JLT = 0x38,
+    JSUB = 0x48, LDA = 0x00, LDB = 0x68, LDCH = 0x50, LDF = 0x70, LDL = 0x08,
+    LDS = 0x6C, LDT = 0x74, LDX = 0x04, LPS = 0xD0, MUL = 0x20, MULF = 0x60,
+    MULR = 0x98, NORM = 0xC8, OR = 0x44, RD = 0xD8, RMO = 0xAC, RSUB = 0x4C,
+    SHIFTL = 0xA4, SHIFTR = 0xA8, SIO = 0xF0, SSK = 0xEC, STA = 0x0C, STB = 0x78,
+    STCH = 0x54, STF = 0x80, STI = 0xD4, STL = 0x14, STS = 0x7C, STSW = 0xE8,
+    STT = 0x84, STX = 0x10, SUB = 0x1C, SUBF = 0x5C, SUBR = 0x94, SVC = 0xB0,
+    TD = 0xE0, TIO = 0xF8, TIX = 0x2C, TIXR = 0xB8, WD = 0xDC
+};
+
+namespace
+{
+    int32_t signExtend(const int32_t value, const int bits)
+    {
+        return static_cast<int32_t>(static_cast<uint32_t>(value) << (32 - bits)) >> (32 - bits);
+    }
+
+    int32_t toWord(const int64_t value)
+    {
+        return static_cast<int32_t>(value & WORD_MASK);
+    }
+
+    const std::string deviceFileName(const int device)
+    {
+        std::ostringstream name;
+        name << std::uppercase << std::hex << std::setw(HEX_CHARS_PER_BYTE) << std::setfill('0') << device << DEVICE_FILE_SUFFIX;
+        return name.str();
+    }
+
+    // SIC/XE floats are 48 bits: sign, 11 bit exponent biased by 1024, 36 bit fraction in [0.5, 1)
+    double decodeFloat(const uint64_t bits)
+    {
+        const uint64_t fraction = bits & ((1ULL << FLOAT_FRACTION_BITS) - 1);
+        if (fraction == 0) return 0.0;
+        const int exponent = static_cast<int>((bits >> FLOAT_FRACTION_BITS) & 0x7FF) - FLOAT_EXPONENT_BIAS;
+        const double magnitude = std::ldexp(static_cast<double>(fraction), exponent - FLOAT_FRACTION_BITS);
+        return (bits >> 47) & 1 ? -magnitude : magnitude;
+    }
+
+    uint64_t encodeFloat(const double value)
+    {
+        if (value == 0.0) return 0;
+        int exponent;
+        const double mantissa = std::frexp(std::fabs(value), &exponent);
+        const uint64_t fraction = static_cast<uint64_t>(std::ldexp(mantissa, FLOAT_FRACTION_BITS));
+        const uint64_t sign = value < 0 ? 1ULL << 47 : 0;
+        return sign | (static_cast<uint64_t>(exponent + FLOAT_EXPONENT_BIAS) & 0x7FF) << FLOAT_FRACTION_BITS | fraction;
+    }
+}
+
+/*********************************************************
+ *                        DEVICES                        *
+ *********************************************************/
+int DeviceTable::readByte(const int device)
+{
+    auto it = inputs.find(device);
+    if (it == inputs.end())
+        it = inputs.insert({device, std::unique_ptr<std::ifstream>(new std::ifstream(deviceFileName(device), std::ios::binary))}).first;
+    char byte;
+    if (!it->second->get(byte)) return 0;  // End of device reads as zero
+    return static_cast<uint8_t>(byte);
+}
+
+void DeviceTable::writeByte(const int device, const int byte)
+{
+    auto it = outputs.find(device);
+    if (it == outputs.end())
+        it = outputs.insert({device, std::unique_ptr<std::ofstream>(new std::ofstream(deviceFileName(device), std::ios::binary))}).first;
+    it->second->put(static_cast<char>(byte));
+}
+
+// Files never make a program wait, a device is ready as long as it could be opened
+bool DeviceTable::isReady(const int device)
+{
+    if (inputs.count(device) || outputs.count(device)) return true;
+    std::ifstream probe(deviceFileName(device));
+    return probe.good() || std::ofstream(deviceFileName(device), std::ios::app).good();
+}
+
+/*********************************************************
+ *                       SIMULATOR                       *
+ *********************************************************/
+Simulator::Simulator(const Parser& parser)
+    : parser(parser),
+    memory(SIC_MEMORY_SIZE, 0),
+    cache(SIC_MEMORY_SIZE, PredecodedInstruction{false, 0, 0, 0, false, AddressingFormat::Format3, TargetAddressMode::Absolute, 0}),
+    F(0.0),
+    stats{0, 0, 0, 0}
+{
+    for (int i = 0; i < NUM_REGISTERS; i++) registers[i] = 0;
+    registers[static_cast<int>(Register::L)] = RETURN_SENTINEL;
+}
+
+/* Copy every T record into memory */
+void Simulator::load(std::istream& inputFile)
+{
+    for (TextRecord record = FileHandling::readTextRecord(inputFile); record.sectionFound; record = FileHandling::readTextRecord(inputFile))
+    {
+        for (std::size_t i = 0; i + 1 < record.objectCode.size(); i += HEX_CHARS_PER_BYTE)
+        {
+            const std::size_t address = record.LOCCTR_START + i / HEX_CHARS_PER_BYTE;
+            if (address < memory.size()) memory[address] = convertStringToHex(record.objectCode.substr(i, HEX_CHARS_PER_BYTE));
+        }
+    }
+}
+
+/* Run the same Parser the listing uses, then keep only the numbers we need to execute */
+PredecodedInstruction Simulator::decode(const int32_t address) const
+{
+    std::string hex;
+    for (int i = 0; i < MAX_INSTRUCTION_BYTES && address + i < SIC_MEMORY_SIZE; i++)
+        hex += convertHexToString(memory[address + i]);
+    std::istringstream stream(hex);
+    const ParsingResult parsed = parseInstruction(stream, parser);
+
+    const uint8_t first = memory[address];
+    const uint8_t second = address + 1 < SIC_MEMORY_SIZE ? memory[address + 1] : 0;
+    const uint8_t third = address + 2 < SIC_MEMORY_SIZE ? memory[address + 2] : 0;
+    const uint8_t fourth = address + 3 < SIC_MEMORY_SIZE ? memory[address + 3] : 0;
+    const uint8_t ni = extract_ni_flags(first);
+    const bool valid = !parsed.instruction.opCode.empty();
+
+    if (parsed.instruction.format == AddressingFormat::Format2)
+        return PredecodedInstruction{valid, static_cast<uint8_t>(extractOpCode(first)), 2, ni, false, AddressingFormat::Format2, TargetAddressMode::Absolute, second};
+    if (ni == 0)    // Plain SIC, the b p e bits are part of a 15 bit address
+        return PredecodedInstruction{valid, static_cast<uint8_t>(extractOpCode(first)), 3, ni, parsed.instruction.isIndexed, AddressingFormat::Format3, TargetAddressMode::Absolute, (second & 0x7F) << 8 | third};
+    if (parsed.instruction.format == AddressingFormat::Format4)
+        return PredecodedInstruction{valid, static_cast<uint8_t>(extractOpCode(first)), 4, ni, parsed.instruction.isIndexed, AddressingFormat::Format4, TargetAddressMode::Absolute, (second & 0x0F) << 16 | third << 8 | fourth};
+    return PredecodedInstruction{valid, static_cast<uint8_t>(extractOpCode(first)), 3, ni, parsed.instruction.isIndexed, AddressingFormat::Format3, parsed.instruction.targetAddressMode, (second & 0x0F) << 8 | third};
+}
+
+const PredecodedInstruction& Simulator::fetch(const int32_t address)
+{
+    PredecodedInstruction& cached = cache[address];
+    if (cached.valid) {
+        stats.cacheHits++;
+        return cached;
+    }
+    stats.decodes++;
+    cached = decode(address);
+    return cached;
+}
+
+int32_t Simulator::targetAddress(const PredecodedInstruction& instruction) const
+{
+    int32_t target = instruction.operand;
+    if (instruction.format == AddressingFormat::Format3 && instruction.ni != 0)
+    {
+        if (instruction.targetAddressMode == TargetAddressMode::PC)
+            target = registers[static_cast<int>(Register::PC)] + signExtend(instruction.operand, 12);
+        else if (instruction.targetAddressMode == TargetAddressMode::Base)
+            target = registers[static_cast<int>(Register::B)] + instruction.operand;
+    }
+    if (instruction.isIndexed) target += registers[static_cast<int>(Register::X)];
+    target &= SIC_MEMORY_SIZE - 1;
+    if (instruction.ni == static_cast<int>(AddressingMode::Indirect)) target = readWord(target) & (SIC_MEMORY_SIZE - 1);
+    return target;
+}
+
+int32_t Simulator::readWord(const int32_t address) const
+{
+    int32_t word = 0;
+    for (int i = 0; i < WORD_BYTES; i++) word = word << 8 | memory[(address + i) & (SIC_MEMORY_SIZE - 1)];
+    return word;
+}
+
+double Simulator::readFloat(const int32_t address) const
+{
+    uint64_t bits = 0;
+    for (int i = 0; i < FLOAT_BYTES; i++) bits = bits << 8 | memory[(address + i) & (SIC_MEMORY_SIZE - 1)];
+    return decodeFloat(bits);
+}
+
+// Big endian store, any cached instruction that could overlap the written bytes is thrown away
+void Simulator::writeBytes(const int32_t address, const uint64_t value, const int count)
+{
+    for (int i = 0; i < count; i++)
+        memory[(address + i) & (SIC_MEMORY_SIZE - 1)] = static_cast<uint8_t>(value >> (8 * (count - 1 - i)));
+    for (int32_t i = address - (MAX_INSTRUCTION_BYTES - 1); i < address + count; i++)
+    {
+        PredecodedInstruction& cached = cache[i & (SIC_MEMORY_SIZE - 1)];
+        if (cached.valid) {
+            cached.valid = false;
+            stats.invalidations++;
+        }
+    }
+}
+
+int32_t Simulator::getRegisterValue(const int reg) const
+{
+    if (reg == static_cast<int>(Register::F)) return toWord(static_cast<int64_t>(F));
+    if (reg < 0 || reg >= NUM_REGISTERS) return 0;
+    return registers[reg];
+}
+
+void Simulator::setRegisterValue(const int reg, const int32_t value)
+{
+    if (reg == static_cast<int>(Register::F)) F = signExtend(toWord(value), 24);
+    else if (reg >= 0 && reg < NUM_REGISTERS) registers[reg] = toWord(value);
+}
+
+void Simulator::compare(const double left, const double right)
+{
+    const int32_t cc = left < right ? CC_LESS : left > right ? CC_GREATER : CC_EQUAL;
+    int32_t& SW = registers[static_cast<int>(Register::SW)];
+    SW = (SW & ~CC_MASK) | cc;
+}
+
+/* Execute one instruction, PC already points past it. Returns false when the program stops */
+bool Simulator::execute(const PredecodedInstruction& instruction, const int32_t address, std::string& haltReason)
+{
+    int32_t& A = registers[static_cast<int>(Register::A)];
+    int32_t& X = registers[static_cast<int>(Register::X)];
+    int32_t& PC = registers[static_cast<int>(Register::PC)];
+    const int32_t SW = registers[static_cast<int>(Register::SW)] & CC_MASK;
+
+    if (instruction.format == AddressingFormat::Format2)
+    {
+        const int r1 = instruction.operand >> 4;
+        const int r2 = instruction.operand & 0x0F;
+        const int32_t v1 = signExtend(getRegisterValue(r1), 24);
+        const int32_t v2 = signExtend(getRegisterValue(r2), 24);
+        switch (instruction.opcode)
+        {
+            case ADDR:  setRegisterValue(r2, v2 + v1); break;
+            case SUBR:  setRegisterValue(r2, v2 - v1); break;
+            case MULR:  setRegisterValue(r2, v2 * v1); break;
+            case DIVR:
+                if (v1 == 0) {haltReason = "division by zero"; return false;}
+                setRegisterValue(r2, v2 / v1); break;
+            case COMPR: compare(v1, v2); break;
+            case CLEAR: setRegisterValue(r1, 0); break;
+            case RMO:   setRegisterValue(r2, getRegisterValue(r1)); break;
+            case TIXR:  X = toWord(X + 1); compare(signExtend(X, 24), v1); break;
+            case SHIFTL: {  // Circular, r2 holds n-1
+                const uint32_t value = static_cast<uint32_t>(getRegisterValue(r1));
+                const int n = (r2 + 1) % 24;
+                setRegisterValue(r1, static_cast<int32_t>(((value << n) | (value >> (24 - n))) & WORD_MASK));
+                break;
+            }
+            case SHIFTR:    // Arithmetic, sign bit fills in
+                setRegisterValue(r1, signExtend(getRegisterValue(r1), 24) >> (r2 + 1)); break;
+            case SVC:   haltReason = "SVC"; return false;
+            default:    haltReason = "unsupported format 2 instruction"; return false;
+        }
+        return true;
+    }
+
+    const int32_t target = targetAddress(instruction);
+    const bool immediate = instruction.ni == static_cast<int>(AddressingMode::Immediate);
+    const int32_t word = immediate ? target : readWord(target);
+    const int32_t value = signExtend(word, 24);
+    switch (instruction.opcode)
+    {
+        case LDA:   A = word; break;
+        case LDX:   X = word; break;
+        case LDL:   registers[static_cast<int>(Register::L)] = word; break;
+        case LDB:   registers[static_cast<int>(Register::B)] = word; break;
+        case LDS:   registers[static_cast<int>(Register::S)] = word; break;
+        case LDT:   registers[static_cast<int>(Register::T)] = word; break;
+        case LDCH:  A = (A & ~0xFF) | (immediate ? target & 0xFF : memory[target]); break;
+        case LDF:   F = immediate ? target : readFloat(target); break;
+        case STA:   writeBytes(target, A, WORD_BYTES); break;
+        case STX:   writeBytes(target, X, WORD_BYTES); break;
+        case STL:   writeBytes(target, registers[static_cast<int>(Register::L)], WORD_BYTES); break;
+        case STB:   writeBytes(target, registers[static_cast<int>(Register::B)], WORD_BYTES); break;
+        case STS:   writeBytes(target, registers[static_cast<int>(Register::S)], WORD_BYTES); break;
+        case STT:   writeBytes(target, registers[static_cast<int>(Register::T)], WORD_BYTES); break;
+        case STSW:  writeBytes(target, registers[static_cast<int>(Register::SW)], WORD_BYTES); break;
+        case STCH:  writeBytes(target, A & 0xFF, 1); break;
+        case STF:   writeBytes(target, encodeFloat(F), FLOAT_BYTES); break;
+        case ADD:   A = toWord(signExtend(A, 24) + value); break;
+        case SUB:   A = toWord(signExtend(A, 24) - value); break;
+        case MUL:   A = toWord(static_cast<int64_t>(signExtend(A, 24)) * value); break;
+        case DIV:
+            if (value == 0) {haltReason = "division by zero"; return false;}
+            A = toWord(signExtend(A, 24) / value); break;
+        case AND:   A = A & word; break;
+        case OR:    A = A | word; break;
+        case COMP:  compare(signExtend(A, 24), value); break;
+        case TIX:   X = toWord(X + 1); compare(signExtend(X, 24), value); break;
+        case ADDF:  F += immediate ? target : readFloat(target); break;
+        case SUBF:  F -= immediate ? target : readFloat(target); break;
+        case MULF:  F *= immediate ? target : readFloat(target); break;
+        case DIVF: {
+            const double divisor = immediate ? target : readFloat(target);
+            if (divisor == 0.0) {haltReason = "division by zero"; return false;}
+            F /= divisor; break;
+        }
+        case COMPF: compare(F, immediate ? target : readFloat(target)); break;
+        case FIX:   A = toWord(static_cast<int64_t>(F)); break;
+        case FLOAT: F = signExtend(A, 24); break;
+        case NORM:  break;  // Doubles are always normalized
+        case J:
+            if (target == address) {haltReason = "J to itself"; return false;}
+            PC = target; break;
+        case JEQ:   if (SW == CC_EQUAL) PC = target; break;
+        case JGT:   if (SW == CC_GREATER) PC = target; break;
+        case JLT:   if (SW == CC_LESS) PC = target; break;
+        case JSUB:  registers[static_cast<int>(Register::L)] = PC; PC = target; break;
+        case RSUB:  PC = registers[static_cast<int>(Register::L)]; break;
+        case TD:    compare(devices.isReady(immediate ? target & 0xFF : memory[target]) ? 0 : 1, 1); break;    // "<" means ready
+        case RD:    A = (A & ~0xFF) | devices.readByte(immediate ? target & 0xFF : memory[target]); break;
+        case WD:    devices.writeByte(immediate ? target & 0xFF : memory[target], A & 0xFF); break;
+        case STI: case LPS: case SSK: case SIO: case HIO: case TIO: break;  // Privileged, nothing to model headless
+        default:    haltReason = "unsupported instruction"; return false;
+    }
+    return true;
+}
+
+/* Fetch, advance PC, execute, until the program returns, stops itself, or hits the instruction limit */
+const std::string Simulator::run(const int32_t entryPoint, const uint64_t maxInstructions)
+{
+    int32_t& PC = registers[static_cast<int>(Register::PC)];
+    PC = entryPoint;
+    std::string haltReason = "instruction limit reached";
+    while (stats.instructions < maxInstructions)
+    {
+        if (PC < 0 || PC >= SIC_MEMORY_SIZE) {
+            haltReason = PC == RETURN_SENTINEL ? "returned to caller" : "PC left memory";
+            break;
+        }
+        const int32_t address = PC;
+        const PredecodedInstruction& instruction = fetch(address);
+        if (!instruction.valid) {
+            haltReason = "invalid opcode";
+            break;
+        }
+        PC = address + instruction.length;
+        stats.instructions++;
+        if (!execute(instruction, address, haltReason)) break;
+    }
+    return haltReason;
+}
+
+// Expects argv[1] to be the object file, argv[2] optionally caps how many instructions run
+int runSimulatorMode(const int argc, const char* argv[])
+{
+    InputFile inputFile = FileHandling::openFile(argv[INPUT_FILE_ARG_NUMBER]);
+    REFUSE_BINARY_OBJECT(inputFile, argv[INPUT_FILE_ARG_NUMBER], "--simulate");
+    const uint64_t maxInstructions = argc > MAX_INSTRUCTIONS_ARG_NUMBER ? std::stoull(argv[MAX_INSTRUCTIONS_ARG_NUMBER]) : DEFAULT_MAX_INSTRUCTIONS;
+    const Parser parser;
+    std::unique_ptr<Simulator> simulator(new Simulator(parser));     // Memory and cache are too big for the stack
+    simulator->load(inputFile);
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const std::string haltReason = simulator->run(FileHandling::getEntryPoint(argv[INPUT_FILE_ARG_NUMBER]), maxInstructions);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const SimulatorStats& stats = simulator->getStats();
+    std::cerr << "halted: " << haltReason << std::endl
+    << "instructions: " << stats.instructions << " in " << std::fixed << std::setprecision(6) << seconds << " s ("
+    << std::setprecision(0) << (seconds > 0 ? stats.instructions / seconds : 0) << " instructions/s)" << std::endl
+    << "decode cache: " << stats.decodes << " decodes, " << stats.cacheHits << " hits, " << stats.invalidations << " invalidations" << std::endl;
+    const REGMAP registers = REGISTERS();
+    for (const auto& reg : registers)
+    {
+        if (reg.first == static_cast<int>(Register::F))
+            std::cerr << reg.second << "=" << std::setprecision(6) << simulator->getFloatRegister() << " ";
+        else
+            std::cerr << reg.second << "=" << intToHexString(simulator->getRegister(static_cast<Register>(reg.first))) << " ";
+    }
+    std::cerr << std::endl;
+    inputFile.close();
+    FileHandling::printDecompressionStats(std::cerr);
+    return EXIT_SUCCESS;
+}
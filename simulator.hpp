@@ -0,0 +1,93 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include "disassembly.hpp"
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define SIC_MEMORY_SIZE (1 << 20)   // 1 MiB
+
+/* Register numbers used by format 2 instructions, same numbering as REGISTERS() */
+enum class Register
+{
+    A =     0,
+    X =     1,
+    L =     2,
+    B =     3,
+    S =     4,
+    T =     5,
+    F =     6,
+    PC =    8,
+    SW =    9
+};
+
+/* Fields of an instruction pulled out once, so executing it again is just a table read */
+struct PredecodedInstruction
+{
+    bool valid;
+    uint8_t opcode;                     // First byte with the ni bits masked off
+    uint8_t length;
+    uint8_t ni;                         // 0 for plain SIC instructions
+    bool isIndexed;
+    AddressingFormat format;
+    TargetAddressMode targetAddressMode;
+    int32_t operand;                    // Displacement, address, or r1r2 byte for format 2
+};
+
+struct SimulatorStats
+{
+    uint64_t instructions;
+    uint64_t decodes;
+    uint64_t cacheHits;
+    uint64_t invalidations;
+};
+
+/* RD/WD/TD map device XX onto the local file XX.dev so programs run without real devices */
+class DeviceTable
+{
+    public:
+        int readByte(const int device);
+        void writeByte(const int device, const int byte);
+        bool isReady(const int device);
+    private:
+        std::map<int, std::unique_ptr<std::ifstream>> inputs;
+        std::map<int, std::unique_ptr<std::ofstream>> outputs;
+};
+
+class Simulator
+{
+    public:
+        Simulator(const Parser& parser);
+        void load(std::istream& inputFile);
+        const std::string run(const int32_t entryPoint, const uint64_t maxInstructions);
+        const SimulatorStats& getStats() const {return stats;}
+        int32_t getRegister(const Register reg) const {return registers[static_cast<int>(reg)];}
+        double getFloatRegister() const {return F;}
+    private:
+        const PredecodedInstruction& fetch(const int32_t address);
+        PredecodedInstruction decode(const int32_t address) const;
+        int32_t targetAddress(const PredecodedInstruction& instruction) const;
+        int32_t readWord(const int32_t address) const;
+        double readFloat(const int32_t address) const;
+        void writeBytes(const int32_t address, const uint64_t value, const int count);
+        int32_t getRegisterValue(const int reg) const;
+        void setRegisterValue(const int reg, const int32_t value);
+        void compare(const double left, const double right);
+        bool execute(const PredecodedInstruction& instruction, const int32_t address, std::string& haltReason);
+
+        const Parser& parser;
+        std::vector<uint8_t> memory;
+        std::vector<PredecodedInstruction> cache;
+        int32_t registers[10];
+        double F;
+        DeviceTable devices;
+        SimulatorStats stats;
+};
+
+int runSimulatorMode(const int argc, const char* argv[]);
+
+#endif
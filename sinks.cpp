@@ -0,0 +1,246 @@
+/*
+ *  @brief
+ *          Consumers of the decode loop's events, so one pass over the object file can feed several views of it
+ *
+ *  The engine no longer writes the listing itself. Every instruction, literal, BASE change, LTORG and RESB it finds
+ *  is reported to a DisassemblySink, and the out.lst writer (ListingSink in output_handler) is just one of them.
+ *  A FanoutSink passes each event along to any number of sinks, which is how the extra views below are attached to
+ *  a normal run with kind=file arguments after the object and symbol files, '-' meaning stdout.
+ *
+ *  listing : another copy of the listing
+ *  xref    : labelled operand targets and every instruction that references them
+ *  stats   : opcode histogram plus counts of the other events
+ *  map     : address ranges covered by code, data and reserved space
+ */
+
+#include "sinks.hpp"
+#include "disassembly.hpp"
+#include "output_handler.hpp"
+#include "byte_operations.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+const constexpr int COLUMN_WIDTH = 12;
+const constexpr int ADDRESS_DIGITS = 4;
+const constexpr int HEX_CHARS_PER_BYTE = 2;
+const constexpr char SINK_ARG_SEPARATOR = '=';
+const constexpr char* STANDARD_OUTPUT = "-";
+const constexpr char* CODE_REGION = "code";
+const constexpr char* DATA_REGION = "data";
+const constexpr char* RESERVED_REGION = "reserved";
+
+namespace
+{
+    const std::string zeroPad(const std::string& hex)
+    {
+        return hex.size() >= ADDRESS_DIGITS ? hex : std::string(ADDRESS_DIGITS - hex.size(), '0') + hex;
+    }
+
+    const std::string address(const int32_t LOCCTR)
+    {
+        return zeroPad(intToHexString(LOCCTR));
+    }
+
+    void writeRegion(std::ostream& stream, const int32_t start, const int32_t length, const char* region, const std::string& name)
+    {
+        stream << address(start) << "-" << address(start + length - 1) << " " << std::left << std::setw(COLUMN_WIDTH) << region << name << std::endl;
+    }
+
+    using SinkFactory = std::unique_ptr<DisassemblySink> (*)(std::ostream& stream, const SymbolProvider& symbols);
+
+    std::unique_ptr<DisassemblySink> createListingSink(std::ostream& stream, const SymbolProvider& symbols) {return std::unique_ptr<DisassemblySink>(new ListingSink(stream, symbols));}
+    std::unique_ptr<DisassemblySink> createXrefSink(std::ostream& stream, const SymbolProvider& symbols) {return std::unique_ptr<DisassemblySink>(new XrefSink(stream, symbols));}
+    std::unique_ptr<DisassemblySink> createStatsSink(std::ostream& stream, const SymbolProvider& symbols) {return std::unique_ptr<DisassemblySink>(new StatsSink(stream));}
+    std::unique_ptr<DisassemblySink> createMapSink(std::ostream& stream, const SymbolProvider& symbols) {return std::unique_ptr<DisassemblySink>(new MapSink(stream));}
+
+    const std::map<std::string, SinkFactory> SINK_KINDS
+    {
+        {"listing", createListingSink},
+        {"xref", createXrefSink},
+        {"stats", createStatsSink},
+        {"map", createMapSink}
+    };
+}
+
+/*********************************************************
+ *                        FANOUT                         *
+ *********************************************************/
+void FanoutSink::attach(DisassemblySink& sink)
+{
+    sinks.push_back(&sink);
+}
+
+// A null stream means the sink writes somewhere the caller already owns
+void FanoutSink::attach(std::unique_ptr<DisassemblySink> sink, std::unique_ptr<std::ostream> stream)
+{
+    sinks.push_back(sink.get());
+    ownedSinks.push_back(std::move(sink));
+    if (stream) ownedStreams.push_back(std::move(stream));
+}
+
+void FanoutSink::start(const std::string& programName, const std::string& startAddress)
+{
+    for (DisassemblySink* sink : sinks) sink->start(programName, startAddress);
+}
+
+void FanoutSink::instruction(const DisassemblerState& state, const int bytesReadIn)
+{
+    for (DisassemblySink* sink : sinks) sink->instruction(state, bytesReadIn);
+}
+
+void FanoutSink::literal(const int LOCCTR, const LITTAB_Entry& entry)
+{
+    for (DisassemblySink* sink : sinks) sink->literal(LOCCTR, entry);
+}
+
+void FanoutSink::data(const int LOCCTR, const std::string& bytes, const DataDirective directive)
+{
+    for (DisassemblySink* sink : sinks) sink->data(LOCCTR, bytes, directive);
+}
+
+void FanoutSink::base(const int address)
+{
+    for (DisassemblySink* sink : sinks) sink->base(address);
+}
+
+void FanoutSink::ltorg()
+{
+    for (DisassemblySink* sink : sinks) sink->ltorg();
+}
+
+void FanoutSink::reserve(const int LOCCTR, const int32_t bytes)
+{
+    for (DisassemblySink* sink : sinks) sink->reserve(LOCCTR, bytes);
+}
+
+void FanoutSink::finish(const std::string& programName)
+{
+    for (DisassemblySink* sink : sinks) sink->finish(programName);
+}
+
+/*********************************************************
+ *                    CROSS REFERENCE                    *
+ *********************************************************/
+// Same target the listing resolves, immediate constants and register operands are not references
+void ReferenceSink::instruction(const DisassemblerState& state, const int bytesReadIn)
+{
+    const ParsedInstruction& instruction = state.instruction;
+    if (instruction.format == AddressingFormat::Format2) return;
+    if (instruction.addresingMode == AddressingMode::Immediate && instruction.targetAddressMode == TargetAddressMode::Absolute) return;
+    const int32_t target = CALCULATE_TARGET_ADDRESS(instruction.targetAddressMode, instruction.objectCode, OffsetInfo{state.BASE, state.LOCCTR + bytesReadIn});
+    if (!CREATE_SYMBOL_OUTPUT(target, symbols).empty()) references[target].push_back(state.LOCCTR);
+}
+
+void XrefSink::finish(const std::string& programName)
+{
+    stream << "XREF " << programName << std::endl;
+    for (const auto& target : references)
+    {
+        stream << std::left << std::setw(COLUMN_WIDTH) << CREATE_SYMBOL_OUTPUT(target.first, symbols) << std::setw(COLUMN_WIDTH) << address(target.first);
+        for (const int32_t LOCCTR : target.second) stream << " " << address(LOCCTR);
+        stream << std::endl;
+    }
+}
+
+/*********************************************************
+ *                       STATISTICS                      *
+ *********************************************************/
+void StatsSink::instruction(const DisassemblerState& state, const int bytesReadIn)
+{
+    opcodes[CREATE_OPCODE_OUTPUT(state.instruction.opCode, state.instruction.format)]++;
+    instructions++;
+    instructionBytes += bytesReadIn;
+}
+
+void StatsSink::literal(const int LOCCTR, const LITTAB_Entry& entry)
+{
+    literals++;
+    literalBytes += getLiteralBytes(entry);
+}
+
+void StatsSink::data(const int LOCCTR, const std::string& bytes, const DataDirective directive)
+{
+    dataLines++;
+    dataBytes += bytes.size() / HEX_CHARS_PER_BYTE;
+}
+
+void StatsSink::base(const int address)
+{
+    baseChanges++;
+}
+
+void StatsSink::ltorg()
+{
+    ltorgs++;
+}
+
+void StatsSink::reserve(const int LOCCTR, const int32_t bytes)
+{
+    reservations++;
+    reservedBytes += bytes;
+}
+
+// Most used opcodes first, ties stay in mnemonic order
+void StatsSink::finish(const std::string& programName)
+{
+    std::vector<std::pair<std::string, uint64_t>> histogram(opcodes.begin(), opcodes.end());
+    std::stable_sort(histogram.begin(), histogram.end(), [](const std::pair<std::string, uint64_t>& a, const std::pair<std::string, uint64_t>& b) {return a.second > b.second;});
+    stream << "STATS " << programName << std::endl
+    << "instructions " << instructions << " (" << instructionBytes << " bytes), literals " << literals << " (" << literalBytes << " bytes), "
+    << "data " << dataLines << " lines (" << dataBytes << " bytes), "
+    << "base changes " << baseChanges << ", ltorg " << ltorgs << ", resb " << reservations << " (" << reservedBytes << " bytes)" << std::endl;
+    for (const auto& opcode : histogram)
+        stream << std::left << std::setw(COLUMN_WIDTH) << opcode.first << std::right << std::setw(COLUMN_WIDTH) << opcode.second << std::endl;
+}
+
+/*********************************************************
+ *                      ADDRESS MAP                      *
+ *********************************************************/
+void MapSink::instruction(const DisassemblerState& state, const int bytesReadIn)
+{
+    writeRegion(stream, state.LOCCTR, bytesReadIn, CODE_REGION, CREATE_OPCODE_OUTPUT(state.instruction.opCode, state.instruction.format));
+}
+
+void MapSink::literal(const int LOCCTR, const LITTAB_Entry& entry)
+{
+    writeRegion(stream, LOCCTR, getLiteralBytes(entry), DATA_REGION, entry.lit_const);
+}
+
+void MapSink::data(const int LOCCTR, const std::string& bytes, const DataDirective directive)
+{
+    writeRegion(stream, LOCCTR, bytes.size() / HEX_CHARS_PER_BYTE, DATA_REGION, bytes);
+}
+
+void MapSink::reserve(const int LOCCTR, const int32_t bytes)
+{
+    writeRegion(stream, LOCCTR, bytes, RESERVED_REGION, std::to_string(bytes));
+}
+
+/* Every kind=file argument from firstSinkArg on becomes a sink attached to the fanout */
+void ATTACH_SINKS(FanoutSink& fanout, const int argc, const char* argv[], const int firstSinkArg, const SymbolProvider& symbols)
+{
+    for (int i = firstSinkArg; i < argc; i++)
+    {
+        const std::string argument = argv[i];
+        const std::size_t separator = argument.find(SINK_ARG_SEPARATOR);
+        const std::string kind = argument.substr(0, separator);
+        if (separator == std::string::npos || !SINK_KINDS.count(kind)) {
+            std::cerr << "Unknown sink: " << argument << ", expected kind=file with kind one of listing, xref, stats, map" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        const std::string fileName = argument.substr(separator + 1);
+        if (fileName == STANDARD_OUTPUT) {
+            fanout.attach(SINK_KINDS.at(kind)(std::cout, symbols), nullptr);
+            continue;
+        }
+        std::unique_ptr<std::ostream> file(new std::ofstream(fileName));
+        if (!*file) {
+            std::cerr << "Failed to open file: " << fileName << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        std::unique_ptr<DisassemblySink> sink = SINK_KINDS.at(kind)(*file, symbols);
+        fanout.attach(std::move(sink), std::move(file));
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef SINKS_H
+#define SINKS_H
+
+#include "symbol_table.hpp"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct DisassemblerState;
+
+/* How a run of data bytes is written out, BYTE takes any number of bytes and WORD exactly three */
+enum class DataDirective
+{
+    Byte,
+    Word
+};
+
+/* Everything the decode loop reports, one call for every listing line it used to write. Override only what you need */
+class DisassemblySink
+{
+    public:
+        virtual ~DisassemblySink() {}
+        virtual void start(const std::string& programName, const std::string& startAddress) {}
+        virtual void instruction(const DisassemblerState& state, const int bytesReadIn) {}
+        virtual void literal(const int LOCCTR, const LITTAB_Entry& entry) {}
+        virtual void data(const int LOCCTR, const std::string& bytes, const DataDirective directive) {}
+        virtual void base(const int address) {}
+        virtual void ltorg() {}
+        virtual void reserve(const int LOCCTR, const int32_t bytes) {}
+        virtual void finish(const std::string& programName) {}
+};
+
+/* Hands every event to each attached sink in the order they were attached */
+class FanoutSink : public DisassemblySink
+{
+    public:
+        void attach(DisassemblySink& sink);
+        void attach(std::unique_ptr<DisassemblySink> sink, std::unique_ptr<std::ostream> stream);
+        void start(const std::string& programName, const std::string& startAddress) override;
+        void instruction(const DisassemblerState& state, const int bytesReadIn) override;
+        void literal(const int LOCCTR, const LITTAB_Entry& entry) override;
+        void data(const int LOCCTR, const std::string& bytes, const DataDirective directive) override;
+        void base(const int address) override;
+        void ltorg() override;
+        void reserve(const int LOCCTR, const int32_t bytes) override;
+        void finish(const std::string& programName) override;
+    private:
+        std::vector<DisassemblySink*> sinks;
+        std::vector<std::unique_ptr<std::ostream>> ownedStreams;   // Files the owned sinks write to, outlive the sinks
+        std::vector<std::unique_ptr<DisassemblySink>> ownedSinks;
+};
+
+/* Every labelled address an operand resolves to, with the addresses of the instructions that reference it */
+class ReferenceSink : public DisassemblySink
+{
+    public:
+        explicit ReferenceSink(const SymbolProvider& symbols) : symbols(symbols) {}
+        void instruction(const DisassemblerState& state, const int bytesReadIn) override;
+        const std::map<int32_t, std::vector<int32_t>>& getReferences() const {return references;}
+    protected:
+        const SymbolProvider& symbols;
+        std::map<int32_t, std::vector<int32_t>> references;
+};
+
+/* The references above written out as a cross reference table once the program is done */
+class XrefSink : public ReferenceSink
+{
+    public:
+        XrefSink(std::ostream& stream, const SymbolProvider& symbols) : ReferenceSink(symbols), stream(stream) {}
+        void finish(const std::string& programName) override;
+    private:
+        std::ostream& stream;
+};
+
+/* Opcode histogram plus a count of every other kind of event */
+class StatsSink : public DisassemblySink
+{
+    public:
+        explicit StatsSink(std::ostream& stream) : stream(stream) {}
+        void instruction(const DisassemblerState& state, const int bytesReadIn) override;
+        void literal(const int LOCCTR, const LITTAB_Entry& entry) override;
+        void data(const int LOCCTR, const std::string& bytes, const DataDirective directive) override;
+        void base(const int address) override;
+        void ltorg() override;
+        void reserve(const int LOCCTR, const int32_t bytes) override;
+        void finish(const std::string& programName) override;
+    private:
+        std::ostream& stream;
+        std::map<std::string, uint64_t> opcodes;
+        uint64_t instructions = 0;
+        uint64_t instructionBytes = 0;
+        uint64_t literals = 0;
+        uint64_t literalBytes = 0;
+        uint64_t dataLines = 0;
+        uint64_t dataBytes = 0;
+        uint64_t baseChanges = 0;
+        uint64_t ltorgs = 0;
+        uint64_t reservations = 0;
+        uint64_t reservedBytes = 0;
+};
+
+/* Address map, one line per unit with the range of memory it covers and what it is */
+class MapSink : public DisassemblySink
+{
+    public:
+        explicit MapSink(std::ostream& stream) : stream(stream) {}
+        void instruction(const DisassemblerState& state, const int bytesReadIn) override;
+        void literal(const int LOCCTR, const LITTAB_Entry& entry) override;
+        void data(const int LOCCTR, const std::string& bytes, const DataDirective directive) override;
+        void reserve(const int LOCCTR, const int32_t bytes) override;
+    private:
+        std::ostream& stream;
+};
+
+void ATTACH_SINKS(FanoutSink& fanout, const int argc, const char* argv[], const int firstSinkArg, const SymbolProvider& symbols);
+
+#endif
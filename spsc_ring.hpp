@@ -0,0 +1,72 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+#define CACHE_LINE_SIZE 64
+
+/*
+ * Lock-free ring buffer for exactly one producer thread and one consumer thread.
+ * The producer only ever writes head and the consumer only ever writes tail, so the two indices
+ * sit on their own cache lines and a pair of acquire/release operations is all the synchronization needed.
+ * CAPACITY must be a power of two so wrapping is a mask instead of a division.
+ */
+template <typename T, std::size_t CAPACITY>
+class SpscRing
+{
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "SpscRing capacity must be a power of two");
+
+    public:
+        SpscRing() : head(0), tail(0), producerStalls(0), consumerStalls(0) {}
+
+        bool tryPush(T&& item)
+        {
+            const std::size_t currentHead = head.load(std::memory_order_relaxed);
+            if (currentHead - tail.load(std::memory_order_acquire) == CAPACITY) return false; // Full
+            slots[currentHead & (CAPACITY - 1)] = std::move(item);
+            head.store(currentHead + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool tryPop(T& item)
+        {
+            const std::size_t currentTail = tail.load(std::memory_order_relaxed);
+            if (currentTail == head.load(std::memory_order_acquire)) return false; // Empty
+            item = std::move(slots[currentTail & (CAPACITY - 1)]);
+            tail.store(currentTail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Blocking versions yield the core while waiting, every wait is counted so we can spot the slow stage
+        void push(T&& item)
+        {
+            while (!tryPush(std::move(item))) {
+                producerStalls++;
+                std::this_thread::yield();
+            }
+        }
+
+        void pop(T& item)
+        {
+            while (!tryPop(item)) {
+                consumerStalls++;
+                std::this_thread::yield();
+            }
+        }
+
+        uint64_t getProducerStalls() const {return producerStalls;}
+        uint64_t getConsumerStalls() const {return consumerStalls;}
+
+    private:
+        alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> head;
+        alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> tail;
+        alignas(CACHE_LINE_SIZE) uint64_t producerStalls;   // Only touched by producer
+        alignas(CACHE_LINE_SIZE) uint64_t consumerStalls;   // Only touched by consumer
+        T slots[CAPACITY];
+};
+
+#endif
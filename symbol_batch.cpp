@@ -0,0 +1,282 @@
+/*
+ *  @brief
+ *          Label resolution a record at a time, by one merge-join of sorted lookups against SYMTAB/LITTAB in an array
+ *
+ *  findLabel resolves every label on its own: hasLiteral then hasSymbol, each a walk down a red-black tree whose
+ *  nodes are spread over the heap, and a second walk for the entry once one answers yes. The addresses of one text
+ *  record sit close together, the LOCCTR of each instruction plus an operand target a few hundred bytes away, so
+ *  here they are collected first, sorted, and resolved in a single forward pass over SYMTAB and LITTAB merged into
+ *  one address-sorted array. The pass gallops from one lookup to the next, so a small batch against a large table
+ *  costs a few cache lines instead of a tree walk per label.
+ *
+ *  BatchSymbolProvider is what the pipeline resolver renders with. Before each record it resolves the addresses the
+ *  record will ask for, in the order it asks for them, so the renderer's lookups are answered by position without a
+ *  search. Lookups it did not see coming (the RESB gaps, extra sinks) gallop through the same label array from where
+ *  the previous one stopped, gap addresses come in ascending order so that is a step or two each.
+ *  --bench-symbols puts every lookup of a program through the map provider and through BatchSymbolProvider with the
+ *  same CREATE_SYMBOL_OUTPUT calls the listing makes, fails if they ever disagree, and reports lookups per second and
+ *  (where the kernel exposes them) cache misses per lookup.
+ */
+
+#include "symbol_batch.hpp"
+#include "bench_counters.hpp"
+#include "memory_accounting.hpp"
+#include "control_flow.hpp"
+#include "length_scan.hpp"
+#include "operand_renderers.hpp"
+#include "byte_operations.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+const constexpr int INPUT_FILE_ARG_NUMBER = 1;
+const constexpr int SYMBOL_FILE_ARG_NUMBER = 2;
+const constexpr int ROUNDS_ARG_NUMBER = 3;
+const constexpr int DEFAULT_ROUNDS = 50;
+const constexpr int COLUMN_WIDTH = 18;
+const constexpr int FIRST_TWELVE_BITS = 3;
+const constexpr std::size_t BATCH_LOOKAHEAD = 2;        // An item asks for its LOCCTR and maybe an operand, a cached operand is skipped
+const constexpr double NANOS_PER_SECOND = 1e9;
+const constexpr char* LDB_INSTRUCTION = "LDB";
+
+namespace
+{
+    struct BenchResult
+    {
+        double lookupsPerSecond;
+        double nanosPerLookup;
+        double cacheMissesPerLookup;
+        bool cacheMissesCounted;
+    };
+
+    bool addressBefore(const BatchLookup& lookup, const BatchLookup& other) {return lookup.address < other.address;}
+    bool labelBefore(const SortedLabel& label, const int32_t address) {return label.address < address;}
+
+    // First label at or after address, doubling the step from where the previous lookup stopped
+    std::vector<SortedLabel>::const_iterator gallop(std::vector<SortedLabel>::const_iterator label, const std::vector<SortedLabel>::const_iterator end, const int32_t address)
+    {
+        std::ptrdiff_t step = 1;
+        while (step < end - label && label[step].address < address) step *= 2;
+        const std::vector<SortedLabel>::const_iterator last = step < end - label ? label + step + 1 : end;
+        return std::lower_bound(label + step / 2, last, address, labelBefore);
+    }
+
+    // Lookups have to be sorted by address already
+    void MERGE_JOIN(std::vector<BatchLookup>& lookups, const std::vector<SortedLabel>& labels)
+    {
+        std::vector<SortedLabel>::const_iterator label = labels.begin();
+        for (BatchLookup& lookup : lookups)
+        {
+            if (label != labels.end() && label->address < lookup.address) label = gallop(label, labels.end(), lookup.address);
+            lookup.label = label != labels.end() && label->address == lookup.address ? &*label : nullptr;
+        }
+    }
+
+    // Every label a record asks for, per record so the batch path resolves exactly what the resolver would
+    std::vector<std::vector<int32_t>> COLLECT_PROGRAM_TARGETS(const MemoryImage& image, const LITMAP& litmap, const Parser& parser)
+    {
+        std::vector<std::vector<int32_t>> targets;
+        int BASE = 0;
+        for (const TextRecord& record : image.records)
+        {
+            const std::vector<InstructionBoundary> boundaries = SCAN_INSTRUCTION_LENGTHS(DECODE_HEX_BYTES(record.objectCode), record.LOCCTR_START, litmap);
+            targets.push_back(COLLECT_RECORD_TARGETS(DECODE_BOUNDARIES(record, boundaries, 0, boundaries.size(), parser), BASE));
+        }
+        return targets;
+    }
+
+    std::size_t PER_LOOKUP_PATH(const std::vector<std::vector<int32_t>>& targets, const SymbolProvider& symbols, const std::vector<SortedLabel>&)
+    {
+        std::size_t resolved = 0;
+        for (const std::vector<int32_t>& record : targets)
+            for (const int32_t address : record) resolved += CREATE_SYMBOL_OUTPUT(address, symbols).size();
+        return resolved;
+    }
+
+    // The pipeline's provider, resolving each record up front and then asked exactly like the per lookup path
+    std::size_t BATCH_PATH(const std::vector<std::vector<int32_t>>& targets, const SymbolProvider&, const std::vector<SortedLabel>& labels)
+    {
+        std::size_t resolved = 0;
+        BatchSymbolProvider symbols(labels);
+        for (const std::vector<int32_t>& record : targets)
+        {
+            symbols.resolve(record);
+            for (const int32_t address : record) resolved += CREATE_SYMBOL_OUTPUT(address, symbols).size();
+        }
+        return resolved;
+    }
+
+    using ResolutionPath = std::size_t (*)(const std::vector<std::vector<int32_t>>& targets, const SymbolProvider& symbols, const std::vector<SortedLabel>& labels);
+
+    BenchResult TIME_PATH(const ResolutionPath path, const std::vector<std::vector<int32_t>>& targets, const std::size_t lookups, const int rounds, const SymbolProvider& symbols, const std::vector<SortedLabel>& labels)
+    {
+        HardwareCounter cacheMisses(HardwareEvent::CacheMisses);
+        std::size_t resolved = 0;
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        cacheMisses.start();
+        for (int round = 0; round < rounds; round++) resolved += path(targets, symbols, labels);
+        const uint64_t missCount = cacheMisses.stop();
+        const double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        static volatile std::size_t keepAlive;              // So the lookups cannot be optimised away
+        keepAlive = resolved;
+        (void)keepAlive;
+        const double total = static_cast<double>(lookups) * rounds;
+        return BenchResult{total / nanos * NANOS_PER_SECOND, nanos / total, missCount / total, cacheMisses.available()};
+    }
+
+    void printResult(const char* path, const BenchResult& result)
+    {
+        std::cout << std::left << std::setw(COLUMN_WIDTH) << path << std::right << std::fixed << std::setprecision(0)
+        << std::setw(COLUMN_WIDTH) << result.lookupsPerSecond << std::setprecision(2) << std::setw(COLUMN_WIDTH) << result.nanosPerLookup;
+        if (result.cacheMissesCounted) std::cout << std::setw(COLUMN_WIDTH) << std::setprecision(3) << result.cacheMissesPerLookup;
+        else std::cout << std::setw(COLUMN_WIDTH) << "n/a";
+        std::cout << std::endl;
+    }
+}
+
+void BatchSymbolProvider::resolve(const std::vector<int32_t>& addresses)
+{
+    batch.clear();
+    for (std::size_t i = 0; i < addresses.size(); i++) batch.push_back(BatchLookup{addresses[i], static_cast<uint32_t>(i), nullptr});
+    sorted = batch;
+    RESOLVE_BATCH(sorted, labels);
+    for (const BatchLookup& lookup : sorted) batch[lookup.index].label = lookup.label;
+    position = 0;
+}
+
+// The label at address or nullptr, from the batch when rendering asks what it was expected to ask
+const SortedLabel* BatchSymbolProvider::find(const int address) const
+{
+    for (std::size_t ahead = position; ahead < batch.size() && ahead <= position + BATCH_LOOKAHEAD; ahead++)
+    {
+        if (batch[ahead].address != address) continue;
+        position = ahead;
+        batchHits++;
+        return batch[ahead].label;
+    }
+    sweeps++;
+    if (swept != labels.begin() && std::prev(swept)->address >= address) swept = std::lower_bound(labels.begin(), swept, address, labelBefore);
+    else if (swept != labels.end() && swept->address < address) swept = gallop(swept, labels.end(), address);
+    return swept != labels.end() && swept->address == address ? &*swept : nullptr;
+}
+
+bool BatchSymbolProvider::hasSymbol(const int address) const
+{
+    const SortedLabel* label = find(address);
+    return label && label->symbol;
+}
+
+// Only asked after hasSymbol said yes, like on every provider
+const std::string BatchSymbolProvider::getSymbol(const int address) const
+{
+    return *find(address)->symbol;
+}
+
+bool BatchSymbolProvider::hasLiteral(const int address) const
+{
+    const SortedLabel* label = find(address);
+    return label && label->literal;
+}
+
+const LITTAB_Entry BatchSymbolProvider::getLiteral(const int address) const
+{
+    return *find(address)->literal;
+}
+
+/* Both tables in one array ordered by address, the maps are ordered already so this is a single merge */
+std::vector<SortedLabel> SORT_LABELS(const SYMMAP& symmap, const LITMAP& litmap)
+{
+    MemoryScope scope(MemorySubsystem::SymbolTable);
+    std::vector<SortedLabel> labels;
+    labels.reserve(symmap.size() + litmap.size());
+    SYMMAP::const_iterator symbol = symmap.begin();
+    LITMAP::const_iterator literal = litmap.begin();
+    while (symbol != symmap.end() || literal != litmap.end())
+    {
+        const int32_t address = literal == litmap.end() || (symbol != symmap.end() && symbol->first < literal->first) ? symbol->first : literal->first;
+        const bool hasSymbol = symbol != symmap.end() && symbol->first == address;
+        const bool hasLiteral = literal != litmap.end() && literal->first == address;
+        labels.push_back(SortedLabel{address, hasLiteral ? &literal->second : nullptr, hasSymbol ? &symbol->second.symbol : nullptr});
+        if (hasSymbol) ++symbol;
+        if (hasLiteral) ++literal;
+    }
+    return labels;
+}
+
+void RESOLVE_BATCH(std::vector<BatchLookup>& lookups, const std::vector<SortedLabel>& labels)
+{
+    std::sort(lookups.begin(), lookups.end(), addressBefore);
+    MERGE_JOIN(lookups, labels);
+}
+
+/*
+ *  The addresses rendering a record looks up: the label column of every item and the operand of every format 3/4
+ *  instruction. BASE follows LDB in order like handleBaseDirective and is left where the record's last LDB put it.
+ */
+std::vector<int32_t> COLLECT_RECORD_TARGETS(const std::vector<DecodedItem>& items, int& BASE)
+{
+    std::vector<int32_t> targets;
+    targets.reserve(items.size() * 2);
+    for (const DecodedItem& item : items)
+    {
+        targets.push_back(item.LOCCTR);
+        if (item.literal) continue;
+        const ParsedInstruction& instruction = item.result.instruction;
+        if (instruction.format != AddressingFormat::Format2)
+            targets.push_back(OPERAND_LOOKUP_ADDRESS(OffsetInfo{BASE, item.LOCCTR + item.result.bytesReadIn}, instruction.objectCode));
+        if (instruction.opCode == LDB_INSTRUCTION) BASE = hexStringToInt(instruction.objectCode.substr(FIRST_TWELVE_BITS));
+    }
+    return targets;
+}
+
+// Expects argv[1] to be the object file, argv[2] the symbol file and optionally argv[3] how many times to resolve each label
+int runSymbolBenchmarkMode(const int argc, const char* argv[])
+{
+    InputFile inputFile                     = FileHandling::openFile(argv[INPUT_FILE_ARG_NUMBER]);
+    const SymbolEntries symbolEntries       = FileHandling::readSymbolTableFile(argv[SYMBOL_FILE_ARG_NUMBER]);
+    const LITMAP litmap                     = CREATE_LITMAP(symbolEntries);
+    const SYMMAP symmap                     = CREATE_SYMMAP(symbolEntries);
+    const MapSymbolProvider symbols         (symmap, litmap);
+    const std::vector<SortedLabel> labels   = SORT_LABELS(symmap, litmap);
+    const Parser parser;
+    const int rounds                        = argc > ROUNDS_ARG_NUMBER ? std::atoi(argv[ROUNDS_ARG_NUMBER]) : DEFAULT_ROUNDS;
+    if (rounds <= 0) {
+        std::cerr << "Rounds must be a positive number: " << argv[ROUNDS_ARG_NUMBER] << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    const std::vector<std::vector<int32_t>> targets = COLLECT_PROGRAM_TARGETS(LOAD_MEMORY_IMAGE(inputFile), litmap, parser);
+    std::size_t lookups = 0;
+    BatchSymbolProvider batch               (labels);
+    for (const std::vector<int32_t>& record : targets)
+    {
+        lookups += record.size();
+        batch.resolve(record);
+        for (const int32_t address : record)
+        {
+            const std::string single = CREATE_SYMBOL_OUTPUT(address, symbols);
+            const std::string batched = CREATE_SYMBOL_OUTPUT(address, batch);
+            if (single == batched) continue;
+            std::cerr << "Resolution paths disagree at " << intToHexString(address) << ": " << single << " vs " << batched << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (lookups == 0) {
+        std::cerr << "No labels to resolve in " << argv[INPUT_FILE_ARG_NUMBER] << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    const BenchResult single = TIME_PATH(PER_LOOKUP_PATH, targets, lookups, rounds, symbols, labels);
+    const BenchResult batched = TIME_PATH(BATCH_PATH, targets, lookups, rounds, symbols, labels);
+    std::cout << lookups << " lookups in " << targets.size() << " records against " << labels.size() << " labels x " << rounds
+    << " rounds, both paths agree, " << batch.getBatchHits() << " provider calls answered by position and " << batch.getSweeps()
+    << " from the label array" << std::endl
+    << std::left << std::setw(COLUMN_WIDTH) << "path" << std::right << std::setw(COLUMN_WIDTH) << "lookups/s"
+    << std::setw(COLUMN_WIDTH) << "ns/lookup" << std::setw(COLUMN_WIDTH) << "misses/lookup" << std::endl;
+    printResult("per lookup", single);
+    printResult("batch provider", batched);
+    inputFile.close();
+    return EXIT_SUCCESS;
+}
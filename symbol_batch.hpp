@@ -0,0 +1,60 @@
+#ifndef SYMBOL_BATCH_H
+#define SYMBOL_BATCH_H
+
+#include "pipeline.hpp"
+#include "symbol_table.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* One address of SYMTAB and LITTAB merged, either pointer may be missing. Points into the maps it was built from */
+struct SortedLabel
+{
+    int32_t address;
+    const LITTAB_Entry* literal;
+    const std::string* symbol;
+};
+
+/* One address to resolve, index is where it came from so results can be put back in lookup order */
+struct BatchLookup
+{
+    int32_t address;
+    uint32_t index;
+    const SortedLabel* label;       // nullptr when neither table has the address
+};
+
+/*
+ *  Answers from labels resolved a record at a time. resolve takes the addresses in the order rendering the record asks
+ *  for them, and the answers are handed out by position. Anything the batch did not see coming (the RESB gaps for
+ *  instance) is found in the label array from where the last such lookup stopped. Lookups
+ *  move the position, so one provider serves one thread.
+ */
+class BatchSymbolProvider : public SymbolProvider
+{
+    public:
+        explicit BatchSymbolProvider(const std::vector<SortedLabel>& labels) : labels(labels), swept(labels.begin()) {}
+        void resolve(const std::vector<int32_t>& addresses);
+        bool hasSymbol(const int address) const override;
+        const std::string getSymbol(const int address) const override;
+        bool hasLiteral(const int address) const override;
+        const LITTAB_Entry getLiteral(const int address) const override;
+        uint64_t getBatchHits() const {return batchHits;}
+        uint64_t getSweeps() const {return sweeps;}
+    private:
+        const SortedLabel* find(const int address) const;
+
+        const std::vector<SortedLabel>& labels;
+        std::vector<BatchLookup> batch;             // In the order the record asks, labels filled in by the join
+        std::vector<BatchLookup> sorted;            // The same sorted for the join, kept so its storage is reused
+        mutable std::size_t position = 0;           // The lookup rendering is at
+        mutable std::vector<SortedLabel>::const_iterator swept;     // First label at or after the last swept address
+        mutable uint64_t batchHits = 0;
+        mutable uint64_t sweeps = 0;
+};
+
+std::vector<SortedLabel> SORT_LABELS(const SYMMAP& symmap, const LITMAP& litmap);
+void RESOLVE_BATCH(std::vector<BatchLookup>& lookups, const std::vector<SortedLabel>& labels);
+std::vector<int32_t> COLLECT_RECORD_TARGETS(const std::vector<DecodedItem>& items, int& BASE);
+int runSymbolBenchmarkMode(const int argc, const char* argv[]);
+
+#endif
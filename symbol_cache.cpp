@@ -0,0 +1,432 @@
+/*
+ *  @brief
+ *          Compiles a symbol file into address sorted arrays plus a string blob and maps it on later runs
+ *
+ *  Parsing the text file means building every SYMTAB_Entry/LITTAB_Entry string and then the SYMMAP/LITMAP trees,
+ *  on every run, for a file that almost never changes. The compiled copy is written next to the symbol file as
+ *  <file>.symc and is only trusted while the size, mtime and hash of the symbol file still match what it was built
+ *  from. A valid copy is mapped as is, nothing is parsed or allocated to start up and lookups search the mapping.
+ *  COMPILE_SYMBOL_CACHE writes the same file from one streaming pass, for readers held to a memory cap.
+ */
+
+#include "symbol_cache.hpp"
+#include "memory_accounting.hpp"
+#include "input_handler.hpp"
+#include "byte_operations.hpp"
+#include "trace.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+const constexpr char COMPILED_MAGIC[] = "SICSYMC1";
+const constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+const constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+const constexpr int64_t NANOS_PER_SECOND = 1000000000LL;
+const constexpr char* TEMPORARY_SUFFIX = ".tmp";
+const constexpr char* SYMBOLS_SPILL_SUFFIX = ".symbols";
+const constexpr char* LITERALS_SPILL_SUFFIX = ".literals";
+const constexpr char* BLOB_SPILL_SUFFIX = ".blob";
+const constexpr double BYTES_PER_KILOBYTE = 1024.0;
+const constexpr std::size_t STABLE_SORT_COPIES = 2;        // std::stable_sort takes a buffer as large as what it sorts
+
+/* 64 bit FNV-1a, cheap and good enough to tell two symbol files apart */
+uint64_t FNV_HASH(const char* data, const std::size_t size)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (std::size_t i = 0; i < size; i++)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+namespace
+{
+    /* Header fields that identify the symbol file, the rest is filled in when compiling */
+    CompiledSymbolHeader STAMP_SOURCE(const char* symbolFile)
+    {
+        CompiledSymbolHeader stamp;
+        std::memset(&stamp, 0, sizeof(stamp));
+        std::memcpy(stamp.magic, COMPILED_MAGIC, sizeof(stamp.magic));
+        const int descriptor = open(symbolFile, O_RDONLY);
+        struct stat status;
+        if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+            std::cerr << "Failed to open file: " << symbolFile << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        stamp.sourceSize = status.st_size;
+        stamp.sourceModified = static_cast<int64_t>(status.st_mtim.tv_sec) * NANOS_PER_SECOND + status.st_mtim.tv_nsec;
+        if (stamp.sourceSize > 0) {
+            void* source = mmap(nullptr, stamp.sourceSize, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (source != MAP_FAILED) {
+                stamp.sourceHash = FNV_HASH(static_cast<const char*>(source), stamp.sourceSize);
+                munmap(source, stamp.sourceSize);
+            }
+        }
+        close(descriptor);
+        return stamp;
+    }
+
+    bool SAME_SOURCE(const CompiledSymbolHeader& a, const CompiledSymbolHeader& b)
+    {
+        return std::memcmp(a.magic, b.magic, sizeof(a.magic)) == 0 && a.sourceSize == b.sourceSize
+            && a.sourceModified == b.sourceModified && a.sourceHash == b.sourceHash;
+    }
+
+    std::size_t IMAGE_SIZE(const CompiledSymbolHeader& header)
+    {
+        return sizeof(CompiledSymbolHeader) + header.symbolCount * sizeof(CompiledSymbol)
+            + header.literalCount * sizeof(CompiledLiteral) + header.blobSize;
+    }
+
+    BlobString addToBlob(std::string& blob, const std::string& text)
+    {
+        const BlobString string{static_cast<uint32_t>(blob.size()), static_cast<uint32_t>(text.size())};
+        blob += text;
+        return string;
+    }
+
+    // CREATE_SYMMAP/CREATE_LITMAP keep the first entry at an address, so the stable sort plus skip does the same
+    template<typename Entry>
+    std::vector<const Entry*> SORT_BY_ADDRESS(const std::vector<Entry>& entries)
+    {
+        std::vector<const Entry*> ordered;
+        for (const Entry& entry : entries) ordered.push_back(&entry);
+        std::stable_sort(ordered.begin(), ordered.end(), [](const Entry* a, const Entry* b) {return hexStringToInt(a->address) < hexStringToInt(b->address);});
+        ordered.erase(std::unique(ordered.begin(), ordered.end(), [](const Entry* a, const Entry* b) {return hexStringToInt(a->address) == hexStringToInt(b->address);}), ordered.end());
+        return ordered;
+    }
+
+    const std::string COMPILE_SYMBOL_TABLE(const SymbolEntries& symbolEntries, CompiledSymbolHeader header)
+    {
+        std::string blob;
+        std::vector<CompiledSymbol> symbols;
+        std::vector<CompiledLiteral> literals;
+        for (const SYMTAB_Entry* entry : SORT_BY_ADDRESS(symbolEntries.SYMTAB))
+            symbols.push_back(CompiledSymbol{hexStringToInt(entry->address), addToBlob(blob, entry->symbol)});
+        for (const LITTAB_Entry* entry : SORT_BY_ADDRESS(symbolEntries.LITTAB))
+            literals.push_back(CompiledLiteral{hexStringToInt(entry->address), addToBlob(blob, entry->name),
+                addToBlob(blob, entry->lit_const), addToBlob(blob, entry->length), addToBlob(blob, entry->address)});
+        header.startAddress = addToBlob(blob, symbolEntries.SYMTAB.empty() ? std::string() : symbolEntries.SYMTAB.front().address);
+        header.symbolCount = symbols.size();
+        header.literalCount = literals.size();
+        header.lastSymbolAddress = GET_LAST_SYMBOL_ADDRESS(symbolEntries);
+        header.blobSize = blob.size();
+
+        std::string image(reinterpret_cast<const char*>(&header), sizeof(header));
+        image.append(reinterpret_cast<const char*>(symbols.data()), symbols.size() * sizeof(CompiledSymbol));
+        image.append(reinterpret_cast<const char*>(literals.data()), literals.size() * sizeof(CompiledLiteral));
+        return image + blob;
+    }
+
+    // Written to a temporary name first so a reader never maps a half written cache
+    bool WRITE_CACHE(const std::string& cacheFile, const std::string& image)
+    {
+        const std::string temporaryFile = cacheFile + TEMPORARY_SUFFIX + std::to_string(getpid());
+        std::ofstream output(temporaryFile, std::ios::binary);
+        output.write(image.data(), image.size());
+        output.close();
+        if (output && std::rename(temporaryFile.c_str(), cacheFile.c_str()) == 0) return true;
+        std::remove(temporaryFile.c_str());
+        return false;
+    }
+}
+
+namespace
+{
+    /* Scratch files the streaming compile writes next to the cache, gone once the cache is published */
+    struct SpillFiles
+    {
+        explicit SpillFiles(const std::string& base)
+            : symbols(base + SYMBOLS_SPILL_SUFFIX), literals(base + LITERALS_SPILL_SUFFIX), blob(base + BLOB_SPILL_SUFFIX) {}
+        ~SpillFiles() {remove();}
+        void remove() const
+        {
+            std::remove(symbols.c_str());
+            std::remove(literals.c_str());
+            std::remove(blob.c_str());
+        }
+        const std::string symbols;      // CompiledSymbol records in file order
+        const std::string literals;     // CompiledLiteral records in file order
+        const std::string blob;         // Their strings in the same order
+    };
+
+    /* Everything the header needs that only the pass over the symbol file knows */
+    struct SpillSummary
+    {
+        uint32_t symbolCount;
+        uint32_t literalCount;
+        uint32_t blobSize;
+        int32_t lastSymbolAddress;
+        std::string startAddress;
+        bool inOrder;                   // Addresses only went up in both tables, so the spill already is the compiled layout
+        bool written;
+    };
+
+    BlobString spillString(std::ostream& blob, SpillSummary& summary, const std::string& text)
+    {
+        const BlobString string{summary.blobSize, static_cast<uint32_t>(text.size())};
+        blob << text;
+        summary.blobSize += text.size();
+        return string;
+    }
+
+    template<typename Entry>
+    void spillEntry(std::ostream& stream, const Entry& entry)
+    {
+        stream.write(reinterpret_cast<const char*>(&entry), sizeof(Entry));
+    }
+
+    // One pass over the symbol file, only the entry being read is ever in memory
+    SpillSummary SPILL_SYMBOL_FILE(const char* symbolFile, const SpillFiles& spill)
+    {
+        std::ofstream symbols(spill.symbols, std::ios::binary), literals(spill.literals, std::ios::binary), blob(spill.blob, std::ios::binary);
+        SpillSummary summary{0, 0, 0, 0, std::string(), true, false};
+        int32_t lastLiteralAddress = std::numeric_limits<int32_t>::min();
+        InputFile stream = FileHandling::openFile(symbolFile);
+        FileHandling::visitSymbolTable(stream, SymbolVisitor{
+            [&](const SYMTAB_Entry& entry) {
+                const int32_t address = hexStringToInt(entry.address);
+                if (!summary.symbolCount) summary.startAddress = entry.address;
+                else summary.inOrder = summary.inOrder && address > summary.lastSymbolAddress;
+                spillEntry(symbols, CompiledSymbol{address, spillString(blob, summary, entry.symbol)});
+                summary.lastSymbolAddress = address;
+                summary.symbolCount++;
+            },
+            [&](const LITTAB_Entry& entry) {
+                const int32_t address = hexStringToInt(entry.address);
+                summary.inOrder = summary.inOrder && address > lastLiteralAddress;
+                spillEntry(literals, CompiledLiteral{address, spillString(blob, summary, entry.name),
+                    spillString(blob, summary, entry.lit_const), spillString(blob, summary, entry.length), spillString(blob, summary, entry.address)});
+                lastLiteralAddress = address;
+                summary.literalCount++;
+            }
+        });
+        symbols.close();
+        literals.close();
+        blob.close();
+        summary.written = symbols && literals && blob;
+        return summary;
+    }
+
+    CompiledSymbolHeader FINISH_HEADER(CompiledSymbolHeader header, const SpillSummary& summary, const uint32_t symbolCount, const uint32_t literalCount)
+    {
+        header.symbolCount = symbolCount;
+        header.literalCount = literalCount;
+        header.lastSymbolAddress = summary.lastSymbolAddress;
+        header.startAddress = BlobString{summary.blobSize, static_cast<uint32_t>(summary.startAddress.size())};
+        header.blobSize = summary.blobSize + summary.startAddress.size();
+        return header;
+    }
+
+    void APPEND_FILE(std::ostream& output, const std::string& file)
+    {
+        std::ifstream input(file, std::ios::binary);
+        if (input.peek() != std::ifstream::traits_type::eof()) output << input.rdbuf();
+    }
+
+    // Sorted input with no repeated address, the spilled arrays and strings go into the cache exactly as written
+    bool CONCATENATE_SPILL(const std::string& temporaryFile, const SpillFiles& spill, const SpillSummary& summary, const CompiledSymbolHeader& stamp)
+    {
+        std::ofstream output(temporaryFile, std::ios::binary);
+        spillEntry(output, FINISH_HEADER(stamp, summary, summary.symbolCount, summary.literalCount));
+        APPEND_FILE(output, spill.symbols);
+        APPEND_FILE(output, spill.literals);
+        APPEND_FILE(output, spill.blob);
+        output << summary.startAddress;
+        output.close();
+        return static_cast<bool>(output);
+    }
+
+    template<typename Entry>
+    std::vector<Entry> LOAD_SPILLED(const std::string& file, const uint32_t count)
+    {
+        std::vector<Entry> entries(count);
+        std::ifstream input(file, std::ios::binary);
+        input.read(reinterpret_cast<char*>(entries.data()), count * sizeof(Entry));
+        return entries;
+    }
+
+    // Stable, so the first entry at an address in file order is the one kept, like CREATE_SYMMAP/CREATE_LITMAP
+    template<typename Entry>
+    void SORT_UNIQUE(std::vector<Entry>& entries)
+    {
+        std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {return a.address < b.address;});
+        entries.erase(std::unique(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {return a.address == b.address;}), entries.end());
+    }
+
+    // Copies the string to the end of the output and points the entry at the copy
+    void moveString(std::istream& blob, std::ostream& output, BlobString& string, uint32_t& blobSize)
+    {
+        std::string text(string.length, '\0');
+        blob.seekg(string.offset);
+        blob.read(&text[0], string.length);
+        output << text;
+        string.offset = blobSize;
+        blobSize += string.length;
+    }
+
+    /*
+     *  Out of order input has to be sorted before it can be searched. Only the fixed size entries are held for that,
+     *  and only while they fit the budget. Their strings are then copied over in the new order, since readers expect
+     *  the strings of consecutive entries to be back to back.
+     */
+    bool SORT_SPILL(const std::string& temporaryFile, const SpillFiles& spill, const SpillSummary& summary, const CompiledSymbolHeader& stamp, const std::size_t sortBudget, const char* symbolFile)
+    {
+        const std::size_t entryBytes = summary.symbolCount * sizeof(CompiledSymbol) + summary.literalCount * sizeof(CompiledLiteral);
+        if (entryBytes * STABLE_SORT_COPIES > sortBudget) {
+            std::cerr << symbolFile << " is not in address order, sorting its " << summary.symbolCount + summary.literalCount << " entries takes "
+            << std::ceil(entryBytes * STABLE_SORT_COPIES / BYTES_PER_KILOBYTE) << " KB and only " << std::floor(sortBudget / BYTES_PER_KILOBYTE)
+            << " KB are left under the memory cap" << std::endl;
+            spill.remove();         // exit skips the destructor
+            exit(EXIT_FAILURE);
+        }
+        std::vector<CompiledSymbol> symbols = LOAD_SPILLED<CompiledSymbol>(spill.symbols, summary.symbolCount);
+        std::vector<CompiledLiteral> literals = LOAD_SPILLED<CompiledLiteral>(spill.literals, summary.literalCount);
+        SORT_UNIQUE(symbols);
+        SORT_UNIQUE(literals);
+
+        std::ifstream blob(spill.blob, std::ios::binary);
+        std::ofstream output(temporaryFile, std::ios::binary);
+        SpillSummary sorted = summary;
+        sorted.blobSize = 0;
+        output.seekp(sizeof(CompiledSymbolHeader) + symbols.size() * sizeof(CompiledSymbol) + literals.size() * sizeof(CompiledLiteral));
+        for (CompiledSymbol& entry : symbols) moveString(blob, output, entry.symbol, sorted.blobSize);
+        for (CompiledLiteral& entry : literals)
+        {
+            moveString(blob, output, entry.name, sorted.blobSize);
+            moveString(blob, output, entry.litConst, sorted.blobSize);
+            moveString(blob, output, entry.length, sorted.blobSize);
+            moveString(blob, output, entry.addressText, sorted.blobSize);
+        }
+        output << summary.startAddress;
+        output.seekp(0);            // Strings are in place, now the arrays pointing at them
+        spillEntry(output, FINISH_HEADER(stamp, sorted, symbols.size(), literals.size()));
+        output.write(reinterpret_cast<const char*>(symbols.data()), symbols.size() * sizeof(CompiledSymbol));
+        output.write(reinterpret_cast<const char*>(literals.data()), literals.size() * sizeof(CompiledLiteral));
+        output.close();
+        return blob && output;
+    }
+}
+
+CompiledSymbolTable::CompiledSymbolTable(const char* symbolFile)
+{
+    MemoryScope scope(MemorySubsystem::SymbolTable);
+    TraceSpan span("loadCompiledSymbols");
+    const std::string cacheFile = std::string(symbolFile) + COMPILED_SYMBOL_SUFFIX;
+    const CompiledSymbolHeader stamp = STAMP_SOURCE(symbolFile);
+    if (mapCache(cacheFile, stamp)) return;
+
+    rebuilt = true;
+    span.setValue(rebuilt);
+    const std::string image = COMPILE_SYMBOL_TABLE(FileHandling::readSymbolTableFile(symbolFile), stamp);
+    if (WRITE_CACHE(cacheFile, image) && mapCache(cacheFile, stamp)) return;
+    ownedImage = image;                 // Read only directory, still use the compiled form for this run
+    view(ownedImage.data());
+}
+
+CompiledSymbolTable::~CompiledSymbolTable()
+{
+    if (mapping) munmap(const_cast<char*>(mapping), mappingSize);
+}
+
+/* Anything off about the cache just means it gets rebuilt */
+bool CompiledSymbolTable::mapCache(const std::string& cacheFile, const CompiledSymbolHeader& stamp)
+{
+    const int descriptor = open(cacheFile.c_str(), O_RDONLY);
+    if (descriptor < 0) return false;
+    struct stat status;
+    const bool sized = fstat(descriptor, &status) == 0 && static_cast<std::size_t>(status.st_size) >= sizeof(CompiledSymbolHeader);
+    void* mapped = sized ? mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0) : MAP_FAILED;
+    close(descriptor);
+    if (mapped == MAP_FAILED) return false;
+
+    const CompiledSymbolHeader* cached = static_cast<const CompiledSymbolHeader*>(mapped);
+    if (!SAME_SOURCE(*cached, stamp) || IMAGE_SIZE(*cached) != static_cast<std::size_t>(status.st_size)) {
+        munmap(mapped, status.st_size);
+        return false;
+    }
+    mapping = static_cast<const char*>(mapped);
+    mappingSize = status.st_size;
+    view(mapping);
+    return true;
+}
+
+void CompiledSymbolTable::view(const char* image)
+{
+    header = reinterpret_cast<const CompiledSymbolHeader*>(image);
+    symbols = reinterpret_cast<const CompiledSymbol*>(image + sizeof(CompiledSymbolHeader));
+    literals = reinterpret_cast<const CompiledLiteral*>(symbols + header->symbolCount);
+    blob = reinterpret_cast<const char*>(literals + header->literalCount);
+}
+
+const CompiledSymbol* CompiledSymbolTable::findSymbol(const int address) const
+{
+    const CompiledSymbol* end = symbols + header->symbolCount;
+    const CompiledSymbol* it = std::lower_bound(symbols, end, address, [](const CompiledSymbol& entry, const int key) {return entry.address < key;});
+    return it != end && it->address == address ? it : nullptr;
+}
+
+const CompiledLiteral* CompiledSymbolTable::findLiteral(const int address) const
+{
+    const CompiledLiteral* end = literals + header->literalCount;
+    const CompiledLiteral* it = std::lower_bound(literals, end, address, [](const CompiledLiteral& entry, const int key) {return entry.address < key;});
+    return it != end && it->address == address ? it : nullptr;
+}
+
+const std::string CompiledSymbolTable::getSymbol(const int address) const
+{
+    return text(findSymbol(address)->symbol);
+}
+
+const LITTAB_Entry CompiledSymbolTable::getLiteral(const int address) const
+{
+    const CompiledLiteral* literal = findLiteral(address);
+    return LITTAB_Entry{text(literal->name), text(literal->litConst), text(literal->length), text(literal->addressText)};
+}
+
+/* The literals alone as a LITMAP, for the length scan which walks them in address order next to the bytes */
+const LITMAP CompiledSymbolTable::getLiteralMap() const
+{
+    MemoryScope scope(MemorySubsystem::SymbolTable);
+    LITMAP map;
+    for (const CompiledLiteral* literal = literals; literal != literals + header->literalCount; ++literal)
+        map.emplace_hint(map.end(), literal->address, LITTAB_Entry{text(literal->name), text(literal->litConst), text(literal->length), text(literal->addressText)});
+    return map;
+}
+
+/* Brings <file>.symc up to date without mapping it, for readers that only ever pull pieces of it in */
+bool COMPILE_SYMBOL_CACHE(const char* symbolFile, const std::size_t sortBudget)
+{
+    MemoryScope scope(MemorySubsystem::SymbolTable);
+    const std::string cacheFile = std::string(symbolFile) + COMPILED_SYMBOL_SUFFIX;
+    const CompiledSymbolHeader stamp = STAMP_SOURCE(symbolFile);
+    const int descriptor = open(cacheFile.c_str(), O_RDONLY);
+    if (descriptor >= 0) {
+        CompiledSymbolHeader cached;
+        struct stat status;
+        const bool current = fstat(descriptor, &status) == 0 && pread(descriptor, &cached, sizeof(cached), 0) == sizeof(cached)
+            && SAME_SOURCE(cached, stamp) && IMAGE_SIZE(cached) == static_cast<std::size_t>(status.st_size);
+        close(descriptor);
+        if (current) return true;
+    }
+    TraceSpan span("compileSymbols");
+    const std::string temporaryFile = cacheFile + TEMPORARY_SUFFIX + std::to_string(getpid());
+    const SpillFiles spill(temporaryFile);
+    const SpillSummary summary = SPILL_SYMBOL_FILE(symbolFile, spill);
+    span.setValue(summary.inOrder);
+    const bool written = summary.written && (summary.inOrder ? CONCATENATE_SPILL(temporaryFile, spill, summary, stamp)
+        : SORT_SPILL(temporaryFile, spill, summary, stamp, sortBudget, symbolFile));
+    if (written && std::rename(temporaryFile.c_str(), cacheFile.c_str()) == 0) return true;
+    std::remove(temporaryFile.c_str());
+    return false;
+}
@@ -0,0 +1,88 @@
+#ifndef SYMBOL_CACHE_H
+#define SYMBOL_CACHE_H
+
+#include "symbol_table.hpp"
+#include <cstdint>
+#include <string>
+
+#define COMPILED_SYMBOL_SUFFIX ".symc"
+
+/* Where a string lives in the blob at the end of the compiled file */
+struct BlobString
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+/*
+ *  Compiled layout, host byte order since the file never leaves the machine that wrote it
+ *      header      everything below, plus size, mtime and hash of the symbol file it was compiled from
+ *      symbols     CompiledSymbol[symbolCount] sorted by address
+ *      literals    CompiledLiteral[literalCount] sorted by address
+ *      blob        every string the entries point at
+ */
+struct CompiledSymbolHeader
+{
+    char magic[8];
+    uint64_t sourceSize;
+    int64_t sourceModified;         // Nanoseconds since the epoch
+    uint64_t sourceHash;            // FNV-1a over the raw bytes of the symbol file
+    uint32_t symbolCount;
+    uint32_t literalCount;
+    int32_t lastSymbolAddress;      // Address of the last SYMTAB line in file order, same as GET_LAST_SYMBOL_ADDRESS
+    uint32_t blobSize;
+    BlobString startAddress;        // Address text of the first SYMTAB line, used for the START line
+};
+
+struct CompiledSymbol
+{
+    int32_t address;
+    BlobString symbol;
+};
+
+struct CompiledLiteral
+{
+    int32_t address;
+    BlobString name;
+    BlobString litConst;
+    BlobString length;
+    BlobString addressText;
+};
+
+/* A symbol file compiled once and mapped on every later run, lookups are binary searches straight over the mapping */
+class CompiledSymbolTable : public SymbolProvider
+{
+    public:
+        explicit CompiledSymbolTable(const char* symbolFile);
+        ~CompiledSymbolTable();
+        CompiledSymbolTable(const CompiledSymbolTable&) = delete;
+        CompiledSymbolTable& operator=(const CompiledSymbolTable&) = delete;
+        bool hasSymbol(const int address) const override {return findSymbol(address) != nullptr;}
+        const std::string getSymbol(const int address) const override;
+        bool hasLiteral(const int address) const override {return findLiteral(address) != nullptr;}
+        const LITTAB_Entry getLiteral(const int address) const override;
+        const LITMAP getLiteralMap() const;
+        const std::string getStartAddress() const {return text(header->startAddress);}
+        int getLastSymbolAddress() const {return header->lastSymbolAddress;}
+        bool wasRebuilt() const {return rebuilt;}
+    private:
+        bool mapCache(const std::string& cacheFile, const CompiledSymbolHeader& stamp);
+        void view(const char* image);
+        const CompiledSymbol* findSymbol(const int address) const;
+        const CompiledLiteral* findLiteral(const int address) const;
+        const std::string text(const BlobString& string) const {return std::string(blob + string.offset, string.length);}
+
+        const char* mapping = nullptr;
+        std::size_t mappingSize = 0;
+        std::string ownedImage;         // Only used when the cache could not be written next to the symbol file
+        const CompiledSymbolHeader* header = nullptr;
+        const CompiledSymbol* symbols = nullptr;
+        const CompiledLiteral* literals = nullptr;
+        const char* blob = nullptr;
+        bool rebuilt = false;
+};
+
+uint64_t FNV_HASH(const char* data, const std::size_t size);
+bool COMPILE_SYMBOL_CACHE(const char* symbolFile, const std::size_t sortBudget);
+
+#endif
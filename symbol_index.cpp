@@ -0,0 +1,362 @@
+/*
+ *  @brief
+ *          Cross program symbol database, built once from many programs and queried without touching them again
+ *
+ *  "Which programs define or reference X" and "what lives at address Y in every build" used to mean disassembling
+ *  every program again. --index reads the SYMTAB/LITTAB of each program, or of each of its control sections, and runs
+ *  the engine once per section with a ReferenceSink to collect the labels its operands resolve to, then writes
+ *  everything as sorted fixed size arrays over a dictionary of distinct strings. --query maps that file and answers with binary searches, the programs are never opened.
+ */
+
+#include "symbol_index.hpp"
+#include "control_sections.hpp"
+#include "disassembly.hpp"
+#include "byte_operations.hpp"
+#include "sinks.hpp"
+#include "binary_object.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <set>
+#include <sstream>
+#include <tuple>
+
+const constexpr int INDEX_ARG_NUMBER = 1;
+const constexpr int FIRST_PROGRAM_ARG_NUMBER = 2;
+const constexpr int QUERY_KIND_ARG_NUMBER = 2;
+const constexpr int QUERY_KEY_ARG_NUMBER = 3;
+const constexpr int FILES_PER_PROGRAM = 2;
+const constexpr int INITIAL_BASE = 0;
+const constexpr int COLUMN_WIDTH = 12;
+const constexpr int ADDRESS_DIGITS = 4;
+const constexpr int HEX_BASE = 16;
+const constexpr double NANOS_PER_MICRO = 1000.0;
+const constexpr char INDEX_MAGIC[] = "SICSIDX1";
+const constexpr char* TEMPORARY_SUFFIX = ".tmp";
+const constexpr char* LITERAL_NAME = "*";
+const constexpr char* NOT_AN_INDEX_MESSAGE = "Not a valid symbol index: ";
+const constexpr char* INDEX_USAGE = "usage: --index <index> <program.obj> <program.sym> [...]";
+const constexpr char* QUERY_USAGE = "usage: --query <index> symbol <name> | address <hex> | refs <name>";
+
+namespace
+{
+    struct PendingDefinition
+    {
+        std::string name;
+        uint32_t program;
+        int32_t address;
+        uint32_t kind;
+    };
+
+    struct PendingReference
+    {
+        std::string name;
+        uint32_t program;
+        int32_t target;
+        int32_t from;
+    };
+
+    struct PendingIndex
+    {
+        std::vector<std::pair<std::string, std::string>> programs;     // Program name and object path
+        std::vector<PendingDefinition> definitions;
+        std::vector<PendingReference> references;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    const std::string zeroPad(const std::string& hex)
+    {
+        return hex.size() >= ADDRESS_DIGITS ? hex : std::string(ADDRESS_DIGITS - hex.size(), '0') + hex;
+    }
+
+    // Unnamed literals are known by their constant, same as the listing shows them
+    const std::string literalLabel(const LITTAB_Entry& entry)
+    {
+        return entry.name.empty() || entry.name == LITERAL_NAME ? entry.lit_const : entry.name;
+    }
+
+    void failIndex(const char* filename, const std::string& reason)
+    {
+        std::cerr << NOT_AN_INDEX_MESSAGE << filename << " (" << reason << ")" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    /* The engine runs with nothing but a ReferenceSink attached, so no listing is rendered */
+    void COLLECT_REFERENCES(std::istream& records, const SymbolEntries& symbolEntries, const uint32_t program, const Parser& parser, PendingIndex& pending)
+    {
+        const LITMAP litmap                     = CREATE_LITMAP(symbolEntries);
+        const SYMMAP symmap                     = CREATE_SYMMAP(symbolEntries);
+        const REGMAP registers                  = REGISTERS();
+        const MapSymbolProvider symbols         (symmap, litmap);
+        std::ostringstream noOutput;
+        ReferenceSink referenceSink             (symbols);
+        DisassemblerContext                     context{records, noOutput, referenceSink, registers, symbols, parser, INITIAL_BASE, false};
+        disassembleTextSections(context, GET_LAST_SYMBOL_ADDRESS(symbolEntries));
+
+        for (const auto& target : referenceSink.getReferences())
+        {
+            const std::string label = CREATE_SYMBOL_OUTPUT(target.first, symbols);
+            for (const int32_t from : target.second) pending.references.push_back(PendingReference{label, program, target.first, from});
+        }
+    }
+
+    /*
+     *  Every control section is indexed as a program of its own, named after its H record and scoped to its own
+     *  SYMTAB/LITTAB pair the way --sections lists it, since each one starts its addresses over. An object without
+     *  sections is simply the one section.
+     */
+    void INGEST_PROGRAM(const char* objectFile, const char* symbolFile, const Parser& parser, PendingIndex& pending)
+    {
+        InputFile inputFile                     = FileHandling::openFile(objectFile);
+        REFUSE_BINARY_OBJECT(inputFile, objectFile, "--index");
+        const std::vector<ControlSection> sections = READ_CONTROL_SECTIONS(inputFile);
+        const std::vector<SymbolEntries> blocks = FileHandling::readSymbolTableBlocks(symbolFile);
+        for (std::size_t i = 0; i < sections.size(); i++)
+        {
+            const uint32_t program = pending.programs.size();
+            pending.programs.push_back(std::make_pair(sections[i].name, std::string(objectFile)));
+            const SymbolEntries symbolEntries = SECTION_SYMBOLS(sections[i], blocks, i);
+            for (const SYMTAB_Entry& entry : symbolEntries.SYMTAB)
+                pending.definitions.push_back(PendingDefinition{entry.symbol, program, hexStringToInt(entry.address), SYMBOL_INDEX_SYMBOL});
+            for (const LITTAB_Entry& entry : symbolEntries.LITTAB)
+                pending.definitions.push_back(PendingDefinition{literalLabel(entry), program, hexStringToInt(entry.address), SYMBOL_INDEX_LITERAL});
+            std::istringstream records(sections[i].records);
+            COLLECT_REFERENCES(records, symbolEntries, program, parser, pending);
+        }
+    }
+
+    template<typename T>
+    void appendArray(std::string& image, const std::vector<T>& entries)
+    {
+        image.append(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(T));
+    }
+
+    const std::string BUILD_INDEX(const PendingIndex& pending)
+    {
+        std::set<std::string> distinct;
+        for (const auto& program : pending.programs) distinct.insert({program.first, program.second});
+        for (const PendingDefinition& definition : pending.definitions) distinct.insert(definition.name);
+        for (const PendingReference& reference : pending.references) distinct.insert(reference.name);
+        const std::vector<std::string> dictionary(distinct.begin(), distinct.end());
+        auto idOf = [&dictionary](const std::string& text) {return static_cast<uint32_t>(std::lower_bound(dictionary.begin(), dictionary.end(), text) - dictionary.begin());};
+
+        std::string blob;
+        std::vector<IndexString> strings;
+        for (const std::string& text : dictionary)
+        {
+            strings.push_back(IndexString{static_cast<uint32_t>(blob.size()), static_cast<uint32_t>(text.size())});
+            blob += text;
+        }
+        std::vector<IndexProgram> programs;
+        for (const auto& program : pending.programs) programs.push_back(IndexProgram{idOf(program.first), idOf(program.second)});
+
+        std::vector<IndexDefinition> definitions;
+        for (const PendingDefinition& definition : pending.definitions)
+            definitions.push_back(IndexDefinition{idOf(definition.name), definition.program, definition.address, definition.kind});
+        std::sort(definitions.begin(), definitions.end(), [](const IndexDefinition& a, const IndexDefinition& b)
+            {return std::tie(a.name, a.program, a.address) < std::tie(b.name, b.program, b.address);});
+        std::vector<uint32_t> byAddress(definitions.size());
+        std::iota(byAddress.begin(), byAddress.end(), 0);
+        std::sort(byAddress.begin(), byAddress.end(), [&definitions](const uint32_t a, const uint32_t b)
+            {return std::tie(definitions[a].address, definitions[a].program, definitions[a].name) < std::tie(definitions[b].address, definitions[b].program, definitions[b].name);});
+
+        std::vector<IndexReference> references;
+        for (const PendingReference& reference : pending.references)
+            references.push_back(IndexReference{idOf(reference.name), reference.program, reference.target, reference.from});
+        std::sort(references.begin(), references.end(), [](const IndexReference& a, const IndexReference& b)
+            {return std::tie(a.name, a.program, a.from) < std::tie(b.name, b.program, b.from);});
+
+        IndexHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+        header.stringCount = strings.size();
+        header.programCount = programs.size();
+        header.definitionCount = definitions.size();
+        header.referenceCount = references.size();
+        header.blobSize = blob.size();
+
+        std::string image(reinterpret_cast<const char*>(&header), sizeof(header));
+        appendArray(image, strings);
+        appendArray(image, programs);
+        appendArray(image, definitions);
+        appendArray(image, byAddress);
+        appendArray(image, references);
+        return image + blob;
+    }
+
+    // Written to a temporary name first so a query never maps a half written index
+    bool WRITE_INDEX(const std::string& indexFile, const std::string& image)
+    {
+        const std::string temporaryFile = indexFile + TEMPORARY_SUFFIX + std::to_string(getpid());
+        std::ofstream output(temporaryFile, std::ios::binary);
+        output.write(image.data(), image.size());
+        output.close();
+        if (output && std::rename(temporaryFile.c_str(), indexFile.c_str()) == 0) return true;
+        std::remove(temporaryFile.c_str());
+        return false;
+    }
+
+    void writeProgram(std::ostream& stream, const SymbolIndex& index, const uint32_t program)
+    {
+        stream << std::setw(COLUMN_WIDTH) << index.text(index.program(program).name) << index.text(index.program(program).objectPath) << std::endl;
+    }
+
+    void writeDefinition(std::ostream& stream, const SymbolIndex& index, const IndexDefinition& definition)
+    {
+        stream << std::left << std::setw(COLUMN_WIDTH) << index.text(definition.name) << std::setw(COLUMN_WIDTH) << zeroPad(intToHexString(definition.address))
+        << std::setw(COLUMN_WIDTH) << (definition.kind == SYMBOL_INDEX_LITERAL ? "literal" : "symbol");
+        writeProgram(stream, index, definition.program);
+    }
+
+    void writeReference(std::ostream& stream, const SymbolIndex& index, const IndexReference& reference)
+    {
+        stream << std::left << std::setw(COLUMN_WIDTH) << index.text(reference.name) << std::setw(COLUMN_WIDTH) << zeroPad(intToHexString(reference.target))
+        << std::setw(COLUMN_WIDTH) << "from " + zeroPad(intToHexString(reference.from));
+        writeProgram(stream, index, reference.program);
+    }
+}
+
+SymbolIndex::SymbolIndex(const char* indexFile)
+{
+    const int descriptor = open(indexFile, O_RDONLY);
+    struct stat status;
+    if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+        std::cerr << "Failed to open file: " << indexFile << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    mappingSize = status.st_size;
+    if (mappingSize < sizeof(IndexHeader)) failIndex(indexFile, "too short");
+    void* mapped = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (mapped == MAP_FAILED) failIndex(indexFile, "could not be mapped");
+    mapping = static_cast<const char*>(mapped);
+
+    header = reinterpret_cast<const IndexHeader*>(mapping);
+    if (std::memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0) failIndex(indexFile, "bad magic");
+    const uint64_t expectedSize = sizeof(IndexHeader) + static_cast<uint64_t>(header->stringCount) * sizeof(IndexString)
+        + static_cast<uint64_t>(header->programCount) * sizeof(IndexProgram) + static_cast<uint64_t>(header->definitionCount) * (sizeof(IndexDefinition) + sizeof(uint32_t))
+        + static_cast<uint64_t>(header->referenceCount) * sizeof(IndexReference) + header->blobSize;
+    if (expectedSize != mappingSize) failIndex(indexFile, "size does not match its header");
+    strings = reinterpret_cast<const IndexString*>(mapping + sizeof(IndexHeader));
+    programs = reinterpret_cast<const IndexProgram*>(strings + header->stringCount);
+    definitions = reinterpret_cast<const IndexDefinition*>(programs + header->programCount);
+    byAddress = reinterpret_cast<const uint32_t*>(definitions + header->definitionCount);
+    references = reinterpret_cast<const IndexReference*>(byAddress + header->definitionCount);
+    blob = reinterpret_cast<const char*>(references + header->referenceCount);
+}
+
+SymbolIndex::~SymbolIndex()
+{
+    munmap(const_cast<char*>(mapping), mappingSize);
+}
+
+/* Strings are sorted by text, so the id of a name is found with one binary search */
+bool SymbolIndex::findString(const std::string& text, uint32_t& id) const
+{
+    const IndexString* end = strings + header->stringCount;
+    const IndexString* it = std::lower_bound(strings, end, text, [this](const IndexString& entry, const std::string& key)
+        {return std::string(blob + entry.offset, entry.length) < key;});
+    if (it == end || std::string(blob + it->offset, it->length) != text) return false;
+    id = it - strings;
+    return true;
+}
+
+const std::string SymbolIndex::text(const uint32_t id) const
+{
+    if (id >= header->stringCount) return std::string();
+    const IndexString& string = strings[id];
+    if (string.offset > header->blobSize || string.length > header->blobSize - string.offset) return std::string();
+    return std::string(blob + string.offset, string.length);
+}
+
+std::vector<const IndexDefinition*> SymbolIndex::definitionsOf(const std::string& name) const
+{
+    std::vector<const IndexDefinition*> found;
+    uint32_t id;
+    if (!findString(name, id)) return found;
+    const IndexDefinition* end = definitions + header->definitionCount;
+    const IndexDefinition* it = std::lower_bound(definitions, end, id, [](const IndexDefinition& entry, const uint32_t key) {return entry.name < key;});
+    for (; it != end && it->name == id; ++it) found.push_back(it);
+    return found;
+}
+
+std::vector<const IndexDefinition*> SymbolIndex::definitionsAt(const int32_t address) const
+{
+    std::vector<const IndexDefinition*> found;
+    const uint32_t* end = byAddress + header->definitionCount;
+    const uint32_t* it = std::lower_bound(byAddress, end, address, [this](const uint32_t entry, const int32_t key) {return definitions[entry].address < key;});
+    for (; it != end && definitions[*it].address == address; ++it) found.push_back(definitions + *it);
+    return found;
+}
+
+std::vector<const IndexReference*> SymbolIndex::referencesTo(const std::string& name) const
+{
+    std::vector<const IndexReference*> found;
+    uint32_t id;
+    if (!findString(name, id)) return found;
+    const IndexReference* end = references + header->referenceCount;
+    const IndexReference* it = std::lower_bound(references, end, id, [](const IndexReference& entry, const uint32_t key) {return entry.name < key;});
+    for (; it != end && it->name == id; ++it) found.push_back(it);
+    return found;
+}
+
+// Expects argv[1] to be the index to write, followed by object/symbol pairs
+int runIndexMode(const int argc, const char* argv[])
+{
+    if (argc < FIRST_PROGRAM_ARG_NUMBER + FILES_PER_PROGRAM || (argc - FIRST_PROGRAM_ARG_NUMBER) % FILES_PER_PROGRAM != 0) {
+        std::cerr << INDEX_USAGE << std::endl;
+        return EXIT_FAILURE;
+    }
+    const Parser parser;
+    PendingIndex pending;
+    for (int i = FIRST_PROGRAM_ARG_NUMBER; i < argc; i += FILES_PER_PROGRAM) INGEST_PROGRAM(argv[i], argv[i + 1], parser, pending);
+    const std::string image = BUILD_INDEX(pending);
+    if (!WRITE_INDEX(argv[INDEX_ARG_NUMBER], image)) {
+        std::cerr << "Failed to write file: " << argv[INDEX_ARG_NUMBER] << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cerr << "INDEX " << pending.programs.size() << " programs or sections, " << pending.definitions.size() << " definitions, "
+    << pending.references.size() << " references, " << image.size() << " bytes written to " << argv[INDEX_ARG_NUMBER] << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// Expects argv[1] to be the index, then the kind of lookup and its key
+int runQueryMode(const int argc, const char* argv[])
+{
+    if (argc <= QUERY_KEY_ARG_NUMBER) {
+        std::cerr << QUERY_USAGE << std::endl;
+        return EXIT_FAILURE;
+    }
+    const SymbolIndex index(argv[INDEX_ARG_NUMBER]);
+    const std::string kind = argv[QUERY_KIND_ARG_NUMBER];
+    const std::string key = argv[QUERY_KEY_ARG_NUMBER];
+    std::ostringstream answer;
+    const Clock::time_point start = Clock::now();
+    std::size_t results = 0;
+    if (kind == "symbol" || kind == "address") {
+        const std::vector<const IndexDefinition*> found = kind == "symbol" ? index.definitionsOf(key) : index.definitionsAt(std::strtol(key.c_str(), nullptr, HEX_BASE));
+        for (const IndexDefinition* definition : found) writeDefinition(answer, index, *definition);
+        results = found.size();
+    }
+    else if (kind == "refs") {
+        const std::vector<const IndexReference*> found = index.referencesTo(key);
+        for (const IndexReference* reference : found) writeReference(answer, index, *reference);
+        results = found.size();
+    }
+    else {
+        std::cerr << QUERY_USAGE << std::endl;
+        return EXIT_FAILURE;
+    }
+    const double micros = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / NANOS_PER_MICRO;
+    std::cout << answer.str();
+    std::cerr << "QUERY " << results << " results in " << std::fixed << std::setprecision(1) << micros << " us" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+#ifndef SYMBOL_INDEX_H
+#define SYMBOL_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define SYMBOL_INDEX_SYMBOL 0
+#define SYMBOL_INDEX_LITERAL 1
+
+/*
+ *  Index layout, host byte order like the compiled symbol cache
+ *      header          counts of everything below
+ *      strings         IndexString[stringCount], one per distinct name or path, sorted by text so an id orders like its text
+ *      programs        IndexProgram[programCount] in the order they were indexed
+ *      definitions     IndexDefinition[definitionCount] sorted by name, program, address
+ *      byAddress       uint32 definition numbers sorted by address, program, name
+ *      references      IndexReference[referenceCount] sorted by name, program, referencing address
+ *      blob            the text of every string
+ */
+struct IndexHeader
+{
+    char magic[8];
+    uint32_t stringCount;
+    uint32_t programCount;
+    uint32_t definitionCount;
+    uint32_t referenceCount;
+    uint64_t blobSize;
+};
+
+struct IndexString
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct IndexProgram
+{
+    uint32_t name;                  // String ids
+    uint32_t objectPath;
+};
+
+struct IndexDefinition
+{
+    uint32_t name;
+    uint32_t program;
+    int32_t address;
+    uint32_t kind;                  // SYMBOL_INDEX_SYMBOL or SYMBOL_INDEX_LITERAL
+};
+
+struct IndexReference
+{
+    uint32_t name;                  // Label the operand resolved to
+    uint32_t program;
+    int32_t target;
+    int32_t from;                   // Address of the referencing instruction
+};
+
+/* A built index mapped read only, every query is a binary search over the mapping */
+class SymbolIndex
+{
+    public:
+        explicit SymbolIndex(const char* indexFile);
+        ~SymbolIndex();
+        SymbolIndex(const SymbolIndex&) = delete;
+        SymbolIndex& operator=(const SymbolIndex&) = delete;
+        bool findString(const std::string& text, uint32_t& id) const;
+        const std::string text(const uint32_t id) const;
+        const IndexProgram& program(const uint32_t id) const {return programs[id];}
+        std::vector<const IndexDefinition*> definitionsOf(const std::string& name) const;
+        std::vector<const IndexDefinition*> definitionsAt(const int32_t address) const;
+        std::vector<const IndexReference*> referencesTo(const std::string& name) const;
+    private:
+        const char* mapping;
+        std::size_t mappingSize;
+        const IndexHeader* header;
+        const IndexString* strings;
+        const IndexProgram* programs;
+        const IndexDefinition* definitions;
+        const uint32_t* byAddress;
+        const IndexReference* references;
+        const char* blob;
+};
+
+int runIndexMode(const int argc, const char* argv[]);
+int runQueryMode(const int argc, const char* argv[]);
+
+#endif
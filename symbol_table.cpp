@@ -8,13 +8,14 @@
 #include "symbol_table.hpp"
 #include "input_handler.hpp"
 #include "byte_operations.hpp"
+#include "trace.hpp"
+#include "memory_accounting.hpp"
 #include <fstream>
 #include <string>
 #include <sstream>
 #include <iostream>
 
 #define LITERAL_TOKENS_SIZE 3
-#define HEADER_SIZE 2
 #define WHITE_SPACE_IDENTIFIER " "
 #define LITERAL_STRING "*"
 
@@ -39,80 +40,6 @@ namespace
         return tokens;
     }
 
-    /* 
-     * Place file pointer at line X
-     */
-    std::ifstream advanceXLines(const uint32_t X, const char* filename)
-    {
-        uint32_t counter = X;
-        std::string line;
-        std::ifstream stream = FileHandling::openFile(filename);
-        while (counter-- > 0)
-        {
-            std::getline(stream, line);
-        }
-        return stream;
-    }
-
-    /* 
-     * Return line number where respective table starts
-     */
-    const int GET_SYMTAB_START(const char* filename)
-    {
-        return HEADER_SIZE;
-    }
-
-    const int GET_LITTAB_START(const char* filename)
-    {
-        uint32_t counter = 0;
-        std::string line;
-        std::ifstream stream = FileHandling::openFile(filename);
-        while (std::getline(stream, line))
-        {
-            if (isNewLine(line)) { // Skip empty lines
-                stream.close();
-                return counter+3;  
-            }
-            counter++;
-        }
-        exit(EXIT_FAILURE);
-    }
-
-    /* 
-     * We will count the size of each table
-     */
-    const int GET_SYMTAB_SIZE(const char* filename)
-    {
-        int32_t counter = 0;
-        std::string line;
-        std::ifstream stream = advanceXLines(GET_SYMTAB_START(filename), filename);
-        while (std::getline(stream, line))
-        {
-            if (isNewLine(line)) {
-                stream.close();
-                return counter;  
-            }
-            counter++;
-        }
-        stream.close();
-        exit(EXIT_FAILURE);
-    }
-
-    const int GET_LITTAB_SIZE(const char* filename)
-    {
-        uint32_t counter = 0;
-        std::string line;
-        std::ifstream stream = advanceXLines(GET_LITTAB_START(filename), filename);
-        std::getline(stream, line);
-        while (!isNewLine(line))
-        {
-            counter++;
-            std::getline(stream, line);
-        }        
-        stream.close();
-        return counter;
-    }
-    
     /* 
      * Tokenize each line to store each word into appropriate field of struct
      */
@@ -130,45 +57,86 @@ namespace
     }
 
     /* 
-     * These functions will start at the first line of the appropriate table, then iterate through the table using its size
-     * and store every entry as a struct into a vector
+     * Each table is a two line header followed by one entry per line up to the next blank line. Reading a whole
+     * SYMTAB/LITTAB pair in one pass means a compressed symbol file only has to be decompressed once.
      */
-    const std::vector<SYMTAB_Entry> CREATE_SYMTAB(const int symtab_size, std::ifstream& stream)
+    void VISIT_SYMBOL_BLOCK(std::istream& stream, const SymbolVisitor& visitor)
     {
-        std::vector<SYMTAB_Entry> symtab;
         std::string line;
-        for (int i = 0; i < symtab_size; i++)
-        {
-            std::getline(stream, line);
-            symtab.push_back(CREATE_SYMTAB_ENTRY(line));
-        }
-        return symtab;
+        std::getline(stream, line);                         // Rest of SYMTAB header
+        while (std::getline(stream, line) && !isNewLine(line))
+            visitor.symbol(CREATE_SYMTAB_ENTRY(line));
+        std::getline(stream, line);                         // LITTAB header
+        std::getline(stream, line);
+        while (std::getline(stream, line) && !isNewLine(line))
+            visitor.literal(CREATE_LITTAB_ENTRY(line));
     }
 
-    const std::vector<LITTAB_Entry> CREATE_LITTAB(const int littab_size, std::ifstream& stream)
+    const SymbolEntries READ_SYMBOL_BLOCK(std::istream& stream)
     {
+        std::vector<SYMTAB_Entry> symtab;
         std::vector<LITTAB_Entry> littab;
-        std::string line;
-        for (int i = 0; i < littab_size; i++)
-        {
-            std::getline(stream, line);
-            littab.push_back(CREATE_LITTAB_ENTRY(line));
-        }
-        return littab;
+        VISIT_SYMBOL_BLOCK(stream, SymbolVisitor{
+            [&](const SYMTAB_Entry& entry) {symtab.push_back(entry);},
+            [&](const LITTAB_Entry& entry) {littab.push_back(entry);}
+        });
+        return SymbolEntries{symtab, littab};
     }
 }
 
 /* Store our SymbolEntries into data structure */
 const SymbolEntries FileHandling::readSymbolTableFile(const char* filename)
 {
-    std::ifstream startSym = advanceXLines(GET_SYMTAB_START(filename), filename);
-    std::ifstream startLit = advanceXLines(GET_LITTAB_START(filename), filename);
-    return SymbolEntries{CREATE_SYMTAB(GET_SYMTAB_SIZE(filename), startSym), CREATE_LITTAB(GET_LITTAB_SIZE(filename), startLit)};
+    MemoryScope scope(MemorySubsystem::SymbolTable);
+    TraceSpan span("readSymbolTableFile");
+    InputFile stream = FileHandling::openFile(filename);
+    return readSymbolTable(stream);
+}
+
+const SymbolEntries FileHandling::readSymbolTable(std::istream& stream)
+{
+    MemoryScope scope(MemorySubsystem::SymbolTable);
+    std::string line;
+    std::getline(stream, line);                             // First line of SYMTAB header
+    return READ_SYMBOL_BLOCK(stream);
+}
+
+/* Same as readSymbolTable but hands each entry over as it is read instead of keeping them */
+void FileHandling::visitSymbolTable(std::istream& stream, const SymbolVisitor& visitor)
+{
+    std::string line;
+    std::getline(stream, line);                             // First line of SYMTAB header
+    VISIT_SYMBOL_BLOCK(stream, visitor);
+}
+
+/* 
+ * Object files holding several control sections come with one SYMTAB/LITTAB pair per section in the same order.
+ * Each pair is laid out exactly like a single program's file, so we just keep reading pairs until the file runs out.
+ */
+const std::vector<SymbolEntries> FileHandling::readSymbolTableBlocks(const char* filename)
+{
+    MemoryScope scope(MemorySubsystem::SymbolTable);
+    InputFile stream = FileHandling::openFile(filename);
+    return readSymbolTableBlocks(stream);
+}
+
+const std::vector<SymbolEntries> FileHandling::readSymbolTableBlocks(std::istream& stream)
+{
+    MemoryScope scope(MemorySubsystem::SymbolTable);
+    std::vector<SymbolEntries> blocks;
+    std::string line;
+    while (std::getline(stream, line))
+    {
+        if (isNewLine(line)) continue;                      // Blank lines between blocks
+        blocks.push_back(READ_SYMBOL_BLOCK(stream));
+    }
+    return blocks;
 }
 
 /* Rearrange our data structure into a map to find symbols and their info easily from current LOCCTR */
 LITMAP CREATE_LITMAP(const SymbolEntries& symbolEntries)
 {
+    MemoryScope scope(MemorySubsystem::SymbolTable);
     LITMAP map;
     for (const auto& entry : symbolEntries.LITTAB)
     {
@@ -180,6 +148,7 @@ LITMAP CREATE_LITMAP(const SymbolEntries& symbolEntries)
 /* Rearrange our data structure into a map to find symbols and their info easily from current address */
 SYMMAP CREATE_SYMMAP(const SymbolEntries& symbolEntries)
 {
+    MemoryScope scope(MemorySubsystem::SymbolTable);
     SYMMAP map;
     for (const auto& entry : symbolEntries.SYMTAB)
     {
@@ -198,6 +167,13 @@ std::vector<LITTAB_Entry> GET_LITERALS(const SymbolEntries& symbolEntries)
     return literals;
 }
 
+/* Address of the last SYMTAB entry, which marks where the program's reserved storage ends */
+int GET_LAST_SYMBOL_ADDRESS(const SymbolEntries& symbolEntries)
+{
+    if (symbolEntries.SYMTAB.empty()) return 0;
+    return hexStringToInt(symbolEntries.SYMTAB.back().address);
+}
+
 /* Look for symbol in our symbol table */
 bool checkForSymbol(const int LOCCTR, const LITMAP& litmap)
 {
@@ -32,6 +32,7 @@ struct SymbolEntries
 };
 
 std::vector<LITTAB_Entry> GET_LITERALS(const SymbolEntries& symbolEntries);
+int GET_LAST_SYMBOL_ADDRESS(const SymbolEntries& symbolEntries);
 
 using SYMMAP = std::map<const int, SYMTAB_Entry>;
 using LITMAP = std::map<const int, LITTAB_Entry>;
@@ -41,6 +42,31 @@ struct SymbolTable
     const LITMAP litmap;
 };
 
+/* What the engine asks of a symbol table, so the maps built from the text file and a compiled table are interchangeable */
+class SymbolProvider
+{
+    public:
+        virtual ~SymbolProvider() {}
+        virtual bool hasSymbol(const int address) const = 0;
+        virtual const std::string getSymbol(const int address) const = 0;
+        virtual bool hasLiteral(const int address) const = 0;
+        virtual const LITTAB_Entry getLiteral(const int address) const = 0;
+};
+
+/* Answers from SYMMAP/LITMAP, the maps have to outlive it */
+class MapSymbolProvider : public SymbolProvider
+{
+    public:
+        MapSymbolProvider(const SYMMAP& symmap, const LITMAP& litmap) : symmap(symmap), litmap(litmap) {}
+        bool hasSymbol(const int address) const override {return symmap.count(address);}
+        const std::string getSymbol(const int address) const override {return symmap.find(address)->second.symbol;}
+        bool hasLiteral(const int address) const override {return litmap.count(address);}
+        const LITTAB_Entry getLiteral(const int address) const override {return litmap.find(address)->second;}
+    private:
+        const SYMMAP& symmap;
+        const LITMAP& litmap;
+};
+
 LITMAP CREATE_LITMAP(const SymbolEntries& litmap);
 SYMMAP CREATE_SYMMAP(const SymbolEntries& litmap);
 bool checkForSymbol(const int LOCCTR, const LITMAP& litmap);
@@ -0,0 +1,32 @@
+#!/bin/sh
+# --to-binary/--to-text: a round trip gives back the text object apart from the newline after the last record, and
+# the binary object lists exactly like the text one, including a program with control sections
+. "$(dirname "$0")/common.sh"
+
+for object in "$ROOT/test.obj" "$ROOT/p3test.obj" "$ROOT/p3test1.obj" "$ROOT/p3test2.obj" "$ROOT/datatable.obj" "$SAMPLES/sections.obj"; do
+    symbols="${object%.obj}.sym"
+    run --to-binary "$object" program.sbo
+    [ "$(head -c 1 program.sbo)" != "H" ] || fail "$object was not converted to the binary form"
+    run --to-text program.sbo program.obj
+    [ "$(cat program.obj)" = "$(cat "$object")" ] || fail "$object did not survive the round trip"
+
+    run "$object" "$symbols"
+    mv out.lst expected.lst
+    run program.sbo "$symbols"
+    same_listing out.lst expected.lst
+done
+
+# The two section sample is also held to its expected listing, so both readers agreeing on a bad one does not pass
+run "$SAMPLES/sections.obj" "$SAMPLES/sections.sym"
+same_listing out.lst "$SAMPLES/sections.lst"
+
+# Modes that only read text records refuse a binary object instead of listing its magic and raw bytes
+run --to-binary "$ROOT/test.obj" program.sbo
+for mode in --pipeline --pwrite --flow --data --out-of-core --sections --simulate --slice; do
+    rm -f out.lst
+    "$DISASSEM" $mode program.sbo "$ROOT/test.sym" 2> stderr > /dev/null && fail "$mode listed a binary object"
+    [ -e out.lst ] && fail "$mode wrote a listing for a binary object"
+done
+"$DISASSEM" --delta "$ROOT/test.obj" "$ROOT/test.sym" program.sbo "$ROOT/test.sym" 2> stderr > /dev/null && fail "--delta read a binary object"
+"$DISASSEM" --index index.sidx program.sbo "$ROOT/test.sym" 2> stderr > /dev/null && fail "--index read a binary object"
+grep -q "reads text object files only" stderr || fail "the refusal does not say why"
@@ -0,0 +1,24 @@
+#!/bin/sh
+# --pack/--bundle: every program lists as it does on its own, binary objects included, and a program whose symbol
+# file has no SYMTAB entries is reported and left out without taking the rest of the bundle down
+. "$(dirname "$0")/common.sh"
+
+cp "$ROOT/test.obj" "$ROOT/test.sym" "$ROOT/p3test2.obj" "$ROOT/p3test2.sym" .
+run --to-binary "$ROOT/p3test1.obj" binary.sbo
+cp "$ROOT/p3test1.sym" binary.sym
+cp "$ROOT/test.obj" empty.obj
+: > empty.sym
+run --pack programs.bndl binary.sbo binary.sym empty.obj empty.sym p3test2.obj p3test2.sym test.obj test.sym
+
+: > expected.lst
+for program in binary p3test2 test; do
+    object=$program.obj
+    [ "$program" = binary ] && object=binary.sbo
+    run "$object" "$program.sym"
+    cat out.lst >> expected.lst
+done
+
+"$DISASSEM" --bundle programs.bndl 2> stderr > /dev/null && fail "a skipped program did not fail the run"
+grep -q "^Symbol file has no SYMTAB entries: empty$" stderr || fail "the empty symbol file was not reported"
+grep -q "^BUNDLE 4 of 4 programs, 1 skipped" stderr || fail "wrong summary"
+same_listing out.lst expected.lst
@@ -0,0 +1,19 @@
+#!/bin/sh
+# --checked: a record with a non hex digit and a symbol line missing its fields are reported and skipped, the rest of
+# that program is still listed and the clean program after it comes out exactly like the default mode lists it
+. "$(dirname "$0")/common.sh"
+
+run "$ROOT/test.obj" "$ROOT/test.sym"
+mv out.lst clean.lst
+
+"$DISASSEM" --checked "$SAMPLES/checked_bad.obj" "$SAMPLES/checked_bad.sym" "$ROOT/test.obj" "$ROOT/test.sym" 2> stderr > /dev/null
+[ $? -eq 1 ] || fail "errors were found but --checked did not exit with 1"
+grep -q "checked_bad.sym:4: SYMTAB line has 1 fields" stderr || fail "the short symbol line was not reported"
+grep -q "checked_bad.obj:2: column 21 of the record is not an uppercase hex digit" stderr || fail "the bad record was not reported"
+grep -q "^CHECKED 2 programs: 1 clean, 1 listed with errors, 0 not listed; 4 records, 1 skipped, 2 errors$" stderr || fail "wrong summary"
+
+sed '/^ *END /q' out.lst > first.lst
+sed '1,/^ *END /d' out.lst > second.lst
+grep -q "^0000        FIRST" first.lst && fail "the skipped record was listed"
+grep -q "^02C7                    CLEAR       A           B400" first.lst || fail "the record after the bad one was not listed"
+same_listing second.lst clean.lst
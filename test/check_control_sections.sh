@@ -0,0 +1,26 @@
+#!/bin/sh
+# Control sections told by a second H record alone: an object without D/R records has to be split into sections by the
+# default mode like --sections does, and the scan that finds them must leave a plain program listed as before, also
+# when the object is compressed and the scan is rewound through the inflater
+. "$(dirname "$0")/common.sh"
+
+run "$SAMPLES/headers_only.obj" "$SAMPLES/sections.sym"
+same_listing out.lst "$SAMPLES/headers_only.lst"
+run --sections "$SAMPLES/headers_only.obj" "$SAMPLES/sections.sym"
+same_listing out.lst "$SAMPLES/headers_only.lst"
+
+gzip -c "$SAMPLES/headers_only.obj" > headers_only.obj.gz
+run headers_only.obj.gz "$SAMPLES/sections.sym"
+same_listing out.lst "$SAMPLES/headers_only.lst"
+
+# Each section is profiled against its own LITTAB, the literal in the second one is only found through its own block
+"$DISASSEM" --profile "$SAMPLES/headers_only.obj" "$SAMPLES/sections.sym" > profile.txt 2> /dev/null || fail "--profile failed"
+grep -q "^constants: literals 1 (2 bytes), BYTE 1 (3 bytes)" profile.txt || fail "sections were not profiled with their own LITTAB"
+
+for program in test p3test2; do
+    run "$ROOT/$program.obj" "$ROOT/$program.sym"
+    mv out.lst expected.lst
+    gzip -c "$ROOT/$program.obj" > program.obj.gz
+    run program.obj.gz "$ROOT/$program.sym"
+    same_listing out.lst expected.lst
+done
@@ -0,0 +1,10 @@
+#!/bin/sh
+# --delta: a build whose second record moved by three bytes, with one operand changed in the first record.
+# The moved record has to line up through the shifted RDREC symbol and be skipped, only the first one is decoded.
+. "$(dirname "$0")/common.sh"
+
+run --delta "$ROOT/test.obj" "$SAMPLES/delta_old.sym" "$SAMPLES/delta_new.obj" "$SAMPLES/delta_new.sym"
+same_listing out.lst "$SAMPLES/delta.lst"
+
+run --delta "$ROOT/test.obj" "$SAMPLES/delta_old.sym" "$ROOT/test.obj" "$SAMPLES/delta_old.sym"
+grep -q "^records: 2 new, 2 old, 2 unchanged, 0 shifted, 0 decoded, 0 changed lines$" out.lst || fail "identical builds reported a change"
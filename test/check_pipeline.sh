@@ -0,0 +1,27 @@
+#!/bin/sh
+# --pipeline: the listing matches the default one, and a compressed object that breaks off after the first block fails
+# the run with the decompression error once every stage has drained, with the --trace file still written
+. "$(dirname "$0")/common.sh"
+
+for program in test p3test p3test1 p3test2 datatable; do
+    run "$ROOT/$program.obj" "$ROOT/$program.sym"
+    mv out.lst expected.lst
+    run --pipeline "$ROOT/$program.obj" "$ROOT/$program.sym"
+    same_listing out.lst expected.lst
+done
+
+# A symbol file without SYMTAB entries leaves the start address empty, as the default mode does
+: > empty.sym
+run "$ROOT/test.obj" empty.sym
+mv out.lst expected.lst
+run --pipeline "$ROOT/test.obj" empty.sym
+same_listing out.lst expected.lst
+
+# Well over one 256 KB block of plaintext, so the header inflates fine and the reader thread hits the cut
+awk 'BEGIN {print "HLONG  000000000000"; for (i = 0; i < 8000; i++) printf "T%06X1E%s\n", i * 30, "B400B400B400B400B400B400B400B400B400B400B400B400B400B400B400"; print "E000000"}' > long.obj
+gzip -c long.obj > long.obj.gz
+head -c "$(($(wc -c < long.obj.gz) / 2))" long.obj.gz > cut.obj.gz
+"$DISASSEM" --trace trace.json --pipeline cut.obj.gz "$ROOT/test.sym" 2> stderr > /dev/null
+[ $? -eq 1 ] || fail "a truncated object did not fail the run"
+grep -q "^Corrupt compressed input: cut.obj.gz (truncated gzip stream)$" stderr || fail "the decompression error was not reported"
+grep -q "spans from 4 threads written to trace.json" stderr || fail "the trace was not written after the error"
@@ -0,0 +1,12 @@
+#!/bin/sh
+# --pwrite: the listing written by positioned writes has to be byte identical to the default one for any thread count
+. "$(dirname "$0")/common.sh"
+
+for program in test p3test p3test1 p3test2 datatable; do
+    run "$ROOT/$program.obj" "$ROOT/$program.sym"
+    mv out.lst expected.lst
+    for threads in 1 2 4 7; do
+        run --pwrite "$ROOT/$program.obj" "$ROOT/$program.sym" "$threads"
+        same_listing out.lst expected.lst
+    done
+done
@@ -0,0 +1,37 @@
+#!/bin/sh
+# --slice: without addresses the listing is the default one, with them it lists whole T records overlapping the range
+# and the RESB gaps between them. Every slice has to be a run of the full listing, with the BASE and LTORG state the
+# skipped records leave behind, so operands render exactly as they do there.
+. "$(dirname "$0")/common.sh"
+
+OBJECT="$ROOT/p3test2.obj"
+SYMBOLS="$ROOT/p3test2.sym"
+
+run "$OBJECT" "$SYMBOLS"
+mv out.lst full.lst
+run --slice "$OBJECT" "$SYMBOLS"
+same_listing out.lst full.lst
+
+# Lists [first, last] and expects the LOCCTR of its first and last listed line, or nothing between START and END
+check_slice()
+{
+    run --slice "$OBJECT" "$SYMBOLS" $1
+    sed '1d;$d' out.lst > body.lst
+    listed="$(head -n 1 body.lst | cut -c 1-4) $(tail -n 1 body.lst | cut -c 1-4)"
+    [ "$listed" = "$2" ] || fail "slice $1 listed $listed, expected $2"
+    awk 'NR == FNR {full[++n] = $0; next} {body[++m] = $0}
+         END {for (i = 1; i + m - 1 <= n; i++) {for (j = 1; j <= m && full[i + j - 1] == body[j]; j++); if (j > m) exit 0} exit 1}' \
+        full.lst body.lst || fail "slice $1 is not a run of the full listing"
+}
+
+check_slice "0 9" "0000 0007"
+check_slice "A 83F" "000A 083E"
+check_slice "845 845" "0841 0858"
+check_slice "853 1090" "0841 1090"
+check_slice "85C 1090" "085C 1090"
+check_slice "1090" "1090 1090"
+check_slice "2000 3000" " "
+
+# Sections told only by a second header are refused like any other sectioned object instead of sliced as one program
+"$DISASSEM" --slice "$SAMPLES/headers_only.obj" "$SAMPLES/headers_only.sym" 2> stderr > /dev/null && fail "an object with two sections was sliced"
+grep -q "single control section only" stderr || fail "the refusal does not say why"
@@ -0,0 +1,25 @@
+# Sourced by every test/check_*.sh, each check runs from its own scratch directory so out.lst never lands in the tree
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+DISASSEM="$ROOT/disassem"
+SAMPLES="$ROOT/test/samples"
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK" || exit 1
+
+fail()
+{
+    echo "FAIL $(basename "$0"): $*" >&2
+    exit 1
+}
+
+# Runs the program and keeps what it printed on stderr in $WORK/stderr for the checks that look at it
+run()
+{
+    "$DISASSEM" "$@" 2> "$WORK/stderr" > /dev/null || fail "disassem $* exited with $?"
+}
+
+# The listing must equal the expected file byte for byte
+same_listing()
+{
+    cmp -s "$1" "$2" || { diff "$2" "$1" >&2; fail "$1 differs from $2"; }
+}
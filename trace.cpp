@@ -0,0 +1,129 @@
+/*
+ *  @brief
+ *          Span tracer for the hot paths, written out as Chrome trace event JSON for Perfetto or about:tracing
+ *
+ *  Counters tell us how long a whole stage took but not where it stalled. With --trace every TraceSpan records
+ *  its start and duration into a fixed buffer owned by the thread it ran on, so recording never takes a lock or
+ *  allocates. Each buffer has a single writer that publishes how many events it holds, and the buffers stay
+ *  alive until the end of the run, when they are all walked and written out as one JSON file.
+ */
+
+#include "trace.hpp"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+const constexpr double NANOS_PER_MICRO = 1000.0;
+const constexpr int TRACE_PROCESS_ID = 1;
+const constexpr char* DEFAULT_THREAD_NAME = "thread";
+
+bool TRACE_ENABLED = false;
+
+namespace
+{
+    struct TraceBuffer
+    {
+        int threadId;
+        std::string threadName;
+        std::unique_ptr<TraceEvent[]> events;
+        std::atomic<std::size_t> count;
+        std::atomic<uint64_t> dropped;
+    };
+
+    std::mutex registryLock;                                // Only taken the first time a thread records
+    std::vector<std::unique_ptr<TraceBuffer>> registry;
+    thread_local TraceBuffer* localBuffer = nullptr;
+    std::chrono::steady_clock::time_point traceStart;
+    std::string traceFileName;
+
+    TraceBuffer& threadBuffer()
+    {
+        if (localBuffer) return *localBuffer;
+        std::lock_guard<std::mutex> guard(registryLock);
+        registry.push_back(std::unique_ptr<TraceBuffer>(new TraceBuffer));
+        localBuffer = registry.back().get();
+        localBuffer->threadId = registry.size();
+        localBuffer->threadName = DEFAULT_THREAD_NAME;
+        localBuffer->events.reset(new TraceEvent[TRACE_BUFFER_EVENTS]);
+        localBuffer->count.store(0);
+        localBuffer->dropped.store(0);
+        return *localBuffer;
+    }
+
+    void writeEvent(std::ostream& stream, const TraceBuffer& buffer, const TraceEvent& event)
+    {
+        stream << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":" << TRACE_PROCESS_ID << ",\"tid\":" << buffer.threadId
+        << ",\"ts\":" << event.startNanos / NANOS_PER_MICRO << ",\"dur\":" << event.durationNanos / NANOS_PER_MICRO
+        << ",\"args\":{\"value\":" << event.value << "}}";
+    }
+}
+
+uint64_t TRACE_NOW()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceStart).count();
+}
+
+void RECORD_SPAN(const char* name, const uint64_t startNanos, const int64_t value)
+{
+    TraceBuffer& buffer = threadBuffer();
+    const std::size_t index = buffer.count.load(std::memory_order_relaxed);
+    if (index == TRACE_BUFFER_EVENTS) {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer.events[index] = TraceEvent{name, startNanos, TRACE_NOW() - startNanos, value};
+    buffer.count.store(index + 1, std::memory_order_release);     // Publish the event to whoever dumps the trace
+}
+
+// Shows up as the track name in the viewer
+void NAME_TRACE_THREAD(const char* name)
+{
+    if (!TRACE_ENABLED) return;
+    TraceBuffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> guard(registryLock);
+    buffer.threadName = name;
+}
+
+void START_TRACE(const char* traceFile)
+{
+    traceFileName = traceFile;
+    traceStart = std::chrono::steady_clock::now();
+    TRACE_ENABLED = true;
+    NAME_TRACE_THREAD("main");
+}
+
+/* Every thread that recorded is finished or idle by the time main gets here */
+bool WRITE_TRACE()
+{
+    if (!TRACE_ENABLED) return true;
+    std::ofstream traceFile(traceFileName);
+    std::lock_guard<std::mutex> guard(registryLock);
+    uint64_t events = 0, dropped = 0;
+    bool first = true;
+    traceFile << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (const std::unique_ptr<TraceBuffer>& buffer : registry)
+    {
+        traceFile << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << TRACE_PROCESS_ID
+        << ",\"tid\":" << buffer->threadId << ",\"args\":{\"name\":\"" << buffer->threadName << "\"}}";
+        first = false;
+        const std::size_t count = buffer->count.load(std::memory_order_acquire);
+        for (std::size_t i = 0; i < count; i++)
+        {
+            traceFile << ",\n";
+            writeEvent(traceFile, *buffer, buffer->events[i]);
+        }
+        events += count;
+        dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    traceFile << "\n]}" << std::endl;
+    std::cerr << "TRACE " << events << " spans from " << registry.size() << " threads written to " << traceFileName;
+    if (dropped) std::cerr << ", " << dropped << " dropped";
+    std::cerr << std::endl;
+    return static_cast<bool>(traceFile);
+}
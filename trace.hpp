@@ -0,0 +1,41 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+
+#define TRACE_BUFFER_EVENTS (1 << 16)   // Per thread, later spans are counted as dropped
+
+struct TraceEvent
+{
+    const char* name;                   // Always a string literal, only the pointer is stored
+    uint64_t startNanos;
+    uint64_t durationNanos;
+    int64_t value;                      // Shown as an argument on the span, an address or a size
+};
+
+extern bool TRACE_ENABLED;              // Set before any thread starts and never changed after
+
+uint64_t TRACE_NOW();
+void RECORD_SPAN(const char* name, const uint64_t startNanos, const int64_t value);
+void NAME_TRACE_THREAD(const char* name);
+void START_TRACE(const char* traceFile);
+bool WRITE_TRACE();
+
+/* Times its own scope. With tracing off the constructor's flag check is all it costs */
+class TraceSpan
+{
+    public:
+        explicit TraceSpan(const char* name, const int64_t value = 0)
+            : name(TRACE_ENABLED ? name : nullptr), value(value), start(this->name ? TRACE_NOW() : 0)
+        {}
+        ~TraceSpan() {if (name) RECORD_SPAN(name, start, value);}
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+        void setValue(const int64_t newValue) {value = newValue;}
+    private:
+        const char* name;
+        int64_t value;
+        const uint64_t start;
+};
+
+#endif
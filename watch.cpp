@@ -0,0 +1,240 @@
+/*
+ *  @brief
+ *          Watches a directory of object/.sym pairs and rewrites the listing of every program that changes
+ *
+ *  Instead of re-running the disassembler by hand after every assemble, --watch dir lists every pair once and then
+ *  sleeps on inotify. Changes are collected until the directory has been quiet for the debounce interval, since an
+ *  assembler writes the object and symbol files one after the other, and then only the programs they belong to are
+ *  listed again into <stem>.lst. The object is <stem>.obj or a binary <stem>.sbo, the text one wins when both are
+ *  there. The parsed symbol file of each program is kept between updates: when only the object changed it is
+ *  reused as is, and a rewritten .sym with the same contents is not parsed again either. Rendering goes through the
+ *  daemon's RENDER_LISTING with one Parser built for the whole session, a program whose files do not decode is
+ *  reported and the watch goes on.
+ *
+ *  Every update reports how long the listing took and how long after the first change it was written.
+ */
+
+#include "watch.hpp"
+#include "bundle.hpp"
+#include <sys/inotify.h>
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <vector>
+
+const constexpr int DIRECTORY_ARG_NUMBER = 1;
+const constexpr int DEBOUNCE_ARG_NUMBER = 2;
+const constexpr int DEFAULT_DEBOUNCE_MILLIS = 100;
+const constexpr int WAIT_FOREVER = -1;
+const constexpr std::size_t EVENT_BUFFER_SIZE = 64 * 1024;
+const constexpr uint32_t WATCHED_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO;    // Written in place or renamed into the directory
+const constexpr double NANOS_PER_MILLI = 1e6;
+const constexpr char* OBJECT_EXTENSION = ".obj";
+const constexpr char* BINARY_OBJECT_EXTENSION = ".sbo";
+const constexpr char* SYMBOL_EXTENSION = ".sym";
+const constexpr char* LISTING_EXTENSION = ".lst";
+const constexpr char* TEMPORARY_SUFFIX = ".tmp";
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    /* What changed for one program since the last update */
+    struct Change
+    {
+        bool object;
+        bool symbols;
+    };
+
+    using Changes = std::map<std::string, Change>;
+
+    struct UpdateResult
+    {
+        bool updated;
+        bool symbolsReused;
+        uint64_t nanos;
+        std::string error;
+    };
+
+    bool endsWith(const std::string& name, const std::string& extension)
+    {
+        return name.size() > extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0;
+    }
+
+    bool exists(const std::string& path)
+    {
+        return access(path.c_str(), R_OK) == 0;
+    }
+
+    // Text object first, then the binary one, empty when the program has neither
+    const std::string objectPathOf(const std::string& path)
+    {
+        for (const char* extension : {OBJECT_EXTENSION, BINARY_OBJECT_EXTENSION})
+            if (exists(path + extension)) return path + extension;
+        return std::string();
+    }
+
+    // Stem of an object file name, empty for anything else
+    const std::string objectStemOf(const std::string& name)
+    {
+        for (const char* extension : {OBJECT_EXTENSION, BINARY_OBJECT_EXTENSION})
+            if (endsWith(name, extension)) return name.substr(0, name.size() - std::strlen(extension));
+        return std::string();
+    }
+
+    double millisBetween(const Clock::time_point start, const Clock::time_point end)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / NANOS_PER_MILLI;
+    }
+
+    // Every stem with both an object and a symbol file, once even when it has a text and a binary object
+    std::set<std::string> LIST_PROGRAMS(const std::string& directory)
+    {
+        std::set<std::string> stems;
+        DIR* listing = opendir(directory.c_str());
+        if (!listing) return stems;
+        while (const dirent* entry = readdir(listing))
+        {
+            const std::string stem = objectStemOf(entry->d_name);
+            if (!stem.empty() && exists(directory + "/" + stem + SYMBOL_EXTENSION)) stems.insert(stem);
+        }
+        closedir(listing);
+        return stems;
+    }
+
+    bool WAIT_FOR_EVENTS(const int fd, const int timeoutMillis)
+    {
+        pollfd watched{fd, POLLIN, 0};
+        int ready;
+        do ready = poll(&watched, 1, timeoutMillis);
+        while (ready < 0 && errno == EINTR);
+        return ready > 0;
+    }
+
+    // Drains what inotify has queued, names other than objects and .sym (our own listings among them) are ignored
+    void COLLECT_CHANGES(const int fd, Changes& changes)
+    {
+        alignas(inotify_event) char buffer[EVENT_BUFFER_SIZE];
+        const ssize_t length = read(fd, buffer, sizeof(buffer));
+        for (ssize_t offset = 0; offset < length; )
+        {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+            const std::string name = event->len ? event->name : "";
+            const std::string stem = objectStemOf(name);
+            if (!stem.empty()) changes[stem].object = true;
+            else if (endsWith(name, SYMBOL_EXTENSION)) changes[name.substr(0, name.size() - std::strlen(SYMBOL_EXTENSION))].symbols = true;
+        }
+    }
+
+    // Written next to the final name and renamed over it, so nothing ever reads half a listing
+    bool WRITE_LISTING(const std::string& path, const std::string& listing)
+    {
+        const std::string temporary = path + TEMPORARY_SUFFIX;
+        {
+            std::ofstream outputFile(temporary);
+            if (!(outputFile << listing)) return false;
+        }
+        return std::rename(temporary.c_str(), path.c_str()) == 0;
+    }
+
+    UpdateResult UPDATE_PROGRAM(const std::string& directory, const std::string& stem, const Change& change, std::map<std::string, WatchedProgram>& programs, const Parser& parser, const REGMAP& registers)
+    {
+        const Clock::time_point start = Clock::now();
+        const std::string path = directory + "/" + stem;
+        const std::string objectPath = objectPathOf(path);
+        std::string object;
+        if (!READ_FILE_CONTENTS(objectPath, object)) return UpdateResult{false, false, 0, "Failed to open file: " + objectPath};
+
+        WatchedProgram& program = programs.insert({stem, WatchedProgram{stem, std::string(), nullptr}}).first->second;
+        bool symbolsReused = program.symbols && !change.symbols;
+        if (!symbolsReused) {
+            std::string symbols;
+            if (!READ_FILE_CONTENTS(path + SYMBOL_EXTENSION, symbols)) return UpdateResult{false, false, 0, "Failed to open file: " + path + SYMBOL_EXTENSION};
+            symbolsReused = program.symbols && program.symbolContents == symbols;
+            if (!symbolsReused) {
+                MemoryBuffer buffer(symbols.data(), symbols.size());
+                std::istream symbolFile(&buffer);
+                const std::vector<SymbolEntries> blocks = FileHandling::readSymbolTableBlocks(symbolFile);
+                if (blocks.empty() || blocks.front().SYMTAB.empty()) return UpdateResult{false, false, 0, "Symbol file has no SYMTAB entries: " + path + SYMBOL_EXTENSION};
+                program.symbols = std::make_shared<const CachedSymbols>(blocks);
+                program.symbolContents = symbols;
+            }
+        }
+        if (!WRITE_LISTING(path + LISTING_EXTENSION, RENDER_LISTING(object, *program.symbols, parser, registers)))
+            return UpdateResult{false, symbolsReused, 0, "Failed to write " + path + LISTING_EXTENSION};
+        return UpdateResult{true, symbolsReused, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()), ""};
+    }
+
+    // A corrupt or unparsable file only fails its own program, the rest of the burst and the watch carry on
+    UpdateResult TRY_UPDATE_PROGRAM(const std::string& directory, const std::string& stem, const Change& change, std::map<std::string, WatchedProgram>& programs, const Parser& parser, const REGMAP& registers)
+    {
+        try {
+            return UPDATE_PROGRAM(directory, stem, change, programs, parser, registers);
+        }
+        catch (const std::exception& error) {
+            programs.erase(stem);           // Parsed again next time, whatever half of it was kept may be stale
+            return UpdateResult{false, false, 0, error.what()};
+        }
+    }
+
+    void REPORT_UPDATE(const std::string& stem, const UpdateResult& result, const double sinceChangeMillis)
+    {
+        if (!result.updated) {
+            std::cerr << stem << ": " << result.error << std::endl;
+            return;
+        }
+        std::cout << stem << LISTING_EXTENSION << " updated in " << std::fixed << std::setprecision(3) << result.nanos / NANOS_PER_MILLI << " ms";
+        if (sinceChangeMillis >= 0) std::cout << ", " << sinceChangeMillis << " ms after the first change";
+        std::cout << ", symbols " << (result.symbolsReused ? "reused" : "parsed") << std::endl;
+    }
+}
+
+// Expects argv[1] to be the directory to watch, argv[2] optionally how many quiet milliseconds end a burst of changes
+int runWatchMode(const int argc, const char* argv[])
+{
+    const std::string directory = argv[DIRECTORY_ARG_NUMBER];
+    const int debounceMillis = argc > DEBOUNCE_ARG_NUMBER ? std::atoi(argv[DEBOUNCE_ARG_NUMBER]) : DEFAULT_DEBOUNCE_MILLIS;
+    if (debounceMillis < 0) {
+        std::cerr << "Debounce must not be negative: " << argv[DEBOUNCE_ARG_NUMBER] << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    const int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, directory.c_str(), WATCHED_EVENTS) < 0) {
+        std::cerr << "Failed to watch " << directory << ": " << std::strerror(errno) << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    const Parser parser;
+    const REGMAP registers = REGISTERS();
+    std::map<std::string, WatchedProgram> programs;
+    for (const std::string& stem : LIST_PROGRAMS(directory))
+        REPORT_UPDATE(stem, TRY_UPDATE_PROGRAM(directory, stem, Change{true, true}, programs, parser, registers), -1);
+    std::cerr << "WATCHING " << directory << " with " << debounceMillis << " ms debounce" << std::endl;
+
+    while (true)
+    {
+        Changes changes;
+        WAIT_FOR_EVENTS(fd, WAIT_FOREVER);
+        const Clock::time_point firstChange = Clock::now();
+        COLLECT_CHANGES(fd, changes);
+        while (WAIT_FOR_EVENTS(fd, debounceMillis)) COLLECT_CHANGES(fd, changes);
+        for (const auto& changed : changes)
+        {
+            const std::string path = directory + "/" + changed.first;
+            if (objectPathOf(path).empty() || !exists(path + SYMBOL_EXTENSION)) continue;          // The other half has not arrived yet
+            const UpdateResult result = TRY_UPDATE_PROGRAM(directory, changed.first, changed.second, programs, parser, registers);
+            REPORT_UPDATE(changed.first, result, millisBetween(firstChange, Clock::now()));
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "daemon.hpp"
+#include <memory>
+#include <string>
+
+/* One object/.sym pair of the watched directory, listed into <stem>.lst next to them */
+struct WatchedProgram
+{
+    std::string stem;
+    std::string symbolContents;                     // The .sym contents the symbols were parsed from
+    std::shared_ptr<const CachedSymbols> symbols;   // Kept between updates while the .sym stays the same
+};
+
+int runWatchMode(const int argc, const char* argv[]);
+
+#endif